@@ -2,6 +2,7 @@
 
 #include "sdk/Headers.hpp"
 #include "sdk/VertexArray.hpp"
+#include "sdk/IndirectBatch.hpp"
 
 class Helper
 {
@@ -10,7 +11,17 @@ class Helper
 public:
 	static std::shared_ptr<VertexArray> makeSphereVertexArray(int horizontalLevel, int verticalLevel, float radius);
 
+	// spheres of each level, finest first, one after another in a single vertex array, and where each one is in it
+	static std::shared_ptr<VertexArray> makeSphereLodVertexArray(const std::vector<int>& levels, float radius, std::vector<MeshRange>& meshes);
+
 	static VertexArray* makeTrailVA(float eccentricity, float focalDistance);
+
+	// positions only, refilled every frame and drawn with drawArrays
+	static VertexArray* makePointsVA(size_t count);
+
+private:
+	// a sphere's vertices and its indices, counted from its own first vertex
+	static void appendSphere(std::vector<float>& coords, std::vector<unsigned int>& indices, int horizontalLevel, int verticalLevel, float radius);
 };
 
 // make vertex array which represents a sphere
@@ -18,6 +29,45 @@ std::shared_ptr<VertexArray> Helper::makeSphereVertexArray(int horizontalLevel,
 {
 	std::vector<float> coords;
 	std::vector<unsigned int> indices;
+	appendSphere(coords, indices, horizontalLevel, verticalLevel, radius);
+
+	VertexBuffer vb(&coords[0], coords.size() * sizeof(float));
+	IndexBuffer ib(&indices[0], indices.size());
+
+	BufferLayout layout;
+	layout.push(GL_FLOAT, 3, GL_FALSE);
+	layout.push(GL_FLOAT, 3, GL_FALSE);
+
+	return std::make_shared<VertexArray>(vb, ib, layout);
+}
+
+// make vertex array which holds a sphere for every level of detail
+std::shared_ptr<VertexArray> Helper::makeSphereLodVertexArray(const std::vector<int>& levels, float radius, std::vector<MeshRange>& meshes)
+{
+	std::vector<float> coords;
+	std::vector<unsigned int> indices;
+	meshes.clear();
+	for (int level : levels)
+	{
+		// six floats a vertex
+		MeshRange mesh = { (GLuint)indices.size(), 0, (GLint)(coords.size() / 6) };
+		appendSphere(coords, indices, level, level, radius);
+		mesh.indexCount = (GLuint)indices.size() - mesh.firstIndex;
+		meshes.push_back(mesh);
+	}
+
+	VertexBuffer vb(&coords[0], coords.size() * sizeof(float));
+	IndexBuffer ib(&indices[0], indices.size());
+
+	BufferLayout layout;
+	layout.push(GL_FLOAT, 3, GL_FALSE);
+	layout.push(GL_FLOAT, 3, GL_FALSE);
+
+	return std::make_shared<VertexArray>(vb, ib, layout);
+}
+
+void Helper::appendSphere(std::vector<float>& coords, std::vector<unsigned int>& indices, int horizontalLevel, int verticalLevel, float radius)
+{
 	float pitchMod = 180.f / verticalLevel;
 	float yawMod = 360.f / horizontalLevel;
 
@@ -74,15 +124,6 @@ std::shared_ptr<VertexArray> Helper::makeSphereVertexArray(int horizontalLevel,
 	coords.push_back(0.0f);
 	coords.push_back(-radius);
 	coords.push_back(0.0f);
-
-	VertexBuffer vb(&coords[0], coords.size() * sizeof(float));
-	IndexBuffer ib(&indices[0], indices.size());
-
-	BufferLayout layout;
-	layout.push(GL_FLOAT, 3, GL_FALSE);
-	layout.push(GL_FLOAT, 3, GL_FALSE);
-
-	return std::make_shared<VertexArray>(vb, ib, layout);
 }
 
 // make trail va
@@ -95,7 +136,8 @@ VertexArray* Helper::makeTrailVA(float eccentricity, float focalDistance)
 	glm::vec3 trailPos;
 	for (degree; degree < 360.f; degree += 0.5f)
 	{
-		trailPos.x = 0.f + cosf(glm::radians(degree)) * focalDistance;
+		// the center sits in the focus, periapsis along +x
+		trailPos.x = (cosf(glm::radians(degree)) - eccentricity) * focalDistance;
 		trailPos.y = 0.f;
 		trailPos.z = 0.f + ratio * sinf(glm::radians(degree)) * focalDistance;
 		vertexes.push_back(trailPos.x);
@@ -123,3 +165,16 @@ VertexArray* Helper::makeTrailVA(float eccentricity, float focalDistance)
 	return va;
 }
 
+// make point cloud va
+VertexArray* Helper::makePointsVA(size_t count)
+{
+	VertexBuffer vb(nullptr, count * 3 * sizeof(float), GL_STREAM_DRAW);
+	IndexBuffer ib(nullptr, 0);
+
+	BufferLayout layout;
+	layout.push(GL_FLOAT, 3, GL_FALSE);
+
+	VertexArray* va = new VertexArray(vb, ib, layout);
+
+	return va;
+}
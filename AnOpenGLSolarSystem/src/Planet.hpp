@@ -3,6 +3,7 @@
 #include "sdk/VertexArray.hpp"
 #include "sdk/Shader.hpp"
 #include "sdk/Renderer.hpp"
+#include "sdk/Camera.hpp"
 
 class Planet
 {
@@ -10,38 +11,37 @@ private:
 	// some renderer stuff
 	std::shared_ptr<VertexArray> _va;
 	std::shared_ptr<Shader> _shader;
+	UniformHandle _modelUniform, _colorUniform, _lightingUniform;
 
-	// attribs
-	glm::vec3 _pos;
+	// attribs, the position is in world space and double like the simulation
+	glm::dvec3 _pos;
 	glm::vec3 _scale;
 	glm::vec4 _color;
 	float _mass;
 
-	// update values
-	float _degreeDelta{ 0.0f };
-	float _lastFrame{ 0.0f };
-	bool _isFirstEntry{ true };
-
 public:
 	Planet(std::shared_ptr<VertexArray>& va, std::shared_ptr<Shader>& shader, 
-		float mass = 1.0f, glm::vec3 pos = {0.0f, 0.0f, 0.0f}, glm::vec3 scale = {1.0f, 1.0f, 1.0f}, glm::vec4 color = {1.0f, 1.0f, 1.0f, 1.0f}) :
+		float mass = 1.0f, glm::dvec3 pos = {0.0, 0.0, 0.0}, glm::vec3 scale = {1.0f, 1.0f, 1.0f}, glm::vec4 color = {1.0f, 1.0f, 1.0f, 1.0f}) :
 		_va(va), _shader(shader), _pos(pos), _scale(scale), _color(color), _mass(mass)
 	{
+		_modelUniform = _shader->uniform("u_model");
+		_colorUniform = _shader->uniform("u_color");
+		_lightingUniform = _shader->uniform("u_shouldEnableLighting");
 	}
 
 	Planet(const Planet& planet) :
-		_va(planet._va), _shader(planet._shader), _pos(planet._pos), _scale(planet._scale), _color(planet._color), _mass(planet._mass)
+		_va(planet._va), _shader(planet._shader), _modelUniform(planet._modelUniform), _colorUniform(planet._colorUniform),
+		_lightingUniform(planet._lightingUniform), _pos(planet._pos), _scale(planet._scale), _color(planet._color), _mass(planet._mass)
 	{
 
 	}
 
-	void draw(GLenum mode = GL_FILL);
-
-	void update(const glm::vec3 center, const float centerMass, const float eccentricity, const float focalDistance);
+	// drawn relative to the camera, only that small float offset reaches the gpu
+	void draw(const Camera& camera, GLenum mode = GL_FILL);
 
 	void scale(const glm::vec3 scale);
 
-	void moveTo(const glm::vec3 pos);
+	void moveTo(const glm::dvec3 pos);
 
 	void setColor(const glm::vec4 color) { _color = color; };
 
@@ -49,43 +49,23 @@ public:
 
 	const glm::vec4 color() const { return _color; };
 
-	const glm::vec3 position() const { return _pos; };
-
-	const float mass() const { return _mass; };
-};
-
-void Planet::update(const glm::vec3 center, const float centerMass, const float eccentricity, const float focalDistance)
-{
-	float distance = glm::length(_pos - center);
-	if (distance == 0.f) return;
-	float centralForce = 9999 * centerMass * _mass / (distance * distance);
-	float angularVelocity = sqrtf(centralForce / (_mass * distance));
+	const glm::vec3 scaling() const { return _scale; };
 
-	if (_isFirstEntry)
-	{
-		_lastFrame = glfwGetTime();
-		_isFirstEntry = false;
-	}
+	const glm::dvec3 position() const { return _pos; };
 
-	float currentFrame = (float)glfwGetTime();
-	_degreeDelta += (currentFrame - _lastFrame) * angularVelocity;
-	_lastFrame = currentFrame;
+	const float mass() const { return _mass; };
 
-	float e = eccentricity;
-	CLAMP(e, 0.01f, 0.99f);
-	float ratio = sqrtf(1 - e * e);
-	_pos.x = center.x + cosf(glm::radians(_degreeDelta)) * focalDistance;
-	_pos.y = center.y;
-	_pos.z = center.z + ratio * sinf(glm::radians(_degreeDelta)) * focalDistance;
-}
+	// what an instanced draw of the planet's vertex array needs of it, relative to the camera like draw
+	const InstanceData instance(const Camera& camera) const { return { camera.relative(_pos), _scale, _color }; };
+};
 
-void Planet::draw(GLenum mode)
+void Planet::draw(const Camera& camera, GLenum mode)
 {
-	glm::mat4 model = glm::translate(glm::mat4(1.0f), _pos);
+	glm::mat4 model = glm::translate(glm::mat4(1.0f), camera.relative(_pos));
 	model = glm::scale(model, _scale);
-	_shader->uniformMatrix4fv("u_model", model);
-	_shader->uniform4fv("u_color", _color);
-	_shader->uniform1i("u_shouldEnableLighting", 1);
+	_shader->set(_modelUniform, model);
+	_shader->set(_colorUniform, _color);
+	_shader->set(_lightingUniform, 1);
 	Renderer::getInstance()->draw(*_va, *_shader, mode, GL_TRIANGLES);
 }
 
@@ -94,7 +74,7 @@ void Planet::scale(const glm::vec3 scale)
 	_scale = scale;
 }
 
-void Planet::moveTo(const glm::vec3 pos)
+void Planet::moveTo(const glm::dvec3 pos)
 {
 	_pos = pos;
 }
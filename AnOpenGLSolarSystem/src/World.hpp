@@ -3,19 +3,48 @@
 #include "Planet.hpp"
 #include "Helper.hpp"
 #include "sdk/Shader.hpp"
+#include "sim/Simulation.hpp"
+#include "sim/SolarSystem.hpp"
+#include "sim/Checkpoint.hpp"
+#include "sim/Playback.hpp"
+#include "sim/Scene.hpp"
+#include "sim/StarCatalog.hpp"
 
 #include <queue>
 
 typedef struct
 {
 	Planet* planet;
-	std::string name;
-	std::string centerPlanet;
-	float eccentricity;
-	float focalDistance;
+	int body;
 	VertexArray* trail;
 }PlanetInfo;
 
+// handles of the uniforms a draw sets, for the shader they were resolved from
+typedef struct
+{
+	Shader* shader;
+	UniformHandle model;
+	UniformHandle color;
+	UniformHandle lighting;
+	UniformHandle isInstanced;
+}DrawUniforms;
+
+// stars of one color drawn together, a range of the sky's points
+typedef struct
+{
+	GLint first;
+	GLsizei count;
+	glm::vec4 color;
+}StarBatch;
+
+typedef struct
+{
+	// index into the simulation's particle systems
+	int system;
+	VertexArray* points;
+	glm::vec4 color;
+}ParticleInfo;
+
 class World
 {
 	NONCOPYABLE(World)
@@ -29,7 +58,26 @@ public:
 	void addPlanet(std::string name, std::string centerPlanet, float eccentricity, float focalDistance, std::shared_ptr<Shader>& shader,
 		float mass = 1.0f, glm::vec3 pos = { 0.0f, 0.0f, 0.0f }, glm::vec3 scale = { 1.0f, 1.0f, 1.0f }, glm::vec4 color = { 1.0f, 1.0f, 1.0f, 1.0f });
 
-	void draw(GLenum mode = GL_FILL);
+	// every body of a scene, catalog bodies go into the simulation without a planet and are drawn as points
+	void addScene(const Scene& scene, std::shared_ptr<Shader>& shader);
+
+	// a main belt and a saturn ring, see populateParticles
+	void addParticles(size_t beltCount, size_t ringCount);
+
+	// the whole simulation to and from a checkpoint file, loading rebuilds every planet and point cloud from it
+	bool saveCheckpoint(const std::string& path) const;
+
+	bool loadCheckpoint(const std::string& path);
+
+	// play a recorded trajectory instead of simulating, planets follow its first bodies and every body is drawn as a point
+	bool openPlayback(const std::string& path);
+
+	void closePlayback();
+
+	// advance the simulation, or the playhead during playback, by a real time delta, then sync render state from it
+	void update(double realDelta);
+
+	void draw(Camera& camera, GLenum mode = GL_FILL);
 
 	void onImGuiRender();
 
@@ -39,68 +87,457 @@ public:
 
 	void renderPlanetNames(Camera& camera, int displayW, int displayH);
 
+	// time warp readout, in orange while accuracy is being traded to keep up with it
+	void renderWarpIndicator(int displayW);
+
+	// the real sky from a star table written by the headless runner's --ingest-stars, false if there isn't a readable one
+	bool loadStars(const std::string& path);
+
+	// the count brightest stars of the table, or random ones around the camera without one
 	void renderStars(Camera& camera, std::shared_ptr<Shader>& shader, int count);
 
+	// stars the sky can show, 0 without a table
+	const size_t skyStarCount() const { return _starTable.size(); };
+
 	void showTrails(Camera& camera, std::shared_ptr<Shader>& shader);
 
+	void drawParticles(Camera& camera, std::shared_ptr<Shader>& shader);
+
+	Simulation& simulation() { return _sim; };
+
+private:
+	// drop the planet of a body merged away, and follow the body that was moved into its slot
+	void onBodyRemoved(int removed, int moved);
+
+	void addParticleInfo(int system);
+
+	// the sky's points and batches for the count brightest stars
+	void buildSky(size_t count);
+
+	// resolved again only when a different shader comes in
+	const DrawUniforms& uniformsOf(Shader& shader);
+
+	// whether any of a sphere of the camera relative center is inside the frustum
+	static bool isInView(const glm::mat4& viewProjection, const glm::vec3& center, float radius);
+
+	// the planet level of detail for a sphere of the projected size, 0 the finest
+	static size_t lodOf(const glm::mat4& projection, const glm::vec3& center, float radius);
+
+	// a packet of va with shader and its handles, lighting off and placed at the camera until the caller says otherwise
+	DrawPacket packetOf(const VertexArray& va, Shader& shader, DrawKind kind, GLenum elementMode);
+
+	// every planet in the list as one instanced packet of va, nearest first. va's instance buffer is written now
+	// and read at the flush, so it takes one list a frame
+	void submitSpheres(const std::vector<Planet*>& planets, VertexArray& va, Camera& camera, Shader& shader, GLenum mode);
+
 private:
 	std::shared_ptr<VertexArray> _vaSphere;
 
-	std::unordered_map<std::string, Planet*> _planetNameMap;
+	// the planet sphere at every level of detail, drawn as one indirect batch
+	std::shared_ptr<VertexArray> _vaPlanets;
+
+	std::unique_ptr<IndirectBatch> _planetBatch;
+
+	// the random stars' own coarse sphere, so their instances don't overwrite the planets' before the flush
+	std::shared_ptr<VertexArray> _vaStar;
+
+	float _sphereRadius{ 1.0f };
+
+	// the shader planets were added with, planets rebuilt from a checkpoint use it too
+	std::shared_ptr<Shader> _planetShader;
+
+	char _checkpointPath[256]{ "solar-system.chk" };
+
+	std::string _checkpointStatus;
+
+	std::unique_ptr<TrajectoryPlayback> _playback;
+
+	double _playhead{ 0.0 };
+
+	bool _isPlaybackPaused{ false };
+
+	// the playhead's positions, kept while the chunks of a new playhead are still decoding
+	std::vector<double> _playbackX, _playbackY, _playbackZ;
+
+	size_t _playbackCount{ 0 };
+
+	VertexArray* _playbackPoints{ nullptr };
+
+	char _playbackPath[256]{ "solar-system.trk" };
+
+	std::string _playbackStatus;
+
+	Simulation _sim;
 
 	std::vector<PlanetInfo> _planetInfos;
 
+	std::vector<ParticleInfo> _particleInfos;
+
+	// every body as a point, once a scene has brought catalog bodies that have no planet
+	VertexArray* _minorPoints{ nullptr };
+
+	size_t _minorCapacity{ 0 };
+
+	// interleaved upload staging, shared by every particle system
+	std::vector<float> _particleVertices;
+
 	std::vector<Planet> _stars;
 
+	// instance upload staging, shared by planets and stars
+	std::vector<Planet*> _instancePlanets;
+
+	std::vector<InstanceData> _instances;
+
+	DrawUniforms _uniforms{ nullptr, -1, -1, -1, -1 };
+
+	StarTable _starTable;
+
+	VertexArray* _skyPoints{ nullptr };
+
+	std::vector<StarBatch> _skyBatches;
+
+	size_t _skyCount{ 0 };
+
 	std::vector<VertexArray> _trails;
 };
 
-inline auto g_world = std::make_unique<World>();
-
 void World::init(int horizontalLevel, int verticalLevel, float radius)
 {
 	_vaSphere = Helper::makeSphereVertexArray(horizontalLevel, verticalLevel, radius);
+	// planets pick one of four meshes a frame, all of them together are one indirect batch placed and colored per instance
+	std::vector<MeshRange> meshes;
+	_vaPlanets = Helper::makeSphereLodVertexArray({ horizontalLevel, glm::max(horizontalLevel / 2, 8), glm::max(horizontalLevel / 4, 8), 8 }, radius, meshes);
+	VertexBuffer planetInstances(nullptr, 0, GL_STREAM_DRAW);
+	_vaPlanets->setInstanceBuffer(planetInstances, Renderer::instanceLayout());
+	_planetBatch = std::make_unique<IndirectBatch>(meshes);
+	// random stars are all one instanced draw of the same mesh
+	_vaStar = Helper::makeSphereVertexArray(8, 8, radius);
+	VertexBuffer starInstances(nullptr, 0, GL_STREAM_DRAW);
+	_vaStar->setInstanceBuffer(starInstances, Renderer::instanceLayout());
+	_sphereRadius = radius;
+	_sim.setThreadCount((int)std::thread::hardware_concurrency());
+	_sim.setBodyRemovedCallback([this](int removed, int moved) { onBodyRemoved(removed, moved); });
 }
 
 void World::addPlanet(std::string name, std::string centerPlanet, float eccentricity, float focalDistance, std::shared_ptr<Shader>& shader,
 	float mass, glm::vec3 pos, glm::vec3 scale, glm::vec4 color)
 {
-	glm::vec3 center = { 0.0f, 0.0f, 0.0f };
-	if (_planetNameMap.find(centerPlanet) != _planetNameMap.end()) center = _planetNameMap[centerPlanet]->position();
-	Planet* planet = new Planet(_vaSphere, shader, mass, pos + center, scale, color);
-	_planetNameMap.insert(std::make_pair(name, planet));
+	int body = _sim.addBody(name, centerPlanet, eccentricity, focalDistance, mass, pos, _sphereRadius * scale.x);
+	Planet* planet = new Planet(_vaSphere, shader, mass, _sim.position(body), scale, color);
 
 	// init trail vao
 	VertexArray* va = Helper::makeTrailVA(eccentricity, focalDistance);
 
-	_planetInfos.push_back({ planet, name, centerPlanet, eccentricity, focalDistance, va });
+	_planetInfos.push_back({ planet, body, va });
+	_planetShader = shader;
+}
+
+void World::addScene(const Scene& scene, std::shared_ptr<Shader>& shader)
+{
+	for (size_t i = 0; i < scene.size(); i++)
+	{
+		const SceneBody& body = scene.body(i);
+		const glm::vec3 pos = { body.pos[0], body.pos[1], body.pos[2] };
+		if (body.flags & SCENE_MINOR)
+		{
+			_sim.addBody(std::string(scene.name(i)), std::string(scene.name(body.center)), body.eccentricity, body.focalDistance, body.mass, pos, body.radius);
+			continue;
+		}
+		addPlanet(std::string(scene.name(i)), std::string(scene.name(body.center)), body.eccentricity, body.focalDistance, shader, body.mass, pos,
+			{ body.scale[0], body.scale[1], body.scale[2] }, { body.color[0], body.color[1], body.color[2], body.color[3] });
+	}
+	if (scene.minorCount() == 0) return;
+
+	delete _minorPoints;
+	_minorCapacity = _sim.bodyCount();
+	_minorPoints = Helper::makePointsVA(_minorCapacity);
+}
+
+void World::addParticles(size_t beltCount, size_t ringCount)
+{
+	size_t first = _sim.particleSystems().size();
+	populateParticles(_sim, beltCount, ringCount);
+	for (size_t i = first; i < _sim.particleSystems().size(); i++) addParticleInfo((int)i);
+}
+
+void World::addParticleInfo(int system)
+{
+	auto& particles = *_sim.particleSystems()[system];
+	glm::vec4 color = particles.center() == _sim.find("Saturn") ? glm::vec4(0.89f, 0.71f, 0.49f, 1.0f) : glm::vec4(0.6f, 0.55f, 0.5f, 1.0f);
+	_particleInfos.push_back({ system, Helper::makePointsVA(particles.size()), color });
 }
 
-void World::draw(GLenum mode)
+bool World::saveCheckpoint(const std::string& path) const
 {
+	// a body without a planet is one of a scene's minor bodies
+	std::vector<CheckpointAppearance> appearance(_sim.bodyCount(), CheckpointAppearance{ {}, {}, CHECKPOINT_BODY_MINOR });
+	for (auto& info : _planetInfos)
+	{
+		const glm::vec4 color = info.planet->color();
+		const glm::vec3 scale = info.planet->scaling();
+		appearance[info.body] = { { color.r, color.g, color.b, color.a }, { scale.x, scale.y, scale.z }, 0 };
+	}
+	return Checkpoint::save(_sim, path, appearance);
+}
+
+bool World::loadCheckpoint(const std::string& path)
+{
+	Checkpoint checkpoint;
+	if (!checkpoint.open(path) || !checkpoint.restore(_sim)) return false;
+
 	for (auto& info : _planetInfos)
 	{
-		auto& planet = info.planet;
-		if (_planetNameMap.find(info.centerPlanet) != _planetNameMap.end())
+		delete info.planet;
+		delete info.trail;
+	}
+	_planetInfos.clear();
+	for (auto& info : _particleInfos) delete info.points;
+	_particleInfos.clear();
+	delete _minorPoints;
+	_minorPoints = nullptr;
+	_minorCapacity = 0;
+
+	// minor bodies stay points the way addScene left them. a checkpoint saved without appearance makes every body
+	// a white planet sized by its radius
+	const CheckpointAppearance* appearance = checkpoint.appearance();
+	size_t minorCount = 0;
+	for (int i = 0; i < (int)_sim.bodyCount(); i++)
+	{
+		const Body& body = _sim.body(i);
+		glm::vec4 color = { 1.0f, 1.0f, 1.0f, 1.0f };
+		float size = (float)_sim.state().radius[i] / _sphereRadius;
+		glm::vec3 scale = { size, size, size };
+		if (appearance)
 		{
-			auto& centerPlanet = _planetNameMap[info.centerPlanet];
-			planet->update(centerPlanet->position(), centerPlanet->mass(), info.eccentricity, info.focalDistance);
+			const CheckpointAppearance& record = appearance[i];
+			if (record.flags & CHECKPOINT_BODY_MINOR)
+			{
+				minorCount++;
+				continue;
+			}
+			color = { record.color[0], record.color[1], record.color[2], record.color[3] };
+			scale = { record.scale[0], record.scale[1], record.scale[2] };
 		}
+		Planet* planet = new Planet(_vaSphere, _planetShader, (float)_sim.mass(i), _sim.position(i), scale, color);
+		_planetInfos.push_back({ planet, i, Helper::makeTrailVA(body.eccentricity, body.focalDistance) });
+	}
+	if (minorCount > 0)
+	{
+		_minorCapacity = _sim.bodyCount();
+		_minorPoints = Helper::makePointsVA(_minorCapacity);
+	}
+	for (int i = 0; i < (int)_sim.particleSystems().size(); i++) addParticleInfo(i);
+	return true;
+}
+
+bool World::openPlayback(const std::string& path)
+{
+	auto playback = std::make_unique<TrajectoryPlayback>();
+	if (!playback->open(path)) return false;
+
+	closePlayback();
+	_playback = std::move(playback);
+	_playhead = _playback->startTime();
+	_isPlaybackPaused = false;
+	const size_t n = _playback->maxBodyCount();
+	_playbackX.assign(n, 0.0);
+	_playbackY.assign(n, 0.0);
+	_playbackZ.assign(n, 0.0);
+	_playbackCount = 0;
+	_playbackPoints = Helper::makePointsVA(n);
+	return true;
+}
+
+void World::closePlayback()
+{
+	_playback.reset();
+	delete _playbackPoints;
+	_playbackPoints = nullptr;
+	_playbackCount = 0;
+}
+
+void World::update(double realDelta)
+{
+	if (!_playback)
+	{
+		_sim.advance(realDelta);
+		for (auto& info : _planetInfos) info.planet->moveTo(_sim.position(info.body));
+		return;
+	}
+
+	// the playhead runs at the simulation's time scale, the simulation itself holds still
+	if (!_isPlaybackPaused && !_sim.clock().isPaused())
+		_playhead = glm::clamp(_playhead + realDelta * _sim.clock().timeScale(), _playback->startTime(), _playback->endTime());
+	if (_playback->positions(_playhead, _playbackX.data(), _playbackY.data(), _playbackZ.data())) _playbackCount = _playback->bodyCount(_playhead);
+	for (auto& info : _planetInfos)
+		if ((size_t)info.body < _playbackCount) info.planet->moveTo({ _playbackX[info.body], _playbackY[info.body], _playbackZ[info.body] });
+}
+
+void World::onBodyRemoved(int removed, int moved)
+{
+	for (auto it = _planetInfos.begin(); it != _planetInfos.end(); ++it)
+	{
+		if (it->body != removed) continue;
+		delete it->planet;
+		delete it->trail;
+		_planetInfos.erase(it);
+		break;
+	}
+	for (auto& info : _planetInfos) if (info.body == moved) info.body = removed;
+}
+
+void World::draw(Camera& camera, GLenum mode)
+{
+	if (!_planetShader) return;
+	// the culling pass, on the cpu: planets out of view are dropped and the rest take the mesh their size on screen asks for
+	const glm::mat4 viewProjection = camera.projectionMatrix() * camera.viewMatrix();
+	auto radiusOf = [&](const InstanceData& instance) { return _sphereRadius * glm::max(instance.scale.x, glm::max(instance.scale.y, instance.scale.z)); };
+	_instances.clear();
+	for (auto& info : _planetInfos)
+	{
+		InstanceData instance = info.planet->instance(camera);
+		if (isInView(viewProjection, instance.offset, radiusOf(instance))) _instances.push_back(instance);
+	}
+	if (_instances.empty()) return;
+	// front to back within every mesh, the batch keeps the order instances are added in
+	std::sort(_instances.begin(), _instances.end(), [](const InstanceData& a, const InstanceData& b) { return glm::length(a.offset) < glm::length(b.offset); });
+	_planetBatch->clear();
+	for (auto& instance : _instances) _planetBatch->add(lodOf(camera.projectionMatrix(), instance.offset, radiusOf(instance)), instance);
+	_planetBatch->upload(*_vaPlanets, Renderer::getInstance()->isMultiDrawIndirect());
+
+	DrawPacket packet = packetOf(*_vaPlanets, *_planetShader, DRAW_INDIRECT, GL_TRIANGLES);
+	packet.polygonMode = mode;
+	packet.lighting = 1;
+	packet.batch = _planetBatch.get();
+	Renderer::getInstance()->submit(packet, RENDER_PASS_OPAQUE, glm::length(_instances.front().offset));
+}
+
+bool World::isInView(const glm::mat4& viewProjection, const glm::vec3& center, float radius)
+{
+	// the frustum's planes are the matrix's last row plus or minus each of the others
+	glm::vec4 w(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		glm::vec4 row(viewProjection[0][axis], viewProjection[1][axis], viewProjection[2][axis], viewProjection[3][axis]);
+		for (glm::vec4 plane : { w + row, w - row })
+			if (glm::dot(glm::vec3(plane), center) + plane.w < -radius * glm::length(glm::vec3(plane))) return false;
 	}
+	return true;
+}
+
+size_t World::lodOf(const glm::mat4& projection, const glm::vec3& center, float radius)
+{
+	// radius on screen as a fraction of half the viewport's height
+	const float size = radius * projection[1][1] / glm::max(glm::length(center), 1e-6f);
+	if (size > 0.25f) return 0;
+	if (size > 0.06f) return 1;
+	if (size > 0.015f) return 2;
+	return 3;
+}
+
+const DrawUniforms& World::uniformsOf(Shader& shader)
+{
+	if (_uniforms.shader != &shader)
+		_uniforms = { &shader, shader.uniform("u_model"), shader.uniform("u_color"), shader.uniform("u_shouldEnableLighting"), shader.uniform("u_isInstanced") };
+	return _uniforms;
+}
+
+DrawPacket World::packetOf(const VertexArray& va, Shader& shader, DrawKind kind, GLenum elementMode)
+{
+	const DrawUniforms& uniforms = uniformsOf(shader);
+	return { 0, &va, &shader, { uniforms.model, uniforms.color, uniforms.lighting, uniforms.isInstanced }, kind, elementMode, GL_FILL, 0, 0,
+		glm::mat4(1.0f), glm::vec4(1.0f), 0, nullptr };
+}
 
-	for (auto& info : _planetInfos) info.planet->draw(mode);
+void World::submitSpheres(const std::vector<Planet*>& planets, VertexArray& va, Camera& camera, Shader& shader, GLenum mode)
+{
+	if (planets.empty()) return;
+	_instances.resize(planets.size());
+	for (size_t i = 0; i < planets.size(); i++) _instances[i] = planets[i]->instance(camera);
+	// front to back, so the depth test rejects the fragments of whatever a nearer sphere already covers
+	std::sort(_instances.begin(), _instances.end(), [](const InstanceData& a, const InstanceData& b) { return glm::length(a.offset) < glm::length(b.offset); });
+	va.instanceBuffer().update(_instances.data(), _instances.size() * sizeof(InstanceData));
+
+	DrawPacket packet = packetOf(va, shader, DRAW_INSTANCED, GL_TRIANGLES);
+	packet.polygonMode = mode;
+	packet.count = (GLsizei)_instances.size();
+	packet.lighting = 1;
+	Renderer::getInstance()->submit(packet, RENDER_PASS_OPAQUE, glm::length(_instances.front().offset));
 }
 
 void World::showTrails(Camera& camera, std::shared_ptr<Shader>& shader)
 {
-	shader->uniform1i("u_shouldEnableLighting", 0);
 	for (auto& info : _planetInfos)
 	{
-		auto& centerPlanet = _planetNameMap[info.centerPlanet];
-		glm::mat4 model = glm::translate(glm::mat4(1.0f), centerPlanet->position());
-		shader->uniformMatrix4fv("u_model", model);
-		shader->uniform4fv("u_color", info.planet->color());
-		Renderer::getInstance()->draw(*info.trail, *shader, GL_FILL, GL_LINES);
+		int center = _sim.parent(info.body);
+		if (center == -1) continue;
+		glm::vec3 offset = camera.relative(_sim.position(center));
+		DrawPacket packet = packetOf(*info.trail, *shader, DRAW_ELEMENTS, GL_LINES);
+		packet.model = glm::translate(glm::mat4(1.0f), offset);
+		packet.color = info.planet->color();
+		Renderer::getInstance()->submit(packet, RENDER_PASS_LINES, glm::length(offset));
+	}
+}
+
+void World::drawParticles(Camera& camera, std::shared_ptr<Shader>& shader)
+{
+	if (_playback)
+	{
+		// recorded bodies are absolute, each is made camera relative in double before it becomes a float
+		_particleVertices.resize(3 * _playbackCount);
+		_sim.parallelFor(_playbackCount, 65536, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++)
+			{
+				glm::vec3 p = camera.relative({ _playbackX[i], _playbackY[i], _playbackZ[i] });
+				_particleVertices[3 * i] = p.x;
+				_particleVertices[3 * i + 1] = p.y;
+				_particleVertices[3 * i + 2] = p.z;
+			}
+		});
+		_playbackPoints->vertexBuffer().update(_particleVertices.data(), _particleVertices.size() * sizeof(float));
+		DrawPacket packet = packetOf(*_playbackPoints, *shader, DRAW_ARRAYS, GL_POINTS);
+		packet.count = (GLsizei)_playbackCount;
+		packet.color = glm::vec4(0.8f, 0.8f, 0.8f, 1.0f);
+		Renderer::getInstance()->submit(packet, RENDER_PASS_POINTS, 0.0f);
+		return;
+	}
+	for (auto& info : _particleInfos)
+	{
+		auto& particles = *_sim.particleSystems()[info.system];
+		const size_t count = particles.size();
+		_particleVertices.resize(3 * count);
+		_sim.parallelFor(count, 65536, [&](size_t begin, size_t end) { particles.interleave(_particleVertices.data(), begin, end); });
+		info.points->vertexBuffer().update(_particleVertices.data(), _particleVertices.size() * sizeof(float));
+
+		// positions are relative to the center already, only its camera relative offset is left for the gpu
+		glm::vec3 offset = camera.relative(_sim.position(particles.center()));
+		DrawPacket packet = packetOf(*info.points, *shader, DRAW_ARRAYS, GL_POINTS);
+		packet.count = (GLsizei)count;
+		packet.model = glm::translate(glm::mat4(1.0f), offset);
+		packet.color = info.color;
+		Renderer::getInstance()->submit(packet, RENDER_PASS_POINTS, glm::length(offset));
+	}
+
+	if (_minorPoints)
+	{
+		// merges only ever shrink the body count
+		const BodyArrays& state = _sim.state();
+		const size_t count = glm::min(state.size(), _minorCapacity);
+		_particleVertices.resize(3 * count);
+		_sim.parallelFor(count, 65536, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++)
+			{
+				glm::vec3 p = camera.relative(state.position(i));
+				_particleVertices[3 * i] = p.x;
+				_particleVertices[3 * i + 1] = p.y;
+				_particleVertices[3 * i + 2] = p.z;
+			}
+		});
+		_minorPoints->vertexBuffer().update(_particleVertices.data(), _particleVertices.size() * sizeof(float));
+		DrawPacket packet = packetOf(*_minorPoints, *shader, DRAW_ARRAYS, GL_POINTS);
+		packet.count = (GLsizei)count;
+		packet.color = glm::vec4(0.7f, 0.7f, 0.65f, 1.0f);
+		Renderer::getInstance()->submit(packet, RENDER_PASS_POINTS, 0.0f);
 	}
 }
 
@@ -113,9 +550,11 @@ void World::renderPlanetInfo(Camera& camera)
 	ImGui::GetBackgroundDrawList()->AddText({ 20, indent }, ImGui::ColorConvertFloat4ToU32({ 255.f, 255.f, 255.f, 255.f }), buf1);
 	for (auto& info : _planetInfos)
 	{
+		const Body& body = _sim.body(info.body);
+		glm::dvec3 pos = _sim.position(info.body);
 		char buf[256];
-		snprintf(buf, sizeof(buf), "%s: x: %.3lf, y: %.3lf, z: %.3lf, mass, %.3lf, center: %s, ecc: %.3lf, fd: %.3lf", info.name.c_str(),
-			info.planet->position().x, info.planet->position().y, info.planet->position().z, info.planet->mass(), info.centerPlanet.c_str(), info.eccentricity, info.focalDistance);
+		snprintf(buf, sizeof(buf), "%s: x: %.3lf, y: %.3lf, z: %.3lf, mass, %.3lf, center: %s, ecc: %.3lf, fd: %.3lf", body.name.c_str(),
+			pos.x, pos.y, pos.z, _sim.mass(info.body), body.centerName.c_str(), body.eccentricity, body.focalDistance);
 		ImGui::GetBackgroundDrawList()->AddText({ 20, indent + 20 }, ImGui::ColorConvertFloat4ToU32({ 255.f, 255.f, 255.f, 255.f }), buf);
 		indent += 20;
 	}
@@ -125,77 +564,225 @@ void World::renderPlanetNames(Camera& camera, int displayW, int displayH)
 {
 	for (auto& info : _planetInfos)
 	{
-		glm::vec4 clipCoord = camera.projectionMatrix() * camera.viewMatrix() * glm::vec4(info.planet->position(), 1.0f);
+		glm::vec4 clipCoord = camera.projectionMatrix() * camera.viewMatrix() * glm::vec4(camera.relative(info.planet->position()), 1.0f);
 		if (clipCoord.w >= 0.1f) {
 			glm::vec3 ndc = { clipCoord.x / clipCoord.w, clipCoord.y / clipCoord.w, clipCoord.z / clipCoord.w };
 			glm::vec2 screenCoords(displayW / 2 * ndc.x + ndc.x + displayW / 2, -displayH / 2 * ndc.y + ndc.y + displayH / 2);
-			ImGui::GetBackgroundDrawList()->AddText({ screenCoords.x, screenCoords.y }, ImGui::ColorConvertFloat4ToU32({ 255.f, 255.f, 255.f, 255.f }), info.name.c_str());
+			ImGui::GetBackgroundDrawList()->AddText({ screenCoords.x, screenCoords.y }, ImGui::ColorConvertFloat4ToU32({ 255.f, 255.f, 255.f, 255.f }), _sim.body(info.body).name.c_str());
+		}
+	}
+}
+
+void World::renderWarpIndicator(int displayW)
+{
+	const WarpStats& warp = _sim.lastWarp();
+	const double timeScale = _sim.clock().timeScale();
+	const bool isTraded = warp.isRailsFallback || warp.particleStepsSkipped > 0;
+	if (timeScale == 1.0 && !isTraded) return;
+
+	char buf[256];
+	int length = snprintf(buf, sizeof(buf), "Time warp %.3gx: %d steps, %.1f ms", timeScale, warp.due, warp.cpuMs);
+	if (warp.isRailsFallback) snprintf(buf + length, sizeof(buf) - length, ", n-body can't keep up, bodies on rails");
+	else if (warp.particleStepsSkipped > 0) snprintf(buf + length, sizeof(buf) - length, ", belt and ring falling behind");
+	ImVec4 color = isTraded ? ImVec4(1.0f, 0.6f, 0.1f, 1.0f) : ImVec4(1.0f, 1.0f, 1.0f, 1.0f);
+	ImGui::GetForegroundDrawList()->AddText({ (float)displayW - ImGui::CalcTextSize(buf).x - 20, 20 }, ImGui::ColorConvertFloat4ToU32(color), buf);
+}
+
+bool World::loadStars(const std::string& path)
+{
+	delete _skyPoints;
+	_skyPoints = nullptr;
+	_skyCount = 0;
+	return _starTable.open(path);
+}
+
+void World::buildSky(size_t count)
+{
+	// brightest first, the sun itself sits at the origin of the catalog and isn't part of the sky
+	std::vector<uint32_t> order;
+	order.reserve(_starTable.size());
+	for (size_t i = 0; i < _starTable.size(); i++) if (glm::length(_starTable.position(i)) > 1e-3) order.push_back((uint32_t)i);
+	count = glm::min(count, order.size());
+	std::nth_element(order.begin(), order.begin() + count, order.end(), [&](uint32_t a, uint32_t b) { return _starTable.star(a).magnitude < _starTable.star(b).magnitude; });
+	order.resize(count);
+
+	// a handful of colors by color index times a handful of brightnesses by magnitude, each a batch of its own
+	const int colorBins = 6, brightnessBins = 4;
+	const float faintest = count ? _starTable.magnitude(*std::max_element(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+		return _starTable.star(a).magnitude < _starTable.star(b).magnitude; })) : 0.0f;
+	auto binOf = [&](uint32_t i) {
+		int color = _starTable.hasColorIndex(i) ? glm::clamp((int)((_starTable.colorIndex(i) + 0.4f) / 2.4f * colorBins), 0, colorBins - 1) : colorBins / 2;
+		int brightness = glm::clamp((int)((faintest - _starTable.magnitude(i)) / 1.5f), 0, brightnessBins - 1);
+		return color * brightnessBins + brightness;
+	};
+	std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return binOf(a) < binOf(b); });
+
+	// stars are at infinity for the camera, so in camera relative space they never move and upload once
+	std::vector<float> vertices(3 * count);
+	_skyBatches.clear();
+	for (size_t k = 0; k < count; k++)
+	{
+		// equatorial to the scene's y up
+		glm::dvec3 p = glm::normalize(_starTable.position(order[k])) * 400.0;
+		vertices[3 * k] = (float)p.x;
+		vertices[3 * k + 1] = (float)p.z;
+		vertices[3 * k + 2] = (float)-p.y;
+		int bin = binOf(order[k]);
+		if (_skyBatches.empty() || binOf(order[k - 1]) != bin)
+		{
+			float bv = (bin / brightnessBins + 0.5f) / colorBins * 2.4f - 0.4f;
+			float brightness = 0.35f + 0.65f * (bin % brightnessBins) / (brightnessBins - 1);
+			_skyBatches.push_back({ (GLint)k, 0, glm::vec4(StarTable::color(bv) * brightness, 1.0f) });
 		}
+		_skyBatches.back().count++;
 	}
+	delete _skyPoints;
+	_skyPoints = Helper::makePointsVA(count);
+	_skyPoints->vertexBuffer().update(vertices.data(), vertices.size() * sizeof(float), GL_STATIC_DRAW);
+	_skyCount = count;
 }
 
 void World::renderStars(Camera& camera, std::shared_ptr<Shader>& shader, int count)
 {
+	if (_starTable.isOpen())
+	{
+		if (!_skyPoints || _skyCount != glm::min((size_t)count, _starTable.size())) buildSky((size_t)count);
+		for (auto& batch : _skyBatches)
+		{
+			DrawPacket packet = packetOf(*_skyPoints, *shader, DRAW_ARRAYS, GL_POINTS);
+			packet.first = batch.first;
+			packet.count = batch.count;
+			packet.color = batch.color;
+			Renderer::getInstance()->submit(packet, RENDER_PASS_SKY, 400.0f);
+		}
+		return;
+	}
+
 	if (_stars.size() > count) _stars.clear();
 	while (_stars.size() < count)
 	{
-		glm::vec3 pos;
-		pos.x = glm::linearRand(camera.position().x - 400.f, camera.position().x + 400.f);
-		pos.y = glm::linearRand(camera.position().y - 400.f, camera.position().y + 400.f);
-		pos.z = glm::linearRand(camera.position().z - 400.f, camera.position().z + 400.f);
+		glm::dvec3 pos = camera.position() + glm::dvec3(glm::linearRand(glm::vec3(-400.f), glm::vec3(400.f)));
 		Planet planet(_vaSphere, shader, 0.0f, pos, { 0.01f, 0.01f, 0.01f },  {1.0f, 1.0f, 1.0f, 1.0f});
 		_stars.push_back(planet);
 	}
 
-	std::vector<int> removeList;
-
+	_instancePlanets.clear();
 	for (auto& star : _stars)
 	{
-		if (glm::length(star.position() - camera.position()) < glm::length(glm::vec3(200.f, 200.f, 200.f)))
+		if (glm::length(star.position() - camera.position()) < glm::length(glm::dvec3(200.0, 200.0, 200.0)))
+			star.moveTo(camera.position() + glm::dvec3(glm::linearRand(glm::vec3(-400.f), glm::vec3(400.f))));
+		_instancePlanets.push_back(&star);
+	}
+	submitSpheres(_instancePlanets, *_vaStar, camera, *shader, GL_FILL);
+}
+
+void World::onImGuiRender()
+{
+	float timeScale = (float)_sim.clock().timeScale();
+	if (ImGui::SliderFloat("Time scale", &timeScale, 0.f, (float)kMaxTimeScale, "%.3gx", ImGuiSliderFlags_Logarithmic)) _sim.clock().setTimeScale(timeScale);
+	ImGui::SameLine();
+	bool isPaused = _sim.clock().isPaused();
+	if (ImGui::Checkbox("Pause simulation", &isPaused)) isPaused ? _sim.clock().pause() : _sim.clock().resume();
+	float budget = (float)(_sim.stepBudget() * 1e3);
+	if (ImGui::SliderFloat("Step budget (ms)", &budget, 1.f, 30.f, "%.1f")) _sim.setStepBudget(budget * 1e-3);
+	int mode = (int)_sim.mode();
+	if (ImGui::Combo("Physics", &mode, "Rails\0N-body gravity\0")) _sim.setMode((SimulationMode)mode);
+	if (_sim.mode() == SimulationMode::NBODY)
+	{
+		int solver = (int)_sim.gravitySolver();
+		if (ImGui::Combo("Gravity solver", &solver, "Direct sum\0Barnes-Hut\0")) _sim.setGravitySolver((GravitySolver)solver);
+		int integrator = (int)_sim.integratorType();
+		if (ImGui::Combo("Integrator", &integrator, "Leapfrog\0Yoshida 4th order\0RK45 adaptive\0Wisdom-Holman\0Block leapfrog\0")) _sim.setIntegrator((IntegratorType)integrator);
+		if (_sim.gravitySolver() == GravitySolver::BARNES_HUT)
 		{
-			glm::vec3 pos;
-			pos.x = glm::linearRand(camera.position().x - 400.f, camera.position().x + 400.f);
-			pos.y = glm::linearRand(camera.position().y - 400.f, camera.position().y + 400.f);
-			pos.z = glm::linearRand(camera.position().z - 400.f, camera.position().z + 400.f);
-			star.moveTo(pos);
+			float theta = (float)_sim.openingAngle();
+			if (ImGui::SliderFloat("Opening angle", &theta, 0.f, 1.5f, "%.2lf")) _sim.setOpeningAngle(theta);
 		}
+		int threads = _sim.threadCount();
+		if (ImGui::SliderInt("Worker threads", &threads, 1, glm::max((int)std::thread::hardware_concurrency(), 1))) _sim.setThreadCount(threads);
+		bool isCompensated = _sim.isCompensatedSummation();
+		if (ImGui::Checkbox("Compensated force sums", &isCompensated)) _sim.setCompensatedSummation(isCompensated);
+		bool isCollisionEnabled = _sim.isCollisionEnabled();
+		if (ImGui::Checkbox("Merge on collision", &isCollisionEnabled)) _sim.setCollisions(isCollisionEnabled);
+		ImGui::SameLine();
+		ImGui::Text("Merged: %zu", _sim.mergeCount());
+	}
+	if (!_sim.particleSystems().empty())
+	{
+		bool isParticleCollisionEnabled = _sim.particleSystems().front()->isSelfInteraction();
+		if (ImGui::Checkbox("Particle collisions", &isParticleCollisionEnabled)) _sim.setParticleCollisions(isParticleCollisionEnabled);
+		ImGui::SameLine();
+		ImGui::Text("Particles: %zu", _sim.particleCount());
 	}
 
+	ImGui::InputText("##checkpoint path", _checkpointPath, sizeof(_checkpointPath));
+	ImGui::SameLine();
+	if (ImGui::Button("Save checkpoint")) _checkpointStatus = saveCheckpoint(_checkpointPath) ? "saved" : "saving failed";
+	ImGui::SameLine();
+	if (ImGui::Button("Load checkpoint")) _checkpointStatus = loadCheckpoint(_checkpointPath) ? "loaded" : "not a readable checkpoint";
+	if (!_checkpointStatus.empty())
+	{
+		ImGui::SameLine();
+		ImGui::Text("%s", _checkpointStatus.c_str());
+	}
 
-	for (auto& star : _stars) star.draw();
-}
+	ImGui::InputText("##playback path", _playbackPath, sizeof(_playbackPath));
+	ImGui::SameLine();
+	if (!_playback && ImGui::Button("Play recording")) _playbackStatus = openPlayback(_playbackPath) ? "" : "not a readable recording";
+	if (_playback && ImGui::Button("Back to simulation")) closePlayback();
+	if (!_playbackStatus.empty())
+	{
+		ImGui::SameLine();
+		ImGui::Text("%s", _playbackStatus.c_str());
+	}
+	if (_playback)
+	{
+		// scrubbing only moves the playhead, the loader catches up while the last frame stays up
+		double start = _playback->startTime(), end = _playback->endTime();
+		ImGui::SliderScalar("Timeline", ImGuiDataType_Double, &_playhead, &start, &end, "%.2lfs");
+		ImGui::SameLine();
+		ImGui::Checkbox("Pause playback", &_isPlaybackPaused);
+		PlaybackStats stats = _playback->stats();
+		ImGui::Text("Bodies: %zu, decoded: %zu of %zu chunks, %.1f MB", _playbackCount, stats.cachedChunks, stats.capacity, stats.cachedBytes / (1024.0 * 1024.0));
+	}
 
-void World::onImGuiRender()
-{
 	ImGui::BeginChild("#planet edit", { 0,0 }, true);
 	for (auto& info : _planetInfos)
 	{
-		ImGui::Text("%s: ", info.name.c_str()); ImGui::SameLine();
+		Body& body = _sim.body(info.body);
+		ImGui::Text("%s: ", body.name.c_str()); ImGui::SameLine();
 		ImGui::PushItemWidth(75.2);
 
 		char id1[64];
-		snprintf(id1, sizeof(id1), "Eccentricity##%s", info.name.c_str());
+		snprintf(id1, sizeof(id1), "Eccentricity##%s", body.name.c_str());
 		char id2[64];
-		snprintf(id2, sizeof(id2), "FocalDistance##%s", info.name.c_str());
+		snprintf(id2, sizeof(id2), "FocalDistance##%s", body.name.c_str());
 		char id3[64];
-		snprintf(id3, sizeof(id3), "Mass##%s", info.name.c_str());
+		snprintf(id3, sizeof(id3), "Mass##%s", body.name.c_str());
 		char id4[64];
-		snprintf(id4, sizeof(id4), "Planet color##%s", info.name.c_str());
+		snprintf(id4, sizeof(id4), "Planet color##%s", body.name.c_str());
 
-		if (ImGui::SliderFloat(id1, &info.eccentricity, 0.01f, 0.99f, "%.2lf")) {
-			VertexArray* va = Helper::makeTrailVA(info.eccentricity, info.focalDistance);
+		float eccentricity = body.eccentricity, focalDistance = body.focalDistance;
+		if (ImGui::SliderFloat(id1, &eccentricity, 0.01f, 0.99f, "%.2lf")) {
+			_sim.setOrbit(info.body, eccentricity, focalDistance);
+			VertexArray* va = Helper::makeTrailVA(eccentricity, focalDistance);
 			delete info.trail;
 			info.trail = va;
 		}
 		ImGui::SameLine();
-		if(ImGui::SliderFloat(id2, &info.focalDistance, 0.f, 1000.f, "%.2lf")) {
-			VertexArray* va = Helper::makeTrailVA(info.eccentricity, info.focalDistance);
+		if(ImGui::SliderFloat(id2, &focalDistance, 0.f, 1000.f, "%.2lf")) {
+			_sim.setOrbit(info.body, eccentricity, focalDistance);
+			VertexArray* va = Helper::makeTrailVA(eccentricity, focalDistance);
 			delete info.trail;
 			info.trail = va;
 		}
 		ImGui::SameLine();
-		float mass = info.planet->mass();
-		if (ImGui::SliderFloat(id3, &mass, 1.f, 999999.f, "%.2lf")) info.planet->setMass(mass);
+		float mass = (float)_sim.mass(info.body);
+		if (ImGui::SliderFloat(id3, &mass, 1.f, 999999.f, "%.2lf"))
+		{
+			_sim.setMass(info.body, mass);
+			info.planet->setMass(mass);
+		}
 		ImGui::PopItemWidth();
 		glm::vec4 color = info.planet->color();
 		if (ImGui::ColorEdit4(id4, &color.x)) info.planet->setColor(color);
@@ -210,6 +797,10 @@ World::~World()
 		delete info.planet;
 		delete info.trail;
 	}
+	for (auto& info : _particleInfos) delete info.points;
+	delete _minorPoints;
+	delete _skyPoints;
+	closePlayback();
 }
 
 
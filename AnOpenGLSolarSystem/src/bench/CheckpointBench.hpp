@@ -0,0 +1,112 @@
+#pragma once
+
+#include "sim/Checkpoint.hpp"
+#include "sim/SolarSystem.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+
+// Save, open and restore times of the checkpoint format from a thousand to a million bodies, then for every
+// integrator whether a run that is saved half way, restored into a fresh simulation and continued ends
+// bit for bit where the uninterrupted run does.
+class CheckpointBench
+{
+	INCONSTRUCTIBLE(CheckpointBench)
+
+public:
+	static void run(const std::vector<size_t>& counts, int steps, int threads);
+
+private:
+	// nbody with collisions and a belt, so every section of the file gets exercised
+	static void populate(Simulation& sim, int randomCount, IntegratorType integrator, int threads);
+
+	static bool isIdentical(const Simulation& a, const Simulation& b);
+};
+
+void CheckpointBench::populate(Simulation& sim, int randomCount, IntegratorType integrator, int threads)
+{
+	sim.setThreadCount(threads);
+	sim.setIntegrator(integrator);
+	sim.setCollisions(true);
+	populateSolarSystem(sim, randomCount);
+	populateParticles(sim, 20000, 5000);
+	sim.setParticleCollisions(true);
+	sim.setMode(SimulationMode::NBODY);
+}
+
+bool CheckpointBench::isIdentical(const Simulation& a, const Simulation& b)
+{
+	if (a.bodyCount() != b.bodyCount() || a.particleCount() != b.particleCount() || a.clock().steps() != b.clock().steps()) return false;
+	const BodyArrays& x = a.state();
+	const BodyArrays& y = b.state();
+	const size_t bytes = a.bodyCount() * sizeof(double);
+	return !memcmp(x.px.data(), y.px.data(), bytes) && !memcmp(x.py.data(), y.py.data(), bytes) && !memcmp(x.pz.data(), y.pz.data(), bytes) &&
+		!memcmp(x.vx.data(), y.vx.data(), bytes) && !memcmp(x.vy.data(), y.vy.data(), bytes) && !memcmp(x.vz.data(), y.vz.data(), bytes) &&
+		!memcmp(x.mass.data(), y.mass.data(), bytes);
+}
+
+void CheckpointBench::run(const std::vector<size_t>& counts, int steps, int threads)
+{
+	const std::string path = (std::filesystem::temp_directory_path() / "checkpoint-bench.chk").string();
+
+	printf("%10s %10s %10s %10s %12s %12s\n", "bodies", "MB", "save ms", "open ms", "restore ms", "GB/s");
+	for (size_t count : counts)
+	{
+		const int randomCount = (int)count - (int)solarSystemDescs().size();
+		Simulation sim;
+		populateSolarSystem(sim, glm::max(randomCount, 0));
+		populateParticles(sim, count, 0);
+		sim.step(1);
+
+		auto start = std::chrono::steady_clock::now();
+		if (!Checkpoint::save(sim, path))
+		{
+			printf("%10zu save failed\n", count);
+			continue;
+		}
+		double saveMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		Checkpoint checkpoint;
+		start = std::chrono::steady_clock::now();
+		bool isOpen = checkpoint.open(path);
+		double openMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		Simulation restored;
+		start = std::chrono::steady_clock::now();
+		bool isRestored = isOpen && checkpoint.restore(restored);
+		double restoreMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		if (!isRestored || !isIdentical(sim, restored))
+		{
+			printf("%10zu restore failed\n", count);
+			continue;
+		}
+
+		double mb = checkpoint.header().fileSize / (1024.0 * 1024.0);
+		printf("%10zu %10.1lf %10.2lf %10.3lf %12.2lf %12.2lf\n", sim.bodyCount(), mb, saveMs, openMs, restoreMs,
+			checkpoint.header().fileSize / (restoreMs * 1e6));
+	}
+
+	printf("\nsaved after %d steps, restored and continued for %d more, against %d uninterrupted steps\n", steps / 2, steps - steps / 2, steps);
+	printf("%16s %10s %12s\n", "integrator", "merged", "bit exact");
+	const std::pair<IntegratorType, const char*> integrators[] = { { IntegratorType::LEAPFROG, "leapfrog" }, { IntegratorType::YOSHIDA4, "yoshida4" },
+		{ IntegratorType::RK45, "rk45" }, { IntegratorType::WISDOM_HOLMAN, "wisdom-holman" }, { IntegratorType::BLOCK_LEAPFROG, "block-leapfrog" } };
+	for (auto& integrator : integrators)
+	{
+		Simulation reference;
+		populate(reference, 300, integrator.first, threads);
+		reference.step(steps);
+
+		Simulation first;
+		populate(first, 300, integrator.first, threads);
+		first.step(steps / 2);
+		Checkpoint checkpoint;
+		Simulation second;
+		second.setThreadCount(threads);
+		bool isResumed = Checkpoint::save(first, path) && checkpoint.open(path) && checkpoint.restore(second);
+		if (isResumed) second.step(steps - steps / 2);
+
+		printf("%16s %10zu %12s\n", integrator.second, reference.mergeCount(), isResumed ? (isIdentical(reference, second) ? "yes" : "no") : "failed");
+	}
+	std::remove(path.c_str());
+}
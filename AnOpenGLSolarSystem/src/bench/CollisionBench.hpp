@@ -0,0 +1,92 @@
+#pragma once
+
+#include "sim/BodyArrays.hpp"
+#include "sim/CollisionGrid.hpp"
+
+#include <chrono>
+#include <random>
+
+// Collision broad phase on equal spheres scattered uniformly in a box, at several volume fractions:
+// a full rebuild, an incremental update after every body moved a little, and the pair search.
+// Small runs are checked against all pairs.
+class CollisionBench
+{
+	INCONSTRUCTIBLE(CollisionBench)
+
+public:
+	static void run(const std::vector<size_t>& counts, const std::vector<double>& fractions);
+
+	// n spheres of radius 1 in a cube sized so they fill the given fraction of it
+	static void makeBox(BodyArrays& bodies, size_t n, double fraction, uint64_t seed);
+
+private:
+	static size_t bruteForcePairs(const BodyArrays& bodies);
+};
+
+void CollisionBench::makeBox(BodyArrays& bodies, size_t n, double fraction, uint64_t seed)
+{
+	const double side = std::cbrt(n * 4.0 / 3.0 * glm::pi<double>() / fraction);
+	std::mt19937_64 rng(seed);
+	std::uniform_real_distribution<double> uniform(0.0, side);
+	bodies.clear();
+	bodies.reserve(n);
+	for (size_t i = 0; i < n; i++) bodies.push({ uniform(rng), uniform(rng), uniform(rng) }, { 0.0, 0.0, 0.0 }, 1.0, 1.0);
+}
+
+size_t CollisionBench::bruteForcePairs(const BodyArrays& bodies)
+{
+	size_t pairs = 0;
+	for (size_t i = 0; i < bodies.size(); i++)
+		for (size_t j = i + 1; j < bodies.size(); j++)
+		{
+			double dx = bodies.px[i] - bodies.px[j], dy = bodies.py[i] - bodies.py[j], dz = bodies.pz[i] - bodies.pz[j];
+			double reach = bodies.radius[i] + bodies.radius[j];
+			if (dx * dx + dy * dy + dz * dz <= reach * reach) pairs++;
+		}
+	return pairs;
+}
+
+void CollisionBench::run(const std::vector<size_t>& counts, const std::vector<double>& fractions)
+{
+	// all pairs gets too slow beyond this
+	const size_t maxChecked = 20000;
+
+	printf("%10s %10s %12s %12s %10s %12s %11s %10s %8s\n", "bodies", "fraction", "rebuild ms", "update ms", "moved", "search ms", "ns/body", "pairs", "check");
+	for (double fraction : fractions)
+	{
+		for (size_t n : counts)
+		{
+			BodyArrays bodies;
+			makeBox(bodies, n, fraction, 4048111);
+			CollisionGrid grid;
+			std::vector<Contact> contacts;
+
+			auto start = std::chrono::steady_clock::now();
+			grid.update(bodies);
+			double rebuildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+			// a step's worth of motion, a tenth of a radius in a random direction
+			std::mt19937_64 rng(n);
+			std::uniform_real_distribution<double> jitter(-0.1, 0.1);
+			for (size_t i = 0; i < n; i++)
+			{
+				bodies.px[i] += jitter(rng); bodies.py[i] += jitter(rng); bodies.pz[i] += jitter(rng);
+			}
+
+			start = std::chrono::steady_clock::now();
+			grid.update(bodies);
+			double updateMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+			start = std::chrono::steady_clock::now();
+			grid.collect(0, grid.cellCount(), contacts);
+			grid.collectLarge(bodies, contacts);
+			double searchMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+			const char* check = "-";
+			if (n <= maxChecked) check = bruteForcePairs(bodies) == contacts.size() ? "ok" : "MISMATCH";
+
+			printf("%10zu %10.4f %12.3lf %12.3lf %10zu %12.3lf %11.1lf %10zu %8s\n", n, fraction, rebuildMs, updateMs, grid.lastMoved(),
+				searchMs, (updateMs + searchMs) * 1e6 / n, contacts.size(), check);
+		}
+	}
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "sim/Ephemeris.hpp"
+#include "sim/SolarSystem.hpp"
+
+#include <chrono>
+#include <filesystem>
+#include <random>
+
+// Bakes the default system at a few segment lengths and degrees: bake time, file size, the worst fit error
+// against the integration, and what scrubbing to a random time costs from the file versus re-integrating.
+class EphemerisBench
+{
+	INCONSTRUCTIBLE(EphemerisBench)
+
+public:
+	static void run(int randomCount, double duration, SimulationMode mode, int threads);
+};
+
+void EphemerisBench::run(int randomCount, double duration, SimulationMode mode, int threads)
+{
+	const std::string path = (std::filesystem::temp_directory_path() / "ephemeris-bench.eph").string();
+	const std::vector<std::pair<double, int>> configs = { { 0.125, 8 }, { 0.25, 8 }, { 0.25, 12 }, { 0.5, 16 }, { 1.0, 16 } };
+
+	// re-integrating to a random time covers half the span on average
+	double replayMs = 0.0;
+	{
+		Simulation sim;
+		sim.setThreadCount(threads);
+		populateSolarSystem(sim, randomCount);
+		sim.setMode(mode);
+		auto start = std::chrono::steady_clock::now();
+		sim.step((int)std::ceil(duration / sim.clock().dt()));
+		replayMs = 0.5 * std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	printf("bodies: %d, span: %.1lfs, re-integrating to a random time: %.3lf ms\n", (int)solarSystemDescs().size() + randomCount, duration, replayMs);
+	printf("%10s %8s %10s %10s %12s %12s %14s %12s\n", "segment", "degree", "bake ms", "KB", "max error", "worst", "lookup ns", "all us");
+	for (auto& config : configs)
+	{
+		Simulation sim;
+		sim.setThreadCount(threads);
+		populateSolarSystem(sim, randomCount);
+		sim.setMode(mode);
+
+		EphemerisBakeStats stats{};
+		auto start = std::chrono::steady_clock::now();
+		bool isBaked = Ephemeris::bake(sim, path, duration, config.first, config.second, &stats);
+		double bakeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		Ephemeris ephemeris;
+		if (!isBaked || !ephemeris.load(path))
+		{
+			printf("%10.3lf %8d bake failed\n", config.first, config.second);
+			continue;
+		}
+
+		// random bodies at random times, nothing stays in cache between lookups
+		const int lookups = 1 << 20;
+		std::mt19937_64 rng(4048111);
+		std::uniform_real_distribution<double> timeDist(ephemeris.startTime(), ephemeris.endTime());
+		std::uniform_int_distribution<int> bodyDist(0, (int)ephemeris.bodyCount() - 1);
+		std::vector<std::pair<int, double>> queries(lookups);
+		for (auto& query : queries) query = { bodyDist(rng), timeDist(rng) };
+		glm::dvec3 sum = { 0.0, 0.0, 0.0 };
+		start = std::chrono::steady_clock::now();
+		for (auto& query : queries) sum += ephemeris.position(query.first, query.second);
+		double lookupNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / lookups;
+
+		// a whole frame's worth, every body at one random time
+		const int frames = 256;
+		std::vector<double> x(ephemeris.bodyCount()), y(ephemeris.bodyCount()), z(ephemeris.bodyCount());
+		start = std::chrono::steady_clock::now();
+		for (int f = 0; f < frames; f++)
+		{
+			ephemeris.positions(timeDist(rng), x.data(), y.data(), z.data(), 0, ephemeris.bodyCount());
+			sum.x += x[f % x.size()];
+		}
+		double allUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / frames;
+
+		// keeps the lookups from being optimised away
+		volatile double sink = sum.x + sum.y + sum.z;
+		(void)sink;
+
+		printf("%10.3lf %8d %10.1lf %10.1lf %12.3e %12s %14.1lf %12.2lf\n", ephemeris.segmentLength(), ephemeris.degree(), bakeMs,
+			stats.bytes / 1024.0, stats.maxError, ephemeris.name(stats.worstBody).c_str(), lookupNs, allUs);
+	}
+	std::remove(path.c_str());
+}
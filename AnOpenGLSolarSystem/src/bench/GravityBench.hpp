@@ -0,0 +1,96 @@
+#pragma once
+
+#include "sim/BodyArrays.hpp"
+#include "sim/Gravity.hpp"
+#include "sim/BarnesHut.hpp"
+
+#include <chrono>
+#include <random>
+
+// Barnes-Hut against direct summation on a plummer star cluster: time per step and force error
+class GravityBench
+{
+	INCONSTRUCTIBLE(GravityBench)
+
+public:
+	static void run(const std::vector<size_t>& counts, const std::vector<double>& thetas, double softening);
+
+	// equal mass plummer sphere with unit scale radius times radius
+	static void makePlummer(BodyArrays& bodies, size_t n, double radius, uint64_t seed);
+
+private:
+	template<typename Fn>
+	static double timeMs(Fn&& fn);
+};
+
+template<typename Fn>
+double GravityBench::timeMs(Fn&& fn)
+{
+	auto start = std::chrono::steady_clock::now();
+	fn();
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void GravityBench::makePlummer(BodyArrays& bodies, size_t n, double radius, uint64_t seed)
+{
+	std::mt19937_64 rng(seed);
+	std::uniform_real_distribution<double> uniform(0.0, 1.0);
+	bodies.clear();
+	bodies.reserve(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		// invert the plummer cumulative mass profile, cut off the far tail
+		double u = glm::min(uniform(rng), 0.999);
+		double r = radius / std::sqrt(std::pow(u, -2.0 / 3.0) - 1.0);
+		double cosTheta = 2.0 * uniform(rng) - 1.0, phi = 2.0 * glm::pi<double>() * uniform(rng);
+		double sinTheta = std::sqrt(1.0 - cosTheta * cosTheta);
+		bodies.push({ r * sinTheta * std::cos(phi), r * sinTheta * std::sin(phi), r * cosTheta }, { 0.0, 0.0, 0.0 }, 1.0 / n);
+	}
+}
+
+void GravityBench::run(const std::vector<size_t>& counts, const std::vector<double>& thetas, double softening)
+{
+	// reference forces are only computed for a sample once direct summation gets too slow
+	const size_t maxSample = 2048;
+
+	printf("direct kernel: %s, softening: %.4f\n", Gravity::kernelName(), softening);
+	printf("%10s %-10s %6s %10s %10s %10s %9s %11s %11s\n", "bodies", "solver", "theta", "build ms", "force ms", "step ms", "speedup", "rms err", "max err");
+
+	for (size_t n : counts)
+	{
+		BodyArrays bodies;
+		makePlummer(bodies, n, 1.0, 4048111 + n);
+
+		// the bodies are in random order, so the first ones are an unbiased sample
+		size_t sample = glm::min(n, maxSample);
+		double sampleMs = timeMs([&]() { Gravity::directSum(bodies, 1.0, softening, 0, sample); });
+		double directMs = sampleMs * (double)n / sample;
+		std::vector<glm::dvec3> reference(sample);
+		for (size_t i = 0; i < sample; i++) reference[i] = bodies.acceleration(i);
+
+		printf("%10zu %-10s %6s %10s %10.3f %10.3f %9s %11s %11s%s\n", n, "direct", "-", "-", directMs, directMs, "1.0x", "-", "-",
+			sample < n ? " (extrapolated)" : "");
+
+		for (double theta : thetas)
+		{
+			BarnesHut tree;
+			tree.setOpeningAngle(theta);
+			double buildMs = timeMs([&]() { tree.build(bodies); });
+			double forceMs = timeMs([&]() { tree.evaluate(bodies, 1.0, softening, 0, n); });
+
+			double sumErr2 = 0.0, maxErr = 0.0;
+			for (size_t i = 0; i < sample; i++)
+			{
+				double err = glm::length(bodies.acceleration(i) - reference[i]) / glm::max(glm::length(reference[i]), 1e-300);
+				sumErr2 += err * err;
+				maxErr = glm::max(maxErr, err);
+			}
+
+			char thetaBuf[16], speedupBuf[16];
+			snprintf(thetaBuf, sizeof(thetaBuf), "%.2f", theta);
+			snprintf(speedupBuf, sizeof(speedupBuf), "%.1fx", directMs / (buildMs + forceMs));
+			printf("%10zu %-10s %6s %10.3f %10.3f %10.3f %9s %11.3e %11.3e\n", n, "barnes-hut", thetaBuf, buildMs, forceMs, buildMs + forceMs,
+				speedupBuf, std::sqrt(sumErr2 / sample), maxErr);
+		}
+	}
+}
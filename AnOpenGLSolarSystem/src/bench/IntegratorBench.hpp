@@ -0,0 +1,86 @@
+#pragma once
+
+#include "sim/Simulation.hpp"
+#include "sim/SolarSystem.hpp"
+#include "sim/Diagnostics.hpp"
+
+#include <chrono>
+
+// Accuracy against cost for every integrator over a range of step sizes: the sun and planets
+// (satellites left out, they aren't bound with the toy masses) run for a fixed simulated time
+// and the worst energy and angular momentum drift is tracked along the way.
+class IntegratorBench
+{
+	INCONSTRUCTIBLE(IntegratorBench)
+
+public:
+	static void run(const std::vector<double>& dts, double duration, int threads);
+
+private:
+	static void populate(Simulation& sim);
+};
+
+void IntegratorBench::populate(Simulation& sim)
+{
+	const float sunMass = solarSystemDescs()[0].mass;
+	int planet = 0;
+	for (auto& desc : solarSystemDescs())
+	{
+		if (strcmp(desc.centerName, "Sun")) continue;
+
+		// spread the planets out in phase and cap them at jupiter's real share of the sun's mass,
+		// the toy masses lined up on one axis make close encounters that swamp any integrator
+		float angle = glm::radians(137.5f * planet++);
+		glm::vec3 pos = { std::cos(angle) * desc.pos.x, desc.pos.y, std::sin(angle) * desc.pos.x };
+		float mass = !strcmp(desc.centerName, desc.name) ? desc.mass : glm::min(desc.mass, sunMass * 1e-3f);
+		sim.addBody(desc.name, desc.centerName, desc.eccentricity, desc.focalDistance, mass, pos);
+	}
+}
+
+void IntegratorBench::run(const std::vector<double>& dts, double duration, int threads)
+{
+	const IntegratorType types[] = { IntegratorType::LEAPFROG, IntegratorType::YOSHIDA4, IntegratorType::RK45, IntegratorType::WISDOM_HOLMAN,
+		IntegratorType::BLOCK_LEAPFROG };
+	// unsoftened, wisdom-holman's kepler drifts assume a point mass
+	const double softening = 0.0;
+
+	printf("simulated: %.1lfs, threads: %d\n", duration, threads);
+	printf("%-14s %10s %10s %12s %12s %14s %14s\n", "integrator", "dt", "steps", "wall ms", "force evals", "max |dE/E0|", "max |dL|/|L0|");
+	for (IntegratorType type : types)
+	{
+		for (double dt : dts)
+		{
+			Simulation sim;
+			sim.clock().setDt(dt);
+			sim.setSoftening(softening);
+			sim.setThreadCount(threads);
+			sim.setIntegrator(type);
+			populate(sim);
+			sim.setMode(SimulationMode::NBODY);
+
+			const double e0 = Diagnostics::energy(sim.state(), kGravity, softening);
+			const glm::dvec3 l0 = Diagnostics::angularMomentum(sim.state());
+			const long long steps = (long long)std::ceil(duration / dt);
+			// sample the invariants a few hundred times, outside the timed region
+			const long long batch = glm::max(steps / 256, 1LL);
+
+			double wall = 0.0, maxEnergy = 0.0, maxMomentum = 0.0;
+			for (long long done = 0; done < steps;)
+			{
+				int n = (int)std::min(batch, steps - done);
+				auto start = std::chrono::steady_clock::now();
+				sim.step(n);
+				wall += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+				done += n;
+
+				double e = Diagnostics::energy(sim.state(), kGravity, softening);
+				glm::dvec3 l = Diagnostics::angularMomentum(sim.state());
+				maxEnergy = glm::max(maxEnergy, std::abs((e - e0) / e0));
+				maxMomentum = glm::max(maxMomentum, glm::length(l - l0) / glm::length(l0));
+			}
+
+			printf("%-14s %10.6lf %10lld %12.2lf %12llu %14.3e %14.3e\n", Integrator::typeName(type), dt, steps, wall * 1e3,
+				(unsigned long long)sim.integrator().evaluations(), maxEnergy, maxMomentum);
+		}
+	}
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "sim/Simulation.hpp"
+#include "sim/SolarSystem.hpp"
+#include "ThreadBench.hpp"
+
+#include <chrono>
+
+// Belt and ring particles at increasing thread counts: the step alone, the copy the viewer uploads
+// every frame, and whether both fit a 60 Hz frame. Self-interaction adds the bump pass.
+class ParticleBench
+{
+	INCONSTRUCTIBLE(ParticleBench)
+
+public:
+	static void run(const std::vector<size_t>& counts, int steps, const std::vector<int>& threadCounts);
+};
+
+void ParticleBench::run(const std::vector<size_t>& counts, int steps, const std::vector<int>& threadCounts)
+{
+	const double frameMs = 1000.0 / 60.0;
+	printf("%10s %8s %6s %10s %11s %13s %10s %6s\n", "particles", "threads", "bumps", "step ms", "upload ms", "Mparticles/s", "contacts", "60 Hz");
+	for (size_t count : counts)
+	{
+		for (bool isSelfInteraction : { false, true })
+		{
+			for (int threads : threadCounts)
+			{
+				// a tenth in the ring, where the particles are packed closest
+				Simulation sim;
+				populateSolarSystem(sim);
+				populateParticles(sim, count - count / 10, count / 10);
+				sim.setThreadCount(threads);
+				sim.setParticleCollisions(isSelfInteraction);
+				std::vector<float> vertices(3 * sim.particleCount());
+
+				double stepMs = 0.0, uploadMs = 0.0;
+				size_t contacts = 0;
+				for (int s = 0; s < steps; s++)
+				{
+					auto start = std::chrono::steady_clock::now();
+					sim.step(1);
+					auto stepped = std::chrono::steady_clock::now();
+					size_t offset = 0;
+					for (auto& particles : sim.particleSystems())
+					{
+						float* out = vertices.data() + 3 * offset;
+						sim.parallelFor(particles->size(), 65536, [&](size_t begin, size_t end) { particles->interleave(out, begin, end); });
+						offset += particles->size();
+						contacts += particles->lastContacts();
+					}
+					stepMs += std::chrono::duration<double, std::milli>(stepped - start).count();
+					uploadMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - stepped).count();
+				}
+				stepMs /= steps;
+				uploadMs /= steps;
+
+				printf("%10zu %8d %6s %10.3lf %11.3lf %13.1lf %10zu %6s\n", count, threads, isSelfInteraction ? "on" : "off", stepMs, uploadMs,
+					count / stepMs * 1e-3, contacts / steps, stepMs + uploadMs <= frameMs ? "yes" : "no");
+			}
+		}
+	}
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include "sim/Playback.hpp"
+#include "sim/SolarSystem.hpp"
+
+#include <chrono>
+#include <filesystem>
+#include <random>
+
+// Records a run, then plays it back out of core under a memory budget: decode cost per chunk, frames that had
+// to wait for the loader during steady playback, how long a jump to a random time takes to show, and the
+// Hermite error halfway between stored frames next to plain linear interpolation.
+class PlaybackBench
+{
+	INCONSTRUCTIBLE(PlaybackBench)
+
+public:
+	static void run(int randomCount, int steps, double budgetMb, int threads);
+
+private:
+	// record sim for steps, keeping exact copies of the states halfway between frames
+	static bool record(Simulation& sim, const std::string& path, int steps, int interval, std::vector<std::pair<double, BodyArrays>>* halfway);
+};
+
+bool PlaybackBench::record(Simulation& sim, const std::string& path, int steps, int interval, std::vector<std::pair<double, BodyArrays>>* halfway)
+{
+	TrajectoryOptions options = TrajectoryRecorder::defaultOptions();
+	options.interval = interval;
+	// the bench wants every frame, so the writer is given room rather than let it drop any
+	options.bufferedFrames = 64;
+	TrajectoryRecorder recorder;
+	if (!recorder.open(path, options, sim.clock().dt())) return false;
+
+	bool isFrame = true;
+	sim.setStepCallback([&](const Simulation& s) {
+		if (isFrame) recorder.capture(s);
+		else if (halfway && halfway->size() < 64) halfway->push_back({ s.clock().time(), s.state() });
+		isFrame = !isFrame;
+	}, interval / 2);
+	sim.step(steps);
+	sim.setStepCallback(nullptr);
+	return recorder.close() && recorder.stats().dropped == 0;
+}
+
+void PlaybackBench::run(int randomCount, int steps, double budgetMb, int threads)
+{
+	const std::string path = (std::filesystem::temp_directory_path() / "playback-bench.trk").string();
+	const int interval = 16;
+
+	// out of core playback of a large rails run
+	{
+		Simulation sim;
+		sim.setThreadCount(threads);
+		populateSolarSystem(sim, randomCount);
+		if (!record(sim, path, steps, interval, nullptr))
+		{
+			printf("recording %s failed\n", path.c_str());
+			return;
+		}
+
+		TrajectoryPlayback playback;
+		if (!playback.open(path, (size_t)(budgetMb * 1024 * 1024)))
+		{
+			printf("opening %s failed\n", path.c_str());
+			return;
+		}
+		const size_t n = playback.maxBodyCount();
+		std::vector<double> x(n), y(n), z(n);
+		printf("bodies: %zu, recorded: %.1lfs, file: %.1lf MB, budget: %.0lf MB, %zu chunks cached at most\n", n, playback.endTime() - playback.startTime(),
+			std::filesystem::file_size(path) / (1024.0 * 1024.0), budgetMb, playback.stats().capacity);
+
+		// 60 Hz frames at a speed that crosses a chunk every half second, waiting out nothing
+		const double speed = (playback.endTime() - playback.startTime()) / 8.0;
+		int waited = 0, frames = 0;
+		double worstMs = 0.0;
+		for (double t = playback.startTime(); t <= playback.endTime(); t += speed / 60.0, frames++)
+		{
+			auto start = std::chrono::steady_clock::now();
+			if (!playback.positions(t, x.data(), y.data(), z.data())) waited++;
+			worstMs = glm::max(worstMs, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+			std::this_thread::sleep_until(start + std::chrono::microseconds(16667));
+		}
+		PlaybackStats stats = playback.stats();
+		printf("playing at %.0fx: %d of %d frames waited on the loader, worst positions() %.2lf ms, decode %.1lf ms a chunk, %.1lf MB decoded in memory\n",
+			speed, waited, frames, worstMs, stats.decodedChunks ? stats.decodeMs / stats.decodedChunks : 0.0, stats.cachedBytes / (1024.0 * 1024.0));
+
+		// jumps to random times, until the frame there shows
+		std::mt19937_64 rng(4048111);
+		std::uniform_real_distribution<double> timeDist(playback.startTime(), playback.endTime());
+		double totalMs = 0.0, maxMs = 0.0;
+		const int scrubs = 16;
+		for (int s = 0; s < scrubs; s++)
+		{
+			double t = timeDist(rng);
+			auto start = std::chrono::steady_clock::now();
+			while (!playback.positions(t, x.data(), y.data(), z.data())) std::this_thread::sleep_for(std::chrono::microseconds(200));
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			totalMs += ms;
+			maxMs = glm::max(maxMs, ms);
+		}
+		stats = playback.stats();
+		printf("random scrubs: %.1lf ms average, %.1lf ms worst until shown, %.1lf MB decoded in memory\n", totalMs / scrubs, maxMs,
+			stats.cachedBytes / (1024.0 * 1024.0));
+	}
+
+	// interpolation error halfway between frames, velocities recorded in nbody and taken from neighbours on the rails
+	printf("\n%6s %9s %12s %14s %14s %14s %14s\n", "mode", "interval", "tolerance", "hermite max", "linear max", "hermite mean", "linear mean");
+	const std::pair<SimulationMode, int> configs[] = { { SimulationMode::RAILS, 4 }, { SimulationMode::RAILS, 16 }, { SimulationMode::NBODY, 4 },
+		{ SimulationMode::NBODY, 16 } };
+	for (auto& [mode, frameInterval] : configs)
+	{
+		Simulation sim;
+		sim.setThreadCount(threads);
+		populateSolarSystem(sim, 500);
+		sim.setMode(mode);
+		std::vector<std::pair<double, BodyArrays>> halfway;
+		if (!record(sim, path, 2048, frameInterval, &halfway)) continue;
+
+		TrajectoryPlayback playback;
+		TrajectoryReader reader;
+		if (!playback.open(path) || !reader.open(path)) continue;
+		const size_t n = playback.maxBodyCount();
+		std::vector<double> x(n), y(n), z(n);
+		double hermiteError = 0.0, linearError = 0.0, hermiteSum = 0.0, linearSum = 0.0;
+		size_t samples = 0;
+		TrajectoryFrames frames;
+		for (auto& exact : halfway)
+		{
+			const double t = exact.first;
+			while (!playback.positions(t, x.data(), y.data(), z.data())) std::this_thread::sleep_for(std::chrono::microseconds(200));
+
+			// linear between the frames either side, which are in one chunk away from chunk edges
+			if (!reader.decode(reader.find(t), frames)) continue;
+			size_t k = (size_t)(std::upper_bound(frames.times.begin(), frames.times.end(), t) - frames.times.begin());
+			if (k == 0 || k == frames.times.size()) continue;
+			const double s = (t - frames.times[k - 1]) / (frames.times[k] - frames.times[k - 1]);
+			const BodyArrays& state = exact.second;
+			for (size_t i = 0; i < glm::min(n, (size_t)frames.bodyCount); i++)
+			{
+				glm::dvec3 p = { state.px[i], state.py[i], state.pz[i] };
+				glm::dvec3 a = { frames.x[(k - 1) * n + i], frames.y[(k - 1) * n + i], frames.z[(k - 1) * n + i] };
+				glm::dvec3 b = { frames.x[k * n + i], frames.y[k * n + i], frames.z[k * n + i] };
+				double hermite = glm::length(glm::dvec3(x[i], y[i], z[i]) - p), linear = glm::length(glm::mix(a, b, s) - p);
+				hermiteError = glm::max(hermiteError, hermite);
+				linearError = glm::max(linearError, linear);
+				hermiteSum += hermite;
+				linearSum += linear;
+				samples++;
+			}
+		}
+		printf("%6s %9d %12.1e %14.3e %14.3e %14.3e %14.3e\n", mode == SimulationMode::RAILS ? "rails" : "nbody", frameInterval,
+			reader.header().positionTolerance, hermiteError, linearError, samples ? hermiteSum / samples : 0.0, samples ? linearSum / samples : 0.0);
+	}
+	std::remove(path.c_str());
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "sim/KeplerOrbits.hpp"
+#include "sim/Gravity.hpp"
+
+#include <chrono>
+#include <random>
+
+// Batch Kepler propagation of random elliptic orbits on one core: time per call, time per body, and the
+// error of the float solve with its double polish against the scalar solve, double throughout. The last column
+// is what rounding the stored elements to float alone would cost on top of that.
+class RailsBench
+{
+	INCONSTRUCTIBLE(RailsBench)
+
+public:
+	static void run(const std::vector<size_t>& counts);
+
+	static void makeOrbits(KeplerOrbits& orbits, size_t count, uint64_t seed = 4048111);
+};
+
+void RailsBench::makeOrbits(KeplerOrbits& orbits, size_t count, uint64_t seed)
+{
+	std::mt19937_64 rng(seed);
+	std::uniform_real_distribution<double> aDist(40.0, 400.0), eDist(0.0, 0.9), unit(-1.0, 1.0), angleDist(-glm::pi<double>(), glm::pi<double>());
+	const double mu = kGravity * 333400.0;
+
+	orbits.clear();
+	orbits.reserve(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		glm::dvec3 periapsis = { unit(rng), 0.1 * unit(rng), unit(rng) };
+		glm::dvec3 direction = glm::cross(periapsis, glm::dvec3(0.1 * unit(rng), 1.0, 0.1 * unit(rng)));
+		orbits.push(mu, aDist(rng), eDist(rng), periapsis, direction, angleDist(rng), 0.0);
+	}
+}
+
+void RailsBench::run(const std::vector<size_t>& counts)
+{
+	printf("kernel: %s\n", KeplerOrbits::kernelName());
+	printf("%10s %12s %12s %14s %14s %14s %14s\n", "orbits", "batch ms", "ns/orbit", "scalar ms", "speedup", "max error", "float elements");
+
+	for (size_t count : counts)
+	{
+		KeplerOrbits orbits;
+		makeOrbits(orbits, count);
+		AlignedVector<double> x(count), y(count), z(count);
+
+		// a spread of times, so every lane sees a different anomaly every call
+		const int calls = 20;
+		double batchMs = 0.0;
+		for (int c = 0; c < calls; c++)
+		{
+			auto start = std::chrono::steady_clock::now();
+			orbits.propagate(1000.0 + 37.3 * c, x.data(), y.data(), z.data(), 0, count);
+			batchMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		}
+		batchMs /= calls;
+
+		// the double precision one body at a time path, what the rails did before
+		const double time = 1000.0 + 37.3 * (calls - 1);
+		double maxError = 0.0;
+		auto start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < count; i++)
+		{
+			glm::dvec3 pos = orbits.position(i, time);
+			maxError = glm::max(maxError, glm::length(pos - glm::dvec3(x[i], y[i], z[i])));
+		}
+		double scalarMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		double floatError = 0.0;
+		for (size_t i = 0; i < count; i++)
+		{
+			double e = (float)orbits.eccentricity(i), E = KeplerOrbits::solve(orbits.meanAnomaly(i, time), e);
+			glm::dvec3 p = glm::vec3(orbits.majorAxis(i)), q = glm::vec3(orbits.minorAxis(i));
+			floatError = glm::max(floatError, glm::length(p * (std::cos(E) - e) + q * std::sin(E) - orbits.position(i, time)));
+		}
+
+		printf("%10zu %12.3lf %12.2lf %14.3lf %13.1lfx %14.3e %14.3e\n", count, batchMs, batchMs * 1e6 / count, scalarMs,
+			batchMs > 0.0 ? scalarMs / batchMs : 0.0, maxError, floatError);
+	}
+}
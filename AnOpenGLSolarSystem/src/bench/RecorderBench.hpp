@@ -0,0 +1,102 @@
+#pragma once
+
+#include "sim/Trajectory.hpp"
+#include "sim/SolarSystem.hpp"
+
+#include <chrono>
+#include <filesystem>
+
+// Records runs of up to 10^5 bodies: how long the simulation waits on capture(), how many buffers the writer
+// needed to keep up and the frames it couldn't within their memory cap, bytes per body and frame against raw doubles, and the worst error of the decoded
+// frames against exact copies taken alongside the recording.
+class RecorderBench
+{
+	INCONSTRUCTIBLE(RecorderBench)
+
+public:
+	static void run(int randomCount, int steps, double tolerance, int threads);
+};
+
+void RecorderBench::run(int randomCount, int steps, double tolerance, int threads)
+{
+	const std::string path = (std::filesystem::temp_directory_path() / "recorder-bench.trk").string();
+	typedef struct
+	{
+		SimulationMode mode;
+		int randomCount;
+		int interval;
+	}Config;
+	const Config configs[] = { { SimulationMode::RAILS, randomCount, 16 }, { SimulationMode::RAILS, randomCount, 1 },
+		{ SimulationMode::NBODY, glm::min(randomCount, 2000), 4 } };
+
+	printf("tolerance: %.1e, %d steps per run\n", tolerance, steps);
+	printf("%6s %8s %9s %8s %8s %8s %12s %10s %8s %10s %12s %12s\n", "mode", "bodies", "interval", "frames", "buffers", "dropped", "capture ms", "stall",
+		"B/body", "ratio", "max pos err", "max vel err");
+	for (const Config& config : configs)
+	{
+		Simulation sim;
+		sim.setThreadCount(threads);
+		populateSolarSystem(sim, config.randomCount);
+		sim.setMode(config.mode);
+
+		TrajectoryOptions options = TrajectoryRecorder::defaultOptions();
+		options.interval = config.interval;
+		options.positionTolerance = tolerance;
+		options.velocityTolerance = 0.1 * tolerance;
+		TrajectoryRecorder recorder;
+		if (!recorder.open(path, options, sim.clock().dt()))
+		{
+			printf("%6s opening %s failed\n", config.mode == SimulationMode::RAILS ? "rails" : "nbody", path.c_str());
+			continue;
+		}
+
+		// exact copies of every 8th frame, to hold the decoded ones against
+		std::vector<std::pair<double, BodyArrays>> exact;
+		int frame = 0;
+		sim.setStepCallback([&](const Simulation& s) {
+			recorder.capture(s);
+			if (frame++ % 8 == 0) exact.push_back({ s.clock().time(), s.state() });
+		}, config.interval);
+
+		auto start = std::chrono::steady_clock::now();
+		sim.step(steps);
+		double runMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		sim.setStepCallback(nullptr);
+		recorder.close();
+		TrajectoryStats stats = recorder.stats();
+
+		double maxPositionError = 0.0, maxVelocityError = 0.0;
+		TrajectoryReader reader;
+		if (reader.open(path))
+		{
+			TrajectoryFrames frames;
+			size_t next = 0;
+			for (size_t c = 0; c < reader.chunkCount() && next < exact.size() && reader.decode(c, frames); c++)
+			{
+				for (size_t k = 0; k < frames.times.size() && next < exact.size(); k++)
+				{
+					// copies of dropped frames have nothing to compare with
+					while (next < exact.size() && exact[next].first < frames.times[k]) next++;
+					if (next == exact.size() || frames.times[k] != exact[next].first) continue;
+					const BodyArrays& state = exact[next++].second;
+					for (size_t i = 0, n = frames.bodyCount; i < n; i++)
+					{
+						maxPositionError = std::max({ maxPositionError, std::abs(frames.x[k * n + i] - state.px[i]),
+							std::abs(frames.y[k * n + i] - state.py[i]), std::abs(frames.z[k * n + i] - state.pz[i]) });
+						if (frames.hasVelocities)
+							maxVelocityError = std::max({ maxVelocityError, std::abs(frames.vx[k * n + i] - state.vx[i]),
+								std::abs(frames.vy[k * n + i] - state.vy[i]), std::abs(frames.vz[k * n + i] - state.vz[i]) });
+					}
+				}
+			}
+		}
+
+		uint64_t written = stats.captured - stats.dropped;
+		printf("%6s %8zu %9d %8llu %8llu %8llu %12.4lf %9.2lf%% %8.2lf %9.1lfx %12.3e %12.3e\n", config.mode == SimulationMode::RAILS ? "rails" : "nbody",
+			sim.bodyCount(), config.interval, (unsigned long long)written, (unsigned long long)stats.buffers, (unsigned long long)stats.dropped,
+			stats.captured ? stats.captureMs / stats.captured : 0.0, 100.0 * stats.captureMs / runMs,
+			written ? (double)stats.bytes / written / sim.bodyCount() : 0.0, stats.bytes ? (double)stats.rawBytes / stats.bytes : 0.0,
+			maxPositionError, maxVelocityError);
+	}
+	std::remove(path.c_str());
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "sim/Scene.hpp"
+
+#include <chrono>
+#include <filesystem>
+#include <random>
+
+// Writes catalog scenes of the default system plus n minor bodies, then loads each three ways: a parse that
+// compiles the cache, a start that maps the cache, and a parse with no cache at all. Hashing the text, which
+// every cached start still pays, and adding the bodies to a Simulation are timed on their own.
+class SceneBench
+{
+	INCONSTRUCTIBLE(SceneBench)
+
+public:
+	static void run(const std::vector<size_t>& counts);
+
+	// the default system and count minor bodies on rings about the sun, the way populateSolarSystem scatters them
+	static bool writeCatalog(const std::string& path, size_t count, uint64_t seed = 4048111);
+};
+
+bool SceneBench::writeCatalog(const std::string& path, size_t count, uint64_t seed)
+{
+	std::ofstream ofs(path, std::ios::trunc);
+	if (!ofs) return false;
+	for (auto& desc : solarSystemDescs())
+	{
+		char line[256];
+		snprintf(line, sizeof(line), "body %s %s %g %g %g pos=%g,%g,%g scale=%g color=%g,%g,%g,%g\n", desc.name, desc.centerName, desc.eccentricity,
+			desc.focalDistance, desc.mass, desc.pos.x, desc.pos.y, desc.pos.z, desc.scale.x, desc.color.r, desc.color.g, desc.color.b, desc.color.a);
+		ofs << line;
+	}
+
+	std::mt19937_64 rng(seed);
+	std::uniform_real_distribution<double> radiusDist(40.0, 400.0), angleDist(0.0, 2.0 * glm::pi<double>()), heightDist(-2.0, 2.0);
+	for (size_t i = 0; i < count; i++)
+	{
+		double radius = radiusDist(rng), angle = angleDist(rng);
+		char line[160];
+		snprintf(line, sizeof(line), "minor Minor%zu Sun 0.01 %.3f 0.001 %.4f %.4f %.4f\n", i, radius, radius * std::cos(angle), heightDist(rng), radius * std::sin(angle));
+		ofs << line;
+	}
+	return ofs.good();
+}
+
+void SceneBench::run(const std::vector<size_t>& counts)
+{
+	const std::string path = (std::filesystem::temp_directory_path() / "scene-bench.scene").string();
+	auto timeMs = [](const std::function<void()>& work) {
+		auto start = std::chrono::steady_clock::now();
+		work();
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	};
+
+	printf("%10s %10s %10s %12s %12s %12s %10s %12s %10s\n", "bodies", "text MB", "cache MB", "first ms", "cached ms", "parse ms", "hash ms",
+		"populate ms", "speedup");
+	for (size_t count : counts)
+	{
+		if (!writeCatalog(path, count))
+		{
+			printf("writing %s failed\n", path.c_str());
+			return;
+		}
+		std::error_code error;
+		std::filesystem::remove(Scene::cachePath(path), error);
+
+		Scene scene;
+		bool isLoaded = true;
+		double firstMs = timeMs([&]() { isLoaded &= scene.load(path); });
+		double cachedMs = timeMs([&]() { isLoaded &= scene.load(path) && scene.isFromCache(); });
+		// the cached scene is the one populated, so the bodies come straight out of the mapping
+		Simulation sim;
+		double populateMs = timeMs([&]() { scene.populate(sim); });
+		Scene parsed;
+		double parseMs = timeMs([&]() { isLoaded &= parsed.load(path, false); });
+		isLoaded &= parsed.size() == scene.size() && sim.bodyCount() == scene.size();
+		if (!isLoaded)
+		{
+			printf("%10zu loading failed: %s\n", count, scene.error().empty() ? parsed.error().c_str() : scene.error().c_str());
+			continue;
+		}
+
+		MappedFile text;
+		text.open(path);
+		uint64_t hash = 0;
+		double hashMs = timeMs([&]() { hash = Scene::contentHash(text.data(), text.size()); });
+		(void)hash;
+
+		printf("%10zu %10.1lf %10.1lf %12.2lf %12.2lf %12.2lf %10.2lf %12.1lf %9.0lfx\n", scene.size(), std::filesystem::file_size(path) / (1024.0 * 1024.0),
+			std::filesystem::file_size(Scene::cachePath(path)) / (1024.0 * 1024.0), firstMs, cachedMs, parseMs, hashMs, populateMs,
+			cachedMs > 0.0 ? parseMs / cachedMs : 0.0);
+	}
+	std::remove(path.c_str());
+	std::remove(Scene::cachePath(path).c_str());
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "sim/StarCatalog.hpp"
+
+#include <chrono>
+#include <filesystem>
+#include <random>
+
+// Writes HYG shaped catalogs of n random stars and ingests them with runs small enough that the external merge
+// has work to do: throughput, how the time splits between parsing and merging, and a check of the table against
+// the csv, its order, its index and the angle and magnitude every star was quantized by.
+class StarBench
+{
+	INCONSTRUCTIBLE(StarBench)
+
+public:
+	static void run(const std::vector<size_t>& counts, int threads);
+
+	// count stars in the HYG column layout, distances log uniform out to 20 kpc and some without a color index
+	static bool writeCatalog(const std::string& path, size_t count, uint64_t seed = 4048111);
+
+private:
+	typedef struct
+	{
+		glm::dvec3 position;
+		double magnitude;
+	}Star;
+
+	static Star starAt(size_t index, uint64_t seed);
+};
+
+StarBench::Star StarBench::starAt(size_t index, uint64_t seed)
+{
+	std::mt19937_64 rng(seed ^ (index * 0x9e3779b97f4a7c15ull));
+	std::uniform_real_distribution<double> unit(0.0, 1.0);
+	const double z = 2.0 * unit(rng) - 1.0, angle = 2.0 * glm::pi<double>() * unit(rng);
+	const double distance = std::exp(std::log(1.3) + unit(rng) * (std::log(20000.0) - std::log(1.3)));
+	const double s = std::sqrt(1.0 - z * z);
+	return { glm::dvec3(s * std::cos(angle), s * std::sin(angle), z) * distance, -1.5 + unit(rng) * 21.0 };
+}
+
+bool StarBench::writeCatalog(const std::string& path, size_t count, uint64_t seed)
+{
+	std::ofstream ofs(path, std::ios::trunc);
+	if (!ofs) return false;
+	ofs << "id,hip,hd,hr,gl,bf,proper,ra,dec,dist,pmra,pmdec,rv,mag,absmag,spect,ci,x,y,z\n";
+	for (size_t i = 0; i < count; i++)
+	{
+		Star star = starAt(i, seed);
+		const double distance = glm::length(star.position);
+		const double ra = std::atan2(star.position.y, star.position.x) / glm::pi<double>() * 12.0, dec = glm::degrees(std::asin(star.position.z / distance));
+		char ci[16] = "";
+		if (i % 7) snprintf(ci, sizeof(ci), "%.3f", -0.3 + (i % 211) * 0.01);
+		char line[320];
+		snprintf(line, sizeof(line), "%zu,%zu,,,,,,%.6f,%.6f,%.4f,0.0,0.0,0,%.2f,%.3f,G2V,%s,%.6f,%.6f,%.6f\n", i, i * 3, ra < 0.0 ? ra + 24.0 : ra, dec,
+			distance, star.magnitude, star.magnitude - 5.0 * std::log10(distance / 10.0), ci, star.position.x, star.position.y, star.position.z);
+		ofs << line;
+	}
+	return ofs.good();
+}
+
+void StarBench::run(const std::vector<size_t>& counts, int threads)
+{
+	const std::string csvPath = (std::filesystem::temp_directory_path() / "star-bench.csv").string();
+	const std::string tablePath = (std::filesystem::temp_directory_path() / "star-bench.stars").string();
+	const uint64_t seed = 4048111;
+
+	printf("%10s %9s %9s %6s %10s %10s %10s %10s %14s %12s\n", "stars", "csv MB", "table MB", "runs", "parse s", "merge s", "wall s", "MB/s",
+		"max angle (\")", "max mag err");
+	for (size_t count : counts)
+	{
+		if (!writeCatalog(csvPath, count, seed))
+		{
+			printf("writing %s failed\n", csvPath.c_str());
+			return;
+		}
+
+		StarIngestOptions options = StarCatalog::defaultOptions();
+		options.threads = threads;
+		options.extent = 20000.0;
+		// eight runs and small blocks, so the read ahead and the merge are both part of what's timed
+		options.runStars = glm::max(count / 8, (size_t)1);
+		options.blockBytes = 4 << 20;
+		StarIngestStats stats;
+		std::string error;
+		if (!StarCatalog::ingest(csvPath, tablePath, options, &stats, error))
+		{
+			printf("%10zu ingesting failed: %s\n", count, error.c_str());
+			continue;
+		}
+
+		StarTable table;
+		bool isValid = table.open(tablePath) && table.size() == count && stats.rows == count;
+		double maxAngle = 0.0, maxMagnitudeError = 0.0;
+		for (size_t i = 0; isValid && i < table.size(); i++)
+		{
+			const StarRecord& star = table.star(i);
+			isValid &= i == 0 || table.star(i - 1).key <= star.key;
+			Star exact = starAt(star.row, seed);
+			glm::dvec3 p = table.position(i);
+			double cosine = glm::dot(glm::normalize(p), glm::normalize(exact.position));
+			maxAngle = glm::max(maxAngle, glm::degrees(std::acos(glm::clamp(cosine, -1.0, 1.0))) * 3600.0);
+			// the csv carries magnitudes to two decimals
+			maxMagnitudeError = glm::max(maxMagnitudeError, std::abs(table.magnitude(i) - std::round(exact.magnitude * 100.0) / 100.0));
+		}
+		for (size_t c = 0; isValid && c < table.cellCount(); c++)
+		{
+			size_t begin, end;
+			table.cellRange(c, begin, end);
+			const int shift = 3 * (kStarAxisBits - kStarIndexLevel);
+			for (size_t i = begin; i < end; i++) isValid &= (table.star(i).key >> shift) == c;
+		}
+		if (!isValid)
+		{
+			printf("%10zu the table doesn't match the catalog\n", count);
+			continue;
+		}
+
+		const double csvMb = stats.bytesRead / (1024.0 * 1024.0);
+		printf("%10zu %9.1lf %9.1lf %6zu %10.3lf %10.3lf %10.3lf %10.1lf %14.4lf %12.4lf\n", count, csvMb, std::filesystem::file_size(tablePath) / (1024.0 * 1024.0),
+			stats.runs, stats.parseSeconds, stats.mergeSeconds, stats.wallSeconds, csvMb / stats.wallSeconds, maxAngle, maxMagnitudeError);
+	}
+	std::remove(csvPath.c_str());
+	std::remove(tablePath.c_str());
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "sim/Simulation.hpp"
+#include "sim/SolarSystem.hpp"
+
+#include <chrono>
+#include <cstring>
+
+// Runs the same nbody scenario at increasing thread counts: speedup, parallel efficiency and
+// whether the final state is bit identical to the single threaded run.
+class ThreadBench
+{
+	INCONSTRUCTIBLE(ThreadBench)
+
+public:
+	static void run(int randomCount, int steps, GravitySolver solver, const std::vector<int>& threadCounts);
+
+	// every thread count from 1 doubling up to the hardware concurrency, which is always included
+	static std::vector<int> defaultThreadCounts();
+
+private:
+	static bool isIdentical(const BodyArrays& a, const BodyArrays& b);
+};
+
+std::vector<int> ThreadBench::defaultThreadCounts()
+{
+	int hardware = glm::max((int)std::thread::hardware_concurrency(), 1);
+	std::vector<int> counts;
+	for (int t = 1; t < hardware; t *= 2) counts.push_back(t);
+	counts.push_back(hardware);
+	return counts;
+}
+
+bool ThreadBench::isIdentical(const BodyArrays& a, const BodyArrays& b)
+{
+	if (a.size() != b.size()) return false;
+	const size_t bytes = a.size() * sizeof(double);
+	return !memcmp(a.px.data(), b.px.data(), bytes) && !memcmp(a.py.data(), b.py.data(), bytes) && !memcmp(a.pz.data(), b.pz.data(), bytes)
+		&& !memcmp(a.vx.data(), b.vx.data(), bytes) && !memcmp(a.vy.data(), b.vy.data(), bytes) && !memcmp(a.vz.data(), b.vz.data(), bytes);
+}
+
+void ThreadBench::run(int randomCount, int steps, GravitySolver solver, const std::vector<int>& threadCounts)
+{
+	printf("solver: %s, bodies: %d, steps: %d, hardware threads: %u\n", solver == GravitySolver::DIRECT ? "direct" : "barnes-hut",
+		randomCount + (int)solarSystemDescs().size(), steps, std::thread::hardware_concurrency());
+	printf("%8s %10s %9s %11s %11s %8s %10s\n", "threads", "ms/step", "speedup", "scaling", "pool busy", "steals", "identical");
+
+	BodyArrays reference;
+	double baseMs = 0.0;
+	for (int threads : threadCounts)
+	{
+		Simulation sim;
+		populateSolarSystem(sim, randomCount);
+		sim.setGravitySolver(solver);
+		sim.setMode(SimulationMode::NBODY);
+		sim.setThreadCount(threads);
+
+		auto start = std::chrono::steady_clock::now();
+		sim.step(steps);
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / steps;
+
+		if (reference.size() == 0)
+		{
+			reference = sim.state();
+			baseMs = ms;
+		}
+
+		JobStats stats = sim.jobs() ? sim.jobs()->stats() : JobStats{ 1, 0.0, 0.0, 0, 0, 1.0 };
+		double speedup = baseMs / ms;
+		printf("%8d %10.3f %8.2fx %10.1f%% %10.1f%% %8llu %10s\n", threads, ms, speedup, 100.0 * speedup / threads, 100.0 * stats.efficiency,
+			(unsigned long long)stats.steals, isIdentical(reference, sim.state()) ? "yes" : "NO");
+	}
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include "sim/Simulation.hpp"
+#include "sim/SolarSystem.hpp"
+#include "sim/Diagnostics.hpp"
+
+#include <chrono>
+#include <functional>
+
+// Block timesteps against uniform leapfrog over the same simulated time, on the default system and a synthetic one with
+// many close moons. Two uniform runs: one at the finest step the block run used anywhere, which resolves every body
+// as well but ends far more accurate, and the coarsest power of two step whose energy error is no worse than the
+// block run's, the like for like comparison, searched down to 16 times finer than the block run's finest step.
+class TimestepBench
+{
+	INCONSTRUCTIBLE(TimestepBench)
+
+public:
+	static void run(int planets, int moonsPerPlanet, int asteroids, int threads);
+
+	// sun, planets at jupiter's mass ratio each with tight moons, plus far out small bodies
+	static void populateMoons(Simulation& sim, int planets, int moonsPerPlanet, int asteroids, uint64_t seed = 4048111);
+
+private:
+	typedef std::function<void(Simulation&)> Populate;
+
+	typedef struct
+	{
+		double dt;
+		double ms;
+		uint64_t evaluations;
+		double drift;
+	}UniformRun;
+
+	static void compare(const char* label, const Populate& populate, double baseDt, double duration, double softening, int threads);
+
+	static UniformRun runUniform(const Populate& populate, double dt, double duration, double softening, int threads);
+};
+
+void TimestepBench::populateMoons(Simulation& sim, int planets, int moonsPerPlanet, int asteroids, uint64_t seed)
+{
+	std::mt19937_64 rng(seed);
+	std::uniform_real_distribution<double> angleDist(0.0, 360.0), moonDist(0.8, 2.0), asteroidDist(300.0, 500.0);
+
+	const float sunMass = solarSystemDescs()[0].mass;
+	sim.addBody("Sun", "Sun", 1.0f, 0.0f, sunMass);
+	for (int p = 0; p < planets; p++)
+	{
+		std::string planet = "Planet" + std::to_string(p);
+		float radius = 60.f + 30.f * p;
+		float angle = glm::radians(137.5f * p);
+		sim.addBody(planet, "Sun", 0.01f, radius, sunMass * 1e-3f, { radius * std::cos(angle), 0.0f, radius * std::sin(angle) });
+		for (int m = 0; m < moonsPerPlanet; m++)
+		{
+			double distance = moonDist(rng), phase = glm::radians(angleDist(rng));
+			glm::vec3 pos = { (float)(distance * std::cos(phase)), 0.0f, (float)(distance * std::sin(phase)) };
+			sim.addBody(planet + "Moon" + std::to_string(m), planet, 0.01f, (float)distance, 1e-6f, pos);
+		}
+	}
+	for (int i = 0; i < asteroids; i++)
+	{
+		double radius = asteroidDist(rng), angle = glm::radians(angleDist(rng));
+		glm::vec3 pos = { (float)(radius * std::cos(angle)), 0.0f, (float)(radius * std::sin(angle)) };
+		sim.addBody("Asteroid" + std::to_string(i), "Sun", 0.01f, (float)radius, 1e-6f, pos);
+	}
+}
+
+TimestepBench::UniformRun TimestepBench::runUniform(const Populate& populate, double dt, double duration, double softening, int threads)
+{
+	Simulation uniform;
+	uniform.clock().setDt(dt);
+	uniform.setSoftening(softening);
+	uniform.setThreadCount(threads);
+	populate(uniform);
+	uniform.setMode(SimulationMode::NBODY);
+	const double e0 = Diagnostics::energy(uniform.state(), kGravity, softening);
+
+	auto start = std::chrono::steady_clock::now();
+	uniform.step((int)std::llround(duration / dt));
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	double drift = std::abs((Diagnostics::energy(uniform.state(), kGravity, softening) - e0) / e0);
+	return { dt, ms, uniform.integrator().bodyEvaluations(), std::isfinite(drift) ? drift : HUGE_VAL };
+}
+
+void TimestepBench::compare(const char* label, const Populate& populate, double baseDt, double duration, double softening, int threads)
+{
+	const int steps = (int)std::ceil(duration / baseDt);
+
+	Simulation block;
+	block.clock().setDt(baseDt);
+	block.setSoftening(softening);
+	block.setThreadCount(threads);
+	block.setIntegrator(IntegratorType::BLOCK_LEAPFROG);
+	populate(block);
+	block.setMode(SimulationMode::NBODY);
+	const double blockE0 = Diagnostics::energy(block.state(), kGravity, softening);
+
+	// levels change from step to step, remember the finest one the run ever needed
+	auto& integrator = dynamic_cast<const BlockLeapfrogIntegrator&>(block.integrator());
+	int deepest = 0;
+	double blockMs = 0.0;
+	for (int i = 0; i < steps; i++)
+	{
+		auto start = std::chrono::steady_clock::now();
+		block.step();
+		blockMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		deepest = glm::max(deepest, integrator.deepestLevel());
+	}
+
+	std::vector<size_t> histogram(deepest + 1);
+	for (uint8_t level : integrator.levels()) histogram[level]++;
+
+	const double blockDrift = std::abs((Diagnostics::energy(block.state(), kGravity, softening) - blockE0) / blockE0);
+
+	// the uniform run has to take the finest step everywhere to resolve the same bodies
+	const UniformRun finest = runUniform(populate, baseDt / (double)(1u << deepest), steps * baseDt, softening, threads);
+
+	// from 16 base steps down, halving until the energy error is no worse than the block run's, past the block
+	// run's finest step if it has to
+	UniformRun matched = finest;
+	for (int k = -4; k <= deepest + 4; k++)
+	{
+		UniformRun run = k == deepest ? finest :
+			runUniform(populate, k < 0 ? baseDt * (double)(1u << -k) : baseDt / (double)(1u << k), steps * baseDt, softening, threads);
+		matched = run;
+		if (run.drift <= blockDrift) break;
+	}
+
+	printf("%s: %zu bodies, base dt: %.4lf, simulated: %.1lfs\n", label, block.bodyCount(), baseDt, steps * baseDt);
+	printf("  bodies per level at the end:");
+	for (int level = 0; level <= deepest; level++) if (histogram[level]) printf(" %d:%zu", level, histogram[level]);
+	printf("\n");
+	const uint64_t blockEvaluations = glm::max(integrator.bodyEvaluations(), (uint64_t)1);
+	printf("  %-16s %10s %10s %14s %12s\n", "", "dt", "wall ms", "body evals", "|dE/E0|");
+	printf("  %-16s %10.6lf %10.2lf %14llu %12.3e\n", "uniform finest", finest.dt, finest.ms, (unsigned long long)finest.evaluations, finest.drift);
+	printf("  %-16s %10.6lf %10.2lf %14llu %12.3e\n", "uniform matched", matched.dt, matched.ms, (unsigned long long)matched.evaluations, matched.drift);
+	printf("  %-16s %10s %10.2lf %14llu %12.3e\n", "block", "adaptive", blockMs, (unsigned long long)integrator.bodyEvaluations(), blockDrift);
+	// uniform over block, above 1 the block run is ahead. against the finest step it buys that with accuracy
+	printf("  vs finest:  %.2lfx wall, %.2lfx force evaluations, at %.2e times the energy error\n", blockMs > 0.0 ? finest.ms / blockMs : 0.0,
+		(double)finest.evaluations / blockEvaluations, finest.drift > 0.0 ? blockDrift / finest.drift : 0.0);
+	printf("  vs matched: %.2lfx wall, %.2lfx force evaluations%s\n", blockMs > 0.0 ? matched.ms / blockMs : 0.0,
+		(double)matched.evaluations / blockEvaluations, matched.drift > blockDrift ? ", no uniform step tried matched the error" : "");
+}
+
+void TimestepBench::run(int planets, int moonsPerPlanet, int asteroids, int threads)
+{
+	compare("default system", [](Simulation& sim) { populateSolarSystem(sim); }, 1.0 / 8.0, 32.0, 0.5, threads);
+	compare("synthetic moons", [&](Simulation& sim) { populateMoons(sim, planets, moonsPerPlanet, asteroids); }, 1.0 / 8.0, 1.0, 0.01, threads);
+}
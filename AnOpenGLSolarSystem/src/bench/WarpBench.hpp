@@ -0,0 +1,60 @@
+#pragma once
+
+#include "sim/Simulation.hpp"
+#include "sim/SolarSystem.hpp"
+
+#include <chrono>
+
+// Feeds 60 Hz frames through advance() at time warps from 1x to 10^7x and reports how the step budget
+// was spent: cpu per frame, steps taken and leapt, whether n-body had to fall back on the rails and
+// whether the simulated time kept up with the warp.
+class WarpBench
+{
+	INCONSTRUCTIBLE(WarpBench)
+
+public:
+	static void run(int randomCount, size_t particleCount, double budgetMs, int threads);
+};
+
+void WarpBench::run(int randomCount, size_t particleCount, double budgetMs, int threads)
+{
+	const int frames = 120;
+	const double frameDelta = 1.0 / 60.0;
+	printf("bodies: %d, particles: %zu, budget: %.1lf ms a frame\n", (int)solarSystemDescs().size() + randomCount, particleCount, budgetMs);
+	printf("%6s %10s %10s %10s %12s %12s %10s %10s %8s\n", "mode", "warp", "avg ms", "max ms", "steps/frame", "leapt/frame", "fallback", "p. behind", "kept up");
+	for (SimulationMode mode : { SimulationMode::RAILS, SimulationMode::NBODY })
+	{
+		for (double warp : { 1.0, 10.0, 100.0, 1e3, 1e4, 1e5, 1e6, 1e7 })
+		{
+			Simulation sim;
+			sim.setThreadCount(threads);
+			populateSolarSystem(sim, randomCount);
+			populateParticles(sim, particleCount - particleCount / 10, particleCount / 10);
+			sim.setMode(mode);
+			sim.setStepBudget(budgetMs * 1e-3);
+			sim.clock().setTimeScale(warp);
+
+			double totalMs = 0.0, maxMs = 0.0;
+			long long steps = 0, leapt = 0, behind = 0;
+			int fallbackFrames = 0;
+			for (int f = 0; f < frames; f++)
+			{
+				auto start = std::chrono::steady_clock::now();
+				sim.advance(frameDelta);
+				double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+				const WarpStats& stats = sim.lastWarp();
+				totalMs += ms;
+				maxMs = glm::max(maxMs, ms);
+				steps += stats.steps;
+				leapt += stats.leapt;
+				behind += stats.particleStepsSkipped;
+				if (stats.isRailsFallback) fallbackFrames++;
+			}
+
+			double expected = frames * frameDelta * warp;
+			printf("%6s %10.0e %10.3lf %10.3lf %12lld %12lld %9d%% %10lld %8s\n", mode == SimulationMode::RAILS ? "rails" : "nbody", warp,
+				totalMs / frames, maxMs, steps / frames, leapt / frames, 100 * fallbackFrames / frames, behind / frames,
+				std::abs(sim.clock().time() - expected) <= 2.0 * sim.clock().dt() ? "yes" : "no");
+		}
+	}
+}
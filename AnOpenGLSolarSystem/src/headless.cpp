@@ -0,0 +1,570 @@
+#include "sim/Simulation.hpp"
+#include "sim/SolarSystem.hpp"
+#include "sim/Ephemeris.hpp"
+#include "sim/Checkpoint.hpp"
+#include "sim/Trajectory.hpp"
+#include "sim/Ensemble.hpp"
+#include "sim/Scene.hpp"
+#include "sim/StarCatalog.hpp"
+#include "bench/GravityBench.hpp"
+#include "bench/ThreadBench.hpp"
+#include "bench/IntegratorBench.hpp"
+#include "bench/TimestepBench.hpp"
+#include "bench/RailsBench.hpp"
+#include "bench/CollisionBench.hpp"
+#include "bench/ParticleBench.hpp"
+#include "bench/EphemerisBench.hpp"
+#include "bench/WarpBench.hpp"
+#include "bench/CheckpointBench.hpp"
+#include "bench/RecorderBench.hpp"
+#include "bench/PlaybackBench.hpp"
+#include "bench/SceneBench.hpp"
+#include "bench/StarBench.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <sstream>
+
+// Headless batch runner, steps the simulation as fast as the cpu allows without any window or GL context.
+
+static void printUsage(const char* exe)
+{
+	printf("usage: %s [--mode rails|nbody] [--solver direct|barnes-hut] [--integrator name] [--theta t] [--steps n] [--duration seconds]\n", exe);
+	printf("          [--dt seconds] [--random n] [--belt n] [--ring n] [--softening s] [--threads n] [--collisions] [--quiet]\n");
+	printf("          [--compensated] [--repro]\n");
+	printf("       %s --ensemble file.csv --sweep Body.field=from:to:count [--sweep ...] [--samples n] [scenario options]\n", exe);
+	printf("       %s --ingest-stars catalog.csv [--table file] [--extent parsecs] [--limit magnitude] [--threads n]\n", exe);
+	printf("       %s --bench gravity [--bodies n,n,...] [--softening s]\n", exe);
+	printf("       %s --bench threads [--solver s] [--random n] [--steps n] [--threads n]\n", exe);
+	printf("       %s --bench integrators [--duration seconds] [--threads n]\n", exe);
+	printf("       %s --bench timesteps [--random n] [--threads n]\n", exe);
+	printf("       %s --bench rails [--bodies n,n,...]\n", exe);
+	printf("       %s --bench collisions [--bodies n,n,...]\n", exe);
+	printf("       %s --bench particles [--bodies n,n,...] [--steps n] [--threads n]\n", exe);
+	printf("       %s --bench warp [--random n] [--belt n] [--budget ms] [--threads n]\n", exe);
+	printf("       %s --bench ephemeris [--mode m] [--random n] [--duration seconds] [--threads n]\n", exe);
+	printf("       %s --bench checkpoint [--bodies n,n,...] [--steps n] [--threads n]\n", exe);
+	printf("       %s --bench recorder [--random n] [--steps n] [--tolerance t] [--threads n]\n", exe);
+	printf("       %s --bench playback [--random n] [--steps n] [--memory mb] [--threads n]\n", exe);
+	printf("       %s --bench scene [--bodies n,n,...]\n", exe);
+	printf("       %s --bench stars [--bodies n,n,...] [--threads n]\n", exe);
+	printf("  --mode m            rails (default) or nbody gravity\n");
+	printf("  --solver s          nbody force solver, direct (default) or barnes-hut\n");
+	printf("  --integrator name   nbody integrator: leapfrog (default), yoshida4, rk45, wisdom-holman or block-leapfrog\n");
+	printf("  --theta t           barnes-hut opening angle (default 0.5)\n");
+	printf("  --steps n           number of fixed steps to take (default 100000)\n");
+	printf("  --duration seconds  simulated time to cover, overrides --steps\n");
+	printf("  --dt seconds        fixed step size (default 1/240)\n");
+	printf("  --scene file        take the bodies from a scene file instead of the built in system, see sim/Scene.hpp\n");
+	printf("  --random n          add n random small bodies orbiting the sun\n");
+	printf("  --belt n            add a main belt of n particles between mars and jupiter\n");
+	printf("  --ring n            add a ring of n particles around saturn\n");
+	printf("  --softening s       gravitational softening length for nbody mode (default 0.5)\n");
+	printf("  --threads n         worker threads for nbody stepping (default: all hardware threads)\n");
+	printf("  --collisions        merge overlapping bodies in nbody mode, and let belt and ring particles bump\n");
+	printf("  --compensated       carry the rounding error of the nbody force sums along, slower but reproducible across cpus\n");
+	printf("  --repro             run the scenario on 1, 2 and --threads threads (at least 4) and compare state hashes along the way\n");
+	printf("  --bake file         run the simulation over the span and save it as a chebyshev ephemeris instead\n");
+	printf("  --segment seconds   ephemeris segment length, rounded to whole steps (default 0.25)\n");
+	printf("  --degree n          chebyshev degree per segment (default 12)\n");
+	printf("  --save file         write a checkpoint of the whole simulation when the run ends\n");
+	printf("  --resume file       continue from a checkpoint instead of the default system, its settings replace the command line's\n");
+	printf("  --record file       stream the body states to a compressed trajectory file during the run\n");
+	printf("  --record-every n    steps between recorded frames (default 16)\n");
+	printf("  --tolerance t       largest position error a recorded frame may have, velocities get a tenth (default 1e-3)\n");
+	printf("  --ensemble file     run every point of the --sweep grid as its own single threaded world, spread over --threads, and\n");
+	printf("                      write each run's stability, closest approach and energy drift to a csv\n");
+	printf("  --sweep spec        a grid axis, Body.field=from:to:count or Body.field=v,v,... with field eccentricity, focal-distance or mass\n");
+	printf("  --samples n         times along each ensemble run the energy drift is taken (default 64), closest approach\n");
+	printf("                      and unbinding are checked every step\n");
+	printf("  --ingest-stars file stream a HYG or Gaia csv into a morton sorted star table for the viewer's sky, see sim/StarCatalog.hpp\n");
+	printf("  --table file        where the star table goes (default: the csv's path with a .stars extension)\n");
+	printf("  --extent parsecs    stars further out, or without a distance, are kept on a sphere of this radius (default 100000)\n");
+	printf("  --limit magnitude   leave out stars fainter than this\n");
+	printf("  --memory mb         decoded chunks the playback benchmark may hold (default 64)\n");
+	printf("  --budget ms         cpu time a frame may spend stepping, for the warp benchmark (default 8)\n");
+	printf("  --quiet             don't print the final body states\n");
+	printf("  --bench name        run a benchmark instead: gravity, threads, integrators, timesteps, rails, collisions, particles, ephemeris, warp,\n");
+	printf("                      checkpoint, recorder, playback, scene, stars\n");
+	printf("  --bodies list       body counts for the benchmark, comma separated\n");
+}
+
+int main(int argc, char** argv)
+{
+	long long steps = 100000;
+	double duration = -1.0;
+	double dt = 1.0 / 240.0;
+	bool quiet = false;
+	bool collisions = false;
+	bool compensated = false, repro = false;
+	int randomCount = 0;
+	size_t beltCount = 0, ringCount = 0;
+	int threads = (int)std::thread::hardware_concurrency();
+	bool hasSteps = false, hasRandom = false, hasThreads = false, hasBodies = false;
+	double softening = 0.5;
+	SimulationMode mode = SimulationMode::RAILS;
+	GravitySolver solver = GravitySolver::DIRECT;
+	IntegratorType integrator = IntegratorType::LEAPFROG;
+	double theta = 0.5;
+	std::string bench;
+	std::string bakePath;
+	std::string savePath, resumePath;
+	std::string recordPath;
+	std::string ensemblePath;
+	std::string scenePath;
+	std::string starsPath, tablePath;
+	StarIngestOptions starOptions = StarCatalog::defaultOptions();
+	std::vector<std::string> sweeps;
+	int samples = 64;
+	int recordInterval = TrajectoryRecorder::defaultOptions().interval;
+	double tolerance = TrajectoryRecorder::defaultOptions().positionTolerance;
+	double segmentLength = 0.25;
+	int degree = 12;
+	double budgetMs = 8.0;
+	double memoryMb = 64.0;
+	std::vector<size_t> benchBodies = { 1000, 10000, 100000 };
+
+	for (int i = 1; i < argc; i++)
+	{
+		const char* arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (!strcmp(arg, "--steps") && hasValue) steps = atoll(argv[++i]), hasSteps = true;
+		else if (!strcmp(arg, "--duration") && hasValue) duration = atof(argv[++i]);
+		else if (!strcmp(arg, "--dt") && hasValue) dt = atof(argv[++i]);
+		else if (!strcmp(arg, "--random") && hasValue) randomCount = atoi(argv[++i]), hasRandom = true;
+		else if (!strcmp(arg, "--belt") && hasValue) beltCount = (size_t)atoll(argv[++i]);
+		else if (!strcmp(arg, "--ring") && hasValue) ringCount = (size_t)atoll(argv[++i]);
+		else if (!strcmp(arg, "--threads") && hasValue) threads = atoi(argv[++i]), hasThreads = true;
+		else if (!strcmp(arg, "--softening") && hasValue) softening = atof(argv[++i]);
+		else if (!strcmp(arg, "--mode") && hasValue)
+		{
+			const char* value = argv[++i];
+			if (!strcmp(value, "rails")) mode = SimulationMode::RAILS;
+			else if (!strcmp(value, "nbody")) mode = SimulationMode::NBODY;
+			else
+			{
+				printUsage(argv[0]);
+				return 1;
+			}
+		}
+		else if (!strcmp(arg, "--solver") && hasValue)
+		{
+			const char* value = argv[++i];
+			if (!strcmp(value, "direct")) solver = GravitySolver::DIRECT;
+			else if (!strcmp(value, "barnes-hut")) solver = GravitySolver::BARNES_HUT;
+			else
+			{
+				printUsage(argv[0]);
+				return 1;
+			}
+		}
+		else if (!strcmp(arg, "--integrator") && hasValue)
+		{
+			const char* value = argv[++i];
+			if (!strcmp(value, "leapfrog")) integrator = IntegratorType::LEAPFROG;
+			else if (!strcmp(value, "yoshida4")) integrator = IntegratorType::YOSHIDA4;
+			else if (!strcmp(value, "rk45")) integrator = IntegratorType::RK45;
+			else if (!strcmp(value, "wisdom-holman")) integrator = IntegratorType::WISDOM_HOLMAN;
+			else if (!strcmp(value, "block-leapfrog")) integrator = IntegratorType::BLOCK_LEAPFROG;
+			else
+			{
+				printUsage(argv[0]);
+				return 1;
+			}
+		}
+		else if (!strcmp(arg, "--theta") && hasValue) theta = atof(argv[++i]);
+		else if (!strcmp(arg, "--bench") && hasValue) bench = argv[++i];
+		else if (!strcmp(arg, "--bake") && hasValue) bakePath = argv[++i];
+		else if (!strcmp(arg, "--segment") && hasValue) segmentLength = atof(argv[++i]);
+		else if (!strcmp(arg, "--degree") && hasValue) degree = atoi(argv[++i]);
+		else if (!strcmp(arg, "--save") && hasValue) savePath = argv[++i];
+		else if (!strcmp(arg, "--resume") && hasValue) resumePath = argv[++i];
+		else if (!strcmp(arg, "--record") && hasValue) recordPath = argv[++i];
+		else if (!strcmp(arg, "--ensemble") && hasValue) ensemblePath = argv[++i];
+		else if (!strcmp(arg, "--scene") && hasValue) scenePath = argv[++i];
+		else if (!strcmp(arg, "--ingest-stars") && hasValue) starsPath = argv[++i];
+		else if (!strcmp(arg, "--table") && hasValue) tablePath = argv[++i];
+		else if (!strcmp(arg, "--extent") && hasValue) starOptions.extent = atof(argv[++i]);
+		else if (!strcmp(arg, "--limit") && hasValue) starOptions.magnitudeLimit = atof(argv[++i]);
+		else if (!strcmp(arg, "--sweep") && hasValue) sweeps.push_back(argv[++i]);
+		else if (!strcmp(arg, "--samples") && hasValue) samples = atoi(argv[++i]);
+		else if (!strcmp(arg, "--record-every") && hasValue) recordInterval = atoi(argv[++i]);
+		else if (!strcmp(arg, "--tolerance") && hasValue) tolerance = atof(argv[++i]);
+		else if (!strcmp(arg, "--memory") && hasValue) memoryMb = atof(argv[++i]);
+		else if (!strcmp(arg, "--budget") && hasValue) budgetMs = atof(argv[++i]);
+		else if (!strcmp(arg, "--bodies") && hasValue)
+		{
+			benchBodies.clear();
+			hasBodies = true;
+			std::stringstream ss(argv[++i]);
+			std::string item;
+			while (std::getline(ss, item, ',')) benchBodies.push_back((size_t)atoll(item.c_str()));
+		}
+		else if (!strcmp(arg, "--collisions")) collisions = true;
+		else if (!strcmp(arg, "--compensated")) compensated = true;
+		else if (!strcmp(arg, "--repro")) repro = true;
+		else if (!strcmp(arg, "--quiet")) quiet = true;
+		else
+		{
+			printUsage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (bench == "gravity")
+	{
+		GravityBench::run(benchBodies, { 0.3, 0.5, 0.7, 1.0 }, softening);
+		return 0;
+	}
+	else if (bench == "threads")
+	{
+		std::vector<int> threadCounts = ThreadBench::defaultThreadCounts();
+		if (hasThreads) threadCounts = { 1, threads };
+		ThreadBench::run(hasRandom ? randomCount : 20000, hasSteps ? (int)steps : 10, solver, threadCounts);
+		return 0;
+	}
+	else if (bench == "integrators")
+	{
+		IntegratorBench::run({ 1.0 / 30.0, 1.0 / 120.0, 1.0 / 480.0 }, duration >= 0.0 ? duration : 20.0, hasThreads ? threads : 1);
+		return 0;
+	}
+	else if (bench == "timesteps")
+	{
+		TimestepBench::run(8, 16, hasRandom ? randomCount : 500, hasThreads ? threads : 1);
+		return 0;
+	}
+	else if (bench == "rails")
+	{
+		RailsBench::run(hasBodies ? benchBodies : std::vector<size_t>{ 10000, 100000, 1000000 });
+		return 0;
+	}
+	else if (bench == "collisions")
+	{
+		CollisionBench::run(hasBodies ? benchBodies : std::vector<size_t>{ 10000, 100000, 1000000 }, { 1e-4, 1e-3, 1e-2, 5e-2 });
+		return 0;
+	}
+	else if (bench == "particles")
+	{
+		std::vector<int> threadCounts = ThreadBench::defaultThreadCounts();
+		if (hasThreads) threadCounts = { 1, threads };
+		ParticleBench::run(hasBodies ? benchBodies : std::vector<size_t>{ 100000, 1000000 }, hasSteps ? (int)steps : 20, threadCounts);
+		return 0;
+	}
+	else if (bench == "ephemeris")
+	{
+		EphemerisBench::run(randomCount, duration >= 0.0 ? duration : 60.0, mode, hasThreads ? threads : 1);
+		return 0;
+	}
+	else if (bench == "warp")
+	{
+		WarpBench::run(hasRandom ? randomCount : 300, beltCount, budgetMs, hasThreads ? threads : 1);
+		return 0;
+	}
+	else if (bench == "checkpoint")
+	{
+		CheckpointBench::run(hasBodies ? benchBodies : std::vector<size_t>{ 1000, 10000, 100000, 1000000 }, hasSteps ? (int)steps : 2000,
+			hasThreads ? threads : 1);
+		return 0;
+	}
+	else if (bench == "recorder")
+	{
+		RecorderBench::run(hasRandom ? randomCount : 100000, hasSteps ? (int)steps : 2048, tolerance, hasThreads ? threads : 1);
+		return 0;
+	}
+	else if (bench == "playback")
+	{
+		PlaybackBench::run(hasRandom ? randomCount : 100000, hasSteps ? (int)steps : 8192, memoryMb, hasThreads ? threads : 1);
+		return 0;
+	}
+	else if (bench == "scene")
+	{
+		SceneBench::run(hasBodies ? benchBodies : std::vector<size_t>{ 100000, 1000000 });
+		return 0;
+	}
+	else if (bench == "stars")
+	{
+		StarBench::run(hasBodies ? benchBodies : std::vector<size_t>{ 100000, 1000000 }, threads);
+		return 0;
+	}
+	else if (!bench.empty())
+	{
+		printUsage(argv[0]);
+		return 1;
+	}
+
+	if (!starsPath.empty())
+	{
+		if (tablePath.empty()) tablePath = std::filesystem::path(starsPath).replace_extension(".stars").string();
+		starOptions.threads = threads;
+		StarIngestStats stats;
+		std::string error;
+		if (starOptions.extent <= 0.0 || !StarCatalog::ingest(starsPath, tablePath, starOptions, &stats, error))
+		{
+			printf("%s\n", starOptions.extent <= 0.0 ? "extent must be positive" : error.c_str());
+			return 1;
+		}
+		printf("%s: %llu stars of %llu rows, %llu without a position or magnitude, %llu fainter than the limit, %llu clamped to the extent\n",
+			tablePath.c_str(), (unsigned long long)stats.stars, (unsigned long long)stats.rows, (unsigned long long)stats.skipped,
+			(unsigned long long)stats.faint, (unsigned long long)stats.clamped);
+		printf("%.1lf MB in %.3lfs (%.1lf MB/s), parsing %.3lfs, merging %zu runs %.3lfs\n", stats.bytesRead / (1024.0 * 1024.0), stats.wallSeconds,
+			stats.bytesRead / (1024.0 * 1024.0) / stats.wallSeconds, stats.parseSeconds, stats.runs, stats.mergeSeconds);
+		return 0;
+	}
+
+	if (dt <= 0.0)
+	{
+		printf("dt must be positive\n");
+		return 1;
+	}
+	if (duration >= 0.0) steps = (long long)std::ceil(duration / dt);
+
+	Scene scene;
+	if (!scenePath.empty())
+	{
+		auto start = std::chrono::steady_clock::now();
+		if (!scene.load(scenePath))
+		{
+			printf("%s\n", scene.error().c_str());
+			return 1;
+		}
+		printf("scene %s: %zu bodies, %zu of them minor, %s in %.3lf ms\n", scenePath.c_str(), scene.size(), scene.minorCount(),
+			scene.isFromCache() ? "mapped from its cache" : "parsed", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+	}
+
+	// the same scenario on any number of threads, false if the checkpoint to resume from can't be read
+	auto setup = [&](Simulation& sim, int threadCount) {
+		sim.clock().setDt(dt);
+		sim.setSoftening(softening);
+		sim.setGravitySolver(solver);
+		sim.setIntegrator(integrator);
+		sim.setOpeningAngle(theta);
+		sim.setCompensatedSummation(compensated);
+		sim.setThreadCount(threadCount);
+		sim.setCollisions(collisions);
+		if (resumePath.empty())
+		{
+			if (scenePath.empty()) populateSolarSystem(sim, randomCount);
+			else scene.populate(sim);
+			populateParticles(sim, beltCount, ringCount);
+			sim.setParticleCollisions(collisions);
+			sim.setMode(mode);
+			return true;
+		}
+
+		Checkpoint checkpoint;
+		if (!checkpoint.open(resumePath) || !checkpoint.restore(sim))
+		{
+			printf("resuming from %s failed, it isn't a checkpoint this build can read\n", resumePath.c_str());
+			return false;
+		}
+		return true;
+	};
+
+	// a resumed checkpoint's settings replace the command line's
+	auto adopt = [&](const Simulation& sim) {
+		if (resumePath.empty()) return;
+		mode = sim.mode();
+		solver = sim.gravitySolver();
+		theta = sim.openingAngle();
+		collisions = sim.isCollisionEnabled();
+		dt = sim.clock().dt();
+		if (duration >= 0.0) steps = (long long)std::ceil(duration / dt);
+	};
+
+	// step in bounded batches so huge step counts don't overflow an int
+	auto run = [&](Simulation& sim) {
+		for (long long done = 0; done < steps;)
+		{
+			int batch = (int)std::min<long long>(steps - done, 1 << 20);
+			sim.step(batch);
+			done += batch;
+		}
+	};
+
+	if (repro)
+	{
+		// hashes at 16 points along each run, so a mismatch also shows roughly when the runs parted
+		const int interval = (int)glm::clamp<long long>(steps / 16, 1, 1 << 30);
+		const int threadCounts[] = { 1, 2, glm::max(hasThreads ? threads : (int)std::thread::hardware_concurrency(), 4) };
+		std::vector<std::pair<uint64_t, uint64_t>> reference;
+		bool isReproducible = true;
+		printf("%8s %10s %18s %7s  %s\n", "threads", "wall s", "final hash", "hashes", "diverged");
+		for (int threadCount : threadCounts)
+		{
+			Simulation sim;
+			if (!setup(sim, threadCount)) return 1;
+			adopt(sim);
+			std::vector<std::pair<uint64_t, uint64_t>> trace = { { sim.clock().steps(), sim.stateHash() } };
+			sim.setStepCallback([&](const Simulation& s) { trace.push_back({ s.clock().steps(), s.stateHash() }); }, interval);
+			auto start = std::chrono::steady_clock::now();
+			run(sim);
+			double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			sim.setStepCallback(nullptr);
+			trace.push_back({ sim.clock().steps(), sim.stateHash() });
+			if (reference.empty()) reference = trace;
+
+			// the runs parted somewhere after the last step both agreed on
+			std::string diverged = "-";
+			for (size_t k = 0; k < trace.size(); k++)
+			{
+				if (k < reference.size() && trace[k] == reference[k]) continue;
+				diverged = k == 0 ? "at the start" : "steps " + std::to_string(trace[k - 1].first + 1) + " to " + std::to_string(trace[k].first);
+				isReproducible = false;
+				break;
+			}
+			printf("%8d %10.3lf   %016llx %7zu  %s\n", sim.threadCount(), wall, (unsigned long long)trace.back().second, trace.size(), diverged.c_str());
+		}
+		printf(isReproducible ? "reproducible, every thread count ended on the same bits\n" : "not reproducible across thread counts\n");
+		return isReproducible ? 0 : 1;
+	}
+
+	if (!ensemblePath.empty())
+	{
+		Simulation probe;
+		if (!setup(probe, 1)) return 1;
+		adopt(probe);
+		Ensemble ensemble([&](Simulation& sim) { return setup(sim, 1); }, steps);
+		ensemble.setSamples(samples);
+		for (auto& spec : sweeps)
+		{
+			if (ensemble.addAxis(spec)) continue;
+			printf("can't read the sweep %s, it should be Body.field=from:to:count or Body.field=v,v,...\n", spec.c_str());
+			return 1;
+		}
+		printf("%zu runs of %lld steps on %d threads, sweeping", ensemble.runCount(), steps, threads);
+		for (auto& axis : ensemble.axes()) printf(" %s.%s (%zu)", axis.body.c_str(), Ensemble::fieldName(axis.field), axis.values.size());
+		printf("\n");
+		EnsembleStats stats{};
+		if (!ensemble.run(ensemblePath, threads, &stats))
+		{
+			printf("the ensemble failed, %s couldn't be written or a sweep names a body the system doesn't have\n", ensemblePath.c_str());
+			return 1;
+		}
+		printf("wrote %s: %zu runs, %zu stable, %zu failed, wall: %.3lfs, %.1lf runs/s\n", ensemblePath.c_str(), stats.runs, stats.stable, stats.failed,
+			stats.wallSeconds, stats.wallSeconds > 0.0 ? stats.runs / stats.wallSeconds : 0.0);
+		return 0;
+	}
+
+	Simulation sim;
+	if (!setup(sim, threads)) return 1;
+	adopt(sim);
+	if (!resumePath.empty()) printf("resumed %s at %.3lfs, step %llu\n", resumePath.c_str(), sim.clock().time(), (unsigned long long)sim.clock().steps());
+
+	if (!bakePath.empty())
+	{
+		EphemerisBakeStats stats{};
+		auto start = std::chrono::steady_clock::now();
+		if (!Ephemeris::bake(sim, bakePath, steps * dt, segmentLength, degree, &stats))
+		{
+			printf("baking %s failed, the file couldn't be written or bodies merged during the span\n", bakePath.c_str());
+			return 1;
+		}
+		double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		printf("baked %s: %zu bodies, %llu segments, %.1lf KB, simulated: %.3lfs, wall: %.3lfs, max error: %.3e (%s)\n", bakePath.c_str(),
+			sim.bodyCount(), (unsigned long long)stats.segments, stats.bytes / 1024.0, sim.clock().time(), wall, stats.maxError,
+			sim.body(stats.worstBody).name.c_str());
+		return 0;
+	}
+
+	TrajectoryRecorder recorder;
+	if (!recordPath.empty())
+	{
+		TrajectoryOptions options = TrajectoryRecorder::defaultOptions();
+		options.interval = recordInterval;
+		options.positionTolerance = tolerance;
+		options.velocityTolerance = 0.1 * tolerance;
+		if (!recorder.open(recordPath, options, sim.clock().dt()))
+		{
+			printf("recording to %s failed, the file couldn't be created or the tolerance isn't positive\n", recordPath.c_str());
+			return 1;
+		}
+		sim.setStepCallback([&](const Simulation& s) { recorder.capture(s); }, recordInterval);
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	run(sim);
+	double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	if (recorder.isOpen())
+	{
+		sim.setStepCallback(nullptr);
+		bool isRecorded = recorder.close();
+		TrajectoryStats stats = recorder.stats();
+		printf("recorded %s: %llu frames, %llu dropped, %llu chunks, %.1lf KB, %.1lfx smaller than raw doubles, capture: %.3lf ms%s\n",
+			recordPath.c_str(), (unsigned long long)(stats.captured - stats.dropped), (unsigned long long)stats.dropped, (unsigned long long)stats.chunks,
+			stats.bytes / 1024.0, stats.bytes ? (double)stats.rawBytes / stats.bytes : 0.0, stats.captureMs, isRecorded ? "" : ", writing failed");
+		if (stats.dropped > 0)
+			printf("warning: the writer fell behind past %.0lf MB of buffers, %llu frames were dropped in %llu gaps that playback holds across. "
+				"Record less often with --record-every\n", TrajectoryRecorder::defaultOptions().maxBufferBytes / (1024.0 * 1024.0),
+				(unsigned long long)stats.dropped, (unsigned long long)stats.gaps);
+	}
+
+	printf("bodies: %zu, particles: %zu, steps: %llu, simulated: %.3lfs, wall: %.3lfs, %.0lf steps/s, %.1lfx real time\n",
+		sim.bodyCount(), sim.particleCount(), (unsigned long long)sim.clock().steps(), sim.clock().time(), wall,
+		wall > 0.0 ? sim.clock().steps() / wall : 0.0, wall > 0.0 ? sim.clock().time() / wall : 0.0);
+	if (mode == SimulationMode::NBODY && wall > 0.0)
+	{
+		double pairs = (double)sim.bodyCount() * sim.bodyCount() * sim.clock().steps();
+		if (solver == GravitySolver::DIRECT) printf("kernel: %s, %.3lf G pair interactions/s\n", Gravity::kernelName(), pairs / wall * 1e-9);
+		else printf("barnes-hut, theta: %.2f, %.3lf ms/step\n", theta, wall * 1e3 / sim.clock().steps());
+		if (collisions) printf("collisions: %zu bodies merged\n", sim.mergeCount());
+		if (sim.jobs())
+		{
+			JobStats stats = sim.jobs()->stats();
+			printf("threads: %d, parallel efficiency: %.1f%%, chunks: %llu, steals: %llu\n", stats.threads, 100.0 * stats.efficiency,
+				(unsigned long long)stats.chunks, (unsigned long long)stats.steals);
+		}
+	}
+
+	if (!savePath.empty())
+	{
+		// how the viewer draws each body, from whatever the bodies came from: the checkpoint resumed, the scene or the
+		// built in system, whose random bodies are minor. looked up by name since merges move bodies around
+		std::vector<CheckpointAppearance> appearance(sim.bodyCount(), CheckpointAppearance{ {}, {}, CHECKPOINT_BODY_MINOR });
+		auto appear = [&](const std::string& name, const CheckpointAppearance& record) {
+			int i = sim.find(name);
+			if (i != -1) appearance[i] = record;
+		};
+		Checkpoint resumed;
+		if (!resumePath.empty())
+		{
+			const CheckpointAppearance* records = resumed.open(resumePath) ? resumed.appearance() : nullptr;
+			if (!records) appearance.clear();
+			for (size_t k = 0; records && k < resumed.header().bodyCount; k++) appear(resumed.name(k), records[k]);
+		}
+		else if (!scenePath.empty())
+		{
+			for (size_t k = 0; k < scene.size(); k++)
+			{
+				const SceneBody& body = scene.body(k);
+				appear(std::string(scene.name(k)), { { body.color[0], body.color[1], body.color[2], body.color[3] }, { body.scale[0], body.scale[1], body.scale[2] },
+					(body.flags & SCENE_MINOR) ? (uint32_t)CHECKPOINT_BODY_MINOR : 0u });
+			}
+		}
+		else
+		{
+			for (auto& desc : solarSystemDescs())
+				appear(desc.name, { { desc.color.r, desc.color.g, desc.color.b, desc.color.a }, { desc.scale.x, desc.scale.y, desc.scale.z }, 0 });
+		}
+
+		auto saveStart = std::chrono::steady_clock::now();
+		if (!Checkpoint::save(sim, savePath, appearance))
+		{
+			printf("saving %s failed\n", savePath.c_str());
+			return 1;
+		}
+		printf("saved %s in %.3lf ms\n", savePath.c_str(), std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - saveStart).count());
+	}
+
+	if (!quiet)
+	{
+		for (int i = 0; i < (int)sim.bodyCount(); i++)
+		{
+			glm::dvec3 pos = sim.position(i);
+			printf("%s: x: %.3f, y: %.3f, z: %.3f\n", sim.body(i).name.c_str(), pos.x, pos.y, pos.z);
+		}
+	}
+
+	return 0;
+}
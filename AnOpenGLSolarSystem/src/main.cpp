@@ -1,10 +1,12 @@
 #include "sdk/Camera.hpp"
 #include "sdk/Controller.hpp"
+#include "sdk/UniformBuffer.hpp"
 #include "vendor/imgui/imgui.h"
 #include "vendor/imgui/imgui_impl_glfw.h"
 #include "vendor/imgui/imgui_impl_opengl3.h"
 
 #include "World.hpp"
+#include "sim/SolarSystem.hpp"
 
 const int windowWidth = 1280, windowHeight = 720;
 bool g_showMenu = true;
@@ -16,7 +18,8 @@ static bool init(GLFWwindow*& window)
 		return false;
 	}
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
+	// 3.3 for the shaders' glsl 330 and instanced attributes
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 	#ifdef __APPLE__
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
@@ -31,6 +34,8 @@ static bool init(GLFWwindow*& window)
 
 	glfwMakeContextCurrent(window);
 
+	// without it glew looks for extensions the way a core profile no longer answers and leaves their entry points unloaded
+	glewExperimental = GL_TRUE;
 	if (glewInit() != GLEW_OK)
 		return false;
 
@@ -51,7 +56,8 @@ int main()
 
 	// init shader
 	auto shader = std::make_shared<Shader>("src/shaders/shader.vert", "src/shaders/shader.frag");
-	shader->uniformMatrix4fv("u_projection", camera.projectionMatrix());
+	// camera and light, one buffer every program reads its Frame and Light blocks from
+	UniformBuffer sceneUniforms({ { FRAME_BLOCK_BINDING, sizeof(FrameBlock) }, { LIGHT_BLOCK_BINDING, sizeof(LightBlock) } });
 
 	// install controller
 	Controller::getInstance()->install(window, &camera);
@@ -64,46 +70,41 @@ int main()
 	ImGuiIO& io = ImGui::GetIO(); (void)io;
 	io.WantSaveIniSettings = false;
 
-	// attribs of 8 planets + sun + moon
-	float sunMass = 333400.f, mercuryMass = 1.f, venusMass = 1.f, earthMass = 4000.f, moonMass = 1.f, marsMass = 1.f, jupiterMass = 3000.f, saturnMass = 3000.f, uranusMass = 1.f, neptuneMass = 1.f, plutoMass = 1.f;
-	float mercuryE = 0.6f, venusE = 0.65f, earthE = 0.7f, moonE = 0.7f, marsE = 0.72f, jupiterE = 0.75f, saturnE = 0.79f, uranusE = 0.81f, neptuneE = 0.83f, plutoE = 0.85f;
-	float mercuryFD = 30.f, venusFD = 60.f, earthFD = 100.f, moonFD = 40.f, marsFD = 140.f, jupiterFD = 170.f, saturnFD = 200.f, uranusFD = 230.f, neptuneFD = 260.f, plutoFD = 300.f;
-	glm::vec3 sunScale = { 1.0f, 1.0f, 1.0f }, mercuryScale = { 0.2f, 0.2f, 0.2f }, venusScale = { 0.3f, 0.3f, 0.3f }, earthScale = { 0.5f, 0.5f, 0.5f }, moonScale = { 0.1f, 0.1f, 0.1f };
-	glm::vec3 marsScale = { 0.28f, 0.28f, 0.28f }, jupiterScale = { 0.7f, 0.7f, 0.7f }, saturnScale = { 0.65f, 0.65f, 0.65f }, uranusScale = { 0.38f, 0.38f, 0.38f }, neptuneScale = { 0.38f, 0.38f, 0.38f };
-	glm::vec3 plutoScale = { 0.2f, 0.2f, 0.2f };
-	glm::vec4 sunColor = { 1.0f, 0.0f, 0.0f, 1.0f }, mercuryColor = { 0.75f, 0.45f, 0.13f, 1.0f }, venusColor = {0.55f, 0.44f, 0.27f, 1.0f}, earthColor = { 0.0f, 0.0f, 1.0f, 1.0f }, moonColor = { 1.0f, 1.0f, 1.0f, 1.0f };
-	glm::vec4 marsColor = { 0.73f, 0.33f, 0.23, 1.0f }, jupiterColor = { 0.57f, 0.40f, 0.25, 1.0f }, saturnColor = { 0.89f, 0.71f, 0.49f, 1.0f }, uranusColor = { 0.16f,0.75f, 0.93f, 1.0f }, neptuneColor = { 0.16f,0.75f, 0.93f, 1.0f };
-	glm::vec4 plutoColor = { 0.46f, 0.67f, 0.71f, 1.0f };
-
-	// init world
-	g_world->init(50, 50, 20.f);
-	g_world->addPlanet("Sun", "Sun", 1.0f, 0.0f, shader, sunMass, { 0.0f, 0.0f, 0.0f }, sunScale, sunColor);
-	g_world->addPlanet("Mercury", "Sun", mercuryE, mercuryFD, shader, mercuryMass, { mercuryFD, 0.0f, 0.0f }, mercuryScale, mercuryColor);
-	g_world->addPlanet("Venus", "Sun", venusE, venusFD, shader, venusMass, { venusFD, 0.0f, 0.0f }, venusScale, venusColor);
-	g_world->addPlanet("Earth", "Sun", earthE, earthFD, shader, earthMass, { earthFD, 0.0f, 0.0f }, earthScale, earthColor);
-	g_world->addPlanet("Mars", "Sun", marsE, marsFD, shader, marsMass, { marsFD, 0.0f, 0.0f }, marsScale, marsColor);
-	g_world->addPlanet("Jupiter", "Sun", jupiterE, jupiterFD, shader, jupiterMass, { jupiterFD, 0.0f, 0.0f }, jupiterScale, jupiterColor);
-	g_world->addPlanet("Saturn", "Sun", saturnE, saturnFD, shader, saturnMass, { saturnFD, 0.0f, 0.0f }, saturnScale, saturnColor);
-	g_world->addPlanet("Uranus", "Sun", uranusE, uranusFD, shader, uranusMass, { uranusFD, 0.0f, 0.0f }, uranusScale, uranusColor);
-	g_world->addPlanet("Neptune", "Sun", neptuneE, neptuneFD, shader, neptuneMass, { neptuneFD, 0.0f, 0.0f }, neptuneScale, neptuneColor);
-	g_world->addPlanet("Pluto", "Sun", plutoE, plutoFD, shader, plutoMass, { plutoFD, 0.0f, 0.0f }, plutoScale, plutoColor);
-
-	// some satellites just for fun
-	g_world->addPlanet("Moon", "Earth", moonE, moonFD, shader, moonMass, { moonFD, 0.0f, 0.0f }, moonScale, moonColor);
-	g_world->addPlanet("Ganymede", "Jupiter", 0.6, 50.f, shader, 1.0f, { moonFD, 0.0f, 0.0f }, moonScale, { 0.21f, 0.22 , 0.17 ,1.0f });
-	g_world->addPlanet("Titan", "Saturn", 0.6, 50.f, shader, 1.0f, { moonFD, 0.0f, 0.0f }, moonScale, saturnColor);
-
-	shader->uniform3fv("u_lightColor", {1.0f, 1.0f, 1.0f});
-	shader->uniform3fv("u_lightPos", { 0.0f, 0.0f, 0.0f });
+	// init world, owned here rather than global so nothing else can reach into it
+	auto world = std::make_unique<World>();
+	world->init(50, 50, kSphereRadius);
+	// the scene's binary cache lets every start after the first skip parsing it, the built in system stands in if it won't load
+	Scene scene;
+	if (scene.load("src/scenes/solar-system.scene")) world->addScene(scene, shader);
+	else
+	{
+		printf("%s, starting with the built in system\n", scene.error().c_str());
+		for (auto& desc : solarSystemDescs())
+			world->addPlanet(desc.name, desc.centerName, desc.eccentricity, desc.focalDistance, shader, desc.mass, desc.pos, desc.scale, desc.color);
+	}
+	world->addParticles(400000, 100000);
+	// a catalog ingested with the headless runner's --ingest-stars lights the sky, random stars stand in without one
+	world->loadStars("src/scenes/sky.stars");
 
+	double lastFrame = glfwGetTime();
 	while (!glfwWindowShouldClose(window))
 	{
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		// world render
-		shader->uniformMatrix4fv("u_view", camera.viewMatrix());
-		shader->uniform3fv("u_viewPos", camera.position());
-		g_world->draw();
+		// world update, the only place the simulation sees wall time
+		double currentFrame = glfwGetTime();
+		world->update(currentFrame - lastFrame);
+		lastFrame = currentFrame;
+
+		// world render, in camera relative space: the eye is the origin and the light moves instead
+		Renderer::getInstance()->resetStats();
+		Shader::resetStats();
+		double submitStart = glfwGetTime();
+		sceneUniforms.write(0, FrameBlock{ camera.viewMatrix(), camera.projectionMatrix(), glm::vec4(0.0f) });
+		sceneUniforms.write(1, LightBlock{ glm::vec4(camera.relative({ 0.0, 0.0, 0.0 }), 1.0f), glm::vec4(1.0f) });
+		sceneUniforms.upload();
+		world->draw(camera);
+		double submitSeconds = glfwGetTime() - submitStart;
 
 		// A better way of dealing with custom key binds is to implement addListener in Controller class(which i'll be doing later)
 		static int lastInsState = 0;
@@ -112,15 +113,25 @@ int main()
 
 		// topmost menu
 		static int display_w, display_h;
-		static bool shouldRenderPlanetNames = true, shouldRenderBasicStats = true, shouldDrawStars = true, shouldShowTrails = true;
+		static bool shouldRenderPlanetNames = true, shouldRenderBasicStats = true, shouldDrawStars = true, shouldShowTrails = true, shouldDrawParticles = true;
 		static int starCnt = 3000;
 		ImGui_ImplGlfw_NewFrame();
 		ImGui_ImplOpenGL3_NewFrame();
 		ImGui::NewFrame();
-		if (shouldShowTrails) g_world->showTrails(camera, shader);
-		if (shouldDrawStars) g_world->renderStars(camera, shader, starCnt);
-		if (shouldRenderPlanetNames) g_world->renderPlanetNames(camera, display_w, display_h);
-		if (shouldRenderBasicStats) g_world->renderPlanetInfo(camera);
+		// cpu time spent submitting and issuing draws, the particle uploads that come between are left out
+		submitStart = glfwGetTime();
+		if (shouldShowTrails) world->showTrails(camera, shader);
+		if (shouldDrawStars) world->renderStars(camera, shader, starCnt);
+		submitSeconds += glfwGetTime() - submitStart;
+		if (shouldDrawParticles) world->drawParticles(camera, shader);
+		// everything submitted this frame, sorted by pass and state, ahead of the imgui overlays
+		submitStart = glfwGetTime();
+		Renderer::getInstance()->flush();
+		submitSeconds += glfwGetTime() - submitStart;
+		const uint64_t submitDraws = Renderer::getInstance()->drawCalls();
+		if (shouldRenderPlanetNames) world->renderPlanetNames(camera, display_w, display_h);
+		if (shouldRenderBasicStats) world->renderPlanetInfo(camera);
+		world->renderWarpIndicator(display_w);
 		ImGui::GetForegroundDrawList()->AddText({ 20, (float)display_h - 30 }, ImGui::ColorConvertFloat4ToU32({ 255.f, 255.f, 255.f, 255.f }), "CS10043301 assignment2: A basic solar system made by 2050250.");
 		if (g_showMenu)
 		{
@@ -138,10 +149,21 @@ int main()
 			ImGui::Checkbox("Render basic stats", &shouldRenderBasicStats); ImGui::SameLine();
 			ImGui::Checkbox("Render planet names", &shouldRenderPlanetNames); ImGui::SameLine();
 			ImGui::Checkbox("Show trails", &shouldShowTrails); ImGui::SameLine();
+			ImGui::Checkbox("Belt and ring", &shouldDrawParticles); ImGui::SameLine();
 			ImGui::Checkbox("Galaxy skybox", &shouldDrawStars);
 			if(shouldDrawStars)
-			ImGui::SliderInt("Star count", &starCnt, 1000, 5000);
-			g_world->onImGuiRender();
+			ImGui::SliderInt("Star count", &starCnt, 1000, world->skyStarCount() ? (int)glm::min(world->skyStarCount(), (size_t)120000) : 5000);
+			world->onImGuiRender();
+			const ShaderStats& uniformStats = Shader::stats();
+			ImGui::Text("Draw submission: %.3f ms cpu, %llu draws, %.2f us a draw", submitSeconds * 1e3, (unsigned long long)submitDraws,
+				submitDraws ? submitSeconds * 1e6 / submitDraws : 0.0);
+			ImGui::Text("Render queue: %llu vertex array binds", (unsigned long long)Renderer::getInstance()->vertexArrayBinds());
+			static bool isMultiDrawEnabled = true;
+			if (ImGui::Checkbox("Multi draw indirect", &isMultiDrawEnabled)) Renderer::getInstance()->setMultiDrawIndirect(isMultiDrawEnabled);
+			ImGui::SameLine();
+			ImGui::Text(IndirectBatch::isMultiDrawSupported() ? "(supported)" : "(not supported, instanced draws per mesh)");
+			ImGui::Text("Uniforms: %llu set, %llu unchanged and skipped, %llu program binds", (unsigned long long)uniformStats.uploads,
+				(unsigned long long)uniformStats.skipped, (unsigned long long)uniformStats.programBinds);
 			ImGui::End();
 		}
 		else Controller::getInstance()->resume();
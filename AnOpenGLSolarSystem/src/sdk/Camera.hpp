@@ -28,7 +28,9 @@ public:
 private:
 	glm::vec3 _up;
 	glm::vec3 _forward;
-	glm::vec3 _position;
+
+	// world position in double, everything handed to the gpu is relative to it
+	glm::dvec3 _position;
 
 	glm::mat4 _projection;
 
@@ -36,16 +38,20 @@ private:
 	GLfloat _yaw{ 0.0f };
 
 public:
-	Camera(glm::vec3 position, glm::mat4 projection, float pitch = 0.f, float yaw = 0.f);
+	Camera(glm::dvec3 position, glm::mat4 projection, float pitch = 0.f, float yaw = 0.f);
 	~Camera() = default;
 
 	void rotate(Rotation rotation, float angle);
 	void move(Direction direction, float offset);
 
 public:
-	const glm::mat4 viewMatrix() const { return glm::lookAt(_position, _forward + _position, _up); };
+	// rotation only, the camera sits at the origin of the float render space
+	const glm::mat4 viewMatrix() const { return glm::lookAt(glm::vec3(0.0f), _forward, _up); };
 	const glm::mat4 projectionMatrix() const { return _projection; };
-	const glm::vec3 position() const { return _position; };
+	const glm::dvec3 position() const { return _position; };
+
+	// a world position in render space, the subtraction happens in double so nothing near the camera jitters
+	const glm::vec3 relative(const glm::dvec3& world) const { return glm::vec3(world - _position); };
 	const float pitch() const { return _pitch; };
 	const float yaw() const { return _yaw; };
 
@@ -53,7 +59,7 @@ private:
 	void update();
 };
 
-Camera::Camera(glm::vec3 position, glm::mat4 projection, float pitch, float yaw) :
+Camera::Camera(glm::dvec3 position, glm::mat4 projection, float pitch, float yaw) :
 	_position(position), _up(glm::vec3(0.0f, 1.0f, 0.0f)), _forward(glm::vec3(0.0f, 0.0f, -1.0f)), _projection(projection), _pitch(pitch), _yaw(yaw)
 {
 	update();
@@ -85,27 +91,28 @@ void Camera::rotate(Rotation rotation, float angle)
 
 void Camera::move(Direction direction, float offset)
 {
-	glm::vec3 right = glm::normalize(glm::cross(_up, _forward));
-	glm::vec3 forward = -glm::normalize(glm::cross(_up, right));
+	glm::dvec3 up = _up;
+	glm::dvec3 right = glm::normalize(glm::cross(up, glm::dvec3(_forward)));
+	glm::dvec3 forward = -glm::normalize(glm::cross(up, right));
 	switch (direction)
 	{
 	case Camera::Direction::FORWARD:
-		_position += forward * offset;
+		_position += forward * (double)offset;
 		break;
 	case Camera::Direction::BACKWARD:
-		_position -= forward * offset;
+		_position -= forward * (double)offset;
 		break;
 	case Camera::Direction::LEFT:
-		_position -= right * offset;
+		_position -= right * (double)offset;
 		break;
 	case Camera::Direction::RIGHT:
-		_position += right * offset;
+		_position += right * (double)offset;
 		break;
 	case Camera::Direction::UP:
-		_position += _up * offset;
+		_position += up * (double)offset;
 		break;
 	case Camera::Direction::DOWN:
-		_position -= _up * offset;
+		_position -= up * (double)offset;
 		break;
 	default:
 		break;
@@ -13,6 +13,9 @@
 #include <fstream>
 #include <sstream>
 #include <unordered_map>
+#include <memory>
+
+#include "Macros.hpp"
 
 inline bool glLogCall(const char* function, const char* file, int line)
 {
@@ -30,29 +33,13 @@ inline void glClearError()
 	while (glGetError() != GL_NO_ERROR);
 }
 
-#ifdef _MSC_VER
-    #define DEBUG_BREAK() __debugbreak()
-#elif defined(__GNUC__) || defined(__clang__)
-    #include <signal.h>
-    #define DEBUG_BREAK() raise(SIGTRAP)
+#ifdef NDEBUG
+// release builds don't drain glGetError around every call, each drain is another round trip into the driver
+#define GLCall(x) \
+x;
 #else
-    #include <cassert>
-    #define DEBUG_BREAK() assert(false)
-#endif
-
-#define ASSERT(x) if (!(x)) DEBUG_BREAK()
-
 #define GLCall(x) \
 glClearError(); \
 x; \
 ASSERT(glLogCall(#x, __FILE__, __LINE__));
-
-#define NONCOPYABLE(classname) \
-public: \
-classname(const classname&) = delete; \
-classname& operator=(const classname&) = delete;
-
-#define INCONSTRUCTIBLE(classname) \
-NONCOPYABLE(classname) \
-classname() = delete; \
-~classname() = delete;
+#endif
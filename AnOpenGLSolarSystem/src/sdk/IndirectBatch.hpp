@@ -0,0 +1,124 @@
+#pragma once
+
+#include "Headers.hpp"
+#include "VertexArray.hpp"
+
+// per instance attributes of an instanced draw, read by shader.vert after a sphere's position and normal
+typedef struct
+{
+	// camera relative
+	glm::vec3 offset;
+	glm::vec3 scale;
+	glm::vec4 color;
+}InstanceData;
+
+// one mesh among several sharing a vertex array's buffers
+typedef struct
+{
+	GLuint firstIndex;
+	GLuint indexCount;
+	GLint baseVertex;
+}MeshRange;
+
+// the layout glMultiDrawElementsIndirect reads its commands in
+typedef struct
+{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+}DrawElementsIndirectCommand;
+
+// Instances of several meshes of one vertex array, gathered by mesh into a command each. With multi draw indirect
+// the whole batch is one call reading the commands from a buffer; without it (gl 3.3) the same commands are a
+// loop of instanced draws, see Renderer.
+class IndirectBatch
+{
+	NONCOPYABLE(IndirectBatch)
+
+private:
+	GLuint _commandBuffer{ 0 };
+	std::vector<MeshRange> _meshes;
+	std::vector<std::vector<InstanceData>> _buckets;
+	std::vector<InstanceData> _instances;
+	std::vector<DrawElementsIndirectCommand> _commands;
+
+public:
+	IndirectBatch(const std::vector<MeshRange>& meshes) : _meshes(meshes), _buckets(meshes.size()) {};
+	~IndirectBatch();
+
+public:
+	void clear();
+
+	// instances of a mesh keep the order they were added in
+	void add(size_t mesh, const InstanceData& instance) { _buckets[mesh].push_back(instance); };
+
+	// lays the instances out mesh by mesh in va's instance buffer, a command for every mesh that has any, and
+	// the commands into their own buffer when they are to be drawn indirect
+	void upload(VertexArray& va, bool isIndirect);
+
+	const std::vector<DrawElementsIndirectCommand>& commands() const { return _commands; };
+
+	const size_t instanceCount() const { return _instances.size(); };
+
+	void bindCommands() const;
+	void unbindCommands() const;
+
+	// multi draw indirect with base instances, gl 4.3 or the two extensions
+	static bool isMultiDrawSupported();
+};
+
+IndirectBatch::~IndirectBatch()
+{
+	if (_commandBuffer == 0) return;
+	GLCall(glDeleteBuffers(1, &_commandBuffer));
+}
+
+void IndirectBatch::clear()
+{
+	for (auto& bucket : _buckets) bucket.clear();
+	_instances.clear();
+	_commands.clear();
+}
+
+void IndirectBatch::upload(VertexArray& va, bool isIndirect)
+{
+	_instances.clear();
+	_commands.clear();
+	for (size_t mesh = 0; mesh < _meshes.size(); mesh++)
+	{
+		auto& bucket = _buckets[mesh];
+		if (bucket.empty()) continue;
+		_commands.push_back({ _meshes[mesh].indexCount, (GLuint)bucket.size(), _meshes[mesh].firstIndex, _meshes[mesh].baseVertex, (GLuint)_instances.size() });
+		_instances.insert(_instances.end(), bucket.begin(), bucket.end());
+	}
+	va.instanceBuffer().update(_instances.data(), _instances.size() * sizeof(InstanceData));
+	if (!isIndirect) return;
+
+	if (_commandBuffer == 0)
+	{
+		GLCall(glGenBuffers(1, &_commandBuffer));
+	}
+	bindCommands();
+	GLCall(glBufferData(GL_DRAW_INDIRECT_BUFFER, _commands.size() * sizeof(DrawElementsIndirectCommand), nullptr, GL_STREAM_DRAW));
+	GLCall(glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, _commands.size() * sizeof(DrawElementsIndirectCommand), _commands.data()));
+	unbindCommands();
+}
+
+void IndirectBatch::bindCommands() const
+{
+	GLCall(glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _commandBuffer));
+}
+
+void IndirectBatch::unbindCommands() const
+{
+	GLCall(glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0));
+}
+
+bool IndirectBatch::isMultiDrawSupported()
+{
+	// mesa and most desktop drivers hand out their newest core version for a 3.3 request, a real 3.3 has neither
+	static const bool isSupported = GLEW_VERSION_4_3 || (GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance);
+	return isSupported;
+}
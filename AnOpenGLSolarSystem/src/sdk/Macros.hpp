@@ -0,0 +1,23 @@
+#pragma once
+
+#ifdef _MSC_VER
+    #define DEBUG_BREAK() __debugbreak()
+#elif defined(__GNUC__) || defined(__clang__)
+    #include <signal.h>
+    #define DEBUG_BREAK() raise(SIGTRAP)
+#else
+    #include <cassert>
+    #define DEBUG_BREAK() assert(false)
+#endif
+
+#define ASSERT(x) if (!(x)) DEBUG_BREAK()
+
+#define NONCOPYABLE(classname) \
+public: \
+classname(const classname&) = delete; \
+classname& operator=(const classname&) = delete;
+
+#define INCONSTRUCTIBLE(classname) \
+NONCOPYABLE(classname) \
+classname() = delete; \
+~classname() = delete;
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "Headers.hpp"
+#include "VertexArray.hpp"
+#include "Shader.hpp"
+#include "IndirectBatch.hpp"
+
+// passes run in this order, opaque spheres first so everything after is depth tested against them
+typedef enum
+{
+	RENDER_PASS_OPAQUE = 0,
+	RENDER_PASS_LINES,
+	RENDER_PASS_POINTS,
+	// the star sky, at the far end of the scene so most of it fails the depth test it comes last
+	RENDER_PASS_SKY
+}RenderPass;
+
+typedef enum
+{
+	DRAW_ELEMENTS = 0,
+	DRAW_ARRAYS,
+	DRAW_INSTANCED,
+	// every command of an IndirectBatch
+	DRAW_INDIRECT
+}DrawKind;
+
+// handles of the uniforms a packet sets, in its shader
+typedef struct
+{
+	UniformHandle model;
+	UniformHandle color;
+	UniformHandle lighting;
+	UniformHandle isInstanced;
+}PacketUniforms;
+
+// one deferred draw and every bit of state it needs
+typedef struct
+{
+	uint64_t key;
+	const VertexArray* va;
+	Shader* shader;
+	PacketUniforms uniforms;
+	DrawKind kind;
+	GLenum elementMode;
+	GLenum polygonMode;
+	// vertices from first for DRAW_ARRAYS, instances for DRAW_INSTANCED, unused for DRAW_ELEMENTS
+	GLint first;
+	GLsizei count;
+	glm::mat4 model;
+	glm::vec4 color;
+	GLint lighting;
+	// DRAW_INDIRECT only, uploaded to va before the flush
+	const IndirectBatch* batch;
+}DrawPacket;
+
+// Packets of a frame, put in draw order by a 64 bit key. From the top: pass (4 bits), program (8), vertex array
+// (12), material (16), depth (24). Sorting on it groups packets sharing a program and vertex array so state is
+// set once a group, packets of one material in a group sit together so their uniforms don't change, and within
+// that opaque packets go front to back for early depth rejection.
+class RenderQueue
+{
+	NONCOPYABLE(RenderQueue)
+
+private:
+	std::vector<DrawPacket> _packets;
+	// (key, packet) pairs and the radix sort's scratch
+	std::vector<std::pair<uint64_t, uint32_t>> _order, _scratch;
+
+public:
+	RenderQueue() = default;
+	~RenderQueue() = default;
+
+	// key filled in from the packet's state, depth is its distance from the camera
+	void submit(DrawPacket packet, RenderPass pass, float depth);
+
+	// the packets in key order, valid until the next submit or clear
+	const std::vector<std::pair<uint64_t, uint32_t>>& sort();
+
+	const DrawPacket& packet(uint32_t index) const { return _packets[index]; };
+
+	const size_t size() const { return _packets.size(); };
+
+	void clear() { _packets.clear(); };
+
+	static uint64_t makeKey(RenderPass pass, GLuint program, GLuint va, uint32_t material, float depth);
+
+	// the same color and lighting always give the same 16 bits
+	static uint32_t materialOf(const glm::vec4& color, GLint lighting);
+};
+
+uint64_t RenderQueue::makeKey(RenderPass pass, GLuint program, GLuint va, uint32_t material, float depth)
+{
+	// log spaced from 1e-3 to 1e6 units, so near draws get fine steps and the far sky a few
+	const double scaled = (std::log10(glm::clamp((double)depth, 1e-3, 1e6)) + 3.0) / 9.0;
+	uint64_t depthBits = (uint64_t)(scaled * ((1 << 24) - 1));
+	return (uint64_t)(pass & 0xf) << 60 | (uint64_t)(program & 0xff) << 52 | (uint64_t)(va & 0xfff) << 40 | (uint64_t)(material & 0xffff) << 24 | depthBits;
+}
+
+uint32_t RenderQueue::materialOf(const glm::vec4& color, GLint lighting)
+{
+	uint32_t bits[4];
+	memcpy(bits, &color, sizeof(bits));
+	uint32_t hash = 2166136261u ^ (uint32_t)lighting;
+	for (uint32_t b : bits) hash = (hash ^ b) * 16777619u;
+	return (hash ^ hash >> 16) & 0xffff;
+}
+
+void RenderQueue::submit(DrawPacket packet, RenderPass pass, float depth)
+{
+	packet.key = makeKey(pass, packet.shader->id(), packet.va->id(), materialOf(packet.color, packet.lighting), depth);
+	_packets.push_back(packet);
+}
+
+// lsd radix sort of the keys, a byte a pass, skipping bytes every key shares. it is stable, so packets with equal keys keep submission order
+const std::vector<std::pair<uint64_t, uint32_t>>& RenderQueue::sort()
+{
+	const size_t n = _packets.size();
+	_order.resize(n);
+	_scratch.resize(n);
+	for (size_t i = 0; i < n; i++) _order[i] = { _packets[i].key, (uint32_t)i };
+
+	for (int shift = 0; shift < 64; shift += 8)
+	{
+		size_t counts[256] = {};
+		for (auto& entry : _order) counts[(entry.first >> shift) & 0xff]++;
+		if (n == 0 || counts[(_order[0].first >> shift) & 0xff] == n) continue;
+		size_t offset = 0;
+		for (size_t& count : counts)
+		{
+			size_t c = count;
+			count = offset;
+			offset += c;
+		}
+		for (auto& entry : _order) _scratch[counts[(entry.first >> shift) & 0xff]++] = entry;
+		_order.swap(_scratch);
+	}
+	return _order;
+}
@@ -3,6 +3,7 @@
 #include "Headers.hpp"
 #include "VertexArray.hpp"
 #include "Shader.hpp"
+#include "RenderQueue.hpp"
 
 class Renderer
 {
@@ -20,21 +21,178 @@ public:
 		return _inst.get();
 	}
 
+	// the shader stays in use after a draw, so a run of draws with one shader binds it once
 	void draw(const VertexArray& va, const Shader& shader, const GLenum polygonMode, const GLenum elementMode) const;
 
+	// count vertices in order from first, no index buffer
+	void drawArrays(const VertexArray& va, const Shader& shader, const GLenum elementMode, const GLsizei count, const GLint first = 0) const;
+
+	// instanceCount copies of va in a single call, each placed and colored by its entry of va's instance buffer
+	void drawInstanced(const VertexArray& va, Shader& shader, const GLenum polygonMode, const GLenum elementMode, const GLsizei instanceCount) const;
+
+	// the layout of an instance buffer of InstanceData
+	static BufferLayout instanceLayout();
+
+	// indirect batches go out as one glMultiDrawElementsIndirect where gl has it, a loop of instanced draws where not
+	const bool isMultiDrawIndirect() const { return _isMultiDrawEnabled && IndirectBatch::isMultiDrawSupported(); };
+
+	// off forces the instanced loop even where multi draw indirect is supported, to compare the two
+	void setMultiDrawIndirect(bool isEnabled) { _isMultiDrawEnabled = isEnabled; };
+
+	// deferred until flush, which draws every packet of the frame in key order, see RenderQueue
+	void submit(const DrawPacket& packet, RenderPass pass, float depth) { _queue.submit(packet, pass, depth); };
+
+	// sort and draw the submitted packets, setting only the state that differs from the packet before
+	void flush();
+
+	// draw calls since the last reset
+	const uint64_t drawCalls() const { return _drawCalls; };
+
+	// vertex array binds since the last reset, the queue binds one once for a run of packets that share it
+	const uint64_t vertexArrayBinds() const { return _vertexArrayBinds; };
+
+	void resetStats() { _drawCalls = 0; _vertexArrayBinds = 0; };
+
 private:
 	static std::unique_ptr<Renderer> _inst;
+
+	// gl's own default, only a draw in another mode sets it
+	mutable GLenum _polygonMode{ GL_FILL };
+
+	mutable uint64_t _drawCalls{ 0 };
+
+	mutable uint64_t _vertexArrayBinds{ 0 };
+
+	RenderQueue _queue;
+
+	bool _isMultiDrawEnabled{ true };
+
+	void setPolygonMode(const GLenum polygonMode) const;
+
+	// the batch's commands, va already bound
+	void drawBatch(const VertexArray& va, const IndirectBatch& batch, const GLenum elementMode) const;
 };
 
 std::unique_ptr<Renderer> Renderer::_inst;
 
-// TODO: encapsulate both glDrawElements and glDrawArrays instead of using default glDrawElements
 void Renderer::draw(const VertexArray& va, const Shader& shader, const GLenum polygonMode, const GLenum elementMode) const
 {
 	va.bind();
 	shader.enable();
-	GLCall(glPolygonMode(GL_FRONT_AND_BACK, polygonMode));
+	setPolygonMode(polygonMode);
 	GLCall(glDrawElements(elementMode, va.count(), GL_UNSIGNED_INT, nullptr));
 	va.unbind();
-	shader.disable();
-}
\ No newline at end of file
+	_drawCalls++;
+}
+
+void Renderer::drawArrays(const VertexArray& va, const Shader& shader, const GLenum elementMode, const GLsizei count, const GLint first) const
+{
+	va.bind();
+	shader.enable();
+	GLCall(glDrawArrays(elementMode, first, count));
+	va.unbind();
+	_drawCalls++;
+}
+
+void Renderer::drawInstanced(const VertexArray& va, Shader& shader, const GLenum polygonMode, const GLenum elementMode, const GLsizei instanceCount) const
+{
+	if (instanceCount == 0) return;
+	// the shader takes the model from the instance attributes for this draw only
+	const UniformHandle isInstanced = shader.uniform("u_isInstanced");
+	shader.set(isInstanced, 1);
+	va.bind();
+	shader.enable();
+	setPolygonMode(polygonMode);
+	GLCall(glDrawElementsInstanced(elementMode, va.count(), GL_UNSIGNED_INT, nullptr, instanceCount));
+	va.unbind();
+	_drawCalls++;
+	shader.set(isInstanced, 0);
+}
+
+void Renderer::flush()
+{
+	const VertexArray* bound = nullptr;
+	for (auto& entry : _queue.sort())
+	{
+		const DrawPacket& packet = _queue.packet(entry.second);
+		Shader& shader = *packet.shader;
+		if (packet.va != bound)
+		{
+			packet.va->bind();
+			bound = packet.va;
+			_vertexArrayBinds++;
+		}
+		shader.enable();
+		// unchanged values are dropped by the shader's own shadow copies
+		const bool isInstanced = packet.kind == DRAW_INSTANCED || packet.kind == DRAW_INDIRECT;
+		shader.set(packet.uniforms.isInstanced, isInstanced ? 1 : 0);
+		shader.set(packet.uniforms.lighting, packet.lighting);
+		shader.set(packet.uniforms.color, packet.color);
+		if (!isInstanced) shader.set(packet.uniforms.model, packet.model);
+
+		switch (packet.kind)
+		{
+		case DRAW_ELEMENTS:
+			setPolygonMode(packet.polygonMode);
+			GLCall(glDrawElements(packet.elementMode, packet.va->count(), GL_UNSIGNED_INT, nullptr));
+			_drawCalls++;
+			break;
+		case DRAW_ARRAYS:
+			GLCall(glDrawArrays(packet.elementMode, packet.first, packet.count));
+			_drawCalls++;
+			break;
+		case DRAW_INSTANCED:
+			setPolygonMode(packet.polygonMode);
+			GLCall(glDrawElementsInstanced(packet.elementMode, packet.va->count(), GL_UNSIGNED_INT, nullptr, packet.count));
+			_drawCalls++;
+			break;
+		case DRAW_INDIRECT:
+			setPolygonMode(packet.polygonMode);
+			drawBatch(*packet.va, *packet.batch, packet.elementMode);
+			break;
+		default:
+			break;
+		}
+	}
+	if (bound) bound->unbind();
+	_queue.clear();
+}
+
+void Renderer::drawBatch(const VertexArray& va, const IndirectBatch& batch, const GLenum elementMode) const
+{
+	auto& commands = batch.commands();
+	if (commands.empty()) return;
+	if (isMultiDrawIndirect())
+	{
+		batch.bindCommands();
+		GLCall(glMultiDrawElementsIndirect(elementMode, GL_UNSIGNED_INT, nullptr, (GLsizei)commands.size(), 0));
+		batch.unbindCommands();
+		_drawCalls++;
+		return;
+	}
+	// gl 3.3 has base vertices but no base instances, so the instance attributes are moved to each command's first
+	for (auto& command : commands)
+	{
+		va.setInstanceOffset(command.baseInstance);
+		GLCall(glDrawElementsInstancedBaseVertex(elementMode, command.count, GL_UNSIGNED_INT, (const void*)(command.firstIndex * sizeof(GLuint)),
+			command.instanceCount, command.baseVertex));
+		_drawCalls++;
+	}
+	va.setInstanceOffset(0);
+}
+
+void Renderer::setPolygonMode(const GLenum polygonMode) const
+{
+	if (_polygonMode == polygonMode) return;
+	GLCall(glPolygonMode(GL_FRONT_AND_BACK, polygonMode));
+	_polygonMode = polygonMode;
+}
+
+BufferLayout Renderer::instanceLayout()
+{
+	BufferLayout layout;
+	layout.push(GL_FLOAT, 3, GL_FALSE);
+	layout.push(GL_FLOAT, 3, GL_FALSE);
+	layout.push(GL_FLOAT, 4, GL_FALSE);
+	return layout;
+}
@@ -1,39 +1,85 @@
 #pragma once
 
 #include "Headers.hpp"
+#include "UniformBuffer.hpp"
+
+#include <cstring>
+
+// a uniform of one shader, resolved once by name. -1 for a name the program doesn't have, setting it does nothing
+typedef int UniformHandle;
+
+typedef struct
+{
+	// glUniform calls made, and ones skipped because the program already had that value
+	uint64_t uploads;
+	uint64_t skipped;
+	uint64_t programBinds;
+}ShaderStats;
 
 class Shader
 {
 	NONCOPYABLE(Shader)
 
 private:
+	// the last value given to a uniform, a set to the same value never reaches GL
+	typedef struct
+	{
+		GLint location;
+		bool isSet;
+		alignas(16) unsigned char shadow[sizeof(glm::mat4)];
+	}UniformSlot;
+
 	GLuint _id;
-	std::unordered_map<std::string, int> _umap;
+	std::vector<UniformSlot> _slots;
+	std::unordered_map<std::string, UniformHandle> _handles;
+
+	// the program in use, so binding the one already bound is free and nothing unbinds after every call
+	static GLuint _current;
+	static ShaderStats _stats;
 
 public:
 	Shader(const std::string& vertexShaderPath, const std::string& fragmentShaderPath);
 	~Shader();
 	Shader(Shader&& shader) noexcept:
-		_id(shader._id), _umap(shader._umap) {
+		_id(shader._id), _slots(std::move(shader._slots)), _handles(std::move(shader._handles)) {
 		shader._id = 0;
 	}
 
 public:
 	void enable() const;
 	void disable() const;
+	const GLuint id() const { return _id; };
+
+	// resolve a uniform once and keep the handle, setting by handle is what draws should do
+	UniformHandle uniform(const std::string& name);
+
+	void set(UniformHandle handle, const glm::mat4& mat);
+	void set(UniformHandle handle, const glm::vec4& vec);
+	void set(UniformHandle handle, const glm::vec3& vec);
+	void set(UniformHandle handle, GLint value);
+
+	// uniform setters by name, for values set once or once a frame
+	void uniformMatrix4fv(const std::string& name, glm::mat4 mat) { set(uniform(name), mat); };
+	void uniform4fv(const std::string& name, glm::vec4 vec) { set(uniform(name), vec); };
+	void uniform3fv(const std::string& name, glm::vec3 vec) { set(uniform(name), vec); };
+	void uniform1i(const std::string& name, GLint value) { set(uniform(name), value); };
 
-	// uniform setters
-	void uniformMatrix4fv(const std::string& name, glm::mat4 mat);
-	void uniform4fv(const std::string& name, glm::vec4 vec);
-	void uniform3fv(const std::string& name, glm::vec3 vec);
-	void uniform1i(const std::string& name, GLint value);
+	// counts over every shader since the last reset
+	static const ShaderStats& stats() { return _stats; };
+	static void resetStats() { _stats = {}; };
 
 private:
-	int getUniformLocation(const std::string& name);
+	// false if handle already holds value, otherwise value is its shadow now and the program is bound for the upload
+	template<typename T>
+	bool isChanged(UniformHandle handle, const T& value);
+
 	std::string getShaderSource(std::string path) const;
 	GLuint compileShader(GLenum type, const std::string& source) const;
 };
 
+GLuint Shader::_current = 0;
+ShaderStats Shader::_stats = {};
+
 Shader::Shader(const std::string& vertexShaderPath, const std::string& fragmentShaderPath)
 {
 	_id = glCreateProgram();
@@ -48,10 +94,19 @@ Shader::Shader(const std::string& vertexShaderPath, const std::string& fragmentS
 
 	GLCall(glDeleteShader(vs));
 	GLCall(glDeleteShader(fs));
+
+	// shared blocks are read from their binding points, whichever buffer is bound there
+	for (auto& block : kUniformBlocks)
+	{
+		GLuint index = glGetUniformBlockIndex(_id, block.name);
+		if (index == GL_INVALID_INDEX) continue;
+		GLCall(glUniformBlockBinding(_id, index, block.binding));
+	}
 }
 
 Shader::~Shader()
 {
+	if (_current == _id) _current = 0;
 	GLCall(glDeleteProgram(_id));
 }
 
@@ -89,51 +144,74 @@ GLuint Shader::compileShader(GLenum type, const std::string& source) const
 
 void Shader::enable() const
 {
+	if (_current == _id) return;
 	GLCall(glUseProgram(_id));
+	_current = _id;
+	_stats.programBinds++;
 }
 
 void Shader::disable() const
 {
+	if (_current == 0) return;
 	GLCall(glUseProgram(0));
+	_current = 0;
 }
 
-int Shader::getUniformLocation(const std::string& name)
+UniformHandle Shader::uniform(const std::string& name)
 {
-	if (_umap.find(name) != _umap.end())
+	auto it = _handles.find(name);
+	if (it != _handles.end()) return it->second;
+
+	int location = glGetUniformLocation(_id, name.c_str());
+	UniformHandle handle = -1;
+	if (location == -1) printf("Uniform %s doesn't exist!\n", name.c_str());
+	else
 	{
-		return _umap[name];
+		handle = (UniformHandle)_slots.size();
+		_slots.push_back({ location, false, {} });
 	}
+	_handles.insert(make_pair(name, handle));
+	return handle;
+}
 
-	int pos = glGetUniformLocation(_id, name.c_str());
-	if (pos == -1) printf("Uniform %s doesn't exist!\n", name.c_str());
-	_umap.insert(make_pair(name, pos));
-	return pos;
+template<typename T>
+bool Shader::isChanged(UniformHandle handle, const T& value)
+{
+	static_assert(sizeof(T) <= sizeof(glm::mat4), "uniform shadows hold a mat4 at most");
+	if (handle < 0) return false;
+	UniformSlot& slot = _slots[handle];
+	if (slot.isSet && memcmp(slot.shadow, &value, sizeof(T)) == 0)
+	{
+		_stats.skipped++;
+		return false;
+	}
+	memcpy(slot.shadow, &value, sizeof(T));
+	slot.isSet = true;
+	_stats.uploads++;
+	enable();
+	return true;
 }
 
-void Shader::uniformMatrix4fv(const std::string& name, glm::mat4 mat)
+void Shader::set(UniformHandle handle, const glm::mat4& mat)
 {
-	this->enable();
-	GLCall(glUniformMatrix4fv(getUniformLocation(name), 1, GL_FALSE, &mat[0][0]));
-	this->disable();
+	if (!isChanged(handle, mat)) return;
+	GLCall(glUniformMatrix4fv(_slots[handle].location, 1, GL_FALSE, &mat[0][0]));
 }
 
-void Shader::uniform4fv(const std::string& name, glm::vec4 vec)
+void Shader::set(UniformHandle handle, const glm::vec4& vec)
 {
-	this->enable();
-	GLCall(glUniform4fv(getUniformLocation(name), 1, &vec.x));
-	this->disable();
+	if (!isChanged(handle, vec)) return;
+	GLCall(glUniform4fv(_slots[handle].location, 1, &vec.x));
 }
 
-void Shader::uniform3fv(const std::string& name, glm::vec3 vec)
+void Shader::set(UniformHandle handle, const glm::vec3& vec)
 {
-	this->enable();
-	GLCall(glUniform3fv(getUniformLocation(name), 1, &vec.x));
-	this->disable();
+	if (!isChanged(handle, vec)) return;
+	GLCall(glUniform3fv(_slots[handle].location, 1, &vec.x));
 }
 
-void Shader::uniform1i(const std::string& name, GLint value)
+void Shader::set(UniformHandle handle, GLint value)
 {
-	this->enable();
-	GLCall(glUniform1i(getUniformLocation(name), value));
-	this->disable();
+	if (!isChanged(handle, value)) return;
+	GLCall(glUniform1i(_slots[handle].location, value));
 }
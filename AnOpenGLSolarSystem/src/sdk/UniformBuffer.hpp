@@ -0,0 +1,95 @@
+#pragma once
+
+#include "Headers.hpp"
+
+#include <cstring>
+
+// binding points of the uniform blocks every program shares, Shader hooks up each block it has by name
+typedef enum
+{
+	FRAME_BLOCK_BINDING = 0,
+	LIGHT_BLOCK_BINDING
+}UniformBlockBinding;
+
+typedef struct
+{
+	const char* name;
+	GLuint binding;
+}UniformBlockName;
+
+inline constexpr UniformBlockName kUniformBlocks[] = { { "Frame", FRAME_BLOCK_BINDING }, { "Light", LIGHT_BLOCK_BINDING } };
+
+// std140 layout of the Frame block in the shaders, vec3s are padded out to vec4s
+typedef struct
+{
+	glm::mat4 view;
+	glm::mat4 projection;
+	// camera relative rendering puts the eye at the origin, w unused
+	glm::vec4 viewPos;
+}FrameBlock;
+
+// std140 layout of the Light block
+typedef struct
+{
+	glm::vec4 lightPos;
+	glm::vec4 lightColor;
+}LightBlock;
+
+// Several uniform blocks in one buffer. Each block sits at an offset the driver accepts for glBindBufferRange
+// and stays bound to its binding point, so writing the blocks and one upload a frame is all that changes them.
+class UniformBuffer
+{
+	NONCOPYABLE(UniformBuffer)
+
+private:
+	GLuint _id;
+	std::vector<size_t> _offsets;
+	std::vector<unsigned char> _staging;
+
+public:
+	// blocks of (binding, size), in the order they're addressed by write
+	UniformBuffer(const std::vector<std::pair<GLuint, size_t>>& blocks);
+	~UniformBuffer();
+
+public:
+	template<typename T>
+	void write(size_t block, const T& value) { memcpy(_staging.data() + _offsets[block], &value, sizeof(T)); };
+
+	// every block to the gpu, orphaning the old storage so draws still reading it aren't waited on
+	void upload() const;
+};
+
+UniformBuffer::UniformBuffer(const std::vector<std::pair<GLuint, size_t>>& blocks)
+{
+	GLint alignment = 256;
+	GLCall(glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment));
+	size_t size = 0;
+	for (auto& block : blocks)
+	{
+		_offsets.push_back(size);
+		size = (size + block.second + alignment - 1) / alignment * alignment;
+	}
+	_staging.resize(size, 0);
+
+	GLCall(glGenBuffers(1, &_id));
+	GLCall(glBindBuffer(GL_UNIFORM_BUFFER, _id));
+	GLCall(glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_DYNAMIC_DRAW));
+	GLCall(glBindBuffer(GL_UNIFORM_BUFFER, 0));
+	for (size_t i = 0; i < blocks.size(); i++)
+	{
+		GLCall(glBindBufferRange(GL_UNIFORM_BUFFER, blocks[i].first, _id, _offsets[i], blocks[i].second));
+	}
+}
+
+UniformBuffer::~UniformBuffer()
+{
+	GLCall(glDeleteBuffers(1, &_id));
+}
+
+void UniformBuffer::upload() const
+{
+	GLCall(glBindBuffer(GL_UNIFORM_BUFFER, _id));
+	GLCall(glBufferData(GL_UNIFORM_BUFFER, _staging.size(), nullptr, GL_DYNAMIC_DRAW));
+	GLCall(glBufferSubData(GL_UNIFORM_BUFFER, 0, _staging.size(), _staging.data()));
+	GLCall(glBindBuffer(GL_UNIFORM_BUFFER, 0));
+}
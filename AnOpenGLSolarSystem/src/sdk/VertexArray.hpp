@@ -13,12 +13,19 @@ private:
 	GLuint _id;
 	VertexBuffer _vbo;
 	IndexBuffer _ibo;
+	// per instance attributes, only for arrays drawn instanced
+	std::unique_ptr<VertexBuffer> _instanceVbo;
+	std::unique_ptr<BufferLayout> _instanceLayout;
+	unsigned int _attributeCount{ 0 };
+
+	void pointInstanceAttributes(size_t first) const;
 
 public:
 	VertexArray(VertexBuffer& vbo, IndexBuffer& ibo, const BufferLayout& layout);
 	~VertexArray();
 	VertexArray(VertexArray&& va) noexcept :
-		_id(va._id), _vbo(std::move(va._vbo)), _ibo(std::move(va._ibo)) {
+		_id(va._id), _vbo(std::move(va._vbo)), _ibo(std::move(va._ibo)), _instanceVbo(std::move(va._instanceVbo)),
+		_instanceLayout(std::move(va._instanceLayout)), _attributeCount(va._attributeCount) {
 		va._id = 0;
 	}
 
@@ -26,6 +33,15 @@ public:
 	void bind() const;
 	void unbind() const;
 	const unsigned int count() const { return _ibo.count(); };
+	const GLuint id() const { return _id; };
+	VertexBuffer& vertexBuffer() { return _vbo; };
+
+	// attributes that advance once an instance instead of once a vertex, at the locations after the per vertex ones
+	void setInstanceBuffer(VertexBuffer& vbo, const BufferLayout& layout);
+	VertexBuffer& instanceBuffer() { return *_instanceVbo; };
+
+	// instance attributes read from instance first on, in place of a base instance where gl has none. the array must be bound
+	void setInstanceOffset(size_t first) const { pointInstanceAttributes(first); };
 };
 
 VertexArray::VertexArray(VertexBuffer& vbo, IndexBuffer& ibo, const BufferLayout& layout) :
@@ -44,9 +60,38 @@ VertexArray::VertexArray(VertexBuffer& vbo, IndexBuffer& ibo, const BufferLayout
 		GLCall(glVertexAttribPointer(i, element.count, element.type, element.normalized, layout.stride(), (const void*)offset));
 		offset += element.count * BufferLayout::getTypeSize(element.type);
 	}
+	_attributeCount = (unsigned int)elements.size();
+	this->unbind();
+}
+
+void VertexArray::setInstanceBuffer(VertexBuffer& vbo, const BufferLayout& layout)
+{
+	_instanceVbo = std::make_unique<VertexBuffer>(std::move(vbo));
+	_instanceLayout = std::make_unique<BufferLayout>(layout);
+	this->bind();
+	for (unsigned int i = 0; i < layout.elements().size(); i++)
+	{
+		GLCall(glEnableVertexAttribArray(_attributeCount + i));
+		GLCall(glVertexAttribDivisor(_attributeCount + i, 1));
+	}
+	pointInstanceAttributes(0);
 	this->unbind();
 }
 
+void VertexArray::pointInstanceAttributes(size_t first) const
+{
+	_instanceVbo->bind();
+	auto& elements = _instanceLayout->elements();
+	size_t offset = first * _instanceLayout->stride();
+	for (int i = 0; i < elements.size(); i++)
+	{
+		auto& element = elements[i];
+		GLCall(glVertexAttribPointer(_attributeCount + i, element.count, element.type, element.normalized, _instanceLayout->stride(), (const void*)offset));
+		offset += element.count * BufferLayout::getTypeSize(element.type);
+	}
+	_instanceVbo->unbind();
+}
+
 VertexArray::~VertexArray()
 {
 	GLCall(glDeleteVertexArrays(1, &_id));
@@ -10,7 +10,7 @@ private:
 	GLuint _id;
 
 public:
-	VertexBuffer(const void* data, const size_t size);
+	VertexBuffer(const void* data, const size_t size, const GLenum usage = GL_STATIC_DRAW);
 	~VertexBuffer();
 	VertexBuffer(VertexBuffer&& vb) noexcept:
 		_id(vb._id) {
@@ -20,13 +20,16 @@ public:
 public:
 	void bind() const;
 	void unbind() const;
+
+	// replace the whole contents, orphaning the old storage so the driver doesn't wait on draws still reading it
+	void update(const void* data, const size_t size, const GLenum usage = GL_STREAM_DRAW);
 };
 
-VertexBuffer::VertexBuffer(const void* data, const size_t size)
+VertexBuffer::VertexBuffer(const void* data, const size_t size, const GLenum usage)
 {
 	GLCall(glGenBuffers(1, &_id));
 	this->bind();
-	glBufferData(GL_ARRAY_BUFFER, size, data, GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, size, data, usage);
 	this->unbind();
 }
 
@@ -43,4 +46,12 @@ void VertexBuffer::bind() const
 void VertexBuffer::unbind() const
 {
 	GLCall(glBindBuffer(GL_ARRAY_BUFFER, 0));
-}
\ No newline at end of file
+}
+
+void VertexBuffer::update(const void* data, const size_t size, const GLenum usage)
+{
+	this->bind();
+	GLCall(glBufferData(GL_ARRAY_BUFFER, size, nullptr, usage));
+	GLCall(glBufferSubData(GL_ARRAY_BUFFER, 0, size, data));
+	this->unbind();
+}
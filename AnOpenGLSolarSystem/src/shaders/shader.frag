@@ -3,11 +3,20 @@
 out vec4 color;
 in vec3 o_normal;
 in vec3 o_fragPos;
+in vec4 o_color;
 
-uniform vec4 u_color;
-uniform vec3 u_lightColor;
-uniform vec3 u_lightPos;
-uniform vec3 u_viewPos;
+layout(std140) uniform Frame
+{
+    mat4 u_view;
+    mat4 u_projection;
+    vec4 u_viewPos;
+};
+
+layout(std140) uniform Light
+{
+    vec4 u_lightPos;
+    vec4 u_lightColor;
+};
 
 uniform int u_shouldEnableLighting;
 
@@ -23,7 +32,7 @@ void main()
 {
 	if(u_shouldEnableLighting == 0) 
 	{
-		color = u_color;
+		color = o_color;
 		return;
 	}
 
@@ -34,20 +43,20 @@ void main()
 	material.shininess = 32.0;
 
 	// ambient light
-	vec3 ambient = u_lightColor * material.ambient;
+	vec3 ambient = u_lightColor.rgb * material.ambient;
 
 	// diffuse light
 	vec3 norm = normalize(o_normal);
-	vec3 lightDir = normalize(u_lightPos - o_fragPos);
+	vec3 lightDir = normalize(u_lightPos.xyz - o_fragPos);
 	float diff = max(dot(norm, lightDir), 0.0);
-	vec3 diffuse = u_lightColor * (diff * material.diffuse);
+	vec3 diffuse = u_lightColor.rgb * (diff * material.diffuse);
 
 	// specular light
-	vec3 viewDir = normalize(u_viewPos - o_fragPos);
+	vec3 viewDir = normalize(u_viewPos.xyz - o_fragPos);
 	vec3 reflectDir = reflect(-lightDir, norm);
 	float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-	vec3 specular = u_lightColor * (spec * material.specular);
+	vec3 specular = u_lightColor.rgb * (spec * material.specular);
 
-	vec3 result = (ambient + diffuse + specular) * u_color.xyz;
+	vec3 result = (ambient + diffuse + specular) * o_color.xyz;
 	color = vec4(result, 1.0);
 }
\ No newline at end of file
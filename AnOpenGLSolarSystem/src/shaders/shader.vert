@@ -2,17 +2,41 @@
 
 layout(location = 0) in vec3 pos;
 layout(location = 1) in vec3 normal;
+// per instance, for instanced draws only
+layout(location = 2) in vec3 instanceOffset;
+layout(location = 3) in vec3 instanceScale;
+layout(location = 4) in vec4 instanceColor;
+
+layout(std140) uniform Frame
+{
+    mat4 u_view;
+    mat4 u_projection;
+    vec4 u_viewPos;
+};
 
 uniform mat4 u_model;
-uniform mat4 u_view;
-uniform mat4 u_projection;
+uniform vec4 u_color;
+uniform int u_isInstanced;
 
 out vec3 o_normal;
 out vec3 o_fragPos;
+out vec4 o_color;
 
 void main()
 {
+    if(u_isInstanced == 1)
+    {
+        // scale then translate, so the normal only needs the inverse scale
+        vec3 worldPos = pos * instanceScale + instanceOffset;
+        gl_Position = u_projection * u_view * vec4(worldPos, 1.0);
+        o_normal = normal / instanceScale;
+        o_fragPos = worldPos;
+        o_color = instanceColor;
+        return;
+    }
+
     gl_Position = u_projection * u_view * u_model * vec4(pos, 1.0);
     o_normal = mat3(transpose(inverse(u_model))) * normal;
     o_fragPos = vec3(u_model * vec4(pos, 1.0));
+    o_color = u_color;
 }
\ No newline at end of file
@@ -0,0 +1,304 @@
+#pragma once
+
+#include "Common.hpp"
+#include "BodyArrays.hpp"
+#include "Reduction.hpp"
+
+typedef struct
+{
+	// monopole
+	double x, y, z;
+	double mass;
+
+	// cell geometry
+	double cx, cy, cz;
+	double halfSize;
+
+	// bodies covered, as a range of the morton sorted arrays
+	uint32_t first;
+	uint32_t count;
+
+	// node index right after this node's subtree, children directly follow their parent
+	uint32_t next;
+	uint32_t isLeaf;
+}OctreeNode;
+
+// O(N log N) Barnes-Hut gravity. Bodies are sorted along a 63 bit morton curve and the octree is
+// rebuilt top-down from the sorted codes every step. Nodes are stored in depth first order, which
+// is morton order too, so a walk never needs a stack: descend with +1 or skip a subtree with next.
+class BarnesHut
+{
+	NONCOPYABLE(BarnesHut)
+
+private:
+	double _theta{ 0.5 };
+	uint32_t _leafSize{ 8 };
+
+	std::vector<OctreeNode> _nodes;
+
+	// bodies in morton order
+	AlignedVector<double> _sx, _sy, _sz, _sm;
+	std::vector<uint32_t> _order;
+	std::vector<uint32_t> _rank;
+	std::vector<uint64_t> _codes;
+
+	// radix sort scratch
+	std::vector<uint64_t> _codesTmp;
+	std::vector<uint32_t> _orderTmp;
+
+public:
+	BarnesHut() = default;
+	~BarnesHut() = default;
+
+	// sort the bodies and rebuild the tree over their current positions
+	void build(const BodyArrays& bodies);
+
+	// accelerations of the bodies at morton ranks [begin, end), written to their original slots in ax/ay/az.
+	// ranks rather than body indices, so a contiguous chunk is spatially coherent.
+	// compensated sums carry the rounding error of every cell and body along.
+	void evaluate(BodyArrays& bodies, double G, double softening, size_t begin, size_t end, bool isCompensated = false) const;
+
+	// accelerations of just the listed bodies, by original body index
+	void evaluateBodies(BodyArrays& bodies, double G, double softening, const uint32_t* indices, size_t count, bool isCompensated = false) const;
+
+	// opening angle: a cell of width s at distance d is used as a point mass when s / d < theta
+	void setOpeningAngle(double theta) { _theta = theta < 0.0 ? 0.0 : theta; };
+
+	void setLeafSize(uint32_t leafSize) { _leafSize = leafSize < 1 ? 1 : leafSize; };
+
+	const double openingAngle() const { return _theta; };
+
+	const size_t nodeCount() const { return _nodes.size(); };
+
+	const size_t bodyCount() const { return _order.size(); };
+
+	// original body index of the body at a morton rank
+	const uint32_t bodyAt(size_t rank) const { return _order[rank]; };
+
+	static uint64_t mortonEncode(uint32_t x, uint32_t y, uint32_t z);
+
+private:
+	void sortByCode();
+
+	uint32_t buildNode(uint32_t first, uint32_t last, int level, glm::dvec3 cellMin, double cellSize);
+
+	// tree walk for the body at morton rank k, without the factor G. Sum is PlainSum or CompensatedSum
+	template<typename Sum>
+	glm::dvec3 accelerationAt(size_t k, double eps2, double theta2) const;
+
+	static uint64_t expandBits(uint64_t v);
+};
+
+// spread the low 21 bits of v so there are two zero bits between each of them
+uint64_t BarnesHut::expandBits(uint64_t v)
+{
+	v &= 0x1fffff;
+	v = (v | v << 32) & 0x1f00000000ffffull;
+	v = (v | v << 16) & 0x1f0000ff0000ffull;
+	v = (v | v << 8) & 0x100f00f00f00f00full;
+	v = (v | v << 4) & 0x10c30c30c30c30c3ull;
+	v = (v | v << 2) & 0x1249249249249249ull;
+	return v;
+}
+
+uint64_t BarnesHut::mortonEncode(uint32_t x, uint32_t y, uint32_t z)
+{
+	return expandBits(x) << 2 | expandBits(y) << 1 | expandBits(z);
+}
+
+void BarnesHut::build(const BodyArrays& bodies)
+{
+	const size_t n = bodies.size();
+	_nodes.clear();
+	_order.resize(n);
+	_codes.resize(n);
+	if (n == 0) return;
+
+	// root cube
+	glm::dvec3 lo = bodies.position(0), hi = lo;
+	for (size_t i = 1; i < n; i++)
+	{
+		glm::dvec3 p = bodies.position(i);
+		lo = glm::min(lo, p);
+		hi = glm::max(hi, p);
+	}
+	double size = glm::max(hi.x - lo.x, glm::max(hi.y - lo.y, hi.z - lo.z));
+	size = size > 0.0 ? size * (1.0 + 1e-9) : 1.0;
+
+	const double cells = (double)(1u << 21);
+	const double scale = cells / size;
+	for (size_t i = 0; i < n; i++)
+	{
+		uint32_t x = (uint32_t)glm::min((bodies.px[i] - lo.x) * scale, cells - 1.0);
+		uint32_t y = (uint32_t)glm::min((bodies.py[i] - lo.y) * scale, cells - 1.0);
+		uint32_t z = (uint32_t)glm::min((bodies.pz[i] - lo.z) * scale, cells - 1.0);
+		_codes[i] = mortonEncode(x, y, z);
+		_order[i] = (uint32_t)i;
+	}
+	sortByCode();
+
+	_sx.resize(n); _sy.resize(n); _sz.resize(n); _sm.resize(n);
+	_rank.resize(n);
+	for (size_t k = 0; k < n; k++)
+	{
+		uint32_t i = _order[k];
+		_rank[i] = (uint32_t)k;
+		_sx[k] = bodies.px[i]; _sy[k] = bodies.py[i]; _sz[k] = bodies.pz[i]; _sm[k] = bodies.mass[i];
+	}
+
+	_nodes.reserve(n / _leafSize * 2 + 64);
+	buildNode(0, (uint32_t)n, 0, lo, size);
+}
+
+// lsd radix sort of (code, index) pairs, 11 bits per pass over the 63 bit codes
+void BarnesHut::sortByCode()
+{
+	const size_t n = _codes.size();
+	_codesTmp.resize(n);
+	_orderTmp.resize(n);
+
+	const int bits = 11, buckets = 1 << bits;
+	std::vector<uint32_t> histogram(buckets);
+	for (int shift = 0; shift < 63; shift += bits)
+	{
+		std::fill(histogram.begin(), histogram.end(), 0);
+		for (size_t i = 0; i < n; i++) histogram[(_codes[i] >> shift) & (buckets - 1)]++;
+
+		uint32_t sum = 0;
+		for (auto& count : histogram)
+		{
+			uint32_t c = count;
+			count = sum;
+			sum += c;
+		}
+
+		for (size_t i = 0; i < n; i++)
+		{
+			uint32_t dst = histogram[(_codes[i] >> shift) & (buckets - 1)]++;
+			_codesTmp[dst] = _codes[i];
+			_orderTmp[dst] = _order[i];
+		}
+		_codes.swap(_codesTmp);
+		_order.swap(_orderTmp);
+	}
+}
+
+uint32_t BarnesHut::buildNode(uint32_t first, uint32_t last, int level, glm::dvec3 cellMin, double cellSize)
+{
+	uint32_t index = (uint32_t)_nodes.size();
+	_nodes.push_back({});
+
+	double halfSize = 0.5 * cellSize;
+	glm::dvec3 com = { 0.0, 0.0, 0.0 };
+	double mass = 0.0;
+	bool isLeaf = last - first <= _leafSize || level == 21;
+
+	if (isLeaf)
+	{
+		for (uint32_t k = first; k < last; k++)
+		{
+			com += _sm[k] * glm::dvec3(_sx[k], _sy[k], _sz[k]);
+			mass += _sm[k];
+		}
+	}
+	else
+	{
+		// the codes in this range share every bit above shift, so the octant digit is sorted too
+		const int shift = 3 * (20 - level);
+		uint32_t begin = first;
+		for (uint64_t octant = 0; octant < 8 && begin < last; octant++)
+		{
+			uint32_t end = (uint32_t)(std::upper_bound(_codes.begin() + begin, _codes.begin() + last, octant,
+				[shift](uint64_t value, uint64_t code) { return value < ((code >> shift) & 7); }) - _codes.begin());
+			if (end == begin) continue;
+
+			glm::dvec3 childMin = cellMin + halfSize * glm::dvec3((octant >> 2) & 1, (octant >> 1) & 1, octant & 1);
+			uint32_t child = buildNode(begin, end, level + 1, childMin, halfSize);
+			com += _nodes[child].mass * glm::dvec3(_nodes[child].x, _nodes[child].y, _nodes[child].z);
+			mass += _nodes[child].mass;
+			begin = end;
+		}
+	}
+
+	if (mass > 0.0) com /= mass;
+	else com = cellMin + glm::dvec3(halfSize);
+
+	OctreeNode& node = _nodes[index];
+	node.x = com.x; node.y = com.y; node.z = com.z;
+	node.mass = mass;
+	node.cx = cellMin.x + halfSize; node.cy = cellMin.y + halfSize; node.cz = cellMin.z + halfSize;
+	node.halfSize = halfSize;
+	node.first = first;
+	node.count = last - first;
+	node.next = (uint32_t)_nodes.size();
+	node.isLeaf = isLeaf;
+	return index;
+}
+
+void BarnesHut::evaluate(BodyArrays& bodies, double G, double softening, size_t begin, size_t end, bool isCompensated) const
+{
+	const double eps2 = softening * softening;
+	const double theta2 = _theta * _theta;
+	for (size_t k = begin; k < end; k++)
+	{
+		glm::dvec3 a = G * (isCompensated ? accelerationAt<CompensatedSum>(k, eps2, theta2) : accelerationAt<PlainSum>(k, eps2, theta2));
+		uint32_t body = _order[k];
+		bodies.ax[body] = a.x; bodies.ay[body] = a.y; bodies.az[body] = a.z;
+	}
+}
+
+void BarnesHut::evaluateBodies(BodyArrays& bodies, double G, double softening, const uint32_t* indices, size_t count, bool isCompensated) const
+{
+	const double eps2 = softening * softening;
+	const double theta2 = _theta * _theta;
+	for (size_t c = 0; c < count; c++)
+	{
+		uint32_t body = indices[c];
+		size_t k = _rank[body];
+		glm::dvec3 a = G * (isCompensated ? accelerationAt<CompensatedSum>(k, eps2, theta2) : accelerationAt<PlainSum>(k, eps2, theta2));
+		bodies.ax[body] = a.x; bodies.ay[body] = a.y; bodies.az[body] = a.z;
+	}
+}
+
+template<typename Sum>
+glm::dvec3 BarnesHut::accelerationAt(size_t k, double eps2, double theta2) const
+{
+	const uint32_t nodeCount = (uint32_t)_nodes.size();
+	const OctreeNode* nodes = _nodes.data();
+	const double x = _sx[k], y = _sy[k], z = _sz[k];
+	Sum ax, ay, az;
+
+	uint32_t i = 0;
+	while (i < nodeCount)
+	{
+		const OctreeNode& node = nodes[i];
+		double dx = node.x - x, dy = node.y - y, dz = node.z - z;
+		double r2 = dx * dx + dy * dy + dz * dz;
+		double width = 2.0 * node.halfSize;
+
+		// never approximate a cell we're sitting in, its monopole can be arbitrarily close
+		bool isInside = std::abs(x - node.cx) <= node.halfSize && std::abs(y - node.cy) <= node.halfSize && std::abs(z - node.cz) <= node.halfSize;
+		if (!isInside && width * width < theta2 * r2)
+		{
+			double r2e = r2 + eps2;
+			double s = node.mass / (r2e * std::sqrt(r2e));
+			ax.add(s * dx); ay.add(s * dy); az.add(s * dz);
+			i = node.next;
+		}
+		else if (node.isLeaf)
+		{
+			for (uint32_t j = node.first; j < node.first + node.count; j++)
+			{
+				double ddx = _sx[j] - x, ddy = _sy[j] - y, ddz = _sz[j] - z;
+				double rr2 = ddx * ddx + ddy * ddy + ddz * ddz + eps2;
+				if (rr2 <= 0.0) continue;
+				double s = _sm[j] / (rr2 * std::sqrt(rr2));
+				ax.add(s * ddx); ay.add(s * ddy); az.add(s * ddz);
+			}
+			i = node.next;
+		}
+		else i++;
+	}
+
+	return { ax.value(), ay.value(), az.value() };
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include "Common.hpp"
+
+#include <cstdlib>
+#include <new>
+
+// minimal allocator handing out 64 byte aligned storage, so SIMD kernels can stream the arrays
+template<typename T>
+class AlignedAllocator
+{
+public:
+	using value_type = T;
+
+	static constexpr size_t alignment = 64;
+
+	AlignedAllocator() = default;
+
+	template<typename U>
+	AlignedAllocator(const AlignedAllocator<U>&) noexcept {}
+
+	template<typename U>
+	struct rebind { using other = AlignedAllocator<U>; };
+
+	T* allocate(size_t n)
+	{
+		size_t bytes = (n * sizeof(T) + alignment - 1) / alignment * alignment;
+#ifdef _MSC_VER
+		void* p = _aligned_malloc(bytes, alignment);
+#else
+		void* p = std::aligned_alloc(alignment, bytes);
+#endif
+		if (p == nullptr) throw std::bad_alloc();
+		return static_cast<T*>(p);
+	}
+
+	void deallocate(T* p, size_t) noexcept
+	{
+#ifdef _MSC_VER
+		_aligned_free(p);
+#else
+		std::free(p);
+#endif
+	}
+
+	template<typename U>
+	bool operator==(const AlignedAllocator<U>&) const noexcept { return true; }
+
+	template<typename U>
+	bool operator!=(const AlignedAllocator<U>&) const noexcept { return false; }
+};
+
+template<typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+// Structure-of-arrays body state. Every component lives in its own contiguous array so the
+// force kernels can load 4 bodies at a time; glm types only show up in the accessors.
+class BodyArrays
+{
+public:
+	AlignedVector<double> px, py, pz;
+	AlignedVector<double> vx, vy, vz;
+	AlignedVector<double> ax, ay, az;
+	AlignedVector<double> mass;
+	// collision radius, 0 for bodies that never collide
+	AlignedVector<double> radius;
+
+public:
+	BodyArrays() = default;
+	~BodyArrays() = default;
+
+	size_t push(glm::dvec3 pos, glm::dvec3 vel, double m, double r = 0.0);
+
+	// move the last body into slot i and drop the last slot
+	void swapRemove(size_t i);
+
+	void reserve(size_t n);
+
+	void clear();
+
+	const size_t size() const { return mass.size(); };
+
+	const glm::dvec3 position(size_t i) const { return { px[i], py[i], pz[i] }; };
+
+	const glm::dvec3 velocity(size_t i) const { return { vx[i], vy[i], vz[i] }; };
+
+	const glm::dvec3 acceleration(size_t i) const { return { ax[i], ay[i], az[i] }; };
+
+	void setPosition(size_t i, glm::dvec3 pos) { px[i] = pos.x; py[i] = pos.y; pz[i] = pos.z; };
+
+	void setVelocity(size_t i, glm::dvec3 vel) { vx[i] = vel.x; vy[i] = vel.y; vz[i] = vel.z; };
+};
+
+size_t BodyArrays::push(glm::dvec3 pos, glm::dvec3 vel, double m, double r)
+{
+	px.push_back(pos.x); py.push_back(pos.y); pz.push_back(pos.z);
+	vx.push_back(vel.x); vy.push_back(vel.y); vz.push_back(vel.z);
+	ax.push_back(0.0); ay.push_back(0.0); az.push_back(0.0);
+	mass.push_back(m);
+	radius.push_back(r);
+	return mass.size() - 1;
+}
+
+void BodyArrays::swapRemove(size_t i)
+{
+	for (auto* v : { &px, &py, &pz, &vx, &vy, &vz, &ax, &ay, &az, &mass, &radius })
+	{
+		(*v)[i] = v->back();
+		v->pop_back();
+	}
+}
+
+void BodyArrays::reserve(size_t n)
+{
+	for (auto* v : { &px, &py, &pz, &vx, &vy, &vz, &ax, &ay, &az, &mass, &radius }) v->reserve(n);
+}
+
+void BodyArrays::clear()
+{
+	for (auto* v : { &px, &py, &pz, &vx, &vy, &vz, &ax, &ay, &az, &mass, &radius }) v->clear();
+}
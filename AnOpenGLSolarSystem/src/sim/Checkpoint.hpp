@@ -0,0 +1,518 @@
+#pragma once
+
+#include "Common.hpp"
+#include "Simulation.hpp"
+#include "MappedFile.hpp"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+inline constexpr char kCheckpointMagic[8] = { 'S', 'S', 'C', 'H', 'K', 'P', 'T', '\0' };
+// version 1 kept e and the orbit axes in float, they are widened on restore
+inline constexpr uint32_t kCheckpointVersion = 2;
+
+// written as is, a file from a big-endian machine reads back as 0x04030201
+inline constexpr uint32_t kCheckpointByteOrder = 0x01020304;
+
+// every section starts on a cache line, so the arrays can be used straight from the mapping
+inline constexpr uint64_t kCheckpointAlignment = 64;
+
+enum class CheckpointSectionId : uint32_t
+{
+	// one CheckpointBody per body
+	BODIES = 1,
+	// every name, back to back without terminators
+	STRINGS,
+	// index is the BodyArrays member: px py pz vx vy vz ax ay az mass radius, doubles
+	BODY_ARRAY,
+	// index is the KeplerOrbits member: mean anomaly, mean motion, e px py pz qx qy qz, doubles
+	ORBIT_ARRAY,
+	// Integrator::saveState, doubles
+	INTEGRATOR,
+	// one CheckpointParticles per belt or ring
+	PARTICLE_SYSTEMS,
+	// index is system * 6 + member: px py pz vx vy vz, floats
+	PARTICLE_ARRAY,
+	// one CheckpointAppearance per body, only there when whoever saved knew how the bodies are drawn
+	APPEARANCE
+};
+
+typedef enum
+{
+	CHECKPOINT_COLLISIONS = 1 << 0,
+	CHECKPOINT_PARTICLE_COLLISIONS = 1 << 1,
+	CHECKPOINT_RAILS_FALLBACK = 1 << 2,
+	CHECKPOINT_PAUSED = 1 << 3,
+	CHECKPOINT_COMPENSATED = 1 << 4
+}CheckpointFlags;
+
+typedef enum
+{
+	// drawn as a point, with no planet or trail of its own
+	CHECKPOINT_BODY_MINOR = 1 << 0
+}CheckpointBodyFlags;
+
+// all fields little-endian and naturally aligned, no padding anywhere
+typedef struct
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t byteOrder;
+	uint64_t fileSize;
+	uint32_t sectionCount;
+	uint32_t bodyCount;
+	uint32_t particleSystemCount;
+	uint32_t mode;
+	uint32_t solver;
+	uint32_t integrator;
+	uint32_t flags;
+	uint32_t reserved;
+	uint64_t steps;
+	uint64_t mergeCount;
+	double time;
+	double dt;
+	double timeScale;
+	double accumulator;
+	double softening;
+	double openingAngle;
+	double stepBudget;
+}CheckpointHeader;
+
+// the header is followed by sectionCount of these, offsets are from the start of the file
+typedef struct
+{
+	uint32_t id;
+	uint32_t index;
+	uint64_t offset;
+	uint64_t bytes;
+}CheckpointSection;
+
+typedef struct
+{
+	uint64_t nameOffset;
+	uint64_t centerNameOffset;
+	uint32_t nameLength;
+	uint32_t centerNameLength;
+	int32_t parent;
+	float eccentricity;
+	float focalDistance;
+	uint32_t reserved;
+}CheckpointBody;
+
+typedef struct
+{
+	uint64_t count;
+	uint64_t nameOffset;
+	uint32_t nameLength;
+	int32_t center;
+	float particleRadius;
+	float restitution;
+	uint32_t isSelfInteraction;
+	uint32_t reserved;
+}CheckpointParticles;
+
+typedef struct
+{
+	float color[4];
+	float scale[3];
+	uint32_t flags;
+}CheckpointAppearance;
+
+static_assert(sizeof(CheckpointHeader) == 128 && sizeof(CheckpointSection) == 24 && sizeof(CheckpointBody) == 40 &&
+	sizeof(CheckpointParticles) == 40 && sizeof(CheckpointAppearance) == 32, "checkpoint records must not pick up padding");
+
+// Checkpoint and restart of a whole Simulation: bodies, hierarchy, rails orbits, integrator state, clock,
+// settings, belts and rings. The file is a header, a section table and the SoA arrays exactly as they sit in
+// memory, so opening one is a mmap and a bounds check, every array is usable in place from the mapping,
+// and restoring is a bulk copy per array with no parsing. Body names are the exception, each becomes a string of
+// its own, so restoring stays linear in the body count (about 0.3 s a million bodies). A restored run continues
+// bit for bit.
+class Checkpoint
+{
+	NONCOPYABLE(Checkpoint)
+
+private:
+	MappedFile _file;
+
+	const CheckpointHeader* _header{ nullptr };
+
+	const CheckpointSection* _sections{ nullptr };
+
+public:
+	Checkpoint() = default;
+	~Checkpoint() = default;
+
+	// replaces path only once the whole file is written. appearance is left out unless it has a record for every body
+	static bool save(const Simulation& sim, const std::string& path, const std::vector<CheckpointAppearance>& appearance = {});
+
+	// map path and check its header and section table, nothing is read beyond those
+	bool open(const std::string& path);
+
+	void close();
+
+	// replace everything in sim with the checkpoint, sim is left untouched if the file doesn't hold together.
+	// The thread count and the body removed callback are sim's own and stay
+	bool restore(Simulation& sim) const;
+
+	const bool isOpen() const { return _header != nullptr; };
+
+	const CheckpointHeader& header() const { return *_header; };
+
+	// a section's elements in place in the mapping, nullptr if there is no such section or it doesn't divide into T
+	template<typename T>
+	const T* section(CheckpointSectionId id, uint32_t index = 0, size_t* count = nullptr) const;
+
+	// in place readers, for looking into a checkpoint without restoring it
+	const std::string name(size_t body) const;
+
+	const glm::dvec3 position(size_t body) const;
+
+	// how every body is drawn, nullptr if the checkpoint was saved without it
+	const CheckpointAppearance* appearance() const;
+
+private:
+	const std::string string(uint64_t offset, uint32_t length) const;
+};
+
+bool Checkpoint::save(const Simulation& sim, const std::string& path, const std::vector<CheckpointAppearance>& appearance)
+{
+	typedef struct
+	{
+		CheckpointSectionId id;
+		uint32_t index;
+		const void* data;
+		uint64_t bytes;
+	}Pending;
+	std::vector<Pending> pending;
+	auto add = [&](CheckpointSectionId id, uint32_t index, const void* data, uint64_t bytes) { pending.push_back({ id, index, data, bytes }); };
+
+	const size_t n = sim.bodyCount();
+	std::string strings;
+	auto addString = [&](const std::string& s) { uint64_t offset = strings.size(); strings += s; return offset; };
+
+	std::vector<CheckpointBody> bodies(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		const Body& body = sim._bodies[i];
+		CheckpointBody& record = bodies[i];
+		record.nameOffset = addString(body.name);
+		record.nameLength = (uint32_t)body.name.size();
+		record.centerNameOffset = addString(body.centerName);
+		record.centerNameLength = (uint32_t)body.centerName.size();
+		record.parent = sim._parents[i];
+		record.eccentricity = body.eccentricity;
+		record.focalDistance = body.focalDistance;
+	}
+	add(CheckpointSectionId::BODIES, 0, bodies.data(), n * sizeof(CheckpointBody));
+
+	const BodyArrays& state = sim._state;
+	const AlignedVector<double>* bodyArrays[] = { &state.px, &state.py, &state.pz, &state.vx, &state.vy, &state.vz,
+		&state.ax, &state.ay, &state.az, &state.mass, &state.radius };
+	for (uint32_t k = 0; k < 11; k++) add(CheckpointSectionId::BODY_ARRAY, k, bodyArrays[k]->data(), n * sizeof(double));
+
+	const KeplerOrbits& orbits = sim._orbits;
+	const AlignedVector<double>* orbitArrays[] = { &orbits._meanAnomaly, &orbits._meanMotion, &orbits._e, &orbits._px, &orbits._py, &orbits._pz,
+		&orbits._qx, &orbits._qy, &orbits._qz };
+	for (uint32_t k = 0; k < 9; k++) add(CheckpointSectionId::ORBIT_ARRAY, k, orbitArrays[k]->data(), n * sizeof(double));
+
+	std::vector<double> integrator;
+	sim._integrator->saveState(integrator);
+	add(CheckpointSectionId::INTEGRATOR, 0, integrator.data(), integrator.size() * sizeof(double));
+
+	std::vector<CheckpointParticles> systems(sim._particleSystems.size());
+	for (size_t s = 0; s < systems.size(); s++)
+	{
+		const ParticleSystem& particles = *sim._particleSystems[s];
+		CheckpointParticles& record = systems[s];
+		record.count = particles.size();
+		record.nameOffset = addString(particles._name);
+		record.nameLength = (uint32_t)particles._name.size();
+		record.center = particles._center;
+		record.particleRadius = particles._particleRadius;
+		record.restitution = particles._restitution;
+		record.isSelfInteraction = particles._isSelfInteraction ? 1 : 0;
+		const AlignedVector<float>* arrays[] = { &particles._px, &particles._py, &particles._pz, &particles._vx, &particles._vy, &particles._vz };
+		for (uint32_t k = 0; k < 6; k++) add(CheckpointSectionId::PARTICLE_ARRAY, (uint32_t)s * 6 + k, arrays[k]->data(), record.count * sizeof(float));
+	}
+	add(CheckpointSectionId::PARTICLE_SYSTEMS, 0, systems.data(), systems.size() * sizeof(CheckpointParticles));
+	if (appearance.size() == n) add(CheckpointSectionId::APPEARANCE, 0, appearance.data(), n * sizeof(CheckpointAppearance));
+
+	// every name is in by now, so the string data no longer moves
+	add(CheckpointSectionId::STRINGS, 0, strings.data(), strings.size());
+
+	CheckpointHeader header{};
+	memcpy(header.magic, kCheckpointMagic, sizeof(header.magic));
+	header.version = kCheckpointVersion;
+	header.byteOrder = kCheckpointByteOrder;
+	header.sectionCount = (uint32_t)pending.size();
+	header.bodyCount = (uint32_t)n;
+	header.particleSystemCount = (uint32_t)systems.size();
+	header.mode = (uint32_t)sim._mode;
+	header.solver = (uint32_t)sim._solver;
+	header.integrator = (uint32_t)sim._integratorType;
+	header.flags = (sim._isCollisionEnabled ? CHECKPOINT_COLLISIONS : 0) | (sim._isRailsFallback ? CHECKPOINT_RAILS_FALLBACK : 0) |
+		(sim._clock._isPaused ? CHECKPOINT_PAUSED : 0) | (sim._isCompensated ? CHECKPOINT_COMPENSATED : 0);
+	for (auto& particles : sim._particleSystems) if (particles->isSelfInteraction()) header.flags |= CHECKPOINT_PARTICLE_COLLISIONS;
+	header.steps = sim._clock._steps;
+	header.mergeCount = sim._mergeCount;
+	header.time = sim._clock._time;
+	header.dt = sim._clock._dt;
+	header.timeScale = sim._clock._timeScale;
+	header.accumulator = sim._clock._accumulator;
+	header.softening = sim._softening;
+	header.openingAngle = sim._barnesHut.openingAngle();
+	header.stepBudget = sim._stepBudget;
+
+	auto align = [](uint64_t offset) { return (offset + kCheckpointAlignment - 1) / kCheckpointAlignment * kCheckpointAlignment; };
+	std::vector<CheckpointSection> table;
+	uint64_t offset = align(sizeof(CheckpointHeader) + pending.size() * sizeof(CheckpointSection));
+	for (const Pending& section : pending)
+	{
+		table.push_back({ (uint32_t)section.id, section.index, offset, section.bytes });
+		offset = align(offset + section.bytes);
+	}
+	header.fileSize = offset;
+
+	// written aside and renamed over, a save that dies half way leaves the last good checkpoint where it was
+	const std::string partial = path + ".partial";
+	std::error_code error;
+	{
+		std::ofstream ofs(partial, std::ios::binary | std::ios::trunc);
+		if (!ofs) return false;
+		ofs.write((const char*)&header, sizeof(header));
+		ofs.write((const char*)table.data(), table.size() * sizeof(CheckpointSection));
+		const char zeros[kCheckpointAlignment] = {};
+		for (size_t s = 0; s < pending.size(); s++)
+		{
+			ofs.write(zeros, table[s].offset - (uint64_t)ofs.tellp());
+			ofs.write((const char*)pending[s].data, pending[s].bytes);
+		}
+		ofs.write(zeros, header.fileSize - (uint64_t)ofs.tellp());
+		ofs.flush();
+		if (!ofs.good())
+		{
+			ofs.close();
+			std::filesystem::remove(partial, error);
+			return false;
+		}
+	}
+	std::filesystem::rename(partial, path, error);
+	if (!error) return true;
+	std::filesystem::remove(partial, error);
+	return false;
+}
+
+bool Checkpoint::open(const std::string& path)
+{
+	close();
+	if (!_file.open(path)) return false;
+
+	const uint8_t* data = _file.data();
+	const uint64_t size = _file.size();
+	const CheckpointHeader* header = (const CheckpointHeader*)data;
+	bool isValid = size >= sizeof(CheckpointHeader) && memcmp(header->magic, kCheckpointMagic, sizeof(header->magic)) == 0 &&
+		header->byteOrder == kCheckpointByteOrder && (header->version == 1 || header->version == kCheckpointVersion) && header->fileSize == size &&
+		sizeof(CheckpointHeader) + (uint64_t)header->sectionCount * sizeof(CheckpointSection) <= size;
+
+	const CheckpointSection* sections = (const CheckpointSection*)(data + sizeof(CheckpointHeader));
+	for (uint32_t s = 0; isValid && s < header->sectionCount; s++)
+		isValid = sections[s].offset % kCheckpointAlignment == 0 && sections[s].offset <= size && sections[s].bytes <= size - sections[s].offset;
+
+	if (!isValid)
+	{
+		_file.close();
+		return false;
+	}
+	_header = header;
+	_sections = sections;
+	return true;
+}
+
+void Checkpoint::close()
+{
+	_header = nullptr;
+	_sections = nullptr;
+	_file.close();
+}
+
+template<typename T>
+const T* Checkpoint::section(CheckpointSectionId id, uint32_t index, size_t* count) const
+{
+	if (count) *count = 0;
+	if (!_header) return nullptr;
+	for (uint32_t s = 0; s < _header->sectionCount; s++)
+	{
+		const CheckpointSection& section = _sections[s];
+		if (section.id != (uint32_t)id || section.index != index) continue;
+		if (section.bytes % sizeof(T) != 0) return nullptr;
+		if (count) *count = (size_t)(section.bytes / sizeof(T));
+		return (const T*)(_file.data() + section.offset);
+	}
+	return nullptr;
+}
+
+const std::string Checkpoint::string(uint64_t offset, uint32_t length) const
+{
+	size_t size;
+	const char* strings = section<char>(CheckpointSectionId::STRINGS, 0, &size);
+	if (!strings || offset > size || length > size - offset) return {};
+	return std::string(strings + offset, length);
+}
+
+const std::string Checkpoint::name(size_t body) const
+{
+	const CheckpointBody& record = section<CheckpointBody>(CheckpointSectionId::BODIES)[body];
+	return string(record.nameOffset, record.nameLength);
+}
+
+const glm::dvec3 Checkpoint::position(size_t body) const
+{
+	return { section<double>(CheckpointSectionId::BODY_ARRAY, 0)[body], section<double>(CheckpointSectionId::BODY_ARRAY, 1)[body],
+		section<double>(CheckpointSectionId::BODY_ARRAY, 2)[body] };
+}
+
+const CheckpointAppearance* Checkpoint::appearance() const
+{
+	size_t count;
+	const CheckpointAppearance* records = section<CheckpointAppearance>(CheckpointSectionId::APPEARANCE, 0, &count);
+	return records && count == _header->bodyCount ? records : nullptr;
+}
+
+bool Checkpoint::restore(Simulation& sim) const
+{
+	if (!_header) return false;
+	const CheckpointHeader& header = *_header;
+	const size_t n = header.bodyCount;
+
+	// everything is checked before sim changes at all
+	size_t count, stringBytes;
+	const CheckpointBody* bodies = section<CheckpointBody>(CheckpointSectionId::BODIES, 0, &count);
+	if (!bodies || count != n || !section<char>(CheckpointSectionId::STRINGS, 0, &stringBytes)) return false;
+	for (size_t i = 0; i < n; i++)
+	{
+		const CheckpointBody& record = bodies[i];
+		if (record.parent < -1 || record.parent >= (int32_t)n || record.nameOffset + record.nameLength > stringBytes ||
+			record.centerNameOffset + record.centerNameLength > stringBytes) return false;
+	}
+	// a body can't be its own ancestor, the update order would never finish its chain. each chain is walked once:
+	// 1 marks bodies on the chain being walked, reaching one again is a cycle, 2 marks chains that end in a root
+	std::vector<uint8_t> marks(n, 0);
+	for (size_t i = 0; i < n; i++)
+	{
+		int body = (int)i;
+		while (body != -1 && marks[body] == 0)
+		{
+			marks[body] = 1;
+			body = bodies[body].parent;
+		}
+		if (body != -1 && marks[body] == 1) return false;
+		for (body = (int)i; body != -1 && marks[body] == 1; body = bodies[body].parent) marks[body] = 2;
+	}
+
+	const double* bodyArrays[11];
+	for (uint32_t k = 0; k < 11; k++)
+		if (!(bodyArrays[k] = section<double>(CheckpointSectionId::BODY_ARRAY, k, &count)) || count != n) return false;
+
+	const double* orbitArrays[9];
+	std::vector<double> widened[7];
+	for (uint32_t k = 0; k < 9; k++)
+	{
+		if (header.version == 1 && k >= 2)
+		{
+			const float* floats = section<float>(CheckpointSectionId::ORBIT_ARRAY, k, &count);
+			if (!floats || count != n) return false;
+			widened[k - 2].assign(floats, floats + n);
+			orbitArrays[k] = widened[k - 2].data();
+		}
+		else if (!(orbitArrays[k] = section<double>(CheckpointSectionId::ORBIT_ARRAY, k, &count)) || count != n) return false;
+	}
+
+	size_t integratorCount;
+	const double* integratorState = section<double>(CheckpointSectionId::INTEGRATOR, 0, &integratorCount);
+	if (!integratorState || header.integrator > (uint32_t)IntegratorType::BLOCK_LEAPFROG || header.mode > (uint32_t)SimulationMode::NBODY ||
+		header.solver > (uint32_t)GravitySolver::BARNES_HUT || !(header.dt > 0.0)) return false;
+	std::unique_ptr<Integrator> integrator = Integrator::create((IntegratorType)header.integrator);
+	if (!integrator->restoreState(integratorState, integratorCount, n)) return false;
+
+	const CheckpointParticles* systems = section<CheckpointParticles>(CheckpointSectionId::PARTICLE_SYSTEMS, 0, &count);
+	if (!systems || count != header.particleSystemCount) return false;
+	std::vector<const float*> particleArrays(6 * count);
+	for (uint32_t s = 0; s < header.particleSystemCount; s++)
+	{
+		if (systems[s].center < 0 || systems[s].center >= (int32_t)n || systems[s].nameOffset + systems[s].nameLength > stringBytes) return false;
+		for (uint32_t k = 0; k < 6; k++)
+		{
+			size_t particleCount;
+			particleArrays[s * 6 + k] = section<float>(CheckpointSectionId::PARTICLE_ARRAY, s * 6 + k, &particleCount);
+			if (!particleArrays[s * 6 + k] || particleCount != systems[s].count) return false;
+		}
+	}
+
+	// bodies and the hierarchy, names are the only part that isn't a straight copy. the name map is left for find to build
+	sim._bodies.clear();
+	sim._bodies.reserve(n);
+	sim._bodyNameMap.clear();
+	sim._isNameMapValid = false;
+	sim._pendingChildren.clear();
+	sim._parents.resize(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		const CheckpointBody& record = bodies[i];
+		sim._bodies.push_back({ string(record.nameOffset, record.nameLength), string(record.centerNameOffset, record.centerNameLength),
+			record.eccentricity, record.focalDistance });
+		sim._parents[i] = record.parent;
+	}
+	// children of centers that were never added wait for them the same way addBody left them
+	for (size_t i = 0; i < n; i++)
+		if (sim._parents[i] == -1 && sim._bodies[i].centerName != sim._bodies[i].name) sim._pendingChildren[sim._bodies[i].centerName].push_back((int)i);
+	sim._isOrderValid = false;
+
+	BodyArrays& state = sim._state;
+	AlignedVector<double>* stateArrays[] = { &state.px, &state.py, &state.pz, &state.vx, &state.vy, &state.vz,
+		&state.ax, &state.ay, &state.az, &state.mass, &state.radius };
+	for (uint32_t k = 0; k < 11; k++) stateArrays[k]->assign(bodyArrays[k], bodyArrays[k] + n);
+
+	KeplerOrbits& orbits = sim._orbits;
+	AlignedVector<double>* elementArrays[] = { &orbits._meanAnomaly, &orbits._meanMotion, &orbits._e, &orbits._px, &orbits._py, &orbits._pz,
+		&orbits._qx, &orbits._qy, &orbits._qz };
+	for (uint32_t k = 0; k < 9; k++) elementArrays[k]->assign(orbitArrays[k], orbitArrays[k] + n);
+
+	Clock& clock = sim._clock;
+	clock._dt = header.dt;
+	clock._timeScale = header.timeScale;
+	clock._time = header.time;
+	clock._accumulator = header.accumulator;
+	clock._steps = header.steps;
+	clock._isPaused = (header.flags & CHECKPOINT_PAUSED) != 0;
+
+	sim._mode = (SimulationMode)header.mode;
+	sim._solver = (GravitySolver)header.solver;
+	sim._integratorType = (IntegratorType)header.integrator;
+	sim._integrator = std::move(integrator);
+	sim._barnesHut.setOpeningAngle(header.openingAngle);
+	sim._softening = header.softening;
+	sim._isCompensated = (header.flags & CHECKPOINT_COMPENSATED) != 0;
+	sim._isCollisionEnabled = (header.flags & CHECKPOINT_COLLISIONS) != 0;
+	sim._collisionGrid.invalidate();
+	sim._contacts.clear();
+	sim._mergeCount = header.mergeCount;
+	sim._isRailsFallback = (header.flags & CHECKPOINT_RAILS_FALLBACK) != 0;
+	sim._stepBudget = header.stepBudget;
+	sim._nbodyStepCost = 0.0;
+	sim._particleStepCost = 0.0;
+	sim._warp = {};
+
+	sim._particleSystems.clear();
+	for (uint32_t s = 0; s < header.particleSystemCount; s++)
+	{
+		const CheckpointParticles& record = systems[s];
+		auto particles = std::make_unique<ParticleSystem>(string(record.nameOffset, record.nameLength), record.center, record.particleRadius);
+		particles->setRestitution(record.restitution);
+		particles->setSelfInteraction(record.isSelfInteraction != 0);
+		AlignedVector<float>* arrays[] = { &particles->_px, &particles->_py, &particles->_pz, &particles->_vx, &particles->_vy, &particles->_vz };
+		for (uint32_t k = 0; k < 6; k++) arrays[k]->assign(particleArrays[s * 6 + k], particleArrays[s * 6 + k] + record.count);
+		sim._particleSystems.push_back(std::move(particles));
+	}
+	return true;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "Common.hpp"
+
+// time warp range the ui offers, the simulation covers anything past its step budget on the rails
+inline constexpr double kMaxTimeScale = 1e7;
+
+// Central simulation clock. Real (wall) time is fed in through advance(), scaled by the
+// time scale and chopped into fixed dt steps, so the integration result does not depend on
+// the frame rate of whoever is driving it.
+class Clock
+{
+	// saves and restores the private state in bulk
+	friend class Checkpoint;
+
+private:
+	double _dt;
+	double _timeScale;
+	double _time{ 0.0 };
+	double _accumulator{ 0.0 };
+	uint64_t _steps{ 0 };
+	// only keeps step counts in int range, Simulation::advance decides how much of them it can afford
+	int _maxStepsPerAdvance{ 1 << 30 };
+	bool _isPaused{ false };
+
+public:
+	Clock(double dt = 1.0 / 240.0, double timeScale = 1.0) :
+		_dt(dt), _timeScale(timeScale)
+	{
+	}
+
+	// accumulate a real time delta, returns how many fixed steps are now due
+	int advance(double realDelta);
+
+	// account for n fixed steps that have been taken
+	void tick(uint64_t n = 1);
+
+	void reset();
+
+	void setDt(double dt) { if (dt > 0.0) _dt = dt; };
+
+	void setTimeScale(double timeScale) { _timeScale = glm::clamp(timeScale, 0.0, kMaxTimeScale); };
+
+	void setMaxStepsPerAdvance(int maxSteps) { _maxStepsPerAdvance = maxSteps; };
+
+	void pause() { _isPaused = true; };
+
+	void resume() { _isPaused = false; };
+
+	const double dt() const { return _dt; };
+
+	const double timeScale() const { return _timeScale; };
+
+	const double time() const { return _time; };
+
+	const uint64_t steps() const { return _steps; };
+
+	const bool isPaused() const { return _isPaused; };
+
+	// fraction of a step left in the accumulator, for render interpolation
+	const double alpha() const { return _accumulator / _dt; };
+};
+
+int Clock::advance(double realDelta)
+{
+	if (_isPaused || realDelta <= 0.0) return 0;
+
+	_accumulator += realDelta * _timeScale;
+	double due = std::floor(_accumulator / _dt);
+	if (due > _maxStepsPerAdvance)
+	{
+		// a stall long enough to overflow the count, drop the backlog instead of spiralling
+		_accumulator = 0.0;
+		return _maxStepsPerAdvance;
+	}
+
+	_accumulator -= due * _dt;
+	return (int)due;
+}
+
+void Clock::tick(uint64_t n)
+{
+	_time += n * _dt;
+	_steps += n;
+}
+
+void Clock::reset()
+{
+	_time = 0.0;
+	_accumulator = 0.0;
+	_steps = 0;
+}
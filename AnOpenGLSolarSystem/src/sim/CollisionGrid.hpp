@@ -0,0 +1,364 @@
+#pragma once
+
+#include "Common.hpp"
+#include "BodyArrays.hpp"
+
+// two overlapping bodies, first < second
+typedef struct
+{
+	uint32_t first;
+	uint32_t second;
+}Contact;
+
+// a body in the grid with the cell it was in at the last update, and its position and radius then
+typedef struct
+{
+	uint64_t key;
+	uint32_t body;
+	double x, y, z;
+	double r;
+}CellEntry;
+
+// Collision broad phase on a uniform grid. Bodies are kept sorted by the packed x, y, z key of their cell,
+// and since few of them change cells from one step to the next the update keeps the ones that stayed,
+// sorts only the movers and merges the two. Runs of equal keys are the occupied cells; each is tested
+// against itself and the 13 cells of its forward half shell, so every pair of neighbouring cells is
+// visited once. The half shell is 4 rows of 3 cells plus the next cell in z, and as the cells are walked
+// in key order the start of each of those rows only moves forward, so finding them is a merge-like sweep
+// instead of a lookup per neighbour. Bodies too big for the cell size stay out of the grid and are tested
+// against everything.
+class CollisionGrid
+{
+	NONCOPYABLE(CollisionGrid)
+
+private:
+	double _cellSize{ 0.0 };
+	double _invCellSize{ 0.0 };
+
+	// bodies up to this radius go in the grid, it is half the cell size
+	double _maxRadius{ 0.0 };
+
+	// 0 picks the cell size from the radii on every full rebuild
+	double _fixedCellSize{ 0.0 };
+
+	size_t _bodyCount{ 0 };
+	bool _isValid{ false };
+
+	std::vector<CellEntry> _entries;
+	std::vector<CellEntry> _movers;
+	std::vector<CellEntry> _merged;
+
+	// radix sort scratch, keys and the slots they came from
+	std::vector<uint64_t> _sortKeys, _sortKeysTmp;
+	std::vector<uint32_t> _sortSlots, _sortSlotsTmp;
+	std::vector<uint32_t> _digitCounts;
+
+	// occupied cells as runs of _entries, with a sentinel at the end, and their keys
+	std::vector<uint32_t> _cellStarts;
+	std::vector<uint64_t> _cellKeys;
+
+	std::vector<uint32_t> _large;
+
+	size_t _lastMoved{ 0 };
+
+	static constexpr int kCoordBits = 21;
+	static constexpr int64_t kCoordBias = (int64_t)1 << (kCoordBits - 1);
+	static constexpr uint64_t kCoordMask = ((uint64_t)1 << kCoordBits) - 1;
+
+	// large bodies are tested one against all, keep their number bounded when picking the cell size
+	static constexpr size_t kMaxLarge = 64;
+
+	// below this many entries std::sort beats the radix passes
+	static constexpr size_t kRadixThreshold = 4096;
+	static constexpr int kDigitBits = 11;
+	static constexpr int kDigits = (3 * kCoordBits + kDigitBits - 1) / kDigitBits;
+
+public:
+	CollisionGrid() = default;
+	~CollisionGrid() = default;
+
+	// bring the grid up to date with the current positions. incremental unless the body count
+	// changed or invalidate() was called since the last update
+	void update(const BodyArrays& bodies);
+
+	// the same for n equal spheres given as float positions
+	void update(const float* x, const float* y, const float* z, double radius, size_t n);
+
+	// forget the grid, the next update sorts from scratch and picks a new cell size
+	void invalidate() { _isValid = false; };
+
+	void setCellSize(double size) { _fixedCellSize = size; _isValid = false; };
+
+	// overlapping pairs with at least one body in occupied cells [begin, end), appended to contacts
+	void collect(size_t begin, size_t end, std::vector<Contact>& contacts) const;
+
+	// overlapping pairs involving a body too big for the grid
+	void collectLarge(const BodyArrays& bodies, std::vector<Contact>& contacts) const;
+
+	const size_t cellCount() const { return _cellKeys.size(); };
+
+	const double cellSize() const { return _cellSize; };
+
+	const size_t largeCount() const { return _large.size(); };
+
+	// bodies that changed cells in the last incremental update
+	const size_t lastMoved() const { return _lastMoved; };
+
+private:
+	// fetch(i) gives body i's current entry, a full rebuild is expected to have picked the cell size already
+	template<typename Fetch>
+	void refresh(size_t n, bool isRebuild, Fetch&& fetch);
+
+	void chooseCellSize(const BodyArrays& bodies);
+
+	void buildCells();
+
+	// stable sort by key: LSD radix over 11 bit digits, skipping digits every key shares
+	void sortEntries(std::vector<CellEntry>& entries);
+
+	uint64_t keyOf(double x, double y, double z) const;
+
+	static uint64_t packKey(int64_t x, int64_t y, int64_t z);
+
+	static bool isBefore(const CellEntry& a, const CellEntry& b) { return a.key < b.key; };
+};
+
+uint64_t CollisionGrid::packKey(int64_t x, int64_t y, int64_t z)
+{
+	return ((uint64_t)(x + kCoordBias) << (2 * kCoordBits)) | ((uint64_t)(y + kCoordBias) << kCoordBits) | (uint64_t)(z + kCoordBias);
+}
+
+uint64_t CollisionGrid::keyOf(double x, double y, double z) const
+{
+	// far outliers share the boundary cells, which costs tests but never misses a pair
+	auto coord = [&](double v) {
+		return (int64_t)glm::clamp(std::floor(v * _invCellSize), (double)-kCoordBias, (double)(kCoordBias - 1));
+	};
+	return packKey(coord(x), coord(y), coord(z));
+}
+
+void CollisionGrid::chooseCellSize(const BodyArrays& bodies)
+{
+	std::vector<double> radii;
+	radii.reserve(bodies.size());
+	for (double r : bodies.radius) if (r > 0.0) radii.push_back(r);
+
+	double maxRadius = 1.0;
+	if (!radii.empty())
+	{
+		// up to twice the median radius, raised until at most kMaxLarge bodies are left out of the grid
+		auto median = radii.begin() + radii.size() / 2;
+		std::nth_element(radii.begin(), median, radii.end());
+		maxRadius = 2.0 * *median;
+		if (radii.size() > kMaxLarge)
+		{
+			auto cut = radii.end() - kMaxLarge - 1;
+			std::nth_element(radii.begin(), cut, radii.end());
+			maxRadius = glm::max(maxRadius, *cut);
+		}
+
+		// and then down to the biggest body that actually made it in, equal radii give the tightest grid
+		double largest = 0.0;
+		for (double r : radii) if (r <= maxRadius) largest = glm::max(largest, r);
+		if (largest > 0.0) maxRadius = largest;
+	}
+	if (_fixedCellSize > 0.0) maxRadius = 0.5 * _fixedCellSize;
+
+	// two grid bodies touching are at most 2 maxRadius apart, so neighbouring cells hold every pair
+	_maxRadius = maxRadius;
+	_cellSize = 2.0 * maxRadius;
+	_invCellSize = 1.0 / _cellSize;
+}
+
+template<typename Fetch>
+void CollisionGrid::refresh(size_t n, bool isRebuild, Fetch&& fetch)
+{
+	if (isRebuild)
+	{
+		_entries.clear();
+		_large.clear();
+		for (size_t i = 0; i < n; i++)
+		{
+			CellEntry entry = fetch((uint32_t)i);
+			if (entry.r <= 0.0) continue;
+			if (entry.r > _maxRadius) _large.push_back((uint32_t)i);
+			else _entries.push_back(entry);
+		}
+		sortEntries(_entries);
+		_lastMoved = _entries.size();
+		_bodyCount = n;
+		_isValid = true;
+	}
+	else
+	{
+		// bodies still in their cell keep their relative order, the movers are sorted on their own and merged back.
+		// this is the only pass that reads the bodies, everything after it streams through _entries
+		_movers.clear();
+		size_t kept = 0;
+		for (const CellEntry& entry : _entries)
+		{
+			CellEntry current = fetch(entry.body);
+			if (current.key == entry.key) _entries[kept++] = current;
+			else _movers.push_back(current);
+		}
+		_lastMoved = _movers.size();
+		if (!_movers.empty())
+		{
+			_entries.resize(kept);
+			sortEntries(_movers);
+			_merged.resize(kept + _movers.size());
+			std::merge(_entries.begin(), _entries.end(), _movers.begin(), _movers.end(), _merged.begin(), isBefore);
+			_entries.swap(_merged);
+		}
+	}
+
+	buildCells();
+}
+
+void CollisionGrid::update(const BodyArrays& bodies)
+{
+	bool isRebuild = !_isValid || bodies.size() != _bodyCount;
+	if (isRebuild) chooseCellSize(bodies);
+	refresh(bodies.size(), isRebuild, [&](uint32_t i) -> CellEntry {
+		return { keyOf(bodies.px[i], bodies.py[i], bodies.pz[i]), i, bodies.px[i], bodies.py[i], bodies.pz[i], bodies.radius[i] };
+	});
+}
+
+void CollisionGrid::update(const float* x, const float* y, const float* z, double radius, size_t n)
+{
+	bool isRebuild = !_isValid || n != _bodyCount;
+	if (isRebuild)
+	{
+		_maxRadius = _fixedCellSize > 0.0 ? 0.5 * _fixedCellSize : radius;
+		_cellSize = 2.0 * _maxRadius;
+		_invCellSize = 1.0 / _cellSize;
+	}
+	refresh(n, isRebuild, [&](uint32_t i) -> CellEntry {
+		return { keyOf(x[i], y[i], z[i]), i, x[i], y[i], z[i], radius };
+	});
+}
+
+void CollisionGrid::sortEntries(std::vector<CellEntry>& entries)
+{
+	const size_t n = entries.size();
+	if (n < kRadixThreshold)
+	{
+		std::stable_sort(entries.begin(), entries.end(), isBefore);
+		return;
+	}
+
+	const uint64_t mask = ((uint64_t)1 << kDigitBits) - 1;
+	const size_t buckets = (size_t)1 << kDigitBits;
+	_sortKeys.resize(n); _sortKeysTmp.resize(n);
+	_sortSlots.resize(n); _sortSlotsTmp.resize(n);
+	_digitCounts.assign(kDigits * buckets, 0);
+	for (size_t s = 0; s < n; s++)
+	{
+		uint64_t key = entries[s].key;
+		_sortKeys[s] = key;
+		_sortSlots[s] = (uint32_t)s;
+		for (int d = 0; d < kDigits; d++) _digitCounts[d * buckets + ((key >> (d * kDigitBits)) & mask)]++;
+	}
+
+	for (int d = 0; d < kDigits; d++)
+	{
+		uint32_t* counts = _digitCounts.data() + d * buckets;
+		const int shift = d * kDigitBits;
+		if (counts[(_sortKeys[0] >> shift) & mask] == n) continue;
+
+		uint32_t offset = 0;
+		for (size_t b = 0; b < buckets; b++)
+		{
+			uint32_t count = counts[b];
+			counts[b] = offset;
+			offset += count;
+		}
+		for (size_t s = 0; s < n; s++)
+		{
+			uint32_t to = counts[(_sortKeys[s] >> shift) & mask]++;
+			_sortKeysTmp[to] = _sortKeys[s];
+			_sortSlotsTmp[to] = _sortSlots[s];
+		}
+		_sortKeys.swap(_sortKeysTmp);
+		_sortSlots.swap(_sortSlotsTmp);
+	}
+
+	_merged.resize(n);
+	for (size_t s = 0; s < n; s++) _merged[s] = entries[_sortSlots[s]];
+	entries.swap(_merged);
+}
+
+void CollisionGrid::buildCells()
+{
+	_cellStarts.clear();
+	_cellKeys.clear();
+	for (size_t s = 0; s < _entries.size(); s++)
+	{
+		if (s > 0 && _entries[s].key == _entries[s - 1].key) continue;
+		_cellStarts.push_back((uint32_t)s);
+		_cellKeys.push_back(_entries[s].key);
+	}
+	_cellStarts.push_back((uint32_t)_entries.size());
+}
+
+void CollisionGrid::collect(size_t begin, size_t end, std::vector<Contact>& contacts) const
+{
+	// rows of the forward half shell as (dx, dy), each spanning dz in [-1, 1]; (0, 0, 1) is handled on its own
+	static const int kRows[4][2] = { { 0, 1 }, { 1, -1 }, { 1, 0 }, { 1, 1 } };
+
+	auto test = [&](uint32_t a, uint32_t b) {
+		const CellEntry& p = _entries[a];
+		const CellEntry& q = _entries[b];
+		double dx = p.x - q.x, dy = p.y - q.y, dz = p.z - q.z;
+		if (dx * dx + dy * dy + dz * dz > (p.r + q.r) * (p.r + q.r)) return;
+		contacts.push_back({ glm::min(p.body, q.body), glm::max(p.body, q.body) });
+	};
+	auto testCells = [&](size_t c, size_t d) {
+		for (uint32_t a = _cellStarts[c]; a < _cellStarts[c + 1]; a++)
+			for (uint32_t b = _cellStarts[d]; b < _cellStarts[d + 1]; b++) test(a, b);
+	};
+
+	const size_t cells = cellCount();
+	size_t cursors[4] = { cells, cells, cells, cells };
+	for (size_t c = begin; c < end; c++)
+	{
+		for (uint32_t a = _cellStarts[c]; a < _cellStarts[c + 1]; a++)
+			for (uint32_t b = a + 1; b < _cellStarts[c + 1]; b++) test(a, b);
+
+		const uint64_t key = _cellKeys[c];
+		const int64_t x = (int64_t)(key >> (2 * kCoordBits)) - kCoordBias;
+		const int64_t y = (int64_t)((key >> kCoordBits) & kCoordMask) - kCoordBias;
+		const int64_t z = (int64_t)(key & kCoordMask) - kCoordBias;
+		if (z + 1 < kCoordBias && c + 1 < cells && _cellKeys[c + 1] == packKey(x, y, z + 1)) testCells(c, c + 1);
+
+		for (int r = 0; r < 4; r++)
+		{
+			int64_t nx = x + kRows[r][0], ny = y + kRows[r][1];
+			if (nx >= kCoordBias || ny < -kCoordBias || ny >= kCoordBias) continue;
+			uint64_t low = packKey(nx, ny, glm::max(z - 1, -kCoordBias)), high = packKey(nx, ny, glm::min(z + 1, kCoordBias - 1));
+
+			// the first cell of a chunk finds its rows by binary search, after that they only move forward
+			size_t& cursor = cursors[r];
+			if (cursor == cells) cursor = std::lower_bound(_cellKeys.begin() + c, _cellKeys.end(), low) - _cellKeys.begin();
+			while (cursor < cells && _cellKeys[cursor] < low) cursor++;
+			for (size_t d = cursor; d < cells && _cellKeys[d] <= high; d++) testCells(c, d);
+		}
+	}
+}
+
+void CollisionGrid::collectLarge(const BodyArrays& bodies, std::vector<Contact>& contacts) const
+{
+	const size_t n = bodies.size();
+	for (uint32_t i : _large)
+	{
+		const double x = bodies.px[i], y = bodies.py[i], z = bodies.pz[i], r = bodies.radius[i];
+		for (size_t j = 0; j < n; j++)
+		{
+			// a pair of large bodies is reported by the lower index only
+			double rj = bodies.radius[j];
+			if (j == i || rj <= 0.0 || (rj > _maxRadius && j < i)) continue;
+			double dx = bodies.px[j] - x, dy = bodies.py[j] - y, dz = bodies.pz[j] - z;
+			if (dx * dx + dy * dy + dz * dz <= (r + rj) * (r + rj)) contacts.push_back({ glm::min(i, (uint32_t)j), glm::max(i, (uint32_t)j) });
+		}
+	}
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+// Shared includes for the simulation core. Nothing under sim/ may pull in GL or GLFW,
+// so the same code can be stepped by the viewer and by the headless runner.
+
+#include "glm/glm.hpp"
+#include "glm/gtc/constants.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "../sdk/Macros.hpp"
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "Common.hpp"
+#include "BodyArrays.hpp"
+
+#include <limits>
+
+// Conserved quantities and close encounters, used to judge integrators and ensemble runs
+class Diagnostics
+{
+	INCONSTRUCTIBLE(Diagnostics)
+
+public:
+	// kinetic plus softened pairwise potential energy, O(N^2)
+	static double energy(const BodyArrays& bodies, double G, double softening);
+
+	static glm::dvec3 angularMomentum(const BodyArrays& bodies);
+
+	static glm::dvec3 momentum(const BodyArrays& bodies);
+
+	// smallest centre to centre distance of any two bodies and which two they are, O(N^2). infinity below two bodies
+	static double closestPair(const BodyArrays& bodies, size_t& first, size_t& second);
+};
+
+double Diagnostics::energy(const BodyArrays& bodies, double G, double softening)
+{
+	const size_t n = bodies.size();
+	const double eps2 = softening * softening;
+	double kinetic = 0.0, potential = 0.0;
+	for (size_t i = 0; i < n; i++)
+	{
+		kinetic += 0.5 * bodies.mass[i] * glm::dot(bodies.velocity(i), bodies.velocity(i));
+		for (size_t j = i + 1; j < n; j++)
+		{
+			double r2 = glm::dot(bodies.position(j) - bodies.position(i), bodies.position(j) - bodies.position(i)) + eps2;
+			if (r2 > 0.0) potential -= G * bodies.mass[i] * bodies.mass[j] / std::sqrt(r2);
+		}
+	}
+	return kinetic + potential;
+}
+
+glm::dvec3 Diagnostics::angularMomentum(const BodyArrays& bodies)
+{
+	glm::dvec3 l = { 0.0, 0.0, 0.0 };
+	for (size_t i = 0; i < bodies.size(); i++) l += bodies.mass[i] * glm::cross(bodies.position(i), bodies.velocity(i));
+	return l;
+}
+
+glm::dvec3 Diagnostics::momentum(const BodyArrays& bodies)
+{
+	glm::dvec3 p = { 0.0, 0.0, 0.0 };
+	for (size_t i = 0; i < bodies.size(); i++) p += bodies.mass[i] * bodies.velocity(i);
+	return p;
+}
+
+double Diagnostics::closestPair(const BodyArrays& bodies, size_t& first, size_t& second)
+{
+	const size_t n = bodies.size();
+	double closest2 = std::numeric_limits<double>::infinity();
+	first = second = 0;
+	for (size_t i = 0; i < n; i++)
+	{
+		for (size_t j = i + 1; j < n; j++)
+		{
+			double dx = bodies.px[j] - bodies.px[i], dy = bodies.py[j] - bodies.py[i], dz = bodies.pz[j] - bodies.pz[i];
+			double r2 = dx * dx + dy * dy + dz * dz;
+			if (r2 < closest2)
+			{
+				closest2 = r2;
+				first = i;
+				second = j;
+			}
+		}
+	}
+	return std::sqrt(closest2);
+}
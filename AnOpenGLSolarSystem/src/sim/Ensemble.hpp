@@ -0,0 +1,342 @@
+#pragma once
+
+#include "Common.hpp"
+#include "Simulation.hpp"
+#include "Diagnostics.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <sstream>
+
+enum class EnsembleField
+{
+	ECCENTRICITY = 0,
+	FOCAL_DISTANCE,
+	MASS
+};
+
+// one dimension of the parameter grid: every value a field of one body takes
+typedef struct
+{
+	std::string body;
+	EnsembleField field;
+	std::vector<double> values;
+}EnsembleAxis;
+
+// summary of one run, what a row of the csv holds
+typedef struct
+{
+	bool isValid;
+	// no merges and no body unbound from its center after any step
+	bool isStable;
+	size_t unbound;
+	size_t merged;
+	// smallest separation after any step
+	double closestApproach;
+	std::string closestFirst, closestSecond;
+	// largest |E - E0| / |E0| over the samples, NaN on the rails where velocities don't follow the orbits
+	double energyDrift;
+	double wallMs;
+}EnsembleResult;
+
+typedef struct
+{
+	size_t runs;
+	size_t stable;
+	size_t failed;
+	double wallSeconds;
+}EnsembleStats;
+
+// builds the template world a run starts from, on the thread that runs it. false if it couldn't be built
+typedef std::function<bool(Simulation& sim)> EnsembleSetup;
+
+// Many independent worlds from one template and a grid of parameters. Every point of the grid is a run of
+// its own Simulation stepped on a single thread, the runs are spread over a work-stealing pool, and each
+// run's summary is streamed to a csv in run order as soon as every run before it has finished.
+class Ensemble
+{
+	NONCOPYABLE(Ensemble)
+
+private:
+	EnsembleSetup _setup;
+	std::vector<EnsembleAxis> _axes;
+	long long _steps;
+	// times along a run the energy drift is taken, the rest is checked every step
+	int _samples{ 64 };
+
+public:
+	Ensemble(const EnsembleSetup& setup, long long steps);
+	~Ensemble() = default;
+
+	// "Body.field=from:to:count" or "Body.field=v,v,...", field is eccentricity, focal-distance or mass. false if it doesn't parse
+	bool addAxis(const std::string& spec);
+
+	void addAxis(const EnsembleAxis& axis) { _axes.push_back(axis); };
+
+	void setSamples(int samples) { _samples = glm::max(samples, 1); };
+
+	// product of the axis sizes, 1 with no axes at all
+	const size_t runCount() const;
+
+	const std::vector<EnsembleAxis>& axes() const { return _axes; };
+
+	// every axis' value in run, the last axis varies fastest
+	std::vector<double> parameters(size_t run) const;
+
+	// every run on threads workers, rows go to csvPath. false if the csv can't be written or an axis names a body the template lacks
+	bool run(const std::string& csvPath, int threads, EnsembleStats* stats = nullptr);
+
+	// builds and steps one run on the calling thread
+	EnsembleResult runOne(size_t run) const;
+
+	static const char* fieldName(EnsembleField field);
+
+private:
+	// the grid point's values written into sim, false if a body isn't there
+	bool apply(Simulation& sim, const std::vector<double>& parameters) const;
+
+	static std::string row(size_t run, const std::vector<double>& parameters, const EnsembleResult& result);
+
+	static std::string quote(const std::string& text);
+};
+
+Ensemble::Ensemble(const EnsembleSetup& setup, long long steps) :
+	_setup(setup), _steps(glm::max(steps, 0ll))
+{
+}
+
+const char* Ensemble::fieldName(EnsembleField field)
+{
+	switch (field)
+	{
+	case EnsembleField::ECCENTRICITY: return "eccentricity";
+	case EnsembleField::FOCAL_DISTANCE: return "focal-distance";
+	case EnsembleField::MASS: return "mass";
+	default: return "";
+	}
+}
+
+bool Ensemble::addAxis(const std::string& spec)
+{
+	size_t dot = spec.rfind('.', spec.find('=')), equals = spec.find('=');
+	if (dot == std::string::npos || equals == std::string::npos || dot == 0 || equals < dot) return false;
+
+	EnsembleAxis axis;
+	axis.body = spec.substr(0, dot);
+	const std::string field = spec.substr(dot + 1, equals - dot - 1), values = spec.substr(equals + 1);
+	if (field == "eccentricity" || field == "e") axis.field = EnsembleField::ECCENTRICITY;
+	else if (field == "focal-distance" || field == "focal") axis.field = EnsembleField::FOCAL_DISTANCE;
+	else if (field == "mass") axis.field = EnsembleField::MASS;
+	else return false;
+
+	// from:to:count is count evenly spaced values including both ends
+	size_t colon = values.find(':');
+	if (colon != std::string::npos)
+	{
+		size_t second = values.find(':', colon + 1);
+		if (second == std::string::npos) return false;
+		double from = atof(values.substr(0, colon).c_str()), to = atof(values.substr(colon + 1, second - colon - 1).c_str());
+		int count = atoi(values.substr(second + 1).c_str());
+		if (count < 1) return false;
+		for (int i = 0; i < count; i++) axis.values.push_back(count == 1 ? from : from + (to - from) * i / (count - 1));
+	}
+	else
+	{
+		std::stringstream ss(values);
+		std::string item;
+		while (std::getline(ss, item, ',')) if (!item.empty()) axis.values.push_back(atof(item.c_str()));
+	}
+	if (axis.values.empty()) return false;
+
+	_axes.push_back(axis);
+	return true;
+}
+
+const size_t Ensemble::runCount() const
+{
+	size_t count = 1;
+	for (auto& axis : _axes) count *= axis.values.size();
+	return count;
+}
+
+std::vector<double> Ensemble::parameters(size_t run) const
+{
+	std::vector<double> values(_axes.size());
+	for (size_t a = _axes.size(); a-- > 0;)
+	{
+		const size_t size = _axes[a].values.size();
+		values[a] = _axes[a].values[run % size];
+		run /= size;
+	}
+	return values;
+}
+
+bool Ensemble::apply(Simulation& sim, const std::vector<double>& parameters) const
+{
+	std::vector<bool> isOrbitSwept(sim.bodyCount(), false);
+	for (size_t a = 0; a < _axes.size(); a++)
+	{
+		int index = sim.find(_axes[a].body);
+		if (index == -1) return false;
+		const Body& body = sim.body(index);
+		switch (_axes[a].field)
+		{
+		case EnsembleField::ECCENTRICITY: sim.setOrbit(index, (float)parameters[a], body.focalDistance); isOrbitSwept[index] = true; break;
+		case EnsembleField::FOCAL_DISTANCE: sim.setOrbit(index, body.eccentricity, (float)parameters[a]); isOrbitSwept[index] = true; break;
+		case EnsembleField::MASS: sim.setMass(index, parameters[a]); break;
+		default: break;
+		}
+	}
+	if (sim.mode() != SimulationMode::NBODY) return true;
+
+	// a fresh world's circular velocities were seeded with the template's masses. the bodies whose orbits are
+	// swept start on them, parents before their satellites, the rest keep their circular orbits
+	if (sim.clock().steps() == 0) sim.seedOrbitalVelocities();
+	for (uint32_t i : sim.updateOrder()) if (isOrbitSwept[i]) sim.launchOnOrbit((int)i);
+	return true;
+}
+
+EnsembleResult Ensemble::runOne(size_t run) const
+{
+	EnsembleResult result{};
+	result.closestApproach = std::numeric_limits<double>::infinity();
+	result.energyDrift = std::numeric_limits<double>::quiet_NaN();
+	auto start = std::chrono::steady_clock::now();
+
+	Simulation sim;
+	if (!_setup(sim)) return result;
+	sim.setThreadCount(1);
+	if (!apply(sim, parameters(run))) return result;
+	result.isValid = true;
+
+	const bool isOnRails = sim.isOnRails();
+	const size_t mergedBefore = sim.mergeCount();
+	const double e0 = Diagnostics::energy(sim.state(), kGravity, sim.softening());
+	std::vector<std::string> unbound;
+	// every step, a close pass or a slingshot shorter than the gap between samples would slip through them
+	auto track = [&](const Simulation& s) {
+		const BodyArrays& state = s.state();
+		size_t first, second;
+		double closest = Diagnostics::closestPair(state, first, second);
+		if (closest < result.closestApproach)
+		{
+			result.closestApproach = closest;
+			result.closestFirst = s.body((int)first).name;
+			result.closestSecond = s.body((int)second).name;
+		}
+		if (isOnRails) return;
+
+		// positive orbital energy about its center, the body is leaving
+		for (size_t i = 0; i < state.size(); i++)
+		{
+			int center = s.parent(i);
+			if (center == -1) continue;
+			glm::dvec3 r = state.position(i) - state.position(center), v = state.velocity(i) - state.velocity(center);
+			double mu = kGravity * (state.mass[center] + state.mass[i]);
+			if (0.5 * glm::dot(v, v) - mu / glm::max(glm::length(r), 1e-12) < 0.0) continue;
+			const std::string& name = s.body((int)i).name;
+			if (std::find(unbound.begin(), unbound.end(), name) == unbound.end()) unbound.push_back(name);
+		}
+	};
+	// the energy is a pass over every pair, so only its drift is sampled
+	auto sample = [&]() {
+		if (isOnRails) return;
+		double drift = e0 != 0.0 ? std::abs(Diagnostics::energy(sim.state(), kGravity, sim.softening()) - e0) / std::abs(e0) : 0.0;
+		result.energyDrift = std::isnan(result.energyDrift) ? drift : glm::max(result.energyDrift, drift);
+	};
+
+	track(sim);
+	sample();
+	sim.setStepCallback(track);
+	const long long interval = glm::max(_steps / _samples, 1ll);
+	for (long long done = 0; done < _steps;)
+	{
+		int batch = (int)glm::min(_steps - done, interval);
+		sim.step(batch);
+		done += batch;
+		sample();
+	}
+	sim.setStepCallback(nullptr);
+
+	result.unbound = unbound.size();
+	result.merged = sim.mergeCount() - mergedBefore;
+	result.isStable = result.unbound == 0 && result.merged == 0;
+	result.wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	return result;
+}
+
+bool Ensemble::run(const std::string& csvPath, int threads, EnsembleStats* stats)
+{
+	// the template has to hold every swept body before a thousand runs find out it doesn't
+	{
+		Simulation probe;
+		if (!_setup(probe)) return false;
+		for (auto& axis : _axes) if (probe.find(axis.body) == -1) return false;
+	}
+
+	std::ofstream ofs(csvPath, std::ios::trunc);
+	if (!ofs) return false;
+	ofs << "run";
+	for (auto& axis : _axes) ofs << "," << quote(axis.body + "." + fieldName(axis.field));
+	ofs << ",stable,unbound,merged,closest_approach,closest_first,closest_second,energy_drift,wall_ms\n";
+	ofs.flush();
+
+	const size_t count = runCount();
+	std::mutex mutex;
+	std::map<size_t, std::string> pending;
+	size_t next = 0, stable = 0, failed = 0;
+	auto start = std::chrono::steady_clock::now();
+	JobSystem pool(threads);
+	pool.parallelFor(0, count, 1, [&](size_t begin, size_t end) {
+		for (size_t run = begin; run < end; run++)
+		{
+			EnsembleResult result = runOne(run);
+			std::string line = row(run, parameters(run), result);
+
+			// finished rows wait for the ones before them, so the file reads the same on any number of threads
+			std::lock_guard<std::mutex> lock(mutex);
+			if (result.isStable) stable++;
+			if (!result.isValid) failed++;
+			pending.emplace(run, std::move(line));
+			for (auto it = pending.begin(); it != pending.end() && it->first == next; it = pending.erase(it), next++) ofs << it->second;
+			ofs.flush();
+		}
+	});
+
+	if (stats) *stats = { count, stable, failed, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() };
+	return (bool)ofs;
+}
+
+std::string Ensemble::row(size_t run, const std::vector<double>& parameters, const EnsembleResult& result)
+{
+	char buffer[64];
+	std::string line = std::to_string(run);
+	for (double value : parameters)
+	{
+		snprintf(buffer, sizeof(buffer), ",%.9g", value);
+		line += buffer;
+	}
+	if (!result.isValid) return line + ",,,,,,,,\n";
+
+	snprintf(buffer, sizeof(buffer), ",%d,%zu,%zu,%.9g", result.isStable ? 1 : 0, result.unbound, result.merged, result.closestApproach);
+	line += buffer;
+	line += "," + quote(result.closestFirst) + "," + quote(result.closestSecond) + ",";
+	if (!std::isnan(result.energyDrift))
+	{
+		snprintf(buffer, sizeof(buffer), "%.6e", result.energyDrift);
+		line += buffer;
+	}
+	snprintf(buffer, sizeof(buffer), ",%.3f\n", result.wallMs);
+	return line + buffer;
+}
+
+std::string Ensemble::quote(const std::string& text)
+{
+	if (text.find_first_of(",\"\n") == std::string::npos) return text;
+	std::string quoted = "\"";
+	for (char c : text) quoted += c == '"' ? std::string("\"\"") : std::string(1, c);
+	return quoted + "\"";
+}
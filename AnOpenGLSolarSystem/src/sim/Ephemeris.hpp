@@ -0,0 +1,409 @@
+#pragma once
+
+#include "Common.hpp"
+#include "Simulation.hpp"
+
+#include <cstring>
+#include <fstream>
+
+inline constexpr char kEphemerisMagic[8] = { 'S', 'S', 'E', 'P', 'H', 'E', 'M', '\0' };
+inline constexpr uint32_t kEphemerisVersion = 1;
+
+// on disk: this header, every body's name as a uint32 length and its bytes, then the coefficients
+// segment by segment, body by body, x y z, degree + 1 doubles each
+typedef struct
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t bodyCount;
+	uint32_t degree;
+	uint32_t reserved;
+	uint64_t segmentCount;
+	double startTime;
+	double segmentLength;
+}EphemerisHeader;
+
+typedef struct
+{
+	uint64_t segments;
+	uint64_t bytes;
+	// largest distance between a fitted and an integrated position, over every step of the span
+	double maxError;
+	int worstBody;
+}EphemerisBakeStats;
+
+// Baked trajectories. The simulation is run once over a span and each body's position is fitted with one
+// Chebyshev polynomial per fixed length segment, the way JPL stores planetary ephemerides. A lookup at any
+// time in the span is then a segment index and a short Clenshaw sum, with no integration at all.
+class Ephemeris
+{
+	NONCOPYABLE(Ephemeris)
+
+private:
+	EphemerisHeader _header{};
+
+	std::vector<std::string> _names;
+
+	std::unordered_map<std::string, int> _nameMap;
+
+	std::vector<double> _coefficients;
+
+public:
+	Ephemeris() = default;
+	~Ephemeris() = default;
+
+	// step sim over duration from where it is now and write the fitted segments to path. The segment length is
+	// rounded to whole steps and every step is a sample, the degree is capped at the steps in a segment.
+	// Fails if bodies are merged during the bake, a file with a body missing halfway is no use to anyone
+	static bool bake(Simulation& sim, const std::string& path, double duration, double segmentLength, int degree,
+		EphemerisBakeStats* stats = nullptr);
+
+	bool load(const std::string& path);
+
+	int find(const std::string& name) const;
+
+	// times outside the baked span are clamped to it
+	const glm::dvec3 position(int body, double t) const;
+
+	const glm::dvec3 velocity(int body, double t) const;
+
+	// positions of bodies [begin, end) at t, into x + begin, y + begin and z + begin
+	void positions(double t, double* x, double* y, double* z, size_t begin, size_t end) const;
+
+	const bool isLoaded() const { return !_coefficients.empty(); };
+
+	const size_t bodyCount() const { return _names.size(); };
+
+	const std::string& name(int body) const { return _names[body]; };
+
+	const int degree() const { return (int)_header.degree; };
+
+	const size_t segmentCount() const { return (size_t)_header.segmentCount; };
+
+	const double segmentLength() const { return _header.segmentLength; };
+
+	const double startTime() const { return _header.startTime; };
+
+	const double endTime() const { return _header.startTime + _header.segmentCount * _header.segmentLength; };
+
+private:
+	// a body's x coefficients in the segment holding t, y and z follow, and t mapped to [-1, 1] in that segment
+	const double* locate(int body, double t, double& tau) const;
+
+	// T_k(tau_j) for k <= degree, at samples + 1 evenly spaced tau_j from -1 to 1, row j after row j
+	static std::vector<double> basis(int degree, int samples);
+
+	// the linear map from samples + 1 evenly spaced values to the least squares coefficients that also pass
+	// exactly through both end values, so neighbouring segments meet. Row k gives coefficient k
+	static std::vector<double> fitOperator(int degree, int samples);
+
+	static double chebyshev(const double* c, int order, double tau);
+
+	// d/dtau of the series, sum k c_k U_(k-1)(tau)
+	static double chebyshevDerivative(const double* c, int order, double tau);
+};
+
+bool Ephemeris::bake(Simulation& sim, const std::string& path, double duration, double segmentLength, int degree, EphemerisBakeStats* stats)
+{
+	const size_t n = sim.bodyCount();
+	const double dt = sim.clock().dt();
+	if (n == 0 || duration <= 0.0 || degree < 1) return false;
+
+	const int samples = std::max(1, (int)std::lround(segmentLength / dt));
+	degree = std::min(degree, samples);
+	const int order = degree + 1;
+
+	EphemerisHeader header{};
+	memcpy(header.magic, kEphemerisMagic, sizeof(header.magic));
+	header.version = kEphemerisVersion;
+	header.bodyCount = (uint32_t)n;
+	header.degree = (uint32_t)degree;
+	header.segmentLength = samples * dt;
+	header.segmentCount = (uint64_t)std::ceil(duration / header.segmentLength - 1e-9);
+	header.startTime = sim.clock().time();
+
+	std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+	if (!ofs) return false;
+	ofs.write((const char*)&header, sizeof(header));
+	for (const Body& body : sim.bodies())
+	{
+		uint32_t length = (uint32_t)body.name.size();
+		ofs.write((const char*)&length, sizeof(length));
+		ofs.write(body.name.data(), length);
+	}
+
+	const std::vector<double> fit = fitOperator(degree, samples);
+	const std::vector<double> tb = basis(degree, samples);
+
+	// every body's track through the current segment, x y z with samples + 1 values each
+	const size_t points = samples + 1, track = 3 * points;
+	std::vector<double> tracks(n * track);
+	std::vector<double> coefficients(n * 3 * order);
+	std::vector<double> errors(n, 0.0);
+	auto record = [&](int j) {
+		const BodyArrays& state = sim.state();
+		for (size_t i = 0; i < n; i++)
+		{
+			tracks[i * track + j] = state.px[i];
+			tracks[i * track + points + j] = state.py[i];
+			tracks[i * track + 2 * points + j] = state.pz[i];
+		}
+	};
+
+	// rails positions are only written by steps, the first sample has to be on the same track as the others
+	if (sim.isOnRails()) sim.placeOnRails();
+
+	bool isIntact = true;
+	record(0);
+	for (uint64_t segment = 0; segment < header.segmentCount && isIntact; segment++)
+	{
+		for (int j = 1; j <= samples; j++)
+		{
+			sim.step(1);
+			if (sim.bodyCount() != n)
+			{
+				isIntact = false;
+				break;
+			}
+			record(j);
+		}
+		if (!isIntact) break;
+
+		// bodies are independent from here on, each one is three small matrix-vector products
+		sim.parallelFor(n, 64, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++)
+			{
+				const double* y = &tracks[i * track];
+				double* c = &coefficients[i * 3 * order];
+				for (int axis = 0; axis < 3; axis++)
+					for (int k = 0; k < order; k++)
+					{
+						const double* row = &fit[k * points];
+						double sum = 0.0;
+						for (size_t j = 0; j < points; j++) sum += row[j] * y[axis * points + j];
+						c[axis * order + k] = sum;
+					}
+
+				for (size_t j = 0; j < points; j++)
+				{
+					double d2 = 0.0;
+					for (int axis = 0; axis < 3; axis++)
+					{
+						double fitted = 0.0;
+						for (int k = 0; k < order; k++) fitted += tb[j * order + k] * c[axis * order + k];
+						double d = fitted - y[axis * points + j];
+						d2 += d * d;
+					}
+					errors[i] = glm::max(errors[i], std::sqrt(d2));
+				}
+			}
+		});
+		ofs.write((const char*)coefficients.data(), coefficients.size() * sizeof(double));
+
+		// the last sample of this segment is the first of the next
+		for (size_t i = 0; i < n; i++)
+			for (int axis = 0; axis < 3; axis++) tracks[i * track + axis * points] = tracks[i * track + axis * points + samples];
+	}
+
+	uint64_t bytes = (uint64_t)ofs.tellp();
+	ofs.close();
+	if (!isIntact || !ofs)
+	{
+		std::remove(path.c_str());
+		return false;
+	}
+
+	if (stats)
+	{
+		auto worst = std::max_element(errors.begin(), errors.end());
+		stats->segments = header.segmentCount;
+		stats->bytes = bytes;
+		stats->maxError = *worst;
+		stats->worstBody = (int)(worst - errors.begin());
+	}
+	return true;
+}
+
+bool Ephemeris::load(const std::string& path)
+{
+	_names.clear();
+	_nameMap.clear();
+	_coefficients.clear();
+
+	std::ifstream ifs(path, std::ios::binary | std::ios::ate);
+	if (!ifs) return false;
+	const uint64_t fileSize = (uint64_t)ifs.tellg();
+	ifs.seekg(0);
+
+	EphemerisHeader header{};
+	ifs.read((char*)&header, sizeof(header));
+	if (!ifs || memcmp(header.magic, kEphemerisMagic, sizeof(header.magic)) != 0 || header.version != kEphemerisVersion ||
+		header.degree < 1 || !(header.segmentLength > 0.0)) return false;
+
+	// every size comes from the header, so each is held against what the file has left before anything is allocated
+	if ((uint64_t)header.bodyCount * sizeof(uint32_t) > fileSize - sizeof(header)) return false;
+	std::vector<std::string> names(header.bodyCount);
+	for (uint32_t i = 0; i < header.bodyCount; i++)
+	{
+		uint32_t length = 0;
+		ifs.read((char*)&length, sizeof(length));
+		if (!ifs || length > 4096) return false;
+		names[i].resize(length);
+		ifs.read(&names[i][0], length);
+		if (!ifs) return false;
+	}
+
+	const uint64_t remaining = fileSize - (uint64_t)ifs.tellg();
+	const uint64_t perBody = 3 * ((uint64_t)header.degree + 1), available = remaining / sizeof(double);
+	if (remaining % sizeof(double) != 0 || (header.bodyCount > 0 && perBody > available / header.bodyCount)) return false;
+	const uint64_t perSegment = perBody * header.bodyCount;
+	if (perSegment == 0 ? remaining != 0 : header.segmentCount != available / perSegment || available % perSegment != 0) return false;
+
+	std::vector<double> coefficients((size_t)available);
+	ifs.read((char*)coefficients.data(), coefficients.size() * sizeof(double));
+	if (!ifs) return false;
+
+	_header = header;
+	_names = std::move(names);
+	for (uint32_t i = 0; i < header.bodyCount; i++) _nameMap.insert(std::make_pair(_names[i], (int)i));
+	_coefficients = std::move(coefficients);
+	return true;
+}
+
+int Ephemeris::find(const std::string& name) const
+{
+	auto it = _nameMap.find(name);
+	return it == _nameMap.end() ? -1 : it->second;
+}
+
+const glm::dvec3 Ephemeris::position(int body, double t) const
+{
+	const int order = degree() + 1;
+	double tau;
+	const double* c = locate(body, t, tau);
+	return { chebyshev(c, order, tau), chebyshev(c + order, order, tau), chebyshev(c + 2 * order, order, tau) };
+}
+
+const glm::dvec3 Ephemeris::velocity(int body, double t) const
+{
+	const int order = degree() + 1;
+	const double scale = 2.0 / segmentLength();
+	double tau;
+	const double* c = locate(body, t, tau);
+	return glm::dvec3(chebyshevDerivative(c, order, tau), chebyshevDerivative(c + order, order, tau),
+		chebyshevDerivative(c + 2 * order, order, tau)) * scale;
+}
+
+void Ephemeris::positions(double t, double* x, double* y, double* z, size_t begin, size_t end) const
+{
+	const int order = degree() + 1;
+	double tau;
+	for (size_t i = begin; i < end; i++)
+	{
+		const double* c = locate((int)i, t, tau);
+		x[i] = chebyshev(c, order, tau);
+		y[i] = chebyshev(c + order, order, tau);
+		z[i] = chebyshev(c + 2 * order, order, tau);
+	}
+}
+
+const double* Ephemeris::locate(int body, double t, double& tau) const
+{
+	const double local = (t - _header.startTime) / _header.segmentLength;
+	const double last = (double)(_header.segmentCount - 1);
+	const double segment = glm::clamp(std::floor(local), 0.0, last);
+	tau = glm::clamp(2.0 * (local - segment) - 1.0, -1.0, 1.0);
+
+	const size_t order = _header.degree + 1;
+	return _coefficients.data() + ((size_t)segment * _header.bodyCount + body) * 3 * order;
+}
+
+std::vector<double> Ephemeris::basis(int degree, int samples)
+{
+	const int order = degree + 1;
+	std::vector<double> tb((samples + 1) * order);
+	for (int j = 0; j <= samples; j++)
+	{
+		double tau = -1.0 + 2.0 * j / samples;
+		double* row = &tb[j * order];
+		row[0] = 1.0;
+		if (order > 1) row[1] = tau;
+		for (int k = 2; k < order; k++) row[k] = 2.0 * tau * row[k - 1] - row[k - 2];
+	}
+	return tb;
+}
+
+std::vector<double> Ephemeris::fitOperator(int degree, int samples)
+{
+	// minimise |A c - y|^2 subject to c(-1) = y_0 and c(1) = y_samples, through the KKT system
+	// [A'A C'; C 0] [c; lambda] = [A'; E] y, solved once for all samples + 1 unit vectors y
+	const int order = degree + 1, points = samples + 1, m = order + 2;
+	const std::vector<double> tb = basis(degree, samples);
+
+	std::vector<double> kkt(m * m, 0.0), rhs(m * points, 0.0);
+	for (int a = 0; a < order; a++)
+	{
+		for (int b = 0; b < order; b++)
+		{
+			double sum = 0.0;
+			for (int j = 0; j < points; j++) sum += tb[j * order + a] * tb[j * order + b];
+			kkt[a * m + b] = sum;
+		}
+		double atMinusOne = (a & 1) ? -1.0 : 1.0;
+		kkt[a * m + order] = kkt[order * m + a] = atMinusOne;
+		kkt[a * m + order + 1] = kkt[(order + 1) * m + a] = 1.0;
+		for (int j = 0; j < points; j++) rhs[a * points + j] = tb[j * order + a];
+	}
+	rhs[order * points] = 1.0;
+	rhs[(order + 1) * points + samples] = 1.0;
+
+	// gaussian elimination with partial pivoting, the system is tiny
+	for (int col = 0; col < m; col++)
+	{
+		int pivot = col;
+		for (int r = col + 1; r < m; r++)
+			if (std::abs(kkt[r * m + col]) > std::abs(kkt[pivot * m + col])) pivot = r;
+		if (pivot != col)
+		{
+			for (int k = 0; k < m; k++) std::swap(kkt[col * m + k], kkt[pivot * m + k]);
+			for (int j = 0; j < points; j++) std::swap(rhs[col * points + j], rhs[pivot * points + j]);
+		}
+		for (int r = 0; r < m; r++)
+		{
+			if (r == col || kkt[r * m + col] == 0.0) continue;
+			double f = kkt[r * m + col] / kkt[col * m + col];
+			for (int k = col; k < m; k++) kkt[r * m + k] -= f * kkt[col * m + k];
+			for (int j = 0; j < points; j++) rhs[r * points + j] -= f * rhs[col * points + j];
+		}
+	}
+
+	std::vector<double> fit(order * points);
+	for (int k = 0; k < order; k++)
+		for (int j = 0; j < points; j++) fit[k * points + j] = rhs[k * points + j] / kkt[k * m + k];
+	return fit;
+}
+
+double Ephemeris::chebyshev(const double* c, int order, double tau)
+{
+	double b1 = 0.0, b2 = 0.0;
+	for (int k = order - 1; k >= 1; k--)
+	{
+		double b0 = 2.0 * tau * b1 - b2 + c[k];
+		b2 = b1;
+		b1 = b0;
+	}
+	return tau * b1 - b2 + c[0];
+}
+
+double Ephemeris::chebyshevDerivative(const double* c, int order, double tau)
+{
+	// T_k' = k U_(k-1), Clenshaw over the U series with coefficients (j + 1) c_(j + 1)
+	double b1 = 0.0, b2 = 0.0;
+	for (int j = order - 2; j >= 0; j--)
+	{
+		double b0 = 2.0 * tau * b1 - b2 + (j + 1) * c[j + 1];
+		b2 = b1;
+		b1 = b0;
+	}
+	return b1;
+}
@@ -0,0 +1,308 @@
+#pragma once
+
+#include "Common.hpp"
+#include "BodyArrays.hpp"
+#include "Reduction.hpp"
+
+#if defined(__AVX2__) && (defined(__FMA__) || defined(_MSC_VER))
+	#define SS_GRAVITY_AVX2
+	#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define SS_GRAVITY_SSE2
+	#include <emmintrin.h>
+#endif
+
+// Gravitational constant in scene units. Picked so a circular N-body orbit has the same angular
+// velocity as the legacy rails formula sqrt(9999 * M / r^3), which was in degrees per second.
+constexpr double kDegToRad = 3.14159265358979323846 / 180.0;
+constexpr double kGravity = 9999.0 * kDegToRad * kDegToRad;
+
+// All-pairs O(N^2) gravity over SoA body arrays
+class Gravity
+{
+	INCONSTRUCTIBLE(Gravity)
+
+public:
+	// writes the acceleration of bodies [begin, end) caused by every body into ax/ay/az.
+	// each body sums its partners in a fixed order, so any split of the range gives the same bits.
+	// compensated sums carry the rounding error of every add along and use an exact sqrt and divide,
+	// which also makes the result the same on every x86 vendor, unlike the rsqrt estimate
+	static void directSum(BodyArrays& bodies, double G, double softening, size_t begin, size_t end, bool isCompensated = false);
+
+	static const char* kernelName();
+
+private:
+	static void directSumScalar(BodyArrays& bodies, double G, double eps2, size_t begin, size_t end);
+
+	static void directSumCompensated(BodyArrays& bodies, double G, double eps2, size_t begin, size_t end);
+
+#ifdef SS_GRAVITY_AVX2
+	static void directSumAVX2(BodyArrays& bodies, double G, double eps2, size_t begin, size_t end);
+
+	static void directSumCompensatedAVX2(BodyArrays& bodies, double G, double eps2, size_t begin, size_t end);
+#endif
+
+#ifdef SS_GRAVITY_SSE2
+	static void directSumSSE2(BodyArrays& bodies, double G, double eps2, size_t begin, size_t end);
+#endif
+};
+
+void Gravity::directSum(BodyArrays& bodies, double G, double softening, size_t begin, size_t end, bool isCompensated)
+{
+	double eps2 = softening * softening;
+	if (isCompensated)
+	{
+#ifdef SS_GRAVITY_AVX2
+		directSumCompensatedAVX2(bodies, G, eps2, begin, end);
+#else
+		directSumCompensated(bodies, G, eps2, begin, end);
+#endif
+		return;
+	}
+#if defined(SS_GRAVITY_AVX2)
+	directSumAVX2(bodies, G, eps2, begin, end);
+#elif defined(SS_GRAVITY_SSE2)
+	directSumSSE2(bodies, G, eps2, begin, end);
+#else
+	directSumScalar(bodies, G, eps2, begin, end);
+#endif
+}
+
+const char* Gravity::kernelName()
+{
+#if defined(SS_GRAVITY_AVX2)
+	return "avx2";
+#elif defined(SS_GRAVITY_SSE2)
+	return "sse2";
+#else
+	return "scalar";
+#endif
+}
+
+void Gravity::directSumScalar(BodyArrays& bodies, double G, double eps2, size_t begin, size_t end)
+{
+	const size_t n = bodies.size();
+	const double* px = bodies.px.data();
+	const double* py = bodies.py.data();
+	const double* pz = bodies.pz.data();
+	const double* m = bodies.mass.data();
+
+	for (size_t i = begin; i < end; i++)
+	{
+		double ax = 0.0, ay = 0.0, az = 0.0;
+		for (size_t j = 0; j < n; j++)
+		{
+			double dx = px[j] - px[i], dy = py[j] - py[i], dz = pz[j] - pz[i];
+			double r2 = dx * dx + dy * dy + dz * dz + eps2;
+			if (r2 <= 0.0) continue;
+			double s = m[j] / (r2 * std::sqrt(r2));
+			ax += s * dx; ay += s * dy; az += s * dz;
+		}
+		bodies.ax[i] = G * ax; bodies.ay[i] = G * ay; bodies.az[i] = G * az;
+	}
+}
+
+void Gravity::directSumCompensated(BodyArrays& bodies, double G, double eps2, size_t begin, size_t end)
+{
+	const size_t n = bodies.size();
+	const double* px = bodies.px.data();
+	const double* py = bodies.py.data();
+	const double* pz = bodies.pz.data();
+	const double* m = bodies.mass.data();
+
+	for (size_t i = begin; i < end; i++)
+	{
+		CompensatedSum ax, ay, az;
+		for (size_t j = 0; j < n; j++)
+		{
+			double dx = px[j] - px[i], dy = py[j] - py[i], dz = pz[j] - pz[i];
+			double r2 = dx * dx + dy * dy + dz * dz + eps2;
+			if (r2 <= 0.0) continue;
+			double s = m[j] / (r2 * std::sqrt(r2));
+			ax.add(s * dx); ay.add(s * dy); az.add(s * dz);
+		}
+		bodies.ax[i] = G * ax.value(); bodies.ay[i] = G * ay.value(); bodies.az[i] = G * az.value();
+	}
+}
+
+#ifdef SS_GRAVITY_AVX2
+void Gravity::directSumAVX2(BodyArrays& bodies, double G, double eps2, size_t begin, size_t end)
+{
+	const size_t n = bodies.size();
+	const size_t n4 = n & ~(size_t)3;
+	const double* px = bodies.px.data();
+	const double* py = bodies.py.data();
+	const double* pz = bodies.pz.data();
+	const double* m = bodies.mass.data();
+	const __m256d vEps2 = _mm256_set1_pd(eps2);
+	const __m256d vHalf = _mm256_set1_pd(0.5);
+	const __m256d vThreeHalves = _mm256_set1_pd(1.5);
+	const __m256d vTiny = _mm256_set1_pd(1e-30);
+	const __m256d vZero = _mm256_setzero_pd();
+
+	for (size_t i = begin; i < end; i++)
+	{
+		const __m256d xi = _mm256_set1_pd(px[i]), yi = _mm256_set1_pd(py[i]), zi = _mm256_set1_pd(pz[i]);
+		__m256d accX = vZero, accY = vZero, accZ = vZero;
+		for (size_t j = 0; j < n4; j += 4)
+		{
+			__m256d dx = _mm256_sub_pd(_mm256_load_pd(px + j), xi);
+			__m256d dy = _mm256_sub_pd(_mm256_load_pd(py + j), yi);
+			__m256d dz = _mm256_sub_pd(_mm256_load_pd(pz + j), zi);
+			__m256d r2 = _mm256_fmadd_pd(dx, dx, _mm256_fmadd_pd(dy, dy, _mm256_fmadd_pd(dz, dz, vEps2)));
+			// self and coincident pairs give r2 == 0, mask them out instead of branching
+			__m256d valid = _mm256_cmp_pd(r2, vZero, _CMP_GT_OQ);
+			// float rsqrt estimate refined twice by newton-raphson, ~46 bits without a divide or sqrt
+			__m256d invR = _mm256_cvtps_pd(_mm_rsqrt_ps(_mm256_cvtpd_ps(_mm256_max_pd(r2, vTiny))));
+			__m256d halfR2 = _mm256_mul_pd(vHalf, r2);
+			invR = _mm256_mul_pd(invR, _mm256_fnmadd_pd(halfR2, _mm256_mul_pd(invR, invR), vThreeHalves));
+			invR = _mm256_mul_pd(invR, _mm256_fnmadd_pd(halfR2, _mm256_mul_pd(invR, invR), vThreeHalves));
+			__m256d invR3 = _mm256_mul_pd(invR, _mm256_mul_pd(invR, invR));
+			__m256d s = _mm256_and_pd(_mm256_mul_pd(_mm256_load_pd(m + j), invR3), valid);
+			accX = _mm256_fmadd_pd(s, dx, accX);
+			accY = _mm256_fmadd_pd(s, dy, accY);
+			accZ = _mm256_fmadd_pd(s, dz, accZ);
+		}
+
+		alignas(32) double lanes[3][4];
+		_mm256_store_pd(lanes[0], accX);
+		_mm256_store_pd(lanes[1], accY);
+		_mm256_store_pd(lanes[2], accZ);
+		double ax = (lanes[0][0] + lanes[0][1]) + (lanes[0][2] + lanes[0][3]);
+		double ay = (lanes[1][0] + lanes[1][1]) + (lanes[1][2] + lanes[1][3]);
+		double az = (lanes[2][0] + lanes[2][1]) + (lanes[2][2] + lanes[2][3]);
+
+		for (size_t j = n4; j < n; j++)
+		{
+			double dx = px[j] - px[i], dy = py[j] - py[i], dz = pz[j] - pz[i];
+			double r2 = dx * dx + dy * dy + dz * dz + eps2;
+			if (r2 <= 0.0) continue;
+			double s = m[j] / (r2 * std::sqrt(r2));
+			ax += s * dx; ay += s * dy; az += s * dz;
+		}
+		bodies.ax[i] = G * ax; bodies.ay[i] = G * ay; bodies.az[i] = G * az;
+	}
+}
+#endif
+
+#ifdef SS_GRAVITY_AVX2
+// neumaier per lane, the lanes and the scalar tail are joined through CompensatedSum
+void Gravity::directSumCompensatedAVX2(BodyArrays& bodies, double G, double eps2, size_t begin, size_t end)
+{
+	const size_t n = bodies.size();
+	const size_t n4 = n & ~(size_t)3;
+	const double* px = bodies.px.data();
+	const double* py = bodies.py.data();
+	const double* pz = bodies.pz.data();
+	const double* m = bodies.mass.data();
+	const __m256d vEps2 = _mm256_set1_pd(eps2);
+	const __m256d vOne = _mm256_set1_pd(1.0);
+	const __m256d vZero = _mm256_setzero_pd();
+	const __m256d vSign = _mm256_set1_pd(-0.0);
+
+	// sum += value, the rounding error of the add goes into compensation
+	auto add = [&](__m256d& sum, __m256d& compensation, __m256d value) {
+		__m256d t = _mm256_add_pd(sum, value);
+		__m256d isSumLarger = _mm256_cmp_pd(_mm256_andnot_pd(vSign, sum), _mm256_andnot_pd(vSign, value), _CMP_GE_OQ);
+		__m256d large = _mm256_blendv_pd(value, sum, isSumLarger), small = _mm256_blendv_pd(sum, value, isSumLarger);
+		compensation = _mm256_add_pd(compensation, _mm256_add_pd(_mm256_sub_pd(large, t), small));
+		sum = t;
+	};
+
+	for (size_t i = begin; i < end; i++)
+	{
+		const __m256d xi = _mm256_set1_pd(px[i]), yi = _mm256_set1_pd(py[i]), zi = _mm256_set1_pd(pz[i]);
+		__m256d accX = vZero, accY = vZero, accZ = vZero, errX = vZero, errY = vZero, errZ = vZero;
+		for (size_t j = 0; j < n4; j += 4)
+		{
+			__m256d dx = _mm256_sub_pd(_mm256_load_pd(px + j), xi);
+			__m256d dy = _mm256_sub_pd(_mm256_load_pd(py + j), yi);
+			__m256d dz = _mm256_sub_pd(_mm256_load_pd(pz + j), zi);
+			// exact sqrt and divide, coincident pairs are given r2 = 1 so nothing divides by zero before the mask
+			__m256d r2 = _mm256_add_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)), _mm256_mul_pd(dz, dz)), vEps2);
+			__m256d valid = _mm256_cmp_pd(r2, vZero, _CMP_GT_OQ);
+			__m256d safeR2 = _mm256_blendv_pd(vOne, r2, valid);
+			__m256d s = _mm256_and_pd(_mm256_div_pd(_mm256_load_pd(m + j), _mm256_mul_pd(safeR2, _mm256_sqrt_pd(safeR2))), valid);
+			add(accX, errX, _mm256_mul_pd(s, dx));
+			add(accY, errY, _mm256_mul_pd(s, dy));
+			add(accZ, errZ, _mm256_mul_pd(s, dz));
+		}
+
+		alignas(32) double lanes[6][4];
+		_mm256_store_pd(lanes[0], accX);
+		_mm256_store_pd(lanes[1], accY);
+		_mm256_store_pd(lanes[2], accZ);
+		_mm256_store_pd(lanes[3], errX);
+		_mm256_store_pd(lanes[4], errY);
+		_mm256_store_pd(lanes[5], errZ);
+		CompensatedSum a[3];
+		for (int d = 0; d < 3; d++)
+		{
+			for (int l = 0; l < 4; l++) a[d].add(lanes[d][l]);
+			for (int l = 0; l < 4; l++) a[d].add(lanes[d + 3][l]);
+		}
+
+		for (size_t j = n4; j < n; j++)
+		{
+			double dx = px[j] - px[i], dy = py[j] - py[i], dz = pz[j] - pz[i];
+			double r2 = dx * dx + dy * dy + dz * dz + eps2;
+			if (r2 <= 0.0) continue;
+			double s = m[j] / (r2 * std::sqrt(r2));
+			a[0].add(s * dx); a[1].add(s * dy); a[2].add(s * dz);
+		}
+		bodies.ax[i] = G * a[0].value(); bodies.ay[i] = G * a[1].value(); bodies.az[i] = G * a[2].value();
+	}
+}
+#endif
+
+#ifdef SS_GRAVITY_SSE2
+void Gravity::directSumSSE2(BodyArrays& bodies, double G, double eps2, size_t begin, size_t end)
+{
+	const size_t n = bodies.size();
+	const size_t n2 = n & ~(size_t)1;
+	const double* px = bodies.px.data();
+	const double* py = bodies.py.data();
+	const double* pz = bodies.pz.data();
+	const double* m = bodies.mass.data();
+	const __m128d vEps2 = _mm_set1_pd(eps2);
+	const __m128d vOne = _mm_set1_pd(1.0);
+	const __m128d vZero = _mm_setzero_pd();
+
+	for (size_t i = begin; i < end; i++)
+	{
+		const __m128d xi = _mm_set1_pd(px[i]), yi = _mm_set1_pd(py[i]), zi = _mm_set1_pd(pz[i]);
+		__m128d accX = vZero, accY = vZero, accZ = vZero;
+		for (size_t j = 0; j < n2; j += 2)
+		{
+			__m128d dx = _mm_sub_pd(_mm_load_pd(px + j), xi);
+			__m128d dy = _mm_sub_pd(_mm_load_pd(py + j), yi);
+			__m128d dz = _mm_sub_pd(_mm_load_pd(pz + j), zi);
+			__m128d r2 = _mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)), _mm_add_pd(_mm_mul_pd(dz, dz), vEps2));
+			__m128d valid = _mm_cmpgt_pd(r2, vZero);
+			__m128d invR3 = _mm_div_pd(vOne, _mm_mul_pd(r2, _mm_sqrt_pd(r2)));
+			__m128d s = _mm_and_pd(_mm_mul_pd(_mm_load_pd(m + j), invR3), valid);
+			accX = _mm_add_pd(accX, _mm_mul_pd(s, dx));
+			accY = _mm_add_pd(accY, _mm_mul_pd(s, dy));
+			accZ = _mm_add_pd(accZ, _mm_mul_pd(s, dz));
+		}
+
+		alignas(16) double lanes[3][2];
+		_mm_store_pd(lanes[0], accX);
+		_mm_store_pd(lanes[1], accY);
+		_mm_store_pd(lanes[2], accZ);
+		double ax = lanes[0][0] + lanes[0][1];
+		double ay = lanes[1][0] + lanes[1][1];
+		double az = lanes[2][0] + lanes[2][1];
+
+		for (size_t j = n2; j < n; j++)
+		{
+			double dx = px[j] - px[i], dy = py[j] - py[i], dz = pz[j] - pz[i];
+			double r2 = dx * dx + dy * dy + dz * dz + eps2;
+			if (r2 <= 0.0) continue;
+			double s = m[j] / (r2 * std::sqrt(r2));
+			ax += s * dx; ay += s * dy; az += s * dz;
+		}
+		bodies.ax[i] = G * ax; bodies.ay[i] = G * ay; bodies.az[i] = G * az;
+	}
+}
+#endif
@@ -0,0 +1,693 @@
+#pragma once
+
+#include "Common.hpp"
+#include "BodyArrays.hpp"
+#include "JobSystem.hpp"
+#include "Kepler.hpp"
+#include "Reduction.hpp"
+
+enum class IntegratorType
+{
+	LEAPFROG = 0,
+	YOSHIDA4,
+	RK45,
+	WISDOM_HOLMAN,
+	BLOCK_LEAPFROG
+};
+
+// What an integrator needs from whoever owns the bodies
+class ForceField
+{
+public:
+	virtual ~ForceField() = default;
+
+	// fill bodies.ax/ay/az from bodies' current positions and masses
+	virtual void accelerations(BodyArrays& bodies) = 0;
+
+	// same, but only the listed bodies' accelerations need to be written
+	virtual void accelerations(BodyArrays& bodies, const std::vector<uint32_t>& active) = 0;
+
+	// run task over [0, n) in chunks, possibly on several threads
+	virtual void parallelFor(size_t n, size_t grain, const RangeTask& task) = 0;
+
+	virtual double gravity() const = 0;
+
+	// the body a body orbits, -1 if it orbits nothing in particular
+	virtual int parent(size_t index) const { return -1; };
+
+	virtual const double softening() const { return 0.0; };
+};
+
+class Integrator
+{
+protected:
+	// whether state.ax/ay/az still match the current positions
+	bool _isAccelerationValid{ false };
+
+	uint64_t _evaluations{ 0 };
+	uint64_t _bodyEvaluations{ 0 };
+
+public:
+	virtual ~Integrator() = default;
+
+	virtual void step(BodyArrays& state, ForceField& forces, double dt) = 0;
+
+	virtual const char* name() const = 0;
+
+	// call whenever bodies, masses or the force law changed behind the integrator's back
+	void invalidate() { _isAccelerationValid = false; };
+
+	// force evaluations so far, the cost measure that matters at large N
+	const uint64_t evaluations() const { return _evaluations; };
+
+	// accelerations computed summed over bodies, what partial evaluations actually cost
+	const uint64_t bodyEvaluations() const { return _bodyEvaluations; };
+
+	// whatever is carried from one step to the next besides the body arrays, flattened to doubles,
+	// so a checkpoint resumes bit for bit
+	void saveState(std::vector<double>& out) const;
+
+	// false if data wasn't saved by this kind of integrator, with n bodies
+	bool restoreState(const double* data, size_t count, size_t n);
+
+	static std::unique_ptr<Integrator> create(IntegratorType type);
+
+	static const char* typeName(IntegratorType type);
+
+protected:
+	virtual void saveExtra(std::vector<double>& out) const {};
+
+	virtual bool restoreExtra(const double* data, size_t count, size_t n) { return count == 0; };
+
+	void evaluate(BodyArrays& state, ForceField& forces);
+
+	static void kick(BodyArrays& state, ForceField& forces, double h);
+
+	static void drift(BodyArrays& state, ForceField& forces, double h);
+};
+
+// second order kick-drift-kick leapfrog, one force evaluation per step
+class LeapfrogIntegrator : public Integrator
+{
+public:
+	void step(BodyArrays& state, ForceField& forces, double dt) override { kickDriftKick(state, forces, dt); };
+
+	const char* name() const override { return "leapfrog"; };
+
+protected:
+	void kickDriftKick(BodyArrays& state, ForceField& forces, double h);
+};
+
+// fourth order yoshida composition of three leapfrog steps, one of them backwards in time
+class Yoshida4Integrator : public LeapfrogIntegrator
+{
+public:
+	void step(BodyArrays& state, ForceField& forces, double dt) override;
+
+	const char* name() const override { return "yoshida4"; };
+};
+
+// dormand-prince 5(4) with an adaptive internal step, sub-stepping each fixed dt as needed
+class RK45Integrator : public Integrator
+{
+private:
+	double _rtol{ 1e-10 };
+	double _atol{ 1e-12 };
+	double _h{ 0.0 };
+	uint64_t _rejected{ 0 };
+
+	BodyArrays _stage;
+	std::vector<std::vector<double>> _kx, _kv;
+	std::vector<double> _x0, _v0;
+
+public:
+	void step(BodyArrays& state, ForceField& forces, double dt) override;
+
+	const char* name() const override { return "rk45"; };
+
+	void setTolerance(double rtol, double atol) { _rtol = rtol; _atol = atol; };
+
+	const uint64_t rejected() const { return _rejected; };
+
+protected:
+	// the adaptive step size carries over between fixed steps
+	void saveExtra(std::vector<double>& out) const override { out.push_back(_h); };
+
+	bool restoreExtra(const double* data, size_t count, size_t n) override;
+
+private:
+	// one trial step of size h, returns the scaled error norm and leaves the candidate in _stage
+	double attempt(BodyArrays& state, ForceField& forces, double h);
+};
+
+// Wisdom-Holman map in democratic heliocentric coordinates: bodies drift on exact kepler orbits
+// about the most massive body, everything else is a kick. Needs the central mass to dominate.
+class WisdomHolmanIntegrator : public Integrator
+{
+private:
+	AlignedVector<double> _qx, _qy, _qz;
+	AlignedVector<double> _ux, _uy, _uz;
+
+public:
+	void step(BodyArrays& state, ForceField& forces, double dt) override;
+
+	const char* name() const override { return "wisdom-holman"; };
+
+private:
+	// accelerations from everything but the central body
+	void interaction(BodyArrays& state, ForceField& forces, size_t central);
+};
+
+// Hierarchical block timesteps on top of kick-drift-kick. Each body gets a power of two level and steps
+// dt / 2^level. The levels split an energy error budget: leapfrog's error on an orbit of rate w stepped at h is
+// about m |e| (w h)^2 / 24, and the steps that meet the budget with the fewest evaluations make every
+// h proportional to the cube root of 1 / (m |e| w^2), so heavy tightly bound bodies step finely and light
+// ones coarsely, down to a floor of steps per orbit. A jerk criterion catches encounters with bodies other than
+// the parent. Centers step at least as finely as their satellites, and a body only gives up a level once
+// its criterion clears the coarser one by a margin, so levels don't flap at the boundary. Bodies are kept
+// sorted by level, so the bodies a sub-step kicks are a prefix of that order.
+class BlockLeapfrogIntegrator : public Integrator
+{
+private:
+	int _maxLevel{ 12 };
+	// relative energy error the levels are chosen for. it only counts orbits about their parents, satellites
+	// perturbing each other strongly add to it
+	double _tolerance{ 1e-6 };
+	double _minStepsPerOrbit{ 32.0 };
+	int _deepestLevel{ 0 };
+
+	std::vector<uint8_t> _levels;
+	// every body deepest level first, and how many bodies are on each level or a finer one
+	std::vector<uint32_t> _order;
+	std::vector<size_t> _finerCount;
+	std::vector<uint32_t> _active;
+	// each orbit's angular rate and the cube root of its error weight, scratch for assignLevels
+	std::vector<double> _rates, _weights;
+
+	// each body's acceleration when its last step opened and how long that step was,
+	// a finite difference jerk that notices encounters with bodies other than the parent
+	AlignedVector<double> _lastAx, _lastAy, _lastAz, _lastDt;
+
+public:
+	void step(BodyArrays& state, ForceField& forces, double dt) override;
+
+	const char* name() const override { return "block-leapfrog"; };
+
+	void setMaxLevel(int level) { _maxLevel = glm::clamp(level, 0, 30); };
+
+	void setTolerance(double tolerance) { _tolerance = tolerance; };
+
+	// the coarsest any orbit is stepped, however little of the energy it holds
+	void setMinStepsPerOrbit(double steps) { _minStepsPerOrbit = glm::max(steps, 4.0); };
+
+	const std::vector<uint8_t>& levels() const { return _levels; };
+
+	// finest level in use during the last step
+	const int deepestLevel() const { return _deepestLevel; };
+
+protected:
+	// the jerk estimate needs the previous step's accelerations and lengths, the hysteresis the levels
+	void saveExtra(std::vector<double>& out) const override;
+
+	bool restoreExtra(const double* data, size_t count, size_t n) override;
+
+private:
+	// pick every body's level from the current state, levels stay fixed for one full dt
+	void assignLevels(const BodyArrays& state, ForceField& forces, double dt);
+};
+
+void Integrator::saveState(std::vector<double>& out) const
+{
+	out.clear();
+	out.push_back(_isAccelerationValid ? 1.0 : 0.0);
+	saveExtra(out);
+}
+
+bool Integrator::restoreState(const double* data, size_t count, size_t n)
+{
+	if (count < 1 || !restoreExtra(data + 1, count - 1, n)) return false;
+	_isAccelerationValid = data[0] != 0.0;
+	return true;
+}
+
+std::unique_ptr<Integrator> Integrator::create(IntegratorType type)
+{
+	switch (type)
+	{
+	case IntegratorType::LEAPFROG: return std::make_unique<LeapfrogIntegrator>();
+	case IntegratorType::YOSHIDA4: return std::make_unique<Yoshida4Integrator>();
+	case IntegratorType::RK45: return std::make_unique<RK45Integrator>();
+	case IntegratorType::WISDOM_HOLMAN: return std::make_unique<WisdomHolmanIntegrator>();
+	case IntegratorType::BLOCK_LEAPFROG: return std::make_unique<BlockLeapfrogIntegrator>();
+	default:
+		ASSERT(false);
+	}
+
+	return nullptr;
+}
+
+const char* Integrator::typeName(IntegratorType type)
+{
+	switch (type)
+	{
+	case IntegratorType::LEAPFROG: return "leapfrog";
+	case IntegratorType::YOSHIDA4: return "yoshida4";
+	case IntegratorType::RK45: return "rk45";
+	case IntegratorType::WISDOM_HOLMAN: return "wisdom-holman";
+	case IntegratorType::BLOCK_LEAPFROG: return "block-leapfrog";
+	default:
+		return "unknown";
+	}
+}
+
+void Integrator::evaluate(BodyArrays& state, ForceField& forces)
+{
+	forces.accelerations(state);
+	_evaluations++;
+	_bodyEvaluations += state.size();
+	_isAccelerationValid = true;
+}
+
+void Integrator::kick(BodyArrays& state, ForceField& forces, double h)
+{
+	forces.parallelFor(state.size(), 4096, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+		{
+			state.vx[i] += h * state.ax[i];
+			state.vy[i] += h * state.ay[i];
+			state.vz[i] += h * state.az[i];
+		}
+	});
+}
+
+void Integrator::drift(BodyArrays& state, ForceField& forces, double h)
+{
+	forces.parallelFor(state.size(), 4096, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+		{
+			state.px[i] += h * state.vx[i];
+			state.py[i] += h * state.vy[i];
+			state.pz[i] += h * state.vz[i];
+		}
+	});
+}
+
+void LeapfrogIntegrator::kickDriftKick(BodyArrays& state, ForceField& forces, double h)
+{
+	if (!_isAccelerationValid) evaluate(state, forces);
+	kick(state, forces, 0.5 * h);
+	drift(state, forces, h);
+	evaluate(state, forces);
+	kick(state, forces, 0.5 * h);
+}
+
+void Yoshida4Integrator::step(BodyArrays& state, ForceField& forces, double dt)
+{
+	const double cbrt2 = std::cbrt(2.0);
+	const double w1 = 1.0 / (2.0 - cbrt2);
+	const double w0 = -cbrt2 * w1;
+	kickDriftKick(state, forces, w1 * dt);
+	kickDriftKick(state, forces, w0 * dt);
+	kickDriftKick(state, forces, w1 * dt);
+}
+
+bool RK45Integrator::restoreExtra(const double* data, size_t count, size_t n)
+{
+	if (count != 1) return false;
+	_h = data[0];
+	return true;
+}
+
+void RK45Integrator::step(BodyArrays& state, ForceField& forces, double dt)
+{
+	if (_h <= 0.0) _h = dt;
+
+	double t = 0.0;
+	while (t < dt)
+	{
+		double remaining = dt - t;
+		bool isTruncated = _h >= remaining;
+		double h = isTruncated ? remaining : _h;
+
+		double err = attempt(state, forces, h);
+		double factor = err > 0.0 ? glm::clamp(0.9 * std::pow(err, -0.2), 0.2, 5.0) : 5.0;
+		if (err > 1.0)
+		{
+			_rejected++;
+			_h = h * factor;
+			continue;
+		}
+
+		// accept, the last stage was evaluated at the new state so its accelerations carry over
+		state.px.swap(_stage.px); state.py.swap(_stage.py); state.pz.swap(_stage.pz);
+		state.vx.swap(_stage.vx); state.vy.swap(_stage.vy); state.vz.swap(_stage.vz);
+		state.ax.swap(_stage.ax); state.ay.swap(_stage.ay); state.az.swap(_stage.az);
+		_isAccelerationValid = true;
+		t = isTruncated ? dt : t + h;
+		// a step cut short by the end of the interval says little about the right step size
+		if (!isTruncated || factor < 1.0) _h = h * factor;
+	}
+}
+
+double RK45Integrator::attempt(BodyArrays& state, ForceField& forces, double h)
+{
+	static const double a[7][6] = {
+		{ 0.0 },
+		{ 1.0 / 5.0 },
+		{ 3.0 / 40.0, 9.0 / 40.0 },
+		{ 44.0 / 45.0, -56.0 / 15.0, 32.0 / 9.0 },
+		{ 19372.0 / 6561.0, -25360.0 / 2187.0, 64448.0 / 6561.0, -212.0 / 729.0 },
+		{ 9017.0 / 3168.0, -355.0 / 33.0, 46732.0 / 5247.0, 49.0 / 176.0, -5103.0 / 18656.0 },
+		{ 35.0 / 384.0, 0.0, 500.0 / 1113.0, 125.0 / 192.0, -2187.0 / 6784.0, 11.0 / 84.0 },
+	};
+	// fifth minus fourth order weights
+	static const double e[7] = { 71.0 / 57600.0, 0.0, -71.0 / 16695.0, 71.0 / 1920.0, -17253.0 / 339200.0, 22.0 / 525.0, -1.0 / 40.0 };
+
+	const size_t n = state.size();
+	if (!_isAccelerationValid) evaluate(state, forces);
+
+	if (_stage.size() != n)
+	{
+		_stage.clear();
+		for (size_t i = 0; i < n; i++) _stage.push({ 0.0, 0.0, 0.0 }, { 0.0, 0.0, 0.0 }, 0.0);
+		_kx.assign(7, std::vector<double>(3 * n));
+		_kv.assign(7, std::vector<double>(3 * n));
+	}
+	std::copy(state.mass.begin(), state.mass.end(), _stage.mass.begin());
+
+	// stage 0 derivatives are the current velocities and accelerations
+	for (size_t i = 0; i < n; i++)
+	{
+		_kx[0][i] = state.vx[i]; _kx[0][n + i] = state.vy[i]; _kx[0][2 * n + i] = state.vz[i];
+		_kv[0][i] = state.ax[i]; _kv[0][n + i] = state.ay[i]; _kv[0][2 * n + i] = state.az[i];
+	}
+
+	for (int s = 1; s < 7; s++)
+	{
+		forces.parallelFor(n, 4096, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++)
+			{
+				double x[3] = { state.px[i], state.py[i], state.pz[i] };
+				double v[3] = { state.vx[i], state.vy[i], state.vz[i] };
+				for (int j = 0; j < s; j++)
+				{
+					double w = h * a[s][j];
+					if (w == 0.0) continue;
+					for (int d = 0; d < 3; d++)
+					{
+						x[d] += w * _kx[j][d * n + i];
+						v[d] += w * _kv[j][d * n + i];
+					}
+				}
+				_stage.px[i] = x[0]; _stage.py[i] = x[1]; _stage.pz[i] = x[2];
+				_stage.vx[i] = v[0]; _stage.vy[i] = v[1]; _stage.vz[i] = v[2];
+			}
+		});
+
+		forces.accelerations(_stage);
+		_evaluations++;
+		_bodyEvaluations += n;
+		for (size_t i = 0; i < n; i++)
+		{
+			_kx[s][i] = _stage.vx[i]; _kx[s][n + i] = _stage.vy[i]; _kx[s][2 * n + i] = _stage.vz[i];
+			_kv[s][i] = _stage.ax[i]; _kv[s][n + i] = _stage.ay[i]; _kv[s][2 * n + i] = _stage.az[i];
+		}
+	}
+
+	// the 7th stage sits at the 5th order solution, _stage now holds the candidate state
+	const double* y0[6] = { state.px.data(), state.py.data(), state.pz.data(), state.vx.data(), state.vy.data(), state.vz.data() };
+	const double* y1[6] = { _stage.px.data(), _stage.py.data(), _stage.pz.data(), _stage.vx.data(), _stage.vy.data(), _stage.vz.data() };
+	double sum = Reduction::sum(forces, n, 0.0, [&](size_t i) {
+		double squares = 0.0;
+		for (int d = 0; d < 6; d++)
+		{
+			const auto& k = d < 3 ? _kx : _kv;
+			const size_t offset = (d % 3) * n;
+			double err = 0.0;
+			for (int j = 0; j < 7; j++) err += e[j] * k[j][offset + i];
+			err *= h;
+			double scale = _atol + _rtol * glm::max(std::abs(y0[d][i]), std::abs(y1[d][i]));
+			squares += (err / scale) * (err / scale);
+		}
+		return squares;
+	});
+
+	return n == 0 ? 0.0 : std::sqrt(sum / (6.0 * n));
+}
+
+void WisdomHolmanIntegrator::interaction(BodyArrays& state, ForceField& forces, size_t central)
+{
+	// relative positions are all the interaction term needs, zeroing the central mass drops its pull
+	double centralMass = state.mass[central];
+	state.mass[central] = 0.0;
+	evaluate(state, forces);
+	state.mass[central] = centralMass;
+}
+
+void WisdomHolmanIntegrator::step(BodyArrays& state, ForceField& forces, double dt)
+{
+	const size_t n = state.size();
+	if (n < 2)
+	{
+		drift(state, forces, dt);
+		return;
+	}
+
+	size_t central = 0;
+	for (size_t i = 1; i < n; i++) if (state.mass[i] > state.mass[central]) central = i;
+	const double centralMass = state.mass[central];
+	const double mu = forces.gravity() * centralMass;
+
+	// barycentre, it moves in a straight line
+	const glm::dvec3 zero = { 0.0, 0.0, 0.0 };
+	double totalMass = Reduction::sum(forces, n, 0.0, [&](size_t i) { return state.mass[i]; });
+	glm::dvec3 com = Reduction::sum(forces, n, zero, [&](size_t i) { return state.mass[i] * state.position(i); }) / totalMass;
+	glm::dvec3 vcm = Reduction::sum(forces, n, zero, [&](size_t i) { return state.mass[i] * state.velocity(i); }) / totalMass;
+
+	// heliocentric positions, barycentric velocities
+	_qx.resize(n); _qy.resize(n); _qz.resize(n);
+	_ux.resize(n); _uy.resize(n); _uz.resize(n);
+	const glm::dvec3 centralPos = state.position(central);
+	for (size_t i = 0; i < n; i++)
+	{
+		_qx[i] = state.px[i] - centralPos.x; _qy[i] = state.py[i] - centralPos.y; _qz[i] = state.pz[i] - centralPos.z;
+		_ux[i] = state.vx[i] - vcm.x; _uy[i] = state.vy[i] - vcm.y; _uz[i] = state.vz[i] - vcm.z;
+	}
+
+	auto interactionKick = [&](double h) {
+		if (!_isAccelerationValid) interaction(state, forces, central);
+		for (size_t i = 0; i < n; i++)
+		{
+			if (i == central) continue;
+			_ux[i] += h * state.ax[i]; _uy[i] += h * state.ay[i]; _uz[i] += h * state.az[i];
+		}
+	};
+
+	auto jump = [&](double h) {
+		glm::dvec3 p = Reduction::sum(forces, n, zero, [&](size_t i) {
+			return i == central ? zero : state.mass[i] * glm::dvec3(_ux[i], _uy[i], _uz[i]);
+		}) * (h / centralMass);
+		for (size_t i = 0; i < n; i++)
+		{
+			if (i == central) continue;
+			_qx[i] += p.x; _qy[i] += p.y; _qz[i] += p.z;
+		}
+	};
+
+	interactionKick(0.5 * dt);
+	jump(0.5 * dt);
+	forces.parallelFor(n, 256, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+		{
+			if (i == central) continue;
+			glm::dvec3 q = { _qx[i], _qy[i], _qz[i] }, u = { _ux[i], _uy[i], _uz[i] };
+			Kepler::drift(mu, q, u, dt);
+			_qx[i] = q.x; _qy[i] = q.y; _qz[i] = q.z;
+			_ux[i] = u.x; _uy[i] = u.y; _uz[i] = u.z;
+		}
+	});
+	jump(0.5 * dt);
+
+	// back to inertial positions, the barycentre fixes where the central body is
+	com += vcm * dt;
+	glm::dvec3 weighted = Reduction::sum(forces, n, zero, [&](size_t i) {
+		return i == central ? zero : state.mass[i] * glm::dvec3(_qx[i], _qy[i], _qz[i]);
+	});
+	glm::dvec3 newCentralPos = com - weighted / totalMass;
+	for (size_t i = 0; i < n; i++)
+	{
+		if (i == central) state.setPosition(i, newCentralPos);
+		else state.setPosition(i, newCentralPos + glm::dvec3(_qx[i], _qy[i], _qz[i]));
+	}
+
+	_isAccelerationValid = false;
+	interactionKick(0.5 * dt);
+
+	for (size_t i = 0; i < n; i++) if (i != central) state.setVelocity(i, vcm + glm::dvec3(_ux[i], _uy[i], _uz[i]));
+	glm::dvec3 momentum = Reduction::sum(forces, n, zero, [&](size_t i) {
+		return i == central ? zero : state.mass[i] * glm::dvec3(_ux[i], _uy[i], _uz[i]);
+	});
+	state.setVelocity(central, vcm - momentum / centralMass);
+}
+
+void BlockLeapfrogIntegrator::assignLevels(const BodyArrays& state, ForceField& forces, double dt)
+{
+	const size_t n = state.size();
+	const double G = forces.gravity();
+	const double softening = forces.softening();
+	const double twoPi = 2.0 * glm::pi<double>();
+	// a level is only given up once the criterion allows the coarser one with this much to spare
+	const double hysteresis = 1.25;
+
+	// every orbit's rate and share of the error, and the totals the budget is split by
+	_rates.assign(n, 0.0);
+	_weights.assign(n, 0.0);
+	double energy = 0.0, weights = 0.0;
+	for (size_t i = 0; i < n; i++)
+	{
+		int parent = forces.parent(i);
+		if (parent < 0 || parent == (int)i) continue;
+		glm::dvec3 r = state.position(i) - state.position(parent), v = state.velocity(i) - state.velocity(parent);
+		double distance = glm::length(r), mu = G * (state.mass[parent] + state.mass[i]);
+		if (mu <= 0.0 || distance <= 0.0) continue;
+		_rates[i] = std::sqrt(mu / (distance * distance * distance));
+		double orbital = state.mass[i] * std::abs(0.5 * glm::dot(v, v) - mu / distance);
+		energy += orbital;
+		_weights[i] = std::cbrt(orbital * _rates[i] * _rates[i] / 24.0);
+		weights += _weights[i];
+	}
+	// minimising the evaluations, sum of 1 / h, under sum of weight^3 h^2 <= tolerance * energy
+	const double scale = weights > 0.0 ? std::sqrt(_tolerance * energy / weights) : 0.0;
+
+	const bool hasPrevious = _levels.size() == n;
+	_levels.resize(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		double bodyDt = dt, eta = twoPi / _minStepsPerOrbit;
+		if (_rates[i] > 0.0)
+		{
+			bodyDt = twoPi / (_rates[i] * _minStepsPerOrbit);
+			if (_weights[i] > 0.0) bodyDt = glm::min(bodyDt, scale / _weights[i]);
+			// twice what the orbit itself turns the acceleration by, anything faster is an encounter
+			eta = 2.0 * _rates[i] * bodyDt;
+		}
+		else if (softening > 0.0)
+		{
+			// nothing to orbit, fall back to the usual sqrt(2 eta eps / |a|)
+			double a = glm::length(state.acceleration(i));
+			if (a > 0.0) bodyDt = std::sqrt(2.0 * eta * softening / a);
+		}
+
+		if (i < _lastDt.size() && _lastDt[i] > 0.0)
+		{
+			glm::dvec3 a = state.acceleration(i);
+			double jerk = glm::length(a - glm::dvec3(_lastAx[i], _lastAy[i], _lastAz[i])) / _lastDt[i];
+			if (jerk > 0.0) bodyDt = glm::min(bodyDt, eta * glm::length(a) / jerk);
+		}
+
+		auto levelOf = [&](double limit) {
+			int level = 0;
+			while (level < _maxLevel && dt / (double)(1u << level) > limit) level++;
+			return level;
+		};
+		int level = levelOf(bodyDt);
+		if (hasPrevious && level < _levels[i]) level = glm::min((int)_levels[i], levelOf(bodyDt / hysteresis));
+		_levels[i] = (uint8_t)level;
+	}
+
+	// a center drifting on a coarse step would drag its fast satellites' orbits around with it
+	for (size_t i = 0; i < n; i++)
+		for (int child = (int)i, parent = forces.parent(i); parent >= 0 && _levels[parent] < _levels[child]; child = parent, parent = forces.parent(parent))
+			_levels[parent] = _levels[child];
+
+	_deepestLevel = 0;
+	for (uint8_t level : _levels) _deepestLevel = glm::max(_deepestLevel, (int)level);
+	_finerCount.assign(_deepestLevel + 2, 0);
+	for (uint8_t level : _levels) _finerCount[level]++;
+	for (int level = _deepestLevel; level-- > 0;) _finerCount[level] += _finerCount[level + 1];
+	// deepest first: the bodies on a level and every finer one are the first _finerCount[level]
+	std::vector<size_t> next(_deepestLevel + 1);
+	for (int level = 0; level <= _deepestLevel; level++) next[level] = _finerCount[level + 1];
+	_order.resize(n);
+	for (size_t i = 0; i < n; i++) _order[next[_levels[i]]++] = (uint32_t)i;
+}
+
+void BlockLeapfrogIntegrator::saveExtra(std::vector<double>& out) const
+{
+	out.push_back((double)_lastDt.size());
+	for (auto* v : { &_lastAx, &_lastAy, &_lastAz, &_lastDt }) out.insert(out.end(), v->begin(), v->end());
+	out.insert(out.end(), _levels.begin(), _levels.end());
+}
+
+bool BlockLeapfrogIntegrator::restoreExtra(const double* data, size_t count, size_t n)
+{
+	// nothing kept yet is fine too, the first step starts the estimate over. without levels, as before they were
+	// saved, the first step has no hysteresis to apply
+	if (count < 1) return false;
+	size_t kept = (size_t)data[0];
+	if ((kept != n && kept != 0) || (count != 1 + 4 * kept && count != 1 + 5 * kept)) return false;
+	const double* v = data + 1;
+	_lastAx.assign(v, v + kept); _lastAy.assign(v + kept, v + 2 * kept);
+	_lastAz.assign(v + 2 * kept, v + 3 * kept); _lastDt.assign(v + 3 * kept, v + 4 * kept);
+	_levels.clear();
+	if (count == 1 + 5 * kept) for (size_t i = 0; i < kept; i++) _levels.push_back((uint8_t)v[4 * kept + i]);
+	return true;
+}
+
+void BlockLeapfrogIntegrator::step(BodyArrays& state, ForceField& forces, double dt)
+{
+	const size_t n = state.size();
+	if (!_isAccelerationValid)
+	{
+		evaluate(state, forces);
+		_lastDt.assign(n, 0.0);
+	}
+	if (_lastDt.size() != n) _lastDt.assign(n, 0.0);
+	_lastAx.resize(n); _lastAy.resize(n); _lastAz.resize(n);
+	assignLevels(state, forces, dt);
+
+	const uint32_t substeps = 1u << _deepestLevel;
+	const double h = dt / substeps;
+	auto halfStep = [&](uint32_t i) { return 0.5 * dt / (double)(1u << _levels[i]); };
+	// bodies whose own step starts or ends at sub-step boundary s, a body on level l does every 2^(deepest - l)
+	auto syncedCount = [&](uint32_t s) {
+		int shared = 0;
+		while (shared < _deepestLevel && (s & (1u << shared)) == 0) shared++;
+		return _finerCount[_deepestLevel - shared];
+	};
+
+	for (uint32_t s = 0; s < substeps; s++)
+	{
+		// opening half kicks for bodies starting a step, their accelerations are from when they last closed one
+		forces.parallelFor(syncedCount(s), 4096, [&](size_t begin, size_t end) {
+			for (size_t c = begin; c < end; c++)
+			{
+				uint32_t i = _order[c];
+				double k = halfStep(i);
+				state.vx[i] += k * state.ax[i]; state.vy[i] += k * state.ay[i]; state.vz[i] += k * state.az[i];
+				_lastAx[i] = state.ax[i]; _lastAy[i] = state.ay[i]; _lastAz[i] = state.az[i];
+			}
+		});
+
+		// the active bodies' forces read every position, so everything has to be at this sub-step
+		drift(state, forces, h);
+
+		_active.assign(_order.begin(), _order.begin() + syncedCount(s + 1));
+		forces.accelerations(state, _active);
+		_evaluations++;
+		_bodyEvaluations += _active.size();
+
+		forces.parallelFor(_active.size(), 4096, [&](size_t begin, size_t end) {
+			for (size_t c = begin; c < end; c++)
+			{
+				uint32_t i = _active[c];
+				double k = halfStep(i);
+				state.vx[i] += k * state.ax[i]; state.vy[i] += k * state.ay[i]; state.vz[i] += k * state.az[i];
+				_lastDt[i] = 2.0 * k;
+			}
+		});
+	}
+
+	// the last sub-step closes every body, so all accelerations are current again
+	_isAccelerationValid = true;
+}
@@ -0,0 +1,220 @@
+#pragma once
+
+#include "Common.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+typedef std::function<void(size_t, size_t)> RangeTask;
+
+typedef struct
+{
+	size_t begin;
+	size_t end;
+	const RangeTask* task;
+	std::atomic<size_t>* remaining;
+}JobChunk;
+
+typedef struct
+{
+	int threads;
+	double wallSeconds;
+	double busySeconds;
+	uint64_t chunks;
+	uint64_t steals;
+	// busy / (wall * threads), 1.0 means every thread worked the whole time
+	double efficiency;
+}JobStats;
+
+// Work-stealing pool for data parallel loops. parallelFor() cuts a range into chunks and deals them
+// round-robin onto per-thread deques; each thread pops its own deque from the back and steals from
+// the front of the others once it runs dry. The calling thread works too, so threads == 1 spawns nothing.
+// Every chunk writes a disjoint output range, so results don't depend on which thread ran what.
+class JobSystem
+{
+	NONCOPYABLE(JobSystem)
+
+private:
+	struct Worker
+	{
+		std::mutex mutex;
+		std::deque<JobChunk> chunks;
+		std::atomic<uint64_t> busyNs{ 0 };
+		std::atomic<uint64_t> executed{ 0 };
+		std::atomic<uint64_t> stolen{ 0 };
+	};
+
+	std::vector<std::unique_ptr<Worker>> _workers;
+	std::vector<std::thread> _threads;
+
+	std::mutex _wakeMutex;
+	std::condition_variable _wakeCv;
+	uint64_t _generation{ 0 };
+	bool _isStopping{ false };
+
+	std::atomic<uint64_t> _wallNs{ 0 };
+
+public:
+	JobSystem(int threads = (int)std::thread::hardware_concurrency());
+	~JobSystem();
+
+	// run task(chunkBegin, chunkEnd) over [begin, end) in chunks of grain, returns once all are done
+	void parallelFor(size_t begin, size_t end, size_t grain, const RangeTask& task);
+
+	const int threadCount() const { return (int)_workers.size(); };
+
+	JobStats stats() const;
+
+	void resetStats();
+
+private:
+	void workerLoop(int self);
+
+	// pop local work or steal some, run it, false if every deque was empty
+	bool runOne(int self);
+};
+
+JobSystem::JobSystem(int threads)
+{
+	if (threads < 1) threads = 1;
+	for (int i = 0; i < threads; i++) _workers.push_back(std::make_unique<Worker>());
+	// slot 0 belongs to whoever calls parallelFor
+	for (int i = 1; i < threads; i++) _threads.emplace_back(&JobSystem::workerLoop, this, i);
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(_wakeMutex);
+		_isStopping = true;
+	}
+	_wakeCv.notify_all();
+	for (auto& thread : _threads) thread.join();
+}
+
+void JobSystem::parallelFor(size_t begin, size_t end, size_t grain, const RangeTask& task)
+{
+	if (end <= begin) return;
+	if (grain == 0) grain = 1;
+
+	const size_t chunkCount = (end - begin + grain - 1) / grain;
+	if (_workers.size() == 1 || chunkCount == 1)
+	{
+		task(begin, end);
+		return;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	std::atomic<size_t> remaining{ chunkCount };
+
+	// deal contiguous chunks round-robin so every deque starts with a similar load
+	size_t chunkIndex = 0;
+	for (size_t b = begin; b < end; b += grain, chunkIndex++)
+	{
+		Worker& worker = *_workers[chunkIndex % _workers.size()];
+		std::lock_guard<std::mutex> lock(worker.mutex);
+		worker.chunks.push_back({ b, glm::min(b + grain, end), &task, &remaining });
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(_wakeMutex);
+		_generation++;
+	}
+	_wakeCv.notify_all();
+
+	while (remaining.load(std::memory_order_acquire) != 0)
+	{
+		if (!runOne(0)) std::this_thread::yield();
+	}
+
+	_wallNs += (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+void JobSystem::workerLoop(int self)
+{
+	uint64_t seen = 0;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(_wakeMutex);
+			_wakeCv.wait(lock, [&]() { return _isStopping || _generation != seen; });
+			if (_isStopping) return;
+			seen = _generation;
+		}
+
+		while (runOne(self));
+	}
+}
+
+bool JobSystem::runOne(int self)
+{
+	JobChunk chunk;
+	bool isFound = false;
+	bool isStolen = false;
+
+	{
+		Worker& own = *_workers[self];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (!own.chunks.empty())
+		{
+			chunk = own.chunks.back();
+			own.chunks.pop_back();
+			isFound = true;
+		}
+	}
+
+	const int count = (int)_workers.size();
+	for (int i = 1; !isFound && i < count; i++)
+	{
+		Worker& victim = *_workers[(self + i) % count];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.chunks.empty())
+		{
+			chunk = victim.chunks.front();
+			victim.chunks.pop_front();
+			isFound = isStolen = true;
+		}
+	}
+
+	if (!isFound) return false;
+
+	Worker& worker = *_workers[self];
+	auto start = std::chrono::steady_clock::now();
+	(*chunk.task)(chunk.begin, chunk.end);
+	worker.busyNs += (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	worker.executed++;
+	if (isStolen) worker.stolen++;
+
+	chunk.remaining->fetch_sub(1, std::memory_order_acq_rel);
+	return true;
+}
+
+JobStats JobSystem::stats() const
+{
+	JobStats stats = { threadCount(), 0.0, 0.0, 0, 0, 0.0 };
+	stats.wallSeconds = _wallNs.load() * 1e-9;
+	for (auto& worker : _workers)
+	{
+		stats.busySeconds += worker->busyNs.load() * 1e-9;
+		stats.chunks += worker->executed.load();
+		stats.steals += worker->stolen.load();
+	}
+	if (stats.wallSeconds > 0.0) stats.efficiency = stats.busySeconds / (stats.wallSeconds * stats.threads);
+	return stats;
+}
+
+void JobSystem::resetStats()
+{
+	_wallNs = 0;
+	for (auto& worker : _workers)
+	{
+		worker->busyNs = 0;
+		worker->executed = 0;
+		worker->stolen = 0;
+	}
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "Common.hpp"
+
+// Two body (kepler) solutions
+class Kepler
+{
+	INCONSTRUCTIBLE(Kepler)
+
+public:
+	// advance a body on its unperturbed orbit about a fixed mass with mu = G * M by dt, in place.
+	// universal variables, so elliptic, parabolic and hyperbolic orbits all go through the same path.
+	static void drift(double mu, glm::dvec3& pos, glm::dvec3& vel, double dt);
+
+	// stumpff functions c2(z) = (1 - cos sqrt z) / z and c3(z) = (sqrt z - sin sqrt z) / sqrt z^3
+	static void stumpff(double z, double& c2, double& c3);
+};
+
+void Kepler::stumpff(double z, double& c2, double& c3)
+{
+	if (std::abs(z) < 1e-3)
+	{
+		// series, the closed forms cancel catastrophically near zero
+		c2 = 1.0 / 2.0 - z / 24.0 + z * z / 720.0 - z * z * z / 40320.0;
+		c3 = 1.0 / 6.0 - z / 120.0 + z * z / 5040.0 - z * z * z / 362880.0;
+	}
+	else if (z > 0.0)
+	{
+		double s = std::sqrt(z);
+		c2 = (1.0 - std::cos(s)) / z;
+		c3 = (s - std::sin(s)) / (s * z);
+	}
+	else
+	{
+		double s = std::sqrt(-z);
+		c2 = (std::cosh(s) - 1.0) / -z;
+		c3 = (std::sinh(s) - s) / (s * -z);
+	}
+}
+
+void Kepler::drift(double mu, glm::dvec3& pos, glm::dvec3& vel, double dt)
+{
+	const double r0 = glm::length(pos);
+	if (r0 == 0.0 || mu <= 0.0 || dt == 0.0)
+	{
+		pos += vel * dt;
+		return;
+	}
+
+	const double sqrtMu = std::sqrt(mu);
+	const double sigma0 = glm::dot(pos, vel) / sqrtMu;
+	const double alpha = 2.0 / r0 - glm::dot(vel, vel) / mu;
+
+	// newton on the universal kepler equation for chi
+	double chi = alpha > 1e-12 ? sqrtMu * dt * alpha : sqrtMu * dt / r0;
+	double c2 = 0.5, c3 = 1.0 / 6.0, r = r0;
+	for (int i = 0; i < 64; i++)
+	{
+		double chi2 = chi * chi;
+		double z = alpha * chi2;
+		stumpff(z, c2, c3);
+		double f = sigma0 * chi2 * c2 + (1.0 - alpha * r0) * chi2 * chi * c3 + r0 * chi - sqrtMu * dt;
+		r = sigma0 * chi * (1.0 - z * c3) + (1.0 - alpha * r0) * chi2 * c2 + r0;
+		double delta = f / r;
+		chi -= delta;
+		if (std::abs(delta) <= 1e-15 * glm::max(std::abs(chi), 1.0)) break;
+	}
+
+	double chi2 = chi * chi;
+	stumpff(alpha * chi2, c2, c3);
+	r = sigma0 * chi * (1.0 - alpha * chi2 * c3) + (1.0 - alpha * r0) * chi2 * c2 + r0;
+
+	// lagrange coefficients
+	double f = 1.0 - chi2 / r0 * c2;
+	double g = dt - chi2 * chi * c3 / sqrtMu;
+	double fDot = sqrtMu / (r * r0) * chi * (alpha * chi2 * c3 - 1.0);
+	double gDot = 1.0 - chi2 / r * c2;
+
+	glm::dvec3 newPos = f * pos + g * vel;
+	vel = fDot * pos + gDot * vel;
+	pos = newPos;
+}
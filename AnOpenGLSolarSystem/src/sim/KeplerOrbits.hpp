@@ -0,0 +1,441 @@
+#pragma once
+
+#include "Common.hpp"
+#include "BodyArrays.hpp"
+
+#if defined(__AVX2__) && (defined(__FMA__) || defined(_MSC_VER))
+	#define SS_KEPLER_AVX2
+	#include <immintrin.h>
+#endif
+
+// Elliptic orbits of on-rails bodies, stored as SoA so a whole batch of Kepler's equations is solved
+// at once. Each orbit is relative to its parent:
+//   pos(t) = p * (cos E - e) + q * sin E,   E - e sin E = M0 + n t
+// where p and q span the orbit plane, p points at periapsis with length a and q has length b.
+// The elements are kept in double, anomalies are wrapped in double and Kepler's equation is solved in single
+// precision, then polished with one double newton step so positions at AU scales advance smoothly instead of
+// in float ulps and the orbit itself isn't rounded to float.
+class KeplerOrbits
+{
+	NONCOPYABLE(KeplerOrbits)
+
+	// saves and restores the private state in bulk
+	friend class Checkpoint;
+
+private:
+	// mean anomaly at t = 0 and mean motion, radians and radians per second
+	AlignedVector<double> _meanAnomaly, _meanMotion;
+
+	AlignedVector<double> _e;
+	AlignedVector<double> _px, _py, _pz;
+	AlignedVector<double> _qx, _qy, _qz;
+
+public:
+	KeplerOrbits() = default;
+	~KeplerOrbits() = default;
+
+	// orbit with semi-major axis a and eccentricity e about a mass with mu = G * M, periapsis along
+	// periapsis and moving towards direction there, at the given mean anomaly at time. returns its index.
+	size_t push(double mu, double a, double e, glm::dvec3 periapsis, glm::dvec3 direction, double meanAnomaly, double time);
+
+	void set(size_t index, double mu, double a, double e, glm::dvec3 periapsis, glm::dvec3 direction, double meanAnomaly, double time);
+
+	// osculating orbit through a relative position and velocity at time, for handing bodies back to the rails.
+	// an unbound body gets a frozen offset instead and false is returned.
+	bool setFromState(size_t index, double mu, glm::dvec3 pos, glm::dvec3 vel, double time);
+
+	// an orbit that never moves off offset
+	void setFixed(size_t index, glm::dvec3 offset);
+
+	void reserve(size_t n);
+
+	void resize(size_t n);
+
+	void clear() { resize(0); };
+
+	// move the last orbit into slot index and drop the last slot
+	void swapRemove(size_t index);
+
+	const size_t size() const { return _e.size(); };
+
+	const double meanAnomaly(size_t index, double time) const;
+
+	const double eccentricity(size_t index) const { return _e[index]; };
+
+	// the scaled periapsis and minor axes, zero q for a fixed orbit
+	const glm::dvec3 majorAxis(size_t index) const { return { _px[index], _py[index], _pz[index] }; };
+
+	const glm::dvec3 minorAxis(size_t index) const { return { _qx[index], _qy[index], _qz[index] }; };
+
+	// positions of orbits [begin, end) at time, relative to their parents
+	void propagate(double time, double* x, double* y, double* z, size_t begin, size_t end) const;
+
+	// scalar versions in double precision, for single bodies and for checking the batch
+	glm::dvec3 position(size_t index, double time) const;
+
+	glm::dvec3 velocity(size_t index, double time) const;
+
+	static const char* kernelName();
+
+	// E - e sin E = M by newton from danby's starting value, in double
+	static double solve(double meanAnomaly, double e);
+
+private:
+	void propagateScalar(double time, double* x, double* y, double* z, size_t begin, size_t end) const;
+
+#ifdef SS_KEPLER_AVX2
+	void propagateAVX2(double time, double* x, double* y, double* z, size_t begin, size_t end) const;
+
+	// sine and cosine of 8 floats, cephes style: quadrant reduction then minimax polynomials on [-pi/4, pi/4]
+	static void sincos8(__m256 x, __m256& s, __m256& c);
+
+	// the same in double for 4 lanes, for the polishing step
+	static void sincos4(__m256d x, __m256d& s, __m256d& c);
+#endif
+
+	static double wrapAngle(double angle);
+};
+
+double KeplerOrbits::wrapAngle(double angle)
+{
+	const double twoPi = 2.0 * glm::pi<double>();
+	return angle - twoPi * std::nearbyint(angle / twoPi);
+}
+
+size_t KeplerOrbits::push(double mu, double a, double e, glm::dvec3 periapsis, glm::dvec3 direction, double meanAnomaly, double time)
+{
+	size_t index = size();
+	resize(index + 1);
+	set(index, mu, a, e, periapsis, direction, meanAnomaly, time);
+	return index;
+}
+
+void KeplerOrbits::set(size_t index, double mu, double a, double e, glm::dvec3 periapsis, glm::dvec3 direction, double meanAnomaly, double time)
+{
+	e = glm::clamp(e, 0.0, 0.99);
+	if (a <= 0.0 || mu <= 0.0 || glm::length(periapsis) == 0.0)
+	{
+		setFixed(index, { 0.0, 0.0, 0.0 });
+		return;
+	}
+
+	// p along periapsis, q in the plane of periapsis and direction, perpendicular to p
+	glm::dvec3 p = glm::normalize(periapsis);
+	glm::dvec3 q = direction - glm::dot(direction, p) * p;
+	q = glm::length(q) > 0.0 ? glm::normalize(q) : glm::normalize(glm::cross(p, glm::dvec3(0.0, 1.0, 0.0)));
+	p *= a;
+	q *= a * std::sqrt(1.0 - e * e);
+
+	double n = std::sqrt(mu / (a * a * a));
+	_meanMotion[index] = n;
+	_meanAnomaly[index] = wrapAngle(meanAnomaly - wrapAngle(n * time));
+	_e[index] = e;
+	_px[index] = p.x; _py[index] = p.y; _pz[index] = p.z;
+	_qx[index] = q.x; _qy[index] = q.y; _qz[index] = q.z;
+}
+
+bool KeplerOrbits::setFromState(size_t index, double mu, glm::dvec3 pos, glm::dvec3 vel, double time)
+{
+	double r = glm::length(pos);
+	double v2 = glm::dot(vel, vel);
+	double energy = 0.5 * v2 - mu / r;
+	if (r == 0.0 || mu <= 0.0 || energy >= 0.0)
+	{
+		setFixed(index, pos);
+		return false;
+	}
+
+	double a = -mu / (2.0 * energy);
+	glm::dvec3 h = glm::cross(pos, vel);
+	glm::dvec3 eVec = glm::cross(vel, h) / mu - pos / r;
+	double e = glm::length(eVec);
+	if (e >= 0.99)
+	{
+		setFixed(index, pos);
+		return false;
+	}
+
+	// with no defined periapsis take the current position, E is then measured from here
+	glm::dvec3 p = e > 1e-12 ? eVec / e : pos / r;
+	glm::dvec3 q = glm::length(h) > 0.0 ? glm::normalize(glm::cross(h, p)) : glm::normalize(vel);
+
+	// eccentric anomaly of the current position
+	double cosE = (1.0 - r / a) / glm::max(e, 1e-12);
+	double sinE = glm::dot(pos, q) / (a * std::sqrt(1.0 - e * e));
+	double E = e > 1e-12 ? std::atan2(sinE, cosE) : std::atan2(glm::dot(pos, q), glm::dot(pos, p));
+	double M = E - e * std::sin(E);
+
+	double n = std::sqrt(mu / (a * a * a));
+	p *= a;
+	q *= a * std::sqrt(1.0 - e * e);
+	_meanMotion[index] = n;
+	_meanAnomaly[index] = wrapAngle(M - wrapAngle(n * time));
+	_e[index] = e;
+	_px[index] = p.x; _py[index] = p.y; _pz[index] = p.z;
+	_qx[index] = q.x; _qy[index] = q.y; _qz[index] = q.z;
+	return true;
+}
+
+void KeplerOrbits::setFixed(size_t index, glm::dvec3 offset)
+{
+	// e = 0, n = 0 keeps E at 0 so the position is p forever
+	_meanMotion[index] = 0.0;
+	_meanAnomaly[index] = 0.0;
+	_e[index] = 0.0;
+	_px[index] = offset.x; _py[index] = offset.y; _pz[index] = offset.z;
+	_qx[index] = 0.0; _qy[index] = 0.0; _qz[index] = 0.0;
+}
+
+void KeplerOrbits::reserve(size_t n)
+{
+	_meanAnomaly.reserve(n); _meanMotion.reserve(n); _e.reserve(n);
+	_px.reserve(n); _py.reserve(n); _pz.reserve(n);
+	_qx.reserve(n); _qy.reserve(n); _qz.reserve(n);
+}
+
+void KeplerOrbits::resize(size_t n)
+{
+	_meanAnomaly.resize(n); _meanMotion.resize(n); _e.resize(n);
+	_px.resize(n); _py.resize(n); _pz.resize(n);
+	_qx.resize(n); _qy.resize(n); _qz.resize(n);
+}
+
+void KeplerOrbits::swapRemove(size_t index)
+{
+	size_t last = size() - 1;
+	_meanAnomaly[index] = _meanAnomaly[last]; _meanMotion[index] = _meanMotion[last]; _e[index] = _e[last];
+	_px[index] = _px[last]; _py[index] = _py[last]; _pz[index] = _pz[last];
+	_qx[index] = _qx[last]; _qy[index] = _qy[last]; _qz[index] = _qz[last];
+	resize(last);
+}
+
+const double KeplerOrbits::meanAnomaly(size_t index, double time) const
+{
+	return wrapAngle(_meanAnomaly[index] + wrapAngle(_meanMotion[index] * time));
+}
+
+double KeplerOrbits::solve(double meanAnomaly, double e)
+{
+	double E = meanAnomaly + (meanAnomaly < 0.0 ? -0.85 : 0.85) * e;
+	for (int i = 0; i < 32; i++)
+	{
+		double delta = (E - e * std::sin(E) - meanAnomaly) / (1.0 - e * std::cos(E));
+		E -= delta;
+		if (std::abs(delta) < 1e-14) break;
+	}
+	return E;
+}
+
+glm::dvec3 KeplerOrbits::position(size_t index, double time) const
+{
+	double e = _e[index];
+	double E = solve(meanAnomaly(index, time), e);
+	glm::dvec3 p = { _px[index], _py[index], _pz[index] }, q = { _qx[index], _qy[index], _qz[index] };
+	return p * (std::cos(E) - e) + q * std::sin(E);
+}
+
+glm::dvec3 KeplerOrbits::velocity(size_t index, double time) const
+{
+	double e = _e[index];
+	double E = solve(meanAnomaly(index, time), e);
+	double rate = _meanMotion[index] / (1.0 - e * std::cos(E));
+	glm::dvec3 p = { _px[index], _py[index], _pz[index] }, q = { _qx[index], _qy[index], _qz[index] };
+	return (q * std::cos(E) - p * std::sin(E)) * rate;
+}
+
+void KeplerOrbits::propagate(double time, double* x, double* y, double* z, size_t begin, size_t end) const
+{
+#ifdef SS_KEPLER_AVX2
+	propagateAVX2(time, x, y, z, begin, end);
+#else
+	propagateScalar(time, x, y, z, begin, end);
+#endif
+}
+
+const char* KeplerOrbits::kernelName()
+{
+#ifdef SS_KEPLER_AVX2
+	return "avx2";
+#else
+	return "scalar";
+#endif
+}
+
+void KeplerOrbits::propagateScalar(double time, double* x, double* y, double* z, size_t begin, size_t end) const
+{
+	for (size_t i = begin; i < end; i++)
+	{
+		double Md = meanAnomaly(i, time);
+		float M = (float)Md;
+		float e = (float)_e[i];
+		float E = M + (M < 0.0f ? -0.85f : 0.85f) * e;
+		float s = std::sin(E), c = std::cos(E);
+		for (int k = 0; k < 6; k++)
+		{
+			float f = E - e * s - M, f1 = 1.0f - e * c, f2 = e * s, f3 = e * c;
+			float d1 = -f / f1;
+			float d2 = -f / (f1 + 0.5f * d1 * f2);
+			float delta = -f / (f1 + 0.5f * d2 * f2 + d2 * d2 * f3 * (1.0f / 6.0f));
+			E += delta;
+			if (std::abs(delta) < 1e-3f) break;
+			s = std::sin(E); c = std::cos(E);
+		}
+
+		// one newton step in double takes the float root to full precision
+		double Ed = E, ed = _e[i];
+		double sd = std::sin(Ed), cd = std::cos(Ed);
+		double delta = (Md - Ed + ed * sd) / (1.0 - ed * cd);
+		double k2 = 1.0 - 0.5 * delta * delta;
+		double ns = sd * k2 + cd * delta;
+		cd = cd * k2 - sd * delta;
+		sd = ns;
+
+		double u = cd - ed;
+		x[i] = _px[i] * u + _qx[i] * sd;
+		y[i] = _py[i] * u + _qy[i] * sd;
+		z[i] = _pz[i] * u + _qz[i] * sd;
+	}
+}
+
+#ifdef SS_KEPLER_AVX2
+void KeplerOrbits::sincos8(__m256 x, __m256& s, __m256& c)
+{
+	const __m256 vTwoOverPi = _mm256_set1_ps(0.636619772367581f);
+	// pi / 2 split in three so the reduction stays exact
+	const __m256 vDp1 = _mm256_set1_ps(1.5703125f);
+	const __m256 vDp2 = _mm256_set1_ps(4.837512969970703125e-4f);
+	const __m256 vDp3 = _mm256_set1_ps(7.54978995489188216e-8f);
+
+	__m256 j = _mm256_round_ps(_mm256_mul_ps(x, vTwoOverPi), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+	__m256i quadrant = _mm256_cvtps_epi32(j);
+	__m256 y = _mm256_fnmadd_ps(j, vDp1, x);
+	y = _mm256_fnmadd_ps(j, vDp2, y);
+	y = _mm256_fnmadd_ps(j, vDp3, y);
+	__m256 y2 = _mm256_mul_ps(y, y);
+
+	__m256 sp = _mm256_fmadd_ps(_mm256_set1_ps(-1.9515295891e-4f), y2, _mm256_set1_ps(8.3321608736e-3f));
+	sp = _mm256_fmadd_ps(sp, y2, _mm256_set1_ps(-1.6666654611e-1f));
+	sp = _mm256_fmadd_ps(_mm256_mul_ps(sp, y2), y, y);
+
+	__m256 cp = _mm256_fmadd_ps(_mm256_set1_ps(2.443315711809948e-5f), y2, _mm256_set1_ps(-1.388731625493765e-3f));
+	cp = _mm256_fmadd_ps(cp, y2, _mm256_set1_ps(4.166664568298827e-2f));
+	cp = _mm256_fmadd_ps(_mm256_mul_ps(cp, y2), y2, _mm256_fnmadd_ps(_mm256_set1_ps(0.5f), y2, _mm256_set1_ps(1.0f)));
+
+	// odd quadrants swap sine and cosine, quadrants 2 and 3 negate sine, 1 and 2 negate cosine
+	__m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(quadrant, _mm256_set1_epi32(1)), _mm256_set1_epi32(1)));
+	__m256 sinSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(quadrant, _mm256_set1_epi32(2)), 30));
+	__m256 cosSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(quadrant, _mm256_set1_epi32(1)), _mm256_set1_epi32(2)), 30));
+	s = _mm256_xor_ps(_mm256_blendv_ps(sp, cp, swap), sinSign);
+	c = _mm256_xor_ps(_mm256_blendv_ps(cp, sp, swap), cosSign);
+}
+
+void KeplerOrbits::sincos4(__m256d x, __m256d& s, __m256d& c)
+{
+	const __m256d vTwoOverPi = _mm256_set1_pd(0.63661977236758134308);
+	const __m256d vPio2Hi = _mm256_set1_pd(1.57079632679489655800e+00);
+	const __m256d vPio2Lo = _mm256_set1_pd(6.12323399573676603587e-17);
+	const __m256d vSignMask = _mm256_set1_pd(-0.0);
+
+	__m256d j = _mm256_round_pd(_mm256_mul_pd(x, vTwoOverPi), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+	__m256d y = _mm256_fnmadd_pd(j, vPio2Hi, x);
+	y = _mm256_fnmadd_pd(j, vPio2Lo, y);
+	__m256d y2 = _mm256_mul_pd(y, y);
+
+	__m256d sp = _mm256_fmadd_pd(_mm256_set1_pd(1.58962301576546568060e-10), y2, _mm256_set1_pd(-2.50507477628578072866e-8));
+	sp = _mm256_fmadd_pd(sp, y2, _mm256_set1_pd(2.75573136213857245213e-6));
+	sp = _mm256_fmadd_pd(sp, y2, _mm256_set1_pd(-1.98412698295895385996e-4));
+	sp = _mm256_fmadd_pd(sp, y2, _mm256_set1_pd(8.33333333332211858878e-3));
+	sp = _mm256_fmadd_pd(sp, y2, _mm256_set1_pd(-1.66666666666666307295e-1));
+	sp = _mm256_fmadd_pd(_mm256_mul_pd(sp, y2), y, y);
+
+	__m256d cp = _mm256_fmadd_pd(_mm256_set1_pd(-1.13585365213876817300e-11), y2, _mm256_set1_pd(2.08757008419747316778e-9));
+	cp = _mm256_fmadd_pd(cp, y2, _mm256_set1_pd(-2.75573141792967388112e-7));
+	cp = _mm256_fmadd_pd(cp, y2, _mm256_set1_pd(2.48015872888517045348e-5));
+	cp = _mm256_fmadd_pd(cp, y2, _mm256_set1_pd(-1.38888888888730564116e-3));
+	cp = _mm256_fmadd_pd(cp, y2, _mm256_set1_pd(4.16666666666665929218e-2));
+	cp = _mm256_fmadd_pd(_mm256_mul_pd(cp, y2), y2, _mm256_fnmadd_pd(_mm256_set1_pd(0.5), y2, _mm256_set1_pd(1.0)));
+
+	// quadrant j mod 4 kept in double, the masks come from comparisons instead of integer shifts
+	__m256d quadrant = _mm256_fnmadd_pd(_mm256_floor_pd(_mm256_mul_pd(j, _mm256_set1_pd(0.25))), _mm256_set1_pd(4.0), j);
+	__m256d odd = _mm256_fnmadd_pd(_mm256_floor_pd(_mm256_mul_pd(quadrant, _mm256_set1_pd(0.5))), _mm256_set1_pd(2.0), quadrant);
+	__m256d swap = _mm256_cmp_pd(odd, _mm256_set1_pd(0.5), _CMP_GT_OQ);
+	__m256d sinSign = _mm256_and_pd(_mm256_cmp_pd(quadrant, _mm256_set1_pd(1.5), _CMP_GT_OQ), vSignMask);
+	__m256d cosSign = _mm256_and_pd(_mm256_and_pd(_mm256_cmp_pd(quadrant, _mm256_set1_pd(0.5), _CMP_GT_OQ),
+		_mm256_cmp_pd(quadrant, _mm256_set1_pd(2.5), _CMP_LT_OQ)), vSignMask);
+	s = _mm256_xor_pd(_mm256_blendv_pd(sp, cp, swap), sinSign);
+	c = _mm256_xor_pd(_mm256_blendv_pd(cp, sp, swap), cosSign);
+}
+
+void KeplerOrbits::propagateAVX2(double time, double* x, double* y, double* z, size_t begin, size_t end) const
+{
+	const __m256d vTime = _mm256_set1_pd(time);
+	const __m256d vTwoPi = _mm256_set1_pd(2.0 * glm::pi<double>());
+	const __m256d vInvTwoPi = _mm256_set1_pd(0.5 / glm::pi<double>());
+	const __m256 vDanby = _mm256_set1_ps(0.85f);
+	const __m256 vOne = _mm256_set1_ps(1.0f);
+	const __m256 vTolerance = _mm256_set1_ps(1e-3f);
+	const __m256 vHalf = _mm256_set1_ps(0.5f);
+	const __m256 vSixth = _mm256_set1_ps(1.0f / 6.0f);
+	const __m256 vSignMask = _mm256_set1_ps(-0.0f);
+	const __m256d vOneD = _mm256_set1_pd(1.0);
+	const __m256d vHalfD = _mm256_set1_pd(0.5);
+
+	auto wrap = [&](__m256d angle) {
+		__m256d turns = _mm256_round_pd(_mm256_mul_pd(angle, vInvTwoPi), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+		return _mm256_fnmadd_pd(turns, vTwoPi, angle);
+	};
+
+	// one double newton step from the float root, then the positions of 4 orbits in double
+	auto polish = [&](size_t k, __m128 Ef, __m256d M) {
+		__m256d E = _mm256_cvtps_pd(Ef), e = _mm256_loadu_pd(_e.data() + k);
+		__m256d s, c;
+		sincos4(E, s, c);
+		__m256d delta = _mm256_div_pd(_mm256_sub_pd(M, _mm256_fnmadd_pd(e, s, E)), _mm256_fnmadd_pd(e, c, vOneD));
+		__m256d k2 = _mm256_fnmadd_pd(vHalfD, _mm256_mul_pd(delta, delta), vOneD);
+		__m256d ns = _mm256_fmadd_pd(c, delta, _mm256_mul_pd(s, k2));
+		c = _mm256_fnmadd_pd(s, delta, _mm256_mul_pd(c, k2));
+		s = ns;
+
+		__m256d u = _mm256_sub_pd(c, e);
+		_mm256_storeu_pd(x + k, _mm256_fmadd_pd(_mm256_loadu_pd(_px.data() + k), u, _mm256_mul_pd(_mm256_loadu_pd(_qx.data() + k), s)));
+		_mm256_storeu_pd(y + k, _mm256_fmadd_pd(_mm256_loadu_pd(_py.data() + k), u, _mm256_mul_pd(_mm256_loadu_pd(_qy.data() + k), s)));
+		_mm256_storeu_pd(z + k, _mm256_fmadd_pd(_mm256_loadu_pd(_pz.data() + k), u, _mm256_mul_pd(_mm256_loadu_pd(_qz.data() + k), s)));
+	};
+
+	size_t i = begin;
+	for (; i + 8 <= end; i += 8)
+	{
+		// mean anomaly, wrapped in double before it is narrowed
+		__m256d lo = _mm256_add_pd(_mm256_loadu_pd(_meanAnomaly.data() + i), wrap(_mm256_mul_pd(_mm256_loadu_pd(_meanMotion.data() + i), vTime)));
+		__m256d hi = _mm256_add_pd(_mm256_loadu_pd(_meanAnomaly.data() + i + 4), wrap(_mm256_mul_pd(_mm256_loadu_pd(_meanMotion.data() + i + 4), vTime)));
+		lo = wrap(lo);
+		hi = wrap(hi);
+		__m256 M = _mm256_set_m128(_mm256_cvtpd_ps(hi), _mm256_cvtpd_ps(lo));
+		__m256 e = _mm256_set_m128(_mm256_cvtpd_ps(_mm256_loadu_pd(_e.data() + i + 4)), _mm256_cvtpd_ps(_mm256_loadu_pd(_e.data() + i)));
+
+		// danby's start, with M in [-pi, pi] the sign of sin M is the sign of M
+		__m256 E = _mm256_fmadd_ps(_mm256_or_ps(_mm256_and_ps(M, vSignMask), vDanby), e, M);
+		__m256 s, c;
+		sincos8(E, s, c);
+		for (int k = 0; k < 6; k++)
+		{
+			// danby's quartic newton: f and its first three derivatives all come from the same sincos
+			__m256 negF = _mm256_sub_ps(M, _mm256_fnmadd_ps(e, s, E));
+			__m256 f1 = _mm256_fnmadd_ps(e, c, vOne);
+			__m256 halfF2 = _mm256_mul_ps(vHalf, _mm256_mul_ps(e, s));
+			__m256 sixthF3 = _mm256_mul_ps(vSixth, _mm256_mul_ps(e, c));
+			__m256 d1 = _mm256_div_ps(negF, f1);
+			__m256 d2 = _mm256_div_ps(negF, _mm256_fmadd_ps(d1, halfF2, f1));
+			__m256 delta = _mm256_div_ps(negF, _mm256_fmadd_ps(_mm256_mul_ps(d2, d2), sixthF3, _mm256_fmadd_ps(d2, halfF2, f1)));
+			E = _mm256_add_ps(E, delta);
+			if (_mm256_movemask_ps(_mm256_cmp_ps(_mm256_andnot_ps(vSignMask, delta), vTolerance, _CMP_LT_OQ)) == 0xff) break;
+			sincos8(E, s, c);
+		}
+
+		polish(i, _mm256_castps256_ps128(E), lo);
+		polish(i + 4, _mm256_extractf128_ps(E, 1), hi);
+	}
+
+	propagateScalar(time, x, y, z, i, end);
+}
+#endif
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "Common.hpp"
+
+#ifdef _WIN32
+	#ifndef WIN32_LEAN_AND_MEAN
+		#define WIN32_LEAN_AND_MEAN
+	#endif
+	#ifndef NOMINMAX
+		#define NOMINMAX
+	#endif
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+// Read-only view of a whole file through the virtual memory system. Nothing is read up front,
+// pages come in from the page cache the first time they are touched.
+class MappedFile
+{
+	NONCOPYABLE(MappedFile)
+
+private:
+	const uint8_t* _data{ nullptr };
+	size_t _size{ 0 };
+
+#ifdef _WIN32
+	HANDLE _file{ INVALID_HANDLE_VALUE };
+	HANDLE _mapping{ nullptr };
+#endif
+
+public:
+	MappedFile() = default;
+	~MappedFile() { close(); };
+
+	// false for a missing or empty file, which can't be mapped
+	bool open(const std::string& path);
+
+	void close();
+
+	const bool isOpen() const { return _data != nullptr; };
+
+	const uint8_t* data() const { return _data; };
+
+	const size_t size() const { return _size; };
+
+	// ask the os to start reading [offset, offset + bytes) in the background, a hint that may do nothing
+	void willNeed(size_t offset, size_t bytes) const;
+};
+
+bool MappedFile::open(const std::string& path)
+{
+	close();
+#ifdef _WIN32
+	_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (_file == INVALID_HANDLE_VALUE) return false;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(_file, &size) || size.QuadPart == 0)
+	{
+		close();
+		return false;
+	}
+	_mapping = CreateFileMappingA(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (_mapping == nullptr)
+	{
+		close();
+		return false;
+	}
+	_data = (const uint8_t*)MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+	if (_data == nullptr)
+	{
+		close();
+		return false;
+	}
+	_size = (size_t)size.QuadPart;
+#else
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd == -1) return false;
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0)
+	{
+		::close(fd);
+		return false;
+	}
+	// the mapping keeps the file alive, the descriptor isn't needed past this
+	void* data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (data == MAP_FAILED) return false;
+	_data = (const uint8_t*)data;
+	_size = (size_t)info.st_size;
+#endif
+	return true;
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+	if (_data) UnmapViewOfFile(_data);
+	if (_mapping) CloseHandle(_mapping);
+	if (_file != INVALID_HANDLE_VALUE) CloseHandle(_file);
+	_mapping = nullptr;
+	_file = INVALID_HANDLE_VALUE;
+#else
+	if (_data) munmap((void*)_data, _size);
+#endif
+	_data = nullptr;
+	_size = 0;
+}
+
+void MappedFile::willNeed(size_t offset, size_t bytes) const
+{
+	if (!_data || offset >= _size) return;
+	bytes = std::min(bytes, _size - offset);
+#ifdef _WIN32
+	WIN32_MEMORY_RANGE_ENTRY range = { (PVOID)(_data + offset), bytes };
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+	// madvise wants a page aligned start
+	const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	const size_t start = offset / page * page;
+	posix_madvise((void*)(_data + start), bytes + offset - start, POSIX_MADV_WILLNEED);
+#endif
+}
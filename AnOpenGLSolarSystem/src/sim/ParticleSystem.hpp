@@ -0,0 +1,200 @@
+#pragma once
+
+#include "Common.hpp"
+#include "BodyArrays.hpp"
+#include "Integrator.hpp"
+#include "CollisionGrid.hpp"
+
+#include <mutex>
+#include <random>
+
+#if defined(__AVX2__) && (defined(__FMA__) || defined(_MSC_VER))
+	#define SS_PARTICLES_AVX2
+	#include <immintrin.h>
+#endif
+
+// A main belt or a planetary ring: many small particles orbiting one central body. They feel only the
+// central body and, optionally, each other through inelastic bumps; no body feels them. State is float
+// SoA relative to the center, 24 bytes a particle, stepped drift-kick-drift in parallel chunks, so a
+// million of them is a few milliseconds a step and never goes near the Planet/VertexArray per body path.
+class ParticleSystem
+{
+	NONCOPYABLE(ParticleSystem)
+
+	// saves and restores the private state in bulk
+	friend class Checkpoint;
+
+private:
+	std::string _name;
+
+	// body index of the center
+	int _center;
+
+	float _particleRadius;
+
+	// fraction of the approach speed kept after a bump
+	float _restitution{ 0.5f };
+
+	bool _isSelfInteraction{ false };
+
+	AlignedVector<float> _px, _py, _pz;
+	AlignedVector<float> _vx, _vy, _vz;
+
+	CollisionGrid _grid;
+	std::vector<Contact> _contacts;
+	size_t _lastContacts{ 0 };
+
+public:
+	ParticleSystem(const std::string& name, int center, float particleRadius);
+	~ParticleSystem() = default;
+
+	// count particles on prograde orbits about a center with mu = G * M, semi-major axes uniform in
+	// [innerRadius, outerRadius], eccentricities up to maxEccentricity and heights within +-thickness / 2
+	void populate(size_t count, double mu, float innerRadius, float outerRadius, float thickness, float maxEccentricity, uint64_t seed);
+
+	void step(ForceField& forces, double mu, double dt);
+
+	void setSelfInteraction(bool enabled) { _isSelfInteraction = enabled; _grid.invalidate(); };
+
+	void setRestitution(float restitution) { _restitution = restitution; };
+
+	void setCenter(int center) { _center = center; };
+
+	const std::string& name() const { return _name; };
+
+	const int center() const { return _center; };
+
+	const size_t size() const { return _px.size(); };
+
+	const bool isSelfInteraction() const { return _isSelfInteraction; };
+
+	const float particleRadius() const { return _particleRadius; };
+
+	// bumps resolved in the last step
+	const size_t lastContacts() const { return _lastContacts; };
+
+	const glm::vec3 position(size_t i) const { return { _px[i], _py[i], _pz[i] }; };
+
+	const glm::vec3 velocity(size_t i) const { return { _vx[i], _vy[i], _vz[i] }; };
+
+	// positions of particles [begin, end) relative to the center, as xyz triples into out + 3 * begin
+	void interleave(float* out, size_t begin, size_t end) const;
+
+private:
+	void driftKickDrift(float mu, float dt, size_t begin, size_t end);
+
+	void bump(ForceField& forces);
+};
+
+ParticleSystem::ParticleSystem(const std::string& name, int center, float particleRadius) :
+	_name(name), _center(center), _particleRadius(particleRadius)
+{
+}
+
+void ParticleSystem::populate(size_t count, double mu, float innerRadius, float outerRadius, float thickness, float maxEccentricity, uint64_t seed)
+{
+	std::mt19937_64 rng(seed);
+	std::uniform_real_distribution<double> aDist(innerRadius, outerRadius), eDist(0.0, maxEccentricity), angleDist(0.0, 2.0 * glm::pi<double>()),
+		heightDist(-0.5 * thickness, 0.5 * thickness);
+
+	size_t first = size();
+	for (auto* v : { &_px, &_py, &_pz, &_vx, &_vy, &_vz }) v->resize(first + count);
+	for (size_t i = first; i < first + count; i++)
+	{
+		// a point on an ellipse in the xz plane, counter clockwise seen from +y like the rails
+		double a = aDist(rng), e = eDist(rng), periapsis = angleDist(rng), E = angleDist(rng);
+		double b = a * std::sqrt(1.0 - e * e), rate = std::sqrt(mu / (a * a * a)) / (1.0 - e * std::cos(E));
+		glm::dvec2 p = { std::cos(periapsis), -std::sin(periapsis) }, q = { std::sin(periapsis), std::cos(periapsis) };
+		glm::dvec2 pos = a * (std::cos(E) - e) * p + b * std::sin(E) * q;
+		glm::dvec2 vel = (b * std::cos(E) * q - a * std::sin(E) * p) * rate;
+		_px[i] = (float)pos.x; _py[i] = (float)heightDist(rng); _pz[i] = (float)pos.y;
+		_vx[i] = (float)vel.x; _vy[i] = 0.0f; _vz[i] = (float)vel.y;
+	}
+	_grid.invalidate();
+}
+
+void ParticleSystem::step(ForceField& forces, double mu, double dt)
+{
+	forces.parallelFor(size(), 16384, [&](size_t begin, size_t end) {
+		driftKickDrift((float)mu, (float)dt, begin, end);
+	});
+	_lastContacts = 0;
+	if (_isSelfInteraction) bump(forces);
+}
+
+void ParticleSystem::driftKickDrift(float mu, float dt, size_t begin, size_t end)
+{
+	const float h = 0.5f * dt;
+	size_t i = begin;
+#ifdef SS_PARTICLES_AVX2
+	const __m256 vH = _mm256_set1_ps(h), vDt = _mm256_set1_ps(dt), vNegMu = _mm256_set1_ps(-mu);
+	const __m256 vTiny = _mm256_set1_ps(1e-12f);
+	for (; i + 8 <= end; i += 8)
+	{
+		__m256 vx = _mm256_load_ps(_vx.data() + i), vy = _mm256_load_ps(_vy.data() + i), vz = _mm256_load_ps(_vz.data() + i);
+		__m256 x = _mm256_fmadd_ps(vx, vH, _mm256_load_ps(_px.data() + i));
+		__m256 y = _mm256_fmadd_ps(vy, vH, _mm256_load_ps(_py.data() + i));
+		__m256 z = _mm256_fmadd_ps(vz, vH, _mm256_load_ps(_pz.data() + i));
+
+		__m256 r2 = _mm256_max_ps(_mm256_fmadd_ps(x, x, _mm256_fmadd_ps(y, y, _mm256_mul_ps(z, z))), vTiny);
+		__m256 k = _mm256_mul_ps(vDt, _mm256_div_ps(vNegMu, _mm256_mul_ps(r2, _mm256_sqrt_ps(r2))));
+		vx = _mm256_fmadd_ps(k, x, vx); vy = _mm256_fmadd_ps(k, y, vy); vz = _mm256_fmadd_ps(k, z, vz);
+
+		_mm256_store_ps(_px.data() + i, _mm256_fmadd_ps(vx, vH, x));
+		_mm256_store_ps(_py.data() + i, _mm256_fmadd_ps(vy, vH, y));
+		_mm256_store_ps(_pz.data() + i, _mm256_fmadd_ps(vz, vH, z));
+		_mm256_store_ps(_vx.data() + i, vx); _mm256_store_ps(_vy.data() + i, vy); _mm256_store_ps(_vz.data() + i, vz);
+	}
+#endif
+	for (; i < end; i++)
+	{
+		float x = _px[i] + h * _vx[i], y = _py[i] + h * _vy[i], z = _pz[i] + h * _vz[i];
+		float r2 = glm::max(x * x + y * y + z * z, 1e-12f);
+		float k = -mu * dt / (r2 * std::sqrt(r2));
+		_vx[i] += k * x; _vy[i] += k * y; _vz[i] += k * z;
+		_px[i] = x + h * _vx[i]; _py[i] = y + h * _vy[i]; _pz[i] = z + h * _vz[i];
+	}
+}
+
+void ParticleSystem::bump(ForceField& forces)
+{
+	_grid.update(_px.data(), _py.data(), _pz.data(), _particleRadius, size());
+	_contacts.clear();
+	std::mutex contactsMutex;
+	forces.parallelFor(_grid.cellCount(), 4096, [&](size_t begin, size_t end) {
+		std::vector<Contact> local;
+		_grid.collect(begin, end, local);
+		if (local.empty()) return;
+		std::lock_guard<std::mutex> lock(contactsMutex);
+		_contacts.insert(_contacts.end(), local.begin(), local.end());
+	});
+	_lastContacts = _contacts.size();
+
+	// impulses are applied one after the other, sorting keeps the result independent of the thread count
+	std::sort(_contacts.begin(), _contacts.end(), [](const Contact& a, const Contact& b) {
+		return a.first < b.first || (a.first == b.first && a.second < b.second);
+	});
+
+	// equal masses: each takes half of the impulse that removes (1 + restitution) of the approach speed
+	for (const Contact& contact : _contacts)
+	{
+		uint32_t a = contact.first, b = contact.second;
+		glm::vec3 normal = position(b) - position(a);
+		float distance = glm::length(normal);
+		if (distance == 0.0f) continue;
+		normal /= distance;
+		float approach = glm::dot(velocity(a) - velocity(b), normal);
+		if (approach <= 0.0f) continue;
+		glm::vec3 impulse = 0.5f * (1.0f + _restitution) * approach * normal;
+		_vx[a] -= impulse.x; _vy[a] -= impulse.y; _vz[a] -= impulse.z;
+		_vx[b] += impulse.x; _vy[b] += impulse.y; _vz[b] += impulse.z;
+	}
+}
+
+void ParticleSystem::interleave(float* out, size_t begin, size_t end) const
+{
+	for (size_t i = begin; i < end; i++)
+	{
+		out[3 * i] = _px[i]; out[3 * i + 1] = _py[i]; out[3 * i + 2] = _pz[i];
+	}
+}
@@ -0,0 +1,350 @@
+#pragma once
+
+#include "Common.hpp"
+#include "Trajectory.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+typedef TrajectoryFramesOf<float> PlaybackChunk;
+
+typedef struct
+{
+	// positions() calls that found their chunks decoded, and ones that had to wait for the loader
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t decodedChunks;
+	double decodeMs;
+	size_t cachedChunks;
+	size_t cachedBytes;
+	size_t capacity;
+}PlaybackStats;
+
+// Plays back a recorded trajectory of any length in bounded memory. The file stays a read-only mapping, so
+// the os pages it in and out as it likes, and only a handful of chunks is ever decoded: a loader thread decodes
+// the chunk under the playhead and the ones it is heading into, and the least recently used chunk away from it
+// makes room. Between stored frames positions are cubic Hermite, with the recorded velocities where there are
+// any and finite differences of the neighbouring frames on the rails.
+class TrajectoryPlayback
+{
+	NONCOPYABLE(TrajectoryPlayback)
+
+private:
+	typedef struct
+	{
+		size_t chunk;
+		uint64_t lastUse;
+		std::shared_ptr<const PlaybackChunk> frames;
+	}CacheEntry;
+
+	typedef struct
+	{
+		const float* p[3];
+		// nullptr without recorded velocities
+		const float* v[3];
+		double time;
+	}FrameView;
+
+	TrajectoryReader _reader;
+
+	size_t _capacity{ 3 };
+
+	std::mutex _mutex;
+	std::condition_variable _wanted;
+	std::thread _loader;
+	bool _isStopping{ false };
+
+	std::vector<CacheEntry> _cache;
+	// chunks to have decoded, most urgent first
+	std::vector<size_t> _queue;
+	uint64_t _useCount{ 0 };
+	double _lastTime{ 0.0 };
+
+	PlaybackStats _stats{};
+
+public:
+	TrajectoryPlayback() = default;
+	~TrajectoryPlayback() { close(); };
+
+	// decoded chunks are held to memoryBudget bytes, but never fewer than 3 so the playhead always has
+	// its chunk and one on either side
+	bool open(const std::string& path, size_t memoryBudget = (size_t)256 << 20);
+
+	void close();
+
+	// every body's position at time into x, y and z, which need room for maxBodyCount(), and aim the loader at
+	// time. False while the chunks around time are still being decoded, the arrays are left as they were so the
+	// last frame stays up
+	bool positions(double time, double* x, double* y, double* z);
+
+	// bodies at time, they change where merges happened during the recording
+	const size_t bodyCount(double time) const;
+
+	const bool isOpen() const { return _reader.isOpen(); };
+
+	const double startTime() const { return _reader.startTime(); };
+
+	const double endTime() const { return _reader.endTime(); };
+
+	const size_t maxBodyCount() const;
+
+	const PlaybackStats stats();
+
+private:
+	void loaderLoop();
+
+	// queue the chunk holding time and the ones in the direction of travel, then the ones behind
+	void aim(size_t chunk, int direction);
+
+	std::shared_ptr<const PlaybackChunk> cached(size_t chunk);
+
+	static FrameView frameView(const PlaybackChunk& frames, size_t k);
+
+	// Hermite between frames a and b. before and after, when given, are the frames either side of them and stand in
+	// for velocities that weren't recorded
+	static void interpolate(double time, const FrameView* before, const FrameView& a, const FrameView& b, const FrameView* after, size_t n,
+		double* x, double* y, double* z);
+};
+
+bool TrajectoryPlayback::open(const std::string& path, size_t memoryBudget)
+{
+	close();
+	if (!_reader.open(path) || _reader.chunkCount() == 0)
+	{
+		_reader.close();
+		return false;
+	}
+
+	// floats for positions and velocities, the most frames and bodies any chunk has
+	size_t frames = 1;
+	for (size_t c = 0; c < _reader.chunkCount(); c++) frames = glm::max(frames, (size_t)_reader.chunk(c).frameCount);
+	const size_t chunkBytes = frames * glm::max(maxBodyCount(), (size_t)1) * 6 * sizeof(float);
+	_capacity = glm::max(memoryBudget / chunkBytes, (size_t)3);
+
+	_cache.clear();
+	_queue.clear();
+	_useCount = 0;
+	_lastTime = _reader.startTime();
+	_stats = {};
+	_stats.capacity = _capacity;
+	_isStopping = false;
+	_loader = std::thread([this]() { loaderLoop(); });
+	aim(0, 1);
+	return true;
+}
+
+void TrajectoryPlayback::close()
+{
+	if (_loader.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_isStopping = true;
+		}
+		_wanted.notify_one();
+		_loader.join();
+	}
+	_cache.clear();
+	_queue.clear();
+	_reader.close();
+}
+
+const size_t TrajectoryPlayback::maxBodyCount() const
+{
+	size_t n = 0;
+	for (size_t c = 0; c < _reader.chunkCount(); c++) n = glm::max(n, (size_t)_reader.chunk(c).bodyCount);
+	return n;
+}
+
+const size_t TrajectoryPlayback::bodyCount(double time) const
+{
+	return _reader.chunkCount() ? _reader.chunk(_reader.find(time)).bodyCount : 0;
+}
+
+const PlaybackStats TrajectoryPlayback::stats()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	_stats.cachedChunks = _cache.size();
+	_stats.cachedBytes = 0;
+	for (auto& entry : _cache)
+		_stats.cachedBytes += (entry.frames->x.size() + entry.frames->y.size() + entry.frames->z.size() + entry.frames->vx.size() +
+			entry.frames->vy.size() + entry.frames->vz.size()) * sizeof(float);
+	return _stats;
+}
+
+bool TrajectoryPlayback::positions(double time, double* x, double* y, double* z)
+{
+	if (!isOpen()) return false;
+	time = glm::clamp(time, startTime(), endTime());
+	const size_t c = _reader.find(time);
+	const int direction = time < _lastTime ? -1 : 1;
+	_lastTime = time;
+	aim(c, direction);
+
+	std::shared_ptr<const PlaybackChunk> chunk = cached(c);
+	std::shared_ptr<const PlaybackChunk> next;
+	// past a chunk's last frame, the next chunk's first frame closes the gap if the bodies carry over and no frames
+	// were dropped in between. across dropped frames the last one recorded holds
+	const bool isBetweenChunks = chunk && time > chunk->times.back() && c + 1 < _reader.chunkCount() &&
+		_reader.chunk(c + 1).bodyCount == chunk->bodyCount && _reader.chunk(c + 1).droppedBefore == 0;
+	if (isBetweenChunks) next = cached(c + 1);
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (!chunk || (isBetweenChunks && !next))
+		{
+			_stats.misses++;
+			return false;
+		}
+		_stats.hits++;
+	}
+
+	const size_t n = chunk->bodyCount, frames = chunk->times.size();
+	if (isBetweenChunks)
+	{
+		FrameView a = frameView(*chunk, frames - 1), b = frameView(*next, 0);
+		FrameView before = frames > 1 ? frameView(*chunk, frames - 2) : a;
+		FrameView after = next->times.size() > 1 ? frameView(*next, 1) : b;
+		interpolate(time, frames > 1 ? &before : nullptr, a, b, next->times.size() > 1 ? &after : nullptr, n, x, y, z);
+	}
+	else if (frames == 1)
+	{
+		FrameView a = frameView(*chunk, 0);
+		interpolate(time, nullptr, a, a, nullptr, n, x, y, z);
+	}
+	else
+	{
+		size_t k = (size_t)(std::upper_bound(chunk->times.begin(), chunk->times.end(), time) - chunk->times.begin());
+		k = glm::clamp(k, (size_t)1, frames - 1) - 1;
+		FrameView a = frameView(*chunk, k), b = frameView(*chunk, k + 1);
+		FrameView before = k > 0 ? frameView(*chunk, k - 1) : a;
+		FrameView after = k + 2 < frames ? frameView(*chunk, k + 2) : b;
+		interpolate(time, k > 0 ? &before : nullptr, a, b, k + 2 < frames ? &after : nullptr, n, x, y, z);
+	}
+	return true;
+}
+
+void TrajectoryPlayback::aim(size_t chunk, int direction)
+{
+	std::vector<size_t> queue = { chunk };
+	const size_t count = _reader.chunkCount();
+	// ahead gets all but one of the slots, a scrub back still finds the previous chunk ready
+	for (size_t d = 1; queue.size() < _capacity - 1; d++)
+	{
+		long long ahead = (long long)chunk + direction * (long long)d;
+		if (ahead < 0 || ahead >= (long long)count) break;
+		queue.push_back((size_t)ahead);
+	}
+	long long behind = (long long)chunk - direction;
+	if (behind >= 0 && behind < (long long)count) queue.push_back((size_t)behind);
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (queue == _queue) return;
+		_queue = std::move(queue);
+	}
+	_wanted.notify_one();
+}
+
+std::shared_ptr<const PlaybackChunk> TrajectoryPlayback::cached(size_t chunk)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	for (auto& entry : _cache)
+	{
+		if (entry.chunk != chunk) continue;
+		entry.lastUse = ++_useCount;
+		return entry.frames;
+	}
+	return nullptr;
+}
+
+void TrajectoryPlayback::loaderLoop()
+{
+	while (true)
+	{
+		size_t chunk = 0, ahead = 0;
+		bool hasAhead = false;
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			auto isCached = [&](size_t c) { return std::any_of(_cache.begin(), _cache.end(), [&](const CacheEntry& entry) { return entry.chunk == c; }); };
+			auto missing = [&]() { return std::find_if(_queue.begin(), _queue.end(), [&](size_t c) { return !isCached(c); }); };
+			_wanted.wait(lock, [&]() { return _isStopping || missing() != _queue.end(); });
+			if (_isStopping) return;
+			auto it = missing();
+			chunk = *it;
+			auto next = std::find_if(it + 1, _queue.end(), [&](size_t c) { return !isCached(c); });
+			if ((hasAhead = next != _queue.end())) ahead = *next;
+		}
+
+		// the next chunk starts coming off the disk while this one decodes
+		if (hasAhead) _reader.prefetch(ahead);
+
+		auto start = std::chrono::steady_clock::now();
+		auto frames = std::make_shared<PlaybackChunk>();
+		bool isDecoded = _reader.decode(chunk, *frames);
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		// a chunk that won't decode is cached empty of frames, rather than retried forever
+		if (!isDecoded) frames->times.clear();
+		if (frames->times.empty()) frames->times.push_back(_reader.chunk(chunk).startTime), frames->bodyCount = 0, frames->hasVelocities = false;
+		_cache.push_back({ chunk, ++_useCount, frames });
+		_stats.decodedChunks++;
+		_stats.decodeMs += ms;
+		while (_cache.size() > _capacity)
+		{
+			// the least recently used chunk the playhead doesn't want, there always is one past capacity
+			auto victim = _cache.end();
+			for (auto it = _cache.begin(); it != _cache.end(); ++it)
+			{
+				if (std::find(_queue.begin(), _queue.end(), it->chunk) != _queue.end()) continue;
+				if (victim == _cache.end() || it->lastUse < victim->lastUse) victim = it;
+			}
+			if (victim == _cache.end()) break;
+			_cache.erase(victim);
+		}
+	}
+}
+
+TrajectoryPlayback::FrameView TrajectoryPlayback::frameView(const PlaybackChunk& frames, size_t k)
+{
+	const size_t offset = k * frames.bodyCount;
+	FrameView view = { { frames.x.data() + offset, frames.y.data() + offset, frames.z.data() + offset }, { nullptr, nullptr, nullptr }, frames.times[k] };
+	if (frames.hasVelocities)
+	{
+		view.v[0] = frames.vx.data() + offset;
+		view.v[1] = frames.vy.data() + offset;
+		view.v[2] = frames.vz.data() + offset;
+	}
+	return view;
+}
+
+void TrajectoryPlayback::interpolate(double time, const FrameView* before, const FrameView& a, const FrameView& b, const FrameView* after, size_t n,
+	double* x, double* y, double* z)
+{
+	double* out[] = { x, y, z };
+	const double h = b.time - a.time;
+	if (!(h > 0.0))
+	{
+		for (int c = 0; c < 3; c++) for (size_t i = 0; i < n; i++) out[c][i] = a.p[c][i];
+		return;
+	}
+
+	// the Hermite basis, tangents scaled by the frame spacing
+	const double s = glm::clamp((time - a.time) / h, 0.0, 1.0), s2 = s * s, s3 = s2 * s;
+	const double h00 = 2.0 * s3 - 3.0 * s2 + 1.0, h10 = (s3 - 2.0 * s2 + s) * h, h01 = -2.0 * s3 + 3.0 * s2, h11 = (s3 - s2) * h;
+	for (int c = 0; c < 3; c++)
+	{
+		const float* p0 = a.p[c];
+		const float* p1 = b.p[c];
+		for (size_t i = 0; i < n; i++)
+		{
+			const double chord = (p1[i] - (double)p0[i]) / h;
+			double m0 = a.v[c] ? a.v[c][i] : before ? (p1[i] - (double)before->p[c][i]) / (b.time - before->time) : chord;
+			double m1 = b.v[c] ? b.v[c][i] : after ? (after->p[c][i] - (double)p0[i]) / (after->time - a.time) : chord;
+			out[c][i] = h00 * p0[i] + h10 * m0 + h01 * p1[i] + h11 * m1;
+		}
+	}
+}
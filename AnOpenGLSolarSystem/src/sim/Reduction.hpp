@@ -0,0 +1,91 @@
+#pragma once
+
+#include "Common.hpp"
+
+// Neumaier's improvement on Kahan summation: the low order bits every add rounds away are collected in a
+// second term, whichever of the two operands is larger, so a long sum of mixed magnitudes keeps close to
+// full precision instead of losing the small terms against the large ones.
+class CompensatedSum
+{
+private:
+	double _sum{ 0.0 };
+	double _compensation{ 0.0 };
+
+public:
+	CompensatedSum() = default;
+
+	void add(double value);
+
+	void add(const CompensatedSum& other) { add(other._sum); add(other._compensation); };
+
+	const double value() const { return _sum + _compensation; };
+};
+
+void CompensatedSum::add(double value)
+{
+	double t = _sum + value;
+	if (std::abs(_sum) >= std::abs(value)) _compensation += (_sum - t) + value;
+	else _compensation += (value - t) + _sum;
+	_sum = t;
+}
+
+// the same interface as a plain double, for code templated on its accumulator
+class PlainSum
+{
+private:
+	double _sum{ 0.0 };
+
+public:
+	PlainSum() = default;
+
+	void add(double value) { _sum += value; };
+
+	const double value() const { return _sum; };
+};
+
+// Parallel reductions that give the same bits on any number of threads. [0, n) is cut into blocks that only
+// depend on n and the block size, each block is folded in index order, and the block results are combined in
+// a fixed pairwise tree, so neither the scheduling nor the thread count can change the order of any addition.
+class Reduction
+{
+	INCONSTRUCTIBLE(Reduction)
+
+public:
+	// pool is anything with parallelFor(n, grain, task). leaf(begin, end) folds a block, combine(a, b) joins two results
+	template<typename T, typename Pool, typename Leaf, typename Combine>
+	static T reduce(Pool& pool, size_t n, size_t blockSize, const T& zero, const Leaf& leaf, const Combine& combine);
+
+	// sum of term(i) over [0, n)
+	template<typename T, typename Pool, typename Term>
+	static T sum(Pool& pool, size_t n, const T& zero, const Term& term, size_t blockSize = 4096);
+};
+
+template<typename T, typename Pool, typename Leaf, typename Combine>
+T Reduction::reduce(Pool& pool, size_t n, size_t blockSize, const T& zero, const Leaf& leaf, const Combine& combine)
+{
+	if (n == 0) return zero;
+	blockSize = glm::max(blockSize, (size_t)1);
+	const size_t blockCount = (n + blockSize - 1) / blockSize;
+	std::vector<T> partials(blockCount, zero);
+	pool.parallelFor(blockCount, 1, [&](size_t begin, size_t end) {
+		for (size_t b = begin; b < end; b++) partials[b] = leaf(b * blockSize, glm::min(n, (b + 1) * blockSize));
+	});
+
+	// neighbours pair up level by level, an odd one out moves up as it is
+	for (size_t count = blockCount; count > 1; count = (count + 1) / 2)
+	{
+		for (size_t i = 0; i < count / 2; i++) partials[i] = combine(partials[2 * i], partials[2 * i + 1]);
+		if (count % 2) partials[count / 2] = partials[count - 1];
+	}
+	return partials[0];
+}
+
+template<typename T, typename Pool, typename Term>
+T Reduction::sum(Pool& pool, size_t n, const T& zero, const Term& term, size_t blockSize)
+{
+	return reduce(pool, n, blockSize, zero, [&](size_t begin, size_t end) {
+		T sum = zero;
+		for (size_t i = begin; i < end; i++) sum += term(i);
+		return sum;
+	}, [](const T& a, const T& b) { return a + b; });
+}
@@ -0,0 +1,380 @@
+#pragma once
+
+#include "Common.hpp"
+#include "MappedFile.hpp"
+#include "Simulation.hpp"
+#include "SolarSystem.hpp"
+
+#include <charconv>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string_view>
+
+inline constexpr char kSceneCacheMagic[8] = { 'S', 'S', 'S', 'C', 'E', 'N', 'E', '\0' };
+inline constexpr uint32_t kSceneCacheVersion = 1;
+
+typedef enum
+{
+	// a catalog body, simulated like any other but drawn as a point instead of a sphere
+	SCENE_MINOR = 1 << 0
+}SceneBodyFlags;
+
+// one body as it sits in the cache, positions relative to the center
+typedef struct
+{
+	uint32_t nameOffset;
+	uint32_t nameLength;
+	// index of the center in the scene, the body itself for a root
+	int32_t center;
+	uint32_t flags;
+	float eccentricity;
+	float focalDistance;
+	float mass;
+	float radius;
+	float pos[3];
+	float scale[3];
+	float color[4];
+}SceneBody;
+
+static_assert(sizeof(SceneBody) == 72, "scene cache records are a fixed layout");
+
+// all fields little-endian, bodies and then the names follow the header
+typedef struct
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t reserved;
+	// of the text the cache was compiled from, a different text never maps a stale cache
+	uint64_t contentHash;
+	uint64_t textBytes;
+	uint64_t bodyCount;
+	uint64_t bodiesOffset;
+	uint64_t namesOffset;
+	uint64_t namesBytes;
+}SceneCacheHeader;
+
+static_assert(sizeof(SceneCacheHeader) == 64, "scene cache records are a fixed layout");
+
+// A scene is a text file, one declaration a line, # starts a comment:
+//
+//   body <name> <center> <eccentricity> <focal distance> <mass> [pos=x,y,z] [scale=s | scale=x,y,z] [color=r,g,b[,a]]
+//   minor <name> <center> <eccentricity> <focal distance> <mass> <x> <y> <z> [radius]
+//
+// a root names itself as its center, centers may be declared after their satellites. pos and x y z are relative
+// to the center and default to the focal distance along +x. a body collides at the sphere radius times its scale,
+// a minor body at its radius, 0.2 if it has none.
+// Minor bodies are the catalog form, millions of them parse without any key=value lookups.
+//
+// Parsing is skipped whenever it can be: the first load compiles the text into a binary cache next to it,
+// named after it plus .cache, and later loads map that cache as long as the hash of the text still matches.
+class Scene
+{
+	NONCOPYABLE(Scene)
+
+private:
+	// parsed bodies, or nothing when they are mapped from the cache
+	std::vector<SceneBody> _parsed;
+	std::string _parsedNames;
+
+	MappedFile _cache;
+	const SceneBody* _bodies{ nullptr };
+	const char* _names{ nullptr };
+	size_t _bodyCount{ 0 };
+	size_t _minorCount{ 0 };
+
+	bool _isFromCache{ false };
+	std::string _error;
+
+public:
+	Scene() = default;
+	~Scene() = default;
+
+	// the cache if it is current, otherwise the text, which then gets a fresh cache. false with error() set if the text doesn't parse
+	bool load(const std::string& path, bool useCache = true);
+
+	// add every body to sim, in file order
+	void populate(Simulation& sim) const;
+
+	const size_t size() const { return _bodyCount; };
+
+	const size_t minorCount() const { return _minorCount; };
+
+	const SceneBody& body(size_t i) const { return _bodies[i]; };
+
+	const std::string_view name(size_t i) const { return { _names + _bodies[i].nameOffset, _bodies[i].nameLength }; };
+
+	const bool isFromCache() const { return _isFromCache; };
+
+	// file and line of the first thing that didn't parse
+	const std::string& error() const { return _error; };
+
+	static std::string cachePath(const std::string& path) { return path + ".cache"; };
+
+	// 64 bit hash of a byte range, eight bytes a round
+	static uint64_t contentHash(const uint8_t* data, size_t bytes);
+
+private:
+	bool parse(const std::string& path, const char* text, size_t bytes);
+
+	bool mapCache(const std::string& path, uint64_t hash, uint64_t textBytes);
+
+	bool writeCache(const std::string& path, uint64_t hash, uint64_t textBytes) const;
+
+	void clear();
+};
+
+uint64_t Scene::contentHash(const uint8_t* data, size_t bytes)
+{
+	uint64_t hash = 14695981039346656037ull ^ bytes;
+	size_t i = 0;
+	for (; i + 8 <= bytes; i += 8)
+	{
+		uint64_t word;
+		memcpy(&word, data + i, 8);
+		hash = (hash ^ word) * 0x100000001b3ull;
+		hash ^= hash >> 32;
+	}
+	for (; i < bytes; i++) hash = (hash ^ data[i]) * 0x100000001b3ull;
+
+	// murmur3's finalizer, so the last few bytes reach every bit
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdull;
+	hash ^= hash >> 33;
+	hash *= 0xc4ceb9fe1a85ec53ull;
+	return hash ^ (hash >> 33);
+}
+
+void Scene::clear()
+{
+	_parsed.clear();
+	_parsedNames.clear();
+	_cache.close();
+	_bodies = nullptr;
+	_names = nullptr;
+	_bodyCount = 0;
+	_minorCount = 0;
+	_isFromCache = false;
+	_error.clear();
+}
+
+bool Scene::load(const std::string& path, bool useCache)
+{
+	clear();
+	MappedFile text;
+	if (!text.open(path))
+	{
+		_error = path + ": can't be read";
+		return false;
+	}
+
+	const uint64_t hash = contentHash(text.data(), text.size());
+	if (useCache && mapCache(cachePath(path), hash, text.size())) return true;
+
+	if (!parse(path, (const char*)text.data(), text.size())) return false;
+	// a cache that can't be written only costs the next load a parse
+	if (useCache) writeCache(cachePath(path), hash, text.size());
+	return true;
+}
+
+bool Scene::mapCache(const std::string& path, uint64_t hash, uint64_t textBytes)
+{
+	if (!_cache.open(path)) return false;
+
+	const uint8_t* data = _cache.data();
+	const uint64_t size = _cache.size();
+	const SceneCacheHeader* header = (const SceneCacheHeader*)data;
+	bool isValid = size >= sizeof(SceneCacheHeader) && memcmp(header->magic, kSceneCacheMagic, sizeof(header->magic)) == 0 &&
+		header->version == kSceneCacheVersion && header->contentHash == hash && header->textBytes == textBytes &&
+		header->bodiesOffset % alignof(SceneBody) == 0 && header->bodyCount <= size / sizeof(SceneBody) &&
+		header->bodiesOffset + header->bodyCount * sizeof(SceneBody) <= size && header->namesOffset + header->namesBytes <= size;
+	if (!isValid)
+	{
+		_cache.close();
+		return false;
+	}
+
+	_bodies = (const SceneBody*)(data + header->bodiesOffset);
+	_names = (const char*)(data + header->namesOffset);
+	_bodyCount = (size_t)header->bodyCount;
+	for (size_t i = 0; i < _bodyCount; i++)
+	{
+		const SceneBody& body = _bodies[i];
+		if ((uint64_t)body.nameOffset + body.nameLength > header->namesBytes || body.center < 0 || (size_t)body.center >= _bodyCount)
+		{
+			clear();
+			return false;
+		}
+		if (body.flags & SCENE_MINOR) _minorCount++;
+	}
+	_isFromCache = true;
+	return true;
+}
+
+bool Scene::writeCache(const std::string& path, uint64_t hash, uint64_t textBytes) const
+{
+	SceneCacheHeader header{};
+	memcpy(header.magic, kSceneCacheMagic, sizeof(header.magic));
+	header.version = kSceneCacheVersion;
+	header.contentHash = hash;
+	header.textBytes = textBytes;
+	header.bodyCount = _bodyCount;
+	header.bodiesOffset = sizeof(SceneCacheHeader);
+	header.namesOffset = header.bodiesOffset + _bodyCount * sizeof(SceneBody);
+	header.namesBytes = _parsedNames.size();
+
+	// written aside and renamed over, so a load never maps half a cache
+	const std::string partial = path + ".partial";
+	{
+		std::ofstream ofs(partial, std::ios::binary | std::ios::trunc);
+		if (!ofs) return false;
+		ofs.write((const char*)&header, sizeof(header));
+		ofs.write((const char*)_parsed.data(), _parsed.size() * sizeof(SceneBody));
+		ofs.write(_parsedNames.data(), _parsedNames.size());
+		if (!ofs.good()) return false;
+	}
+	std::error_code error;
+	std::filesystem::rename(partial, path, error);
+	if (error) std::filesystem::remove(partial, error);
+	return !error;
+}
+
+bool Scene::parse(const std::string& path, const char* text, size_t bytes)
+{
+	const char* const end = text + bytes;
+	size_t lineNumber = 0;
+	std::unordered_map<std::string_view, int32_t> indices;
+	// center names by body, resolved once every body is known
+	std::vector<std::pair<size_t, size_t>> centers;
+	std::string centerNames;
+
+	// one body a line at most, sizing for that up front saves rehashing a million names
+	const size_t lines = (size_t)std::count(text, end, '\n') + 1;
+	indices.reserve(lines);
+	centers.reserve(lines);
+	_parsed.reserve(lines);
+
+	auto fail = [&](const std::string& what) {
+		_error = path + (lineNumber ? ":" + std::to_string(lineNumber) : std::string()) + ": " + what;
+		_parsed.clear();
+		_parsedNames.clear();
+		return false;
+	};
+
+	for (const char* line = text; line < end;)
+	{
+		const char* lineEnd = (const char*)memchr(line, '\n', end - line);
+		if (!lineEnd) lineEnd = end;
+		lineNumber++;
+		const char* p = line;
+		line = lineEnd + 1;
+
+		auto skipSpace = [&]() { while (p < lineEnd && (*p == ' ' || *p == '\t' || *p == '\r')) p++; };
+		auto token = [&]() {
+			skipSpace();
+			const char* start = p;
+			while (p < lineEnd && *p != ' ' && *p != '\t' && *p != '\r' && *p != '#') p++;
+			return std::string_view(start, p - start);
+		};
+		auto number = [&](std::string_view item, float& value) {
+			auto result = std::from_chars(item.data(), item.data() + item.size(), value);
+			return result.ec == std::errc() && result.ptr == item.data() + item.size();
+		};
+		// comma separated floats, count of them or exactly one when single is allowed
+		auto numbers = [&](std::string_view item, float* values, int count, int minimum) {
+			int read = 0;
+			for (size_t start = 0; read < count && start <= item.size(); read++)
+			{
+				size_t comma = item.find(',', start);
+				if (comma == std::string_view::npos) comma = item.size();
+				if (!number(item.substr(start, comma - start), values[read])) return -1;
+				start = comma + 1;
+				if (comma == item.size()) return read + 1 >= minimum ? read + 1 : -1;
+			}
+			return -1;
+		};
+
+		std::string_view kind = token();
+		if (kind.empty()) continue;
+		const bool isMinor = kind == "minor";
+		if (!isMinor && kind != "body") return fail("expected body or minor, not " + std::string(kind));
+
+		SceneBody body{};
+		std::string_view name = token(), center = token();
+		if (name.empty() || center.empty()) return fail("a body needs a name and a center");
+		if (!number(token(), body.eccentricity) || !number(token(), body.focalDistance) || !number(token(), body.mass))
+			return fail("expected eccentricity, focal distance and mass after " + std::string(name));
+		body.flags = isMinor ? SCENE_MINOR : 0;
+		body.pos[0] = body.focalDistance;
+		body.scale[0] = body.scale[1] = body.scale[2] = 1.0f;
+		body.color[0] = body.color[1] = body.color[2] = body.color[3] = 1.0f;
+		body.radius = -1.0f;
+
+		if (isMinor)
+		{
+			if (!number(token(), body.pos[0]) || !number(token(), body.pos[1]) || !number(token(), body.pos[2]))
+				return fail("expected x y z after " + std::string(name));
+			body.scale[0] = body.scale[1] = body.scale[2] = 0.01f;
+			std::string_view radius = token();
+			if (!radius.empty() && !number(radius, body.radius)) return fail("bad radius " + std::string(radius));
+		}
+		else
+		{
+			for (std::string_view item = token(); !item.empty(); item = token())
+			{
+				size_t equals = item.find('=');
+				std::string_view key = item.substr(0, equals), value = equals == std::string_view::npos ? std::string_view() : item.substr(equals + 1);
+				int read = 0;
+				if (key == "pos") read = numbers(value, body.pos, 3, 3);
+				else if (key == "color") read = numbers(value, body.color, 4, 3);
+				else if (key == "scale")
+				{
+					read = numbers(value, body.scale, 3, 1);
+					if (read == 1) body.scale[1] = body.scale[2] = body.scale[0];
+					else if (read == 2) read = -1;
+				}
+				else return fail("unknown key " + std::string(key));
+				if (read < 0) return fail("bad value for " + std::string(key));
+			}
+		}
+		if (body.radius < 0.0f) body.radius = kSphereRadius * body.scale[0];
+		skipSpace();
+		if (p < lineEnd && *p != '#') return fail("unexpected " + std::string(p, lineEnd - p));
+
+		if (!indices.emplace(name, (int32_t)_parsed.size()).second) return fail(std::string(name) + " is declared twice");
+		body.nameOffset = (uint32_t)_parsedNames.size();
+		body.nameLength = (uint32_t)name.size();
+		_parsedNames.append(name.data(), name.size());
+		centers.push_back({ centerNames.size(), center.size() });
+		centerNames.append(center.data(), center.size());
+		if (isMinor) _minorCount++;
+		_parsed.push_back(body);
+	}
+
+	for (size_t i = 0; i < _parsed.size(); i++)
+	{
+		auto it = indices.find(std::string_view(centerNames.data() + centers[i].first, centers[i].second));
+		if (it == indices.end())
+		{
+			lineNumber = 0;
+			return fail(std::string(centerNames, centers[i].first, centers[i].second) + ", the center of " +
+				std::string(_parsedNames, _parsed[i].nameOffset, _parsed[i].nameLength) + ", is never declared");
+		}
+		_parsed[i].center = it->second;
+	}
+
+	_bodies = _parsed.data();
+	_names = _parsedNames.data();
+	_bodyCount = _parsed.size();
+	return true;
+}
+
+void Scene::populate(Simulation& sim) const
+{
+	for (size_t i = 0; i < _bodyCount; i++)
+	{
+		const SceneBody& body = _bodies[i];
+		sim.addBody(std::string(name(i)), std::string(name(body.center)), body.eccentricity, body.focalDistance, body.mass,
+			{ body.pos[0], body.pos[1], body.pos[2] }, body.radius);
+	}
+}
@@ -0,0 +1,909 @@
+#pragma once
+
+#include "Common.hpp"
+#include "Clock.hpp"
+#include "BodyArrays.hpp"
+#include "Gravity.hpp"
+#include "BarnesHut.hpp"
+#include "JobSystem.hpp"
+#include "Integrator.hpp"
+#include "KeplerOrbits.hpp"
+#include "CollisionGrid.hpp"
+#include "ParticleSystem.hpp"
+
+#include <chrono>
+#include <functional>
+#include <mutex>
+
+enum class SimulationMode
+{
+	RAILS = 0,
+	NBODY
+};
+
+enum class GravitySolver
+{
+	DIRECT = 0,
+	BARNES_HUT
+};
+
+// per body metadata, the physical state itself lives in BodyArrays
+typedef struct
+{
+	std::string name;
+	std::string centerName;
+	float eccentricity;
+	float focalDistance;
+}Body;
+
+// what the last advance() did with the steps the clock asked for
+typedef struct
+{
+	int due;
+	// taken one fixed step at a time, at full accuracy
+	int steps;
+	// covered by a single closed form jump along the rails
+	int leapt;
+	// steps the belts and rings fell behind by, they are never leapt
+	int particleStepsSkipped;
+	double cpuMs;
+	bool isRailsFallback;
+}WarpStats;
+
+// called with the slot a body was removed from and the index of the last body, which now lives in that slot
+typedef std::function<void(int removed, int moved)> BodyRemovedCallback;
+
+class Simulation;
+
+// called with the simulation every interval steps, once the bodies have reached that step
+typedef std::function<void(const Simulation& sim)> StepCallback;
+
+// Headless simulation engine. Owns every body's physical state and advances it in fixed
+// steps driven by a Clock, so it can run without a window or GL context.
+class Simulation : public ForceField
+{
+	NONCOPYABLE(Simulation)
+
+	// saves and restores the private state in bulk
+	friend class Checkpoint;
+
+private:
+	Clock _clock;
+
+	SimulationMode _mode{ SimulationMode::RAILS };
+
+	GravitySolver _solver{ GravitySolver::DIRECT };
+
+	IntegratorType _integratorType{ IntegratorType::LEAPFROG };
+
+	std::unique_ptr<Integrator> _integrator{ Integrator::create(IntegratorType::LEAPFROG) };
+
+	BarnesHut _barnesHut;
+
+	// null when stepping single threaded
+	std::unique_ptr<JobSystem> _jobs;
+
+	std::vector<Body> _bodies;
+
+	BodyArrays _state;
+
+	// every body's rails orbit about its center, and the batch output relative to the centers
+	KeplerOrbits _orbits;
+	AlignedVector<double> _railsX, _railsY, _railsZ;
+
+	// names only matter when bodies are added or looked up from the ui, stepping goes by index. built on the first
+	// find after a restore, so resuming a checkpoint doesn't hash every name up front
+	mutable std::unordered_map<std::string, int> _bodyNameMap;
+
+	mutable bool _isNameMapValid{ true };
+
+	// each body's center, -1 for roots
+	std::vector<int> _parents;
+
+	// bodies whose center hasn't been added yet, by the center's name
+	std::unordered_map<std::string, std::vector<int>> _pendingChildren;
+
+	// body indices sorted by depth in the hierarchy, depth d occupies [_levelStarts[d], _levelStarts[d + 1])
+	std::vector<uint32_t> _updateOrder;
+	std::vector<size_t> _levelStarts;
+	bool _isOrderValid{ false };
+
+	double _softening{ 0.5 };
+
+	// force sums carry their rounding error along, see Gravity::directSum
+	bool _isCompensated{ false };
+
+	// n-body collisions merge the overlapping bodies into the heaviest one
+	bool _isCollisionEnabled{ false };
+	CollisionGrid _collisionGrid;
+	std::vector<Contact> _contacts;
+	size_t _mergeCount{ 0 };
+
+	BodyRemovedCallback _onBodyRemoved;
+
+	StepCallback _onStep;
+	uint64_t _stepInterval{ 1 };
+
+	// belts and rings, they follow their centers but no body feels them
+	std::vector<std::unique_ptr<ParticleSystem>> _particleSystems;
+
+	// cpu seconds one advance() may spend, and the smoothed cost of a step of each kind, which sizes its batches
+	double _stepBudget{ 0.008 };
+	double _nbodyStepCost{ 0.0 }, _particleStepCost{ 0.0 };
+
+	// n-body mode that couldn't keep up with the time scale and handed its bodies to the rails for now
+	bool _isRailsFallback{ false };
+
+	WarpStats _warp{};
+
+public:
+	Simulation() = default;
+	~Simulation() = default;
+
+	int addBody(const std::string& name, const std::string& centerName, float eccentricity, float focalDistance,
+		float mass = 1.0f, glm::vec3 pos = { 0.0f, 0.0f, 0.0f }, float radius = 0.0f);
+
+	// take exactly n fixed steps, regardless of the clock's time scale
+	void step(int n = 1);
+
+	// feed real elapsed time through the clock and cover however many steps are due, returns that count.
+	// N-body steps are taken while they fit in the step budget and the bodies go on the rails past it,
+	// belts and rings step with whatever budget is left
+	int advance(double realDelta);
+
+	void setMode(SimulationMode mode);
+
+	void setGravitySolver(GravitySolver solver) { _solver = solver; _integrator->invalidate(); };
+
+	void setOpeningAngle(double theta) { _barnesHut.setOpeningAngle(theta); _integrator->invalidate(); };
+
+	void setSoftening(double softening) { _softening = softening; _integrator->invalidate(); };
+
+	void setCompensatedSummation(bool enabled) { _isCompensated = enabled; _integrator->invalidate(); };
+
+	void setIntegrator(IntegratorType type);
+
+	// 1 steps on the calling thread only, anything above spins up a work-stealing pool
+	void setThreadCount(int threads);
+
+	// cpu seconds advance() may spend stepping before it trades accuracy for keeping up with the time scale
+	void setStepBudget(double seconds) { _stepBudget = glm::max(seconds, 0.0); };
+
+	void setMass(int index, double mass);
+
+	// a belt or ring of count particles about centerName, see ParticleSystem::populate. -1 if there is no such body
+	int addParticles(const std::string& name, const std::string& centerName, size_t count, float innerRadius, float outerRadius,
+		float thickness, float maxEccentricity, float particleRadius, uint64_t seed = 4048111);
+
+	// particles bump into each other inside every belt and ring
+	void setParticleCollisions(bool enabled);
+
+	void setCollisions(bool enabled) { _isCollisionEnabled = enabled; _collisionGrid.invalidate(); };
+
+	void setBodyRemovedCallback(const BodyRemovedCallback& callback) { _onBodyRemoved = callback; };
+
+	// a rails leap in advance() calls it once at the end if it crossed a multiple of interval, an empty callback detaches
+	void setStepCallback(const StepCallback& callback, int interval = 1) { _onStep = callback; _stepInterval = (uint64_t)glm::max(interval, 1); };
+
+	// new rails ellipse for a body, it keeps its place along the orbit
+	void setOrbit(int index, float eccentricity, float focalDistance);
+
+	int find(const std::string& name) const;
+
+	// move every body to where its rails orbit has it right now, a body added in rails mode only gets there on the next step
+	void placeOnRails() { placeOnRails(_clock.time()); };
+
+	// move a body to where its rails orbit has it and give it the orbit's velocity, its satellites come along.
+	// n-body mode otherwise starts every body on a circular orbit and never looks at the eccentricity again
+	void launchOnOrbit(int index);
+
+	// give every body a circular velocity about its center, parents first
+	void seedOrbitalVelocities();
+
+	Clock& clock() { return _clock; };
+
+	const Clock& clock() const { return _clock; };
+
+	const SimulationMode mode() const { return _mode; };
+
+	// rails mode, or n-body mode falling back on the rails to keep up
+	const bool isOnRails() const { return _mode == SimulationMode::RAILS || _isRailsFallback; };
+
+	const bool isRailsFallback() const { return _isRailsFallback; };
+
+	const double stepBudget() const { return _stepBudget; };
+
+	const WarpStats& lastWarp() const { return _warp; };
+
+	const GravitySolver gravitySolver() const { return _solver; };
+
+	const IntegratorType integratorType() const { return _integratorType; };
+
+	const Integrator& integrator() const { return *_integrator; };
+
+	const double openingAngle() const { return _barnesHut.openingAngle(); };
+
+	const double softening() const override { return _softening; };
+
+	const bool isCompensatedSummation() const { return _isCompensated; };
+
+	const bool isCollisionEnabled() const { return _isCollisionEnabled; };
+
+	// bodies absorbed by collisions so far
+	const size_t mergeCount() const { return _mergeCount; };
+
+	const int threadCount() const { return _jobs ? _jobs->threadCount() : 1; };
+
+	JobSystem* jobs() { return _jobs.get(); };
+
+	Body& body(int index) { return _bodies[index]; };
+
+	const Body& body(int index) const { return _bodies[index]; };
+
+	const std::vector<Body>& bodies() const { return _bodies; };
+
+	const BodyArrays& state() const { return _state; };
+
+	const std::vector<std::unique_ptr<ParticleSystem>>& particleSystems() const { return _particleSystems; };
+
+	const size_t particleCount() const;
+
+	// 64 bit FNV-1a of the step count and every bit of the body and particle state, for telling runs apart
+	const uint64_t stateHash() const;
+
+	const KeplerOrbits& orbits() const { return _orbits; };
+
+	// parents before children, so a single pass over it sees every center already placed
+	const std::vector<uint32_t>& updateOrder();
+
+	const size_t depthCount() { updateOrder(); return _levelStarts.empty() ? 0 : _levelStarts.size() - 1; };
+
+	const size_t bodyCount() const { return _bodies.size(); };
+
+	const glm::dvec3 position(int index) const { return _state.position(index); };
+
+	const glm::dvec3 velocity(int index) const { return _state.velocity(index); };
+
+	const double mass(int index) const { return _state.mass[index]; };
+
+	const double radius(int index) const { return _state.radius[index]; };
+
+	// ForceField, with the selected gravity solver and softening
+	void accelerations(BodyArrays& bodies) override;
+
+	void accelerations(BodyArrays& bodies, const std::vector<uint32_t>& active) override;
+
+	// run task over [0, n) in chunks, on the pool if there is one
+	void parallelFor(size_t n, size_t grain, const RangeTask& task) override;
+
+	double gravity() const override { return kGravity; };
+
+	int parent(size_t index) const override { return _parents[index]; };
+
+private:
+	void placeOnRails(double time);
+
+	// n fixed steps of the bodies alone, the clock follows them
+	void stepBodies(int n);
+
+	// n fixed steps of every belt and ring, they don't move the clock
+	void stepParticles(int n);
+
+	// hand the n-body bodies to their osculating orbits, and take them back with every velocity taken from its orbit
+	void enterRailsFallback() { syncRailsOrbits(); _isRailsFallback = true; };
+
+	void leaveRailsFallback();
+
+	static void smoothCost(double& cost, double sample) { cost = cost == 0.0 ? sample : 0.75 * cost + 0.25 * sample; };
+
+	// put each body on the osculating orbit through where it currently is and how it moves
+	void syncRailsOrbits();
+
+	// rebuild a body's rails orbit from its eccentricity, focal distance and masses
+	void refreshOrbit(int index);
+
+	// hang a body off a center that was added after it, false if that would close a loop
+	bool adoptChild(int child, int center);
+
+	void rebuildUpdateOrder();
+
+	// find overlapping bodies and merge each touching group into its heaviest member
+	void resolveCollisions();
+
+	// swap-remove the listed bodies, nothing may still have one of them as its center
+	void removeBodies(std::vector<uint32_t>& removed);
+
+	glm::dvec3 circularVelocity(int index, int center) const;
+};
+
+int Simulation::addBody(const std::string& name, const std::string& centerName, float eccentricity, float focalDistance,
+	float mass, glm::vec3 pos, float radius)
+{
+	glm::dvec3 center = { 0.0, 0.0, 0.0 };
+	int centerIndex = find(centerName);
+	if (centerIndex != -1) center = _state.position(centerIndex);
+
+	int index = (int)_bodies.size();
+	_bodies.push_back({ name, centerName, eccentricity, focalDistance });
+	_parents.push_back(centerIndex);
+	_state.push(glm::dvec3(pos) + center, { 0.0, 0.0, 0.0 }, mass, radius);
+	_bodyNameMap.insert(std::make_pair(name, index));
+	if (centerIndex != -1) _state.setVelocity(index, circularVelocity(index, centerIndex));
+	else if (centerName != name) _pendingChildren[centerName].push_back(index);
+
+	// the rails orbit starts at periapsis, in the direction of pos
+	_orbits.resize(index + 1);
+	_orbits.setFixed(index, { 0.0, 0.0, 0.0 });
+	refreshOrbit(index);
+
+	auto pending = _pendingChildren.find(name);
+	if (pending != _pendingChildren.end())
+	{
+		for (int child : pending->second) adoptChild(child, index);
+		_pendingChildren.erase(pending);
+	}
+	_isOrderValid = false;
+
+	_integrator->invalidate();
+	return index;
+}
+
+void Simulation::step(int n)
+{
+	stepBodies(n);
+	stepParticles(n);
+}
+
+void Simulation::stepBodies(int n)
+{
+	if (n <= 0) return;
+
+	const double dt = _clock.dt();
+	const bool isOnRails = this->isOnRails();
+	const auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < n; i++)
+	{
+		switch (isOnRails ? SimulationMode::RAILS : _mode)
+		{
+		case SimulationMode::RAILS:
+			placeOnRails(_clock.time() + dt);
+			break;
+		case SimulationMode::NBODY:
+			_integrator->step(_state, *this, dt);
+			if (_isCollisionEnabled) resolveCollisions();
+			break;
+		default:
+			break;
+		}
+		_clock.tick();
+		if (_onStep && _clock.steps() % _stepInterval == 0) _onStep(*this);
+	}
+	if (!isOnRails) smoothCost(_nbodyStepCost, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / n);
+}
+
+void Simulation::stepParticles(int n)
+{
+	if (n <= 0 || _particleSystems.empty()) return;
+
+	const double dt = _clock.dt();
+	const auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < n; i++)
+		for (auto& particles : _particleSystems) particles->step(*this, kGravity * _state.mass[particles->center()], dt);
+	smoothCost(_particleStepCost, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / n);
+}
+
+int Simulation::advance(double realDelta)
+{
+	const int due = _clock.advance(realDelta);
+	const auto start = std::chrono::steady_clock::now();
+	auto spent = [&]() { return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(); };
+	_warp = { due, 0, 0, 0, 0.0, _isRailsFallback };
+	if (due <= 0) return 0;
+
+	// back to n-body once a whole frame of it fits in three quarters of the budget, the margin keeps it from
+	// flapping. The cost isn't measured on the rails, so it drifts down and a one-off spike can't strand n-body
+	// there. A frame known not to fit isn't started
+	if (_isRailsFallback)
+	{
+		_nbodyStepCost *= 0.98;
+		if (due * _nbodyStepCost <= 0.75 * _stepBudget) leaveRailsFallback();
+	}
+	if (!isOnRails() && due * _nbodyStepCost > _stepBudget) enterRailsFallback();
+
+	// n-body steps in batches sized from what they have been costing, one at a time until that is known
+	int done = 0;
+	while (!isOnRails() && done < due)
+	{
+		int batch = _nbodyStepCost > 0.0 ? (int)glm::min((double)(due - done), (_stepBudget - spent()) / _nbodyStepCost) : 1;
+		if (batch <= 0)
+		{
+			enterRailsFallback();
+			break;
+		}
+		stepBodies(batch);
+		done += batch;
+	}
+	_warp.steps = done;
+
+	// the rails are closed form, one evaluation covers any span exactly
+	if (done < due)
+	{
+		const int left = due - done;
+		placeOnRails(_clock.time() + left * _clock.dt());
+		_clock.tick(left);
+		_warp.leapt = left;
+		if (_onStep && _clock.steps() / _stepInterval != (_clock.steps() - left) / _stepInterval) _onStep(*this);
+	}
+
+	// belts and rings get what is left of the budget, at least a step a frame, and fall behind rather than blow up on a longer step
+	if (!_particleSystems.empty())
+	{
+		int particleSteps = _particleStepCost > 0.0 ? (int)glm::clamp((_stepBudget - spent()) / _particleStepCost, 1.0, (double)due) : 1;
+		stepParticles(particleSteps);
+		_warp.particleStepsSkipped = due - particleSteps;
+	}
+
+	_warp.cpuMs = spent() * 1e3;
+	_warp.isRailsFallback = _isRailsFallback;
+	return due;
+}
+
+void Simulation::setMode(SimulationMode mode)
+{
+	if (mode == _mode) return;
+
+	// an n-body fallback is on the rails already, with its orbits current
+	if (_isRailsFallback) _isRailsFallback = false;
+	else if (mode == SimulationMode::NBODY) seedOrbitalVelocities();
+	else syncRailsOrbits();
+	_mode = mode;
+	_integrator->invalidate();
+}
+
+void Simulation::setIntegrator(IntegratorType type)
+{
+	if (type == _integratorType) return;
+
+	_integratorType = type;
+	_integrator = Integrator::create(type);
+}
+
+int Simulation::find(const std::string& name) const
+{
+	if (!_isNameMapValid)
+	{
+		_bodyNameMap.clear();
+		_bodyNameMap.reserve(_bodies.size());
+		for (size_t i = 0; i < _bodies.size(); i++) _bodyNameMap.insert(std::make_pair(_bodies[i].name, (int)i));
+		_isNameMapValid = true;
+	}
+	auto it = _bodyNameMap.find(name);
+	return it == _bodyNameMap.end() ? -1 : it->second;
+}
+
+void Simulation::placeOnRails(double time)
+{
+	const size_t n = _bodies.size();
+	_railsX.resize(n); _railsY.resize(n); _railsZ.resize(n);
+	parallelFor(n, 16384, [&](size_t begin, size_t end) {
+		_orbits.propagate(time, _railsX.data(), _railsY.data(), _railsZ.data(), begin, end);
+	});
+
+	// depth by depth, every body in a depth only reads centers placed by the one before
+	updateOrder();
+	for (size_t depth = 1; depth + 1 < _levelStarts.size(); depth++)
+	{
+		const size_t first = _levelStarts[depth];
+		parallelFor(_levelStarts[depth + 1] - first, 8192, [&](size_t begin, size_t end) {
+			for (size_t k = first + begin; k < first + end; k++)
+			{
+				uint32_t i = _updateOrder[k];
+				uint32_t center = (uint32_t)_parents[i];
+				_state.px[i] = _state.px[center] + _railsX[i];
+				_state.py[i] = _state.py[center] + _railsY[i];
+				_state.pz[i] = _state.pz[center] + _railsZ[i];
+			}
+		});
+	}
+}
+
+const std::vector<uint32_t>& Simulation::updateOrder()
+{
+	if (!_isOrderValid) rebuildUpdateOrder();
+	return _updateOrder;
+}
+
+void Simulation::rebuildUpdateOrder()
+{
+	const size_t n = _bodies.size();
+	std::vector<int> depths(n, -1);
+	std::vector<int> chain;
+	int deepest = -1;
+	for (size_t i = 0; i < n; i++)
+	{
+		// walk up to the first body with a known depth, then assign on the way back down
+		int body = (int)i;
+		while (body != -1 && depths[body] == -1)
+		{
+			chain.push_back(body);
+			body = _parents[body];
+		}
+		int depth = body == -1 ? -1 : depths[body];
+		for (auto it = chain.rbegin(); it != chain.rend(); ++it) depths[*it] = ++depth;
+		chain.clear();
+		deepest = glm::max(deepest, depths[i]);
+	}
+
+	// counting sort by depth keeps index order within a depth
+	_levelStarts.assign(deepest + 2, 0);
+	for (size_t i = 0; i < n; i++) _levelStarts[depths[i] + 1]++;
+	for (size_t d = 1; d < _levelStarts.size(); d++) _levelStarts[d] += _levelStarts[d - 1];
+	_updateOrder.resize(n);
+	std::vector<size_t> cursor(_levelStarts.begin(), _levelStarts.end() - 1);
+	for (size_t i = 0; i < n; i++) _updateOrder[cursor[depths[i]]++] = (uint32_t)i;
+	_isOrderValid = true;
+}
+
+bool Simulation::adoptChild(int child, int center)
+{
+	for (int body = center; body != -1; body = _parents[body])
+		if (body == child) return false;
+
+	// its position so far was relative to nothing, now it is relative to the center
+	_parents[child] = center;
+	_state.setPosition(child, _state.position(child) + _state.position(center));
+	_state.setVelocity(child, circularVelocity(child, center));
+	_orbits.setFixed(child, { 0.0, 0.0, 0.0 });
+	refreshOrbit(child);
+	return true;
+}
+
+void Simulation::resolveCollisions()
+{
+	_collisionGrid.update(_state);
+	_contacts.clear();
+	std::mutex contactsMutex;
+	parallelFor(_collisionGrid.cellCount(), 1024, [&](size_t begin, size_t end) {
+		std::vector<Contact> local;
+		_collisionGrid.collect(begin, end, local);
+		if (local.empty()) return;
+		std::lock_guard<std::mutex> lock(contactsMutex);
+		_contacts.insert(_contacts.end(), local.begin(), local.end());
+	});
+	_collisionGrid.collectLarge(_state, _contacts);
+	if (_contacts.empty()) return;
+
+	// touching groups by union-find, the result doesn't depend on the order contacts were found in
+	const int n = (int)_bodies.size();
+	std::vector<int> roots(n);
+	for (int i = 0; i < n; i++) roots[i] = i;
+	auto find = [&](int i) {
+		while (roots[i] != i) i = roots[i] = roots[roots[i]];
+		return i;
+	};
+	for (const Contact& contact : _contacts)
+	{
+		int a = find((int)contact.first), b = find((int)contact.second);
+		if (a != b) roots[glm::max(a, b)] = glm::min(a, b);
+	}
+
+	// the heaviest member survives, the lowest index breaks ties. roots are the lowest index of their group
+	std::vector<int> survivors(n, -1);
+	std::vector<uint32_t> members;
+	for (const Contact& contact : _contacts)
+		for (uint32_t i : { contact.first, contact.second })
+			if (survivors[i] == -1)
+			{
+				survivors[i] = (int)i;
+				members.push_back(i);
+			}
+	std::sort(members.begin(), members.end());
+	for (uint32_t i : members)
+	{
+		int& best = survivors[find((int)i)];
+		if (_state.mass[i] > _state.mass[best]) best = (int)i;
+	}
+
+	// mass, momentum and volume add up, the survivor sits at the centre of mass
+	std::vector<uint32_t> removed;
+	std::unordered_map<int, std::pair<glm::dvec3, glm::dvec3>> sums;
+	for (uint32_t i : members)
+	{
+		int root = find((int)i);
+		int survivor = survivors[root];
+		auto& sum = sums.try_emplace(survivor, glm::dvec3(0.0), glm::dvec3(0.0)).first->second;
+		sum.first += _state.mass[i] * _state.position(i);
+		sum.second += _state.mass[i] * _state.velocity(i);
+		if ((int)i != survivor) removed.push_back(i);
+	}
+	for (uint32_t i : removed)
+	{
+		int survivor = survivors[find((int)i)];
+		_state.radius[survivor] = std::cbrt(_state.radius[survivor] * _state.radius[survivor] * _state.radius[survivor]
+			+ _state.radius[i] * _state.radius[i] * _state.radius[i]);
+		_state.mass[survivor] += _state.mass[i];
+	}
+	for (auto& [survivor, sum] : sums)
+	{
+		double total = _state.mass[survivor];
+		if (total <= 0.0) continue;
+		_state.setPosition(survivor, sum.first / total);
+		_state.setVelocity(survivor, sum.second / total);
+	}
+
+	// whatever orbited an absorbed body now orbits its survivor, or climbs past its own group
+	auto survivorOf = [&](int i) { return survivors[i] == -1 ? i : survivors[find(i)]; };
+	for (int i = 0; i < n; i++)
+	{
+		int center = _parents[i];
+		for (int guard = 0; center != -1 && guard < n; guard++)
+		{
+			if (survivorOf(center) == survivorOf(i)) center = _parents[center];
+			else if (survivorOf(center) != center) center = survivorOf(center);
+			else break;
+		}
+		if (center == _parents[i] || survivorOf(i) != i) continue;
+		_parents[i] = center;
+		_bodies[i].centerName = center == -1 ? _bodies[i].name : _bodies[center].name;
+	}
+	for (auto& particles : _particleSystems) particles->setCenter(survivorOf(particles->center()));
+
+	_mergeCount += removed.size();
+	removeBodies(removed);
+}
+
+void Simulation::removeBodies(std::vector<uint32_t>& removed)
+{
+	// highest first, so the last slot never holds a body that is still waiting to be removed
+	std::sort(removed.begin(), removed.end(), std::greater<uint32_t>());
+
+	// remap from an index before the removal to the one after, -1 for removed bodies
+	const size_t n = _bodies.size();
+	std::vector<int> remap(n), original(n);
+	for (size_t i = 0; i < n; i++) remap[i] = original[i] = (int)i;
+
+	for (uint32_t slot : removed)
+	{
+		const size_t last = _bodies.size() - 1;
+		if (_isNameMapValid) _bodyNameMap.erase(_bodies[slot].name);
+		remap[original[slot]] = -1;
+		if (slot != last)
+		{
+			_bodies[slot] = std::move(_bodies[last]);
+			_parents[slot] = _parents[last];
+			original[slot] = original[last];
+			remap[original[slot]] = (int)slot;
+			if (_isNameMapValid) _bodyNameMap[_bodies[slot].name] = (int)slot;
+		}
+		_bodies.pop_back();
+		_parents.pop_back();
+		_state.swapRemove(slot);
+		_orbits.swapRemove(slot);
+		if (_onBodyRemoved) _onBodyRemoved((int)slot, (int)last);
+	}
+
+	for (int& center : _parents) if (center != -1) center = remap[center];
+	for (auto& particles : _particleSystems) particles->setCenter(remap[particles->center()]);
+	for (auto& [name, children] : _pendingChildren)
+	{
+		for (int& child : children) child = remap[child];
+		children.erase(std::remove(children.begin(), children.end(), -1), children.end());
+	}
+
+	_isOrderValid = false;
+	_collisionGrid.invalidate();
+	_integrator->invalidate();
+}
+
+int Simulation::addParticles(const std::string& name, const std::string& centerName, size_t count, float innerRadius, float outerRadius,
+	float thickness, float maxEccentricity, float particleRadius, uint64_t seed)
+{
+	int center = find(centerName);
+	if (center == -1) return -1;
+
+	auto particles = std::make_unique<ParticleSystem>(name, center, particleRadius);
+	particles->populate(count, kGravity * _state.mass[center], innerRadius, outerRadius, thickness, maxEccentricity, seed);
+	_particleSystems.push_back(std::move(particles));
+	return (int)_particleSystems.size() - 1;
+}
+
+void Simulation::setParticleCollisions(bool enabled)
+{
+	for (auto& particles : _particleSystems) particles->setSelfInteraction(enabled);
+}
+
+const size_t Simulation::particleCount() const
+{
+	size_t count = 0;
+	for (auto& particles : _particleSystems) count += particles->size();
+	return count;
+}
+
+const uint64_t Simulation::stateHash() const
+{
+	uint64_t hash = 14695981039346656037ull;
+	auto mix = [&](const void* data, size_t bytes) {
+		const uint8_t* p = (const uint8_t*)data;
+		for (size_t i = 0; i < bytes; i++) hash = (hash ^ p[i]) * 1099511628211ull;
+	};
+
+	uint64_t steps = _clock.steps();
+	mix(&steps, sizeof(steps));
+	const size_t n = _state.size();
+	for (const AlignedVector<double>* member : { &_state.px, &_state.py, &_state.pz, &_state.vx, &_state.vy, &_state.vz, &_state.mass })
+		mix(member->data(), n * sizeof(double));
+	mix(_parents.data(), _parents.size() * sizeof(int));
+	for (auto& particles : _particleSystems)
+	{
+		for (size_t i = 0; i < particles->size(); i++)
+		{
+			glm::vec3 p = particles->position(i), v = particles->velocity(i);
+			mix(&p, sizeof(p));
+			mix(&v, sizeof(v));
+		}
+	}
+	return hash;
+}
+
+void Simulation::setMass(int index, double mass)
+{
+	_state.mass[index] = mass;
+	_integrator->invalidate();
+
+	// the mean motion of the body and of everything orbiting it depends on the mass
+	for (int i = 0; i < (int)_bodies.size(); i++)
+		if (i == index || _parents[i] == index) refreshOrbit(i);
+}
+
+void Simulation::setOrbit(int index, float eccentricity, float focalDistance)
+{
+	_bodies[index].eccentricity = eccentricity;
+	_bodies[index].focalDistance = focalDistance;
+	refreshOrbit(index);
+}
+
+void Simulation::refreshOrbit(int index)
+{
+	int center = _parents[index];
+	if (center == -1) return;
+
+	const Body& body = _bodies[index];
+	const double time = _clock.time();
+	double mu = kGravity * (_state.mass[center] + _state.mass[index]);
+
+	// keep the current orientation and place on the orbit if there is one, otherwise start at periapsis towards the body
+	glm::dvec3 periapsis = _orbits.majorAxis(index), direction = _orbits.minorAxis(index);
+	double meanAnomaly = _orbits.meanAnomaly(index, time);
+	if (glm::length(direction) == 0.0)
+	{
+		periapsis = _state.position(index) - _state.position(center);
+		if (glm::length(periapsis) == 0.0) periapsis = { 1.0, 0.0, 0.0 };
+		// counter clockwise seen from +y like the legacy rails, i.e. from +x towards +z
+		direction = glm::cross(periapsis, glm::dvec3(0.0, 1.0, 0.0));
+		meanAnomaly = 0.0;
+	}
+	_orbits.set(index, mu, body.focalDistance, body.eccentricity, periapsis, direction, meanAnomaly, time);
+}
+
+void Simulation::accelerations(BodyArrays& bodies)
+{
+	switch (_solver)
+	{
+	case GravitySolver::DIRECT:
+		parallelFor(bodies.size(), 64, [&](size_t begin, size_t end) {
+			Gravity::directSum(bodies, kGravity, _softening, begin, end, _isCompensated);
+		});
+		break;
+	case GravitySolver::BARNES_HUT:
+		_barnesHut.build(bodies);
+		parallelFor(bodies.size(), 256, [&](size_t begin, size_t end) {
+			_barnesHut.evaluate(bodies, kGravity, _softening, begin, end, _isCompensated);
+		});
+		break;
+	default:
+		break;
+	}
+}
+
+void Simulation::accelerations(BodyArrays& bodies, const std::vector<uint32_t>& active)
+{
+	switch (_solver)
+	{
+	case GravitySolver::DIRECT:
+		parallelFor(active.size(), 16, [&](size_t begin, size_t end) {
+			for (size_t c = begin; c < end; c++) Gravity::directSum(bodies, kGravity, _softening, active[c], active[c] + 1, _isCompensated);
+		});
+		break;
+	case GravitySolver::BARNES_HUT:
+		_barnesHut.build(bodies);
+		parallelFor(active.size(), 64, [&](size_t begin, size_t end) {
+			_barnesHut.evaluateBodies(bodies, kGravity, _softening, active.data() + begin, end - begin, _isCompensated);
+		});
+		break;
+	default:
+		break;
+	}
+}
+
+void Simulation::parallelFor(size_t n, size_t grain, const RangeTask& task)
+{
+	if (_jobs) _jobs->parallelFor(0, n, grain, task);
+	else task(0, n);
+}
+
+void Simulation::setThreadCount(int threads)
+{
+	if (threads == threadCount() && (threads > 1) == (_jobs != nullptr)) return;
+	if (threads <= 1) _jobs.reset();
+	else _jobs = std::make_unique<JobSystem>(threads);
+}
+
+void Simulation::seedOrbitalVelocities()
+{
+	for (uint32_t i : updateOrder())
+	{
+		int center = _parents[i];
+		if (center == -1) _state.setVelocity(i, { 0.0, 0.0, 0.0 });
+		else _state.setVelocity(i, circularVelocity(i, center));
+	}
+}
+
+void Simulation::leaveRailsFallback()
+{
+	const double time = _clock.time();
+	for (uint32_t i : updateOrder())
+	{
+		int center = _parents[i];
+		if (center != -1) _state.setVelocity(i, _state.velocity(center) + _orbits.velocity(i, time));
+	}
+	_isRailsFallback = false;
+	_integrator->invalidate();
+
+	// the drifted estimate only said it was worth a try, the next steps measure it again
+	_nbodyStepCost = 0.0;
+}
+
+void Simulation::launchOnOrbit(int index)
+{
+	int center = _parents[index];
+	if (center == -1) return;
+
+	const double time = _clock.time();
+	const glm::dvec3 dp = _state.position(center) + _orbits.position(index, time) - _state.position(index);
+	const glm::dvec3 dv = _state.velocity(center) + _orbits.velocity(index, time) - _state.velocity(index);
+	for (int i = 0; i < (int)_bodies.size(); i++)
+	{
+		int ancestor = i;
+		while (ancestor != -1 && ancestor != index) ancestor = _parents[ancestor];
+		if (ancestor != index) continue;
+		_state.setPosition(i, _state.position(i) + dp);
+		_state.setVelocity(i, _state.velocity(i) + dv);
+	}
+	_integrator->invalidate();
+}
+
+void Simulation::syncRailsOrbits()
+{
+	const double time = _clock.time();
+	for (int i = 0; i < (int)_bodies.size(); i++)
+	{
+		int center = _parents[i];
+		if (center == -1) continue;
+
+		double mu = kGravity * (_state.mass[center] + _state.mass[i]);
+		_orbits.setFromState(i, mu, _state.position(i) - _state.position(center), _state.velocity(i) - _state.velocity(center), time);
+	}
+}
+
+glm::dvec3 Simulation::circularVelocity(int index, int center) const
+{
+	glm::dvec3 offset = _state.position(index) - _state.position(center);
+	double distance = glm::length(offset);
+	if (distance == 0.0) return _state.velocity(center);
+
+	// the rails move counter clockwise seen from +y, i.e. from +x towards +z
+	glm::dvec3 tangent = glm::cross(offset, glm::dvec3(0.0, 1.0, 0.0));
+	if (glm::length(tangent) == 0.0) tangent = glm::cross(offset, glm::dvec3(1.0, 0.0, 0.0));
+	double speed = std::sqrt(kGravity * (_state.mass[center] + _state.mass[index]) / distance);
+	return _state.velocity(center) + glm::normalize(tangent) * speed;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "Common.hpp"
+#include "Simulation.hpp"
+
+#include <random>
+
+// radius of the unit sphere mesh, a body's collision radius is this times its scale
+inline constexpr float kSphereRadius = 20.0f;
+
+typedef struct
+{
+	const char* name;
+	const char* centerName;
+	float eccentricity;
+	float focalDistance;
+	float mass;
+	glm::vec3 pos;
+	glm::vec3 scale;
+	glm::vec4 color;
+}BodyDesc;
+
+// attribs of 8 planets + sun + some satellites, shared by the viewer and the headless runner
+inline const std::vector<BodyDesc>& solarSystemDescs()
+{
+	float sunMass = 333400.f, mercuryMass = 1.f, venusMass = 1.f, earthMass = 4000.f, moonMass = 1.f, marsMass = 1.f, jupiterMass = 3000.f, saturnMass = 3000.f, uranusMass = 1.f, neptuneMass = 1.f, plutoMass = 1.f;
+	float mercuryE = 0.6f, venusE = 0.65f, earthE = 0.7f, moonE = 0.7f, marsE = 0.72f, jupiterE = 0.75f, saturnE = 0.79f, uranusE = 0.81f, neptuneE = 0.83f, plutoE = 0.85f;
+	float mercuryFD = 30.f, venusFD = 60.f, earthFD = 100.f, moonFD = 40.f, marsFD = 140.f, jupiterFD = 170.f, saturnFD = 200.f, uranusFD = 230.f, neptuneFD = 260.f, plutoFD = 300.f;
+	glm::vec3 sunScale = { 1.0f, 1.0f, 1.0f }, mercuryScale = { 0.2f, 0.2f, 0.2f }, venusScale = { 0.3f, 0.3f, 0.3f }, earthScale = { 0.5f, 0.5f, 0.5f }, moonScale = { 0.1f, 0.1f, 0.1f };
+	glm::vec3 marsScale = { 0.28f, 0.28f, 0.28f }, jupiterScale = { 0.7f, 0.7f, 0.7f }, saturnScale = { 0.65f, 0.65f, 0.65f }, uranusScale = { 0.38f, 0.38f, 0.38f }, neptuneScale = { 0.38f, 0.38f, 0.38f };
+	glm::vec3 plutoScale = { 0.2f, 0.2f, 0.2f };
+	glm::vec4 sunColor = { 1.0f, 0.0f, 0.0f, 1.0f }, mercuryColor = { 0.75f, 0.45f, 0.13f, 1.0f }, venusColor = {0.55f, 0.44f, 0.27f, 1.0f}, earthColor = { 0.0f, 0.0f, 1.0f, 1.0f }, moonColor = { 1.0f, 1.0f, 1.0f, 1.0f };
+	glm::vec4 marsColor = { 0.73f, 0.33f, 0.23, 1.0f }, jupiterColor = { 0.57f, 0.40f, 0.25, 1.0f }, saturnColor = { 0.89f, 0.71f, 0.49f, 1.0f }, uranusColor = { 0.16f,0.75f, 0.93f, 1.0f }, neptuneColor = { 0.16f,0.75f, 0.93f, 1.0f };
+	glm::vec4 plutoColor = { 0.46f, 0.67f, 0.71f, 1.0f };
+
+	static const std::vector<BodyDesc> descs = {
+		{ "Sun", "Sun", 1.0f, 0.0f, sunMass, { 0.0f, 0.0f, 0.0f }, sunScale, sunColor },
+		{ "Mercury", "Sun", mercuryE, mercuryFD, mercuryMass, { mercuryFD, 0.0f, 0.0f }, mercuryScale, mercuryColor },
+		{ "Venus", "Sun", venusE, venusFD, venusMass, { venusFD, 0.0f, 0.0f }, venusScale, venusColor },
+		{ "Earth", "Sun", earthE, earthFD, earthMass, { earthFD, 0.0f, 0.0f }, earthScale, earthColor },
+		{ "Mars", "Sun", marsE, marsFD, marsMass, { marsFD, 0.0f, 0.0f }, marsScale, marsColor },
+		{ "Jupiter", "Sun", jupiterE, jupiterFD, jupiterMass, { jupiterFD, 0.0f, 0.0f }, jupiterScale, jupiterColor },
+		{ "Saturn", "Sun", saturnE, saturnFD, saturnMass, { saturnFD, 0.0f, 0.0f }, saturnScale, saturnColor },
+		{ "Uranus", "Sun", uranusE, uranusFD, uranusMass, { uranusFD, 0.0f, 0.0f }, uranusScale, uranusColor },
+		{ "Neptune", "Sun", neptuneE, neptuneFD, neptuneMass, { neptuneFD, 0.0f, 0.0f }, neptuneScale, neptuneColor },
+		{ "Pluto", "Sun", plutoE, plutoFD, plutoMass, { plutoFD, 0.0f, 0.0f }, plutoScale, plutoColor },
+
+		// some satellites just for fun
+		{ "Moon", "Earth", moonE, moonFD, moonMass, { moonFD, 0.0f, 0.0f }, moonScale, moonColor },
+		{ "Ganymede", "Jupiter", 0.6, 50.f, 1.0f, { moonFD, 0.0f, 0.0f }, moonScale, { 0.21f, 0.22 , 0.17 ,1.0f } },
+		{ "Titan", "Saturn", 0.6, 50.f, 1.0f, { moonFD, 0.0f, 0.0f }, moonScale, saturnColor },
+	};
+
+	return descs;
+}
+
+// the default system plus count random small bodies orbiting the sun, a fixed seed keeps runs comparable
+inline void populateSolarSystem(Simulation& sim, int randomCount = 0, uint64_t seed = 4048111)
+{
+	for (auto& desc : solarSystemDescs())
+		sim.addBody(desc.name, desc.centerName, desc.eccentricity, desc.focalDistance, desc.mass, desc.pos, kSphereRadius * desc.scale.x);
+
+	std::mt19937_64 rng(seed);
+	std::uniform_real_distribution<double> radiusDist(40.0, 400.0), angleDist(0.0, 360.0), heightDist(-2.0, 2.0);
+	for (int i = 0; i < randomCount; i++)
+	{
+		double radius = radiusDist(rng), angle = glm::radians(angleDist(rng));
+		glm::vec3 pos = { (float)(radius * std::cos(angle)), (float)heightDist(rng), (float)(radius * std::sin(angle)) };
+		sim.addBody("Body" + std::to_string(i), "Sun", 0.01f, (float)radius, 0.001f, pos, 0.01f * kSphereRadius);
+	}
+}
+
+// a main belt between Mars and Jupiter and a ring around Saturn, drawn as points by the viewer
+inline void populateParticles(Simulation& sim, size_t beltCount, size_t ringCount)
+{
+	if (beltCount > 0) sim.addParticles("Main belt", "Sun", beltCount, 148.0f, 162.0f, 4.0f, 0.05f, 0.05f);
+	if (ringCount > 0) sim.addParticles("Saturn ring", "Saturn", ringCount, 17.0f, 28.0f, 0.2f, 0.001f, 0.02f);
+}
@@ -0,0 +1,726 @@
+#pragma once
+
+#include "Common.hpp"
+#include "BarnesHut.hpp"
+#include "JobSystem.hpp"
+#include "MappedFile.hpp"
+
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <queue>
+#include <thread>
+
+inline constexpr char kStarTableMagic[8] = { 'S', 'S', 'S', 'T', 'A', 'R', 'S', '\0' };
+inline constexpr uint32_t kStarTableVersion = 1;
+// bits of each quantized coordinate, three of them make the 63 bit morton key
+inline constexpr int kStarAxisBits = 21;
+// the table is indexed by the cells of this octree level, 8^4 of them
+inline constexpr int kStarIndexLevel = 4;
+inline constexpr int16_t kStarNoColorIndex = INT16_MIN;
+
+// one star as it sits in the table, 16 bytes
+typedef struct
+{
+	// morton interleaved quantized position, see StarTable::position
+	uint64_t key;
+	// thousandths of a magnitude
+	int16_t magnitude;
+	// B-V in thousandths, kStarNoColorIndex if the catalog had none
+	int16_t colorIndex;
+	// data row of the catalog the star came from, 0 for the first line after the header
+	uint32_t row;
+}StarRecord;
+
+static_assert(sizeof(StarRecord) == 16, "star tables are a fixed layout");
+
+// all fields little-endian, the cell index and then the stars follow the header
+typedef struct
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t axisBits;
+	uint64_t starCount;
+	// parsecs, stars further out sit on the sphere of this radius
+	double extent;
+	// parsecs, where the radial compander turns from linear to logarithmic
+	double compandScale;
+	// cellCount + 1 star offsets, cell c holds stars [cells[c], cells[c + 1])
+	uint64_t cellsOffset;
+	uint64_t starsOffset;
+	uint32_t indexLevel;
+	float brightestMagnitude;
+	float faintestMagnitude;
+	uint32_t reserved;
+}StarTableHeader;
+
+static_assert(sizeof(StarTableHeader) == 72, "star tables are a fixed layout");
+
+typedef struct
+{
+	// parsecs, see StarTableHeader
+	double extent;
+	double compandScale;
+	// stars fainter than this are left out
+	double magnitudeLimit;
+	// csv bytes read at a time, a second block is read ahead while this one parses
+	size_t blockBytes;
+	// stars sorted in memory before they go to disk as one run of the external merge
+	size_t runStars;
+	int threads;
+}StarIngestOptions;
+
+typedef struct
+{
+	uint64_t rows;
+	uint64_t stars;
+	// rows without a usable position or magnitude
+	uint64_t skipped;
+	// rows fainter than the magnitude limit
+	uint64_t faint;
+	// stars further than the extent or without a distance, kept on its sphere in their direction
+	uint64_t clamped;
+	uint64_t bytesRead;
+	size_t runs;
+	double parseSeconds;
+	double mergeSeconds;
+	double wallSeconds;
+}StarIngestStats;
+
+// Turns a star catalog csv, HYG or a Gaia export, into a packed star table. The csv is streamed a block at
+// a time with the next block read ahead, every block is cut at line ends into pieces that parse in parallel,
+// and the stars are sorted along a morton curve in runs of a fixed size that an external merge joins at the
+// end, so a catalog of any size ingests in the same bounded memory.
+//
+// Columns are found by name in the header line: x, y, z in parsecs (HYG), or else ra and dec in degrees with
+// dist in parsecs or parallax in milliarcseconds (Gaia). The magnitude is mag, vmag, gmag or phot_g_mean_mag,
+// the color index ci, b_v or bv, or bp_rp which is turned into an approximate B-V.
+class StarCatalog
+{
+	INCONSTRUCTIBLE(StarCatalog)
+
+public:
+	static StarIngestOptions defaultOptions();
+
+	// false with error set if the csv can't be read, lacks the columns or the table can't be written
+	static bool ingest(const std::string& csvPath, const std::string& tablePath, const StarIngestOptions& options, StarIngestStats* stats,
+		std::string& error);
+
+	// quantized morton key of a position in parsecs, clamped to the extent
+	static uint64_t encode(const glm::dvec3& position, double extent, double compandScale);
+
+	static glm::dvec3 decode(uint64_t key, double extent, double compandScale);
+
+	// B-V from Gaia's BP-RP, a rough fit through a few main sequence stars that is good enough to color a point
+	static double bvFromBpRp(double bpRp);
+
+private:
+	enum class Column
+	{
+		X = 0,
+		Y,
+		Z,
+		RA,
+		DEC,
+		DIST,
+		PARALLAX,
+		MAGNITUDE,
+		COLOR_INDEX,
+		BP_RP,
+		COUNT
+	};
+
+	typedef struct
+	{
+		// the column each field of a row is, -1 for ones nobody reads
+		std::vector<int> roles;
+		// past this field a row has nothing left to read
+		int lastField;
+		bool hasCartesian;
+	}Layout;
+
+	static bool readLayout(const std::string& header, Layout& layout, std::string& error);
+
+	// the stars of the whole lines in [text, end), rows numbered from 0 within them. returns the rows seen
+	static uint64_t parse(const char* text, const char* end, const Layout& layout, const StarIngestOptions& options, std::vector<StarRecord>& stars,
+		StarIngestStats& counts);
+
+	// the fields of a line, quotes removed, up to the layout's last field
+	static int splitFields(const char* line, const char* end, int lastField, std::string_view* fields);
+
+	// the runs in runsPath merged into one morton ordered table at tablePath
+	static bool merge(const std::string& runsPath, const std::vector<std::pair<uint64_t, uint64_t>>& runs, std::vector<StarRecord> lastRun,
+		const std::string& tablePath, const StarIngestOptions& options, std::string& error);
+
+	static bool isBefore(const StarRecord& a, const StarRecord& b) { return a.key < b.key || (a.key == b.key && a.row < b.row); };
+
+	static uint64_t compactBits(uint64_t v);
+};
+
+// Read side of a star table: the file is mapped and stars are read straight out of the mapping.
+class StarTable
+{
+	NONCOPYABLE(StarTable)
+
+private:
+	MappedFile _file;
+	const StarTableHeader* _header{ nullptr };
+	const uint64_t* _cells{ nullptr };
+	const StarRecord* _stars{ nullptr };
+
+public:
+	StarTable() = default;
+	~StarTable() = default;
+
+	// false if the file is missing, isn't a star table or is cut short
+	bool open(const std::string& path);
+
+	void close();
+
+	const bool isOpen() const { return _header != nullptr; };
+
+	const size_t size() const { return _header ? (size_t)_header->starCount : 0; };
+
+	const StarTableHeader& header() const { return *_header; };
+
+	const StarRecord& star(size_t i) const { return _stars[i]; };
+
+	// parsecs, equatorial: +x toward the vernal equinox, +z toward the north celestial pole
+	const glm::dvec3 position(size_t i) const { return StarCatalog::decode(_stars[i].key, _header->extent, _header->compandScale); };
+
+	const float magnitude(size_t i) const { return _stars[i].magnitude * 1e-3f; };
+
+	const bool hasColorIndex(size_t i) const { return _stars[i].colorIndex != kStarNoColorIndex; };
+
+	const float colorIndex(size_t i) const { return _stars[i].colorIndex * 1e-3f; };
+
+	const size_t cellCount() const { return (size_t)1 << (3 * kStarIndexLevel); };
+
+	// the stars of an index cell, which is a morton prefix so the cells of a box are few contiguous ranges
+	void cellRange(size_t cell, size_t& begin, size_t& end) const { begin = (size_t)_cells[cell]; end = (size_t)_cells[cell + 1]; };
+
+	// linear rgb of a star of B-V bv, through its black body temperature
+	static glm::vec3 color(float bv);
+};
+
+StarIngestOptions StarCatalog::defaultOptions()
+{
+	StarIngestOptions options;
+	options.extent = 100000.0;
+	options.compandScale = 1.0;
+	options.magnitudeLimit = std::numeric_limits<double>::infinity();
+	options.blockBytes = 16 << 20;
+	options.runStars = 4 << 20;
+	options.threads = (int)std::thread::hardware_concurrency();
+	return options;
+}
+
+double StarCatalog::bvFromBpRp(double bpRp)
+{
+	bpRp = glm::clamp(bpRp, -0.5, 4.0);
+	return 0.899 * bpRp - 0.130 * bpRp * bpRp;
+}
+
+uint64_t StarCatalog::encode(const glm::dvec3& position, double extent, double compandScale)
+{
+	// the radius is companded logarithmically past compandScale, so a quantization step is about the same angle
+	// near and far and the nearest stars don't snap onto a coarse grid sized for the whole galaxy
+	double r = glm::length(position);
+	glm::dvec3 c(0.0);
+	if (r > 0.0)
+	{
+		const double companded = extent * std::log1p(glm::min(r, extent) / compandScale) / std::log1p(extent / compandScale);
+		c = position * (companded / r);
+	}
+	const double cells = (double)(1u << kStarAxisBits);
+	auto quantize = [&](double value) {
+		return (uint32_t)glm::clamp(std::floor((value / extent * 0.5 + 0.5) * cells), 0.0, cells - 1.0);
+	};
+	return BarnesHut::mortonEncode(quantize(c.x), quantize(c.y), quantize(c.z));
+}
+
+// gather every third bit of v into the low 21 bits, the inverse of BarnesHut's expandBits
+uint64_t StarCatalog::compactBits(uint64_t v)
+{
+	v &= 0x1249249249249249ull;
+	v = (v ^ (v >> 2)) & 0x10c30c30c30c30c3ull;
+	v = (v ^ (v >> 4)) & 0x100f00f00f00f00full;
+	v = (v ^ (v >> 8)) & 0x1f0000ff0000ffull;
+	v = (v ^ (v >> 16)) & 0x1f00000000ffffull;
+	v = (v ^ (v >> 32)) & 0x1fffffull;
+	return v;
+}
+
+glm::dvec3 StarCatalog::decode(uint64_t key, double extent, double compandScale)
+{
+	const double cells = (double)(1u << kStarAxisBits);
+	auto unquantize = [&](uint64_t q) { return ((q + 0.5) / cells * 2.0 - 1.0) * extent; };
+	glm::dvec3 c(unquantize(compactBits(key >> 2)), unquantize(compactBits(key >> 1)), unquantize(compactBits(key)));
+	const double companded = glm::length(c);
+	if (companded == 0.0) return c;
+	const double r = compandScale * std::expm1(glm::min(companded, extent) / extent * std::log1p(extent / compandScale));
+	return c * (r / companded);
+}
+
+int StarCatalog::splitFields(const char* line, const char* end, int lastField, std::string_view* fields)
+{
+	int count = 0;
+	const char* p = line;
+	while (count <= lastField)
+	{
+		if (p < end && *p == '"')
+		{
+			// quoted, a doubled quote inside doesn't end it. numbers never have one, so it isn't unescaped
+			const char* start = ++p;
+			while (p < end && !(*p == '"' && (p + 1 >= end || p[1] != '"'))) p += *p == '"' ? 2 : 1;
+			fields[count++] = std::string_view(start, std::min(p, end) - start);
+			if (p < end) p++;
+			while (p < end && *p != ',') p++;
+		}
+		else
+		{
+			const char* start = p;
+			while (p < end && *p != ',') p++;
+			const char* last = p;
+			while (last > start && (last[-1] == ' ' || last[-1] == '\r')) last--;
+			while (start < last && *start == ' ') start++;
+			fields[count++] = std::string_view(start, last - start);
+		}
+		if (p >= end) break;
+		p++;
+	}
+	return count;
+}
+
+bool StarCatalog::readLayout(const std::string& header, Layout& layout, std::string& error)
+{
+	std::string text = header;
+	// a byte order mark isn't part of the first column's name
+	if (text.size() >= 3 && (uint8_t)text[0] == 0xef && (uint8_t)text[1] == 0xbb && (uint8_t)text[2] == 0xbf) text.erase(0, 3);
+	for (char& c : text) c = (char)std::tolower((unsigned char)c);
+
+	std::vector<std::string_view> names(std::count(text.begin(), text.end(), ',') + 1);
+	const int fieldCount = splitFields(text.data(), text.data() + text.size(), (int)names.size() - 1, names.data());
+	const std::pair<const char*, Column> known[] = { { "x", Column::X }, { "y", Column::Y }, { "z", Column::Z }, { "ra", Column::RA },
+		{ "dec", Column::DEC }, { "dist", Column::DIST }, { "parallax", Column::PARALLAX }, { "mag", Column::MAGNITUDE }, { "vmag", Column::MAGNITUDE },
+		{ "gmag", Column::MAGNITUDE }, { "phot_g_mean_mag", Column::MAGNITUDE }, { "ci", Column::COLOR_INDEX }, { "b_v", Column::COLOR_INDEX },
+		{ "bv", Column::COLOR_INDEX }, { "bp_rp", Column::BP_RP } };
+
+	layout.roles.assign(fieldCount, -1);
+	layout.lastField = -1;
+	bool isFound[(int)Column::COUNT] = {};
+	for (int f = 0; f < fieldCount; f++)
+	{
+		for (auto& [name, column] : known)
+		{
+			// the first of several names for one column wins
+			if (names[f] != name || isFound[(int)column]) continue;
+			layout.roles[f] = (int)column;
+			layout.lastField = f;
+			isFound[(int)column] = true;
+		}
+	}
+
+	layout.hasCartesian = isFound[(int)Column::X] && isFound[(int)Column::Y] && isFound[(int)Column::Z];
+	const bool hasSpherical = isFound[(int)Column::RA] && isFound[(int)Column::DEC];
+	if (!layout.hasCartesian && !hasSpherical) error = "the header has neither x, y, z nor ra, dec columns";
+	else if (!isFound[(int)Column::MAGNITUDE]) error = "the header has no mag, vmag, gmag or phot_g_mean_mag column";
+	else return true;
+	return false;
+}
+
+uint64_t StarCatalog::parse(const char* text, const char* end, const Layout& layout, const StarIngestOptions& options, std::vector<StarRecord>& stars,
+	StarIngestStats& counts)
+{
+	std::vector<std::string_view> fields(layout.lastField + 1);
+	uint64_t row = 0;
+	for (const char* line = text; line < end; row++)
+	{
+		const char* lineEnd = (const char*)memchr(line, '\n', end - line);
+		if (!lineEnd) lineEnd = end;
+		const int fieldCount = splitFields(line, lineEnd, layout.lastField, fields.data());
+		line = lineEnd + 1;
+
+		double values[(int)Column::COUNT];
+		bool has[(int)Column::COUNT] = {};
+		for (int f = 0; f < fieldCount; f++)
+		{
+			const int role = layout.roles[f];
+			if (role == -1 || fields[f].empty()) continue;
+			const char* first = fields[f].data();
+			if (*first == '+') first++;
+			auto result = std::from_chars(first, fields[f].data() + fields[f].size(), values[role]);
+			has[role] = result.ec == std::errc() && std::isfinite(values[role]);
+		}
+
+		if (!has[(int)Column::MAGNITUDE])
+		{
+			counts.skipped++;
+			continue;
+		}
+		const double magnitude = values[(int)Column::MAGNITUDE];
+		if (magnitude > options.magnitudeLimit)
+		{
+			counts.faint++;
+			continue;
+		}
+
+		glm::dvec3 position;
+		double distance;
+		if (layout.hasCartesian && has[(int)Column::X] && has[(int)Column::Y] && has[(int)Column::Z])
+		{
+			position = { values[(int)Column::X], values[(int)Column::Y], values[(int)Column::Z] };
+			distance = glm::length(position);
+		}
+		else if (has[(int)Column::RA] && has[(int)Column::DEC])
+		{
+			const double ra = glm::radians(values[(int)Column::RA]), dec = glm::radians(values[(int)Column::DEC]);
+			// a missing or negative parallax still places the star in the sky, just not how far
+			if (has[(int)Column::DIST] && values[(int)Column::DIST] > 0.0) distance = values[(int)Column::DIST];
+			else if (has[(int)Column::PARALLAX] && values[(int)Column::PARALLAX] > 0.0) distance = 1000.0 / values[(int)Column::PARALLAX];
+			else distance = std::numeric_limits<double>::infinity();
+			position = glm::dvec3(std::cos(dec) * std::cos(ra), std::cos(dec) * std::sin(ra), std::sin(dec));
+			if (std::isfinite(distance)) position *= distance;
+		}
+		else
+		{
+			counts.skipped++;
+			continue;
+		}
+		if (distance > options.extent)
+		{
+			position = glm::normalize(position) * options.extent;
+			counts.clamped++;
+		}
+
+		StarRecord star;
+		star.key = encode(position, options.extent, options.compandScale);
+		star.magnitude = (int16_t)glm::clamp(std::lround(magnitude * 1000.0), -32767l, 32767l);
+		double bv = std::numeric_limits<double>::quiet_NaN();
+		if (has[(int)Column::COLOR_INDEX]) bv = values[(int)Column::COLOR_INDEX];
+		else if (has[(int)Column::BP_RP]) bv = bvFromBpRp(values[(int)Column::BP_RP]);
+		star.colorIndex = std::isnan(bv) ? kStarNoColorIndex : (int16_t)glm::clamp(std::lround(bv * 1000.0), -32767l, 32767l);
+		star.row = (uint32_t)row;
+		stars.push_back(star);
+	}
+	return row;
+}
+
+bool StarCatalog::ingest(const std::string& csvPath, const std::string& tablePath, const StarIngestOptions& options, StarIngestStats* stats,
+	std::string& error)
+{
+	auto start = std::chrono::steady_clock::now();
+	StarIngestStats counts{};
+	std::ifstream ifs(csvPath, std::ios::binary);
+	if (!ifs)
+	{
+		error = "can't read " + csvPath;
+		return false;
+	}
+	std::string header;
+	std::getline(ifs, header);
+	Layout layout;
+	if (!readLayout(header, layout, error))
+	{
+		error = csvPath + ": " + error;
+		return false;
+	}
+	counts.bytesRead = header.size() + 1;
+
+	const std::string runsPath = tablePath + ".runs";
+	std::ofstream runsFile;
+	// (offset, count) of every run written out, the last one stays in memory for the merge
+	std::vector<std::pair<uint64_t, uint64_t>> runs;
+	std::vector<StarRecord> run;
+	run.reserve(options.runStars);
+	auto flushRun = [&]() {
+		std::sort(run.begin(), run.end(), isBefore);
+		if (!runsFile.is_open()) runsFile.open(runsPath, std::ios::binary | std::ios::trunc);
+		runs.push_back({ runs.empty() ? 0 : runs.back().first + runs.back().second * sizeof(StarRecord), run.size() });
+		runsFile.write((const char*)run.data(), run.size() * sizeof(StarRecord));
+		run.clear();
+		return runsFile.good();
+	};
+
+	JobSystem pool(glm::max(options.threads, 1));
+	const size_t pieceCount = (size_t)pool.threadCount() * 4;
+	std::vector<std::vector<StarRecord>> pieceStars(pieceCount);
+	std::vector<StarIngestStats> pieceCounts(pieceCount);
+	std::vector<uint64_t> pieceRows(pieceCount);
+
+	// the block being parsed holds the partial line the previous block ended on, then what was read after it
+	std::string block, next;
+	size_t nextBytes = 0;
+	auto readBlock = [&]() {
+		next.resize(options.blockBytes);
+		ifs.read(&next[0], (std::streamsize)options.blockBytes);
+		nextBytes = (size_t)ifs.gcount();
+	};
+	readBlock();
+	uint64_t row = 0;
+	double parseSeconds = 0.0;
+	std::string carry;
+	for (bool isLast = false; !isLast;)
+	{
+		block.swap(carry);
+		block.append(next.data(), nextBytes);
+		counts.bytesRead += nextBytes;
+		isLast = nextBytes == 0;
+		std::thread reader;
+		if (!isLast) reader = std::thread(readBlock);
+
+		// whole lines parse now, the tail waits for the rest of its line in the next block
+		size_t whole = block.size();
+		if (!isLast)
+		{
+			size_t lastLine = block.rfind('\n');
+			whole = lastLine == std::string::npos ? 0 : lastLine + 1;
+		}
+		carry.assign(block, whole, std::string::npos);
+
+		// pieces end at line ends, so each starts on a fresh row
+		std::vector<size_t> cuts(pieceCount + 1, whole);
+		cuts[0] = 0;
+		for (size_t p = 1; p < pieceCount; p++)
+		{
+			size_t target = glm::max(cuts[p - 1], whole * p / pieceCount);
+			const char* lineEnd = target == 0 ? nullptr : (const char*)memchr(block.data() + target - 1, '\n', whole - (target - 1));
+			cuts[p] = target == 0 ? 0 : lineEnd ? (size_t)(lineEnd - block.data()) + 1 : whole;
+		}
+
+		auto parseStart = std::chrono::steady_clock::now();
+		pool.parallelFor(0, pieceCount, 1, [&](size_t begin, size_t end) {
+			for (size_t p = begin; p < end; p++)
+			{
+				pieceStars[p].clear();
+				pieceCounts[p] = {};
+				pieceRows[p] = parse(block.data() + cuts[p], block.data() + cuts[p + 1], layout, options, pieceStars[p], pieceCounts[p]);
+			}
+		});
+		parseSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - parseStart).count();
+
+		for (size_t p = 0; p < pieceCount; p++)
+		{
+			for (StarRecord& star : pieceStars[p])
+			{
+				star.row += (uint32_t)row;
+				run.push_back(star);
+				if (run.size() == options.runStars && !flushRun())
+				{
+					if (reader.joinable()) reader.join();
+					error = "can't write " + runsPath;
+					return false;
+				}
+			}
+			row += pieceRows[p];
+			counts.skipped += pieceCounts[p].skipped;
+			counts.faint += pieceCounts[p].faint;
+			counts.clamped += pieceCounts[p].clamped;
+			counts.stars += pieceStars[p].size();
+		}
+		if (reader.joinable()) reader.join();
+	}
+	counts.rows = row;
+	counts.parseSeconds = parseSeconds;
+	std::sort(run.begin(), run.end(), isBefore);
+	if (runsFile.is_open())
+	{
+		runsFile.close();
+		if (!runsFile)
+		{
+			error = "can't write " + runsPath;
+			return false;
+		}
+	}
+	counts.runs = runs.size() + (run.empty() ? 0 : 1);
+
+	auto mergeStart = std::chrono::steady_clock::now();
+	bool isMerged = merge(runsPath, runs, std::move(run), tablePath, options, error);
+	std::error_code ignored;
+	std::filesystem::remove(runsPath, ignored);
+	if (!isMerged) return false;
+	counts.mergeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - mergeStart).count();
+	counts.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	if (stats) *stats = counts;
+	return true;
+}
+
+bool StarCatalog::merge(const std::string& runsPath, const std::vector<std::pair<uint64_t, uint64_t>>& runs, std::vector<StarRecord> lastRun,
+	const std::string& tablePath, const StarIngestOptions& options, std::string& error)
+{
+	const size_t cellCount = (size_t)1 << (3 * kStarIndexLevel);
+	const int cellShift = 3 * (kStarAxisBits - kStarIndexLevel);
+	StarTableHeader header{};
+	memcpy(header.magic, kStarTableMagic, sizeof(header.magic));
+	header.version = kStarTableVersion;
+	header.axisBits = kStarAxisBits;
+	header.extent = options.extent;
+	header.compandScale = options.compandScale;
+	header.indexLevel = kStarIndexLevel;
+	header.cellsOffset = sizeof(StarTableHeader);
+	header.starsOffset = header.cellsOffset + (cellCount + 1) * sizeof(uint64_t);
+	header.brightestMagnitude = std::numeric_limits<float>::infinity();
+	header.faintestMagnitude = -std::numeric_limits<float>::infinity();
+	std::vector<uint64_t> cells(cellCount + 1, 0);
+
+	// written aside and renamed over, so a viewer never maps half a table
+	const std::string partial = tablePath + ".partial";
+	std::ofstream ofs(partial, std::ios::binary | std::ios::trunc);
+	if (!ofs)
+	{
+		error = "can't write " + partial;
+		return false;
+	}
+	ofs.write((const char*)&header, sizeof(header));
+	ofs.write((const char*)cells.data(), cells.size() * sizeof(uint64_t));
+
+	// every run is read a buffer at a time, the smallest head of them all goes out next
+	const size_t bufferStars = 8192;
+	typedef struct
+	{
+		std::vector<StarRecord> buffer;
+		size_t next;
+		// stars of the run still on disk, and where they start
+		uint64_t left;
+		uint64_t offset;
+	}Cursor;
+	std::vector<Cursor> cursors(runs.size() + 1);
+	std::ifstream ifs;
+	if (!runs.empty()) ifs.open(runsPath, std::ios::binary);
+	auto refill = [&](Cursor& cursor) {
+		size_t count = (size_t)glm::min<uint64_t>(cursor.left, bufferStars);
+		cursor.buffer.resize(count);
+		cursor.next = 0;
+		ifs.seekg((std::streamoff)cursor.offset);
+		ifs.read((char*)cursor.buffer.data(), count * sizeof(StarRecord));
+		cursor.left -= count;
+		cursor.offset += count * sizeof(StarRecord);
+		return (bool)ifs;
+	};
+	for (size_t r = 0; r < runs.size(); r++)
+	{
+		cursors[r] = { {}, 0, runs[r].second, runs[r].first };
+		if (!refill(cursors[r]))
+		{
+			error = "can't read " + runsPath;
+			return false;
+		}
+	}
+	// the last run never left memory
+	cursors.back() = { std::move(lastRun), 0, 0, 0 };
+
+	auto isLater = [&](size_t a, size_t b) { return isBefore(cursors[b].buffer[cursors[b].next], cursors[a].buffer[cursors[a].next]); };
+	std::priority_queue<size_t, std::vector<size_t>, decltype(isLater)> heads(isLater);
+	for (size_t r = 0; r < cursors.size(); r++) if (!cursors[r].buffer.empty()) heads.push(r);
+
+	std::vector<StarRecord> out;
+	out.reserve(bufferStars);
+	uint64_t written = 0;
+	while (!heads.empty())
+	{
+		size_t r = heads.top();
+		heads.pop();
+		Cursor& cursor = cursors[r];
+		const StarRecord& star = cursor.buffer[cursor.next++];
+		out.push_back(star);
+		cells[(star.key >> cellShift) + 1]++;
+		header.brightestMagnitude = glm::min(header.brightestMagnitude, star.magnitude * 1e-3f);
+		header.faintestMagnitude = glm::max(header.faintestMagnitude, star.magnitude * 1e-3f);
+		if (out.size() == bufferStars)
+		{
+			ofs.write((const char*)out.data(), out.size() * sizeof(StarRecord));
+			written += out.size();
+			out.clear();
+		}
+		if (cursor.next == cursor.buffer.size() && cursor.left > 0 && !refill(cursor))
+		{
+			error = "can't read " + runsPath;
+			return false;
+		}
+		if (cursor.next < cursor.buffer.size()) heads.push(r);
+	}
+	ofs.write((const char*)out.data(), out.size() * sizeof(StarRecord));
+	written += out.size();
+
+	// counts become offsets now that every star is placed
+	for (size_t c = 0; c < cellCount; c++) cells[c + 1] += cells[c];
+	header.starCount = written;
+	if (written == 0) header.brightestMagnitude = header.faintestMagnitude = 0.0f;
+	ofs.seekp(0);
+	ofs.write((const char*)&header, sizeof(header));
+	ofs.write((const char*)cells.data(), cells.size() * sizeof(uint64_t));
+	ofs.close();
+	if (!ofs)
+	{
+		error = "can't write " + partial;
+		return false;
+	}
+	std::error_code renameError;
+	std::filesystem::rename(partial, tablePath, renameError);
+	if (renameError)
+	{
+		std::filesystem::remove(partial, renameError);
+		error = "can't write " + tablePath;
+		return false;
+	}
+	return true;
+}
+
+bool StarTable::open(const std::string& path)
+{
+	close();
+	if (!_file.open(path)) return false;
+	const StarTableHeader* header = (const StarTableHeader*)_file.data();
+	const size_t cellCount = (size_t)1 << (3 * kStarIndexLevel);
+	bool isValid = _file.size() >= sizeof(StarTableHeader) && memcmp(header->magic, kStarTableMagic, sizeof(header->magic)) == 0 &&
+		header->version == kStarTableVersion && header->axisBits == kStarAxisBits && header->indexLevel == kStarIndexLevel &&
+		header->extent > 0.0 && header->compandScale > 0.0;
+	isValid = isValid && header->cellsOffset + (cellCount + 1) * sizeof(uint64_t) <= _file.size() &&
+		header->starsOffset + header->starCount * sizeof(StarRecord) <= _file.size();
+	if (!isValid)
+	{
+		close();
+		return false;
+	}
+	_header = header;
+	_cells = (const uint64_t*)(_file.data() + header->cellsOffset);
+	_stars = (const StarRecord*)(_file.data() + header->starsOffset);
+	if (_cells[cellCount] != header->starCount)
+	{
+		close();
+		return false;
+	}
+	return true;
+}
+
+void StarTable::close()
+{
+	_file.close();
+	_header = nullptr;
+	_cells = nullptr;
+	_stars = nullptr;
+}
+
+glm::vec3 StarTable::color(float bv)
+{
+	// Ballesteros' temperature of a black body of that color index
+	bv = glm::clamp(bv, -0.4f, 2.0f);
+	const float t = 4600.0f * (1.0f / (0.92f * bv + 1.7f) + 1.0f / (0.92f * bv + 0.62f)) / 100.0f;
+	// and a fit of the black body's color by temperature, in hundreds of kelvin
+	glm::vec3 rgb;
+	if (t <= 66.0f)
+	{
+		rgb.r = 1.0f;
+		rgb.g = glm::clamp((99.4708f * std::log(t) - 161.1196f) / 255.0f, 0.0f, 1.0f);
+		rgb.b = t <= 19.0f ? 0.0f : glm::clamp((138.5177f * std::log(t - 10.0f) - 305.0448f) / 255.0f, 0.0f, 1.0f);
+	}
+	else
+	{
+		rgb.r = glm::clamp(329.6987f * std::pow(t - 60.0f, -0.1332f) / 255.0f, 0.0f, 1.0f);
+		rgb.g = glm::clamp(288.1222f * std::pow(t - 60.0f, -0.0755f) / 255.0f, 0.0f, 1.0f);
+		rgb.b = 1.0f;
+	}
+	return rgb;
+}
@@ -0,0 +1,582 @@
+#pragma once
+
+#include "Common.hpp"
+#include "Simulation.hpp"
+#include "MappedFile.hpp"
+
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <thread>
+
+inline constexpr char kTrajectoryMagic[8] = { 'S', 'S', 'T', 'R', 'A', 'C', 'K', '\0' };
+// version 1 had no dropped frame counts, its index is skipped and its chunks scanned with none
+inline constexpr uint32_t kTrajectoryVersion = 2;
+
+// on disk: this header, the chunks back to back, then the index of every chunk. indexOffset stays 0 until the
+// recorder is closed, a reader scans the chunks instead if it is
+typedef struct
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t framesPerChunk;
+	uint32_t interval;
+	// frames dropped after the last chunk, ones dropped before a chunk are counted in it
+	uint32_t droppedAtEnd;
+	double dt;
+	double positionTolerance;
+	double velocityTolerance;
+	uint64_t indexOffset;
+	uint64_t chunkCount;
+}TrajectoryHeader;
+
+typedef enum
+{
+	TRAJECTORY_VELOCITIES = 1 << 0
+}TrajectoryChunkFlags;
+
+// followed by frameCount frame times as doubles, then payloadBytes of encoded frames
+typedef struct
+{
+	uint32_t frameCount;
+	uint32_t bodyCount;
+	uint32_t flags;
+	// frames dropped between the chunk before and this one, playback doesn't interpolate across them
+	uint32_t droppedBefore;
+	uint64_t payloadBytes;
+	double startTime;
+	double endTime;
+}TrajectoryChunkHeader;
+
+typedef struct
+{
+	uint64_t offset;
+	double startTime;
+	double endTime;
+	uint32_t frameCount;
+	uint32_t bodyCount;
+	uint32_t droppedBefore;
+	uint32_t reserved;
+}TrajectoryIndexEntry;
+
+static_assert(sizeof(TrajectoryHeader) == 64 && sizeof(TrajectoryChunkHeader) == 40 && sizeof(TrajectoryIndexEntry) == 40,
+	"trajectory records must not pick up padding");
+
+typedef struct
+{
+	// steps between frames, see Simulation::setStepCallback
+	int interval;
+	// a chunk is a keyframe and the frames predicted from it, the unit of seeking and decoding
+	int framesPerChunk;
+	// largest error a recorded position or velocity may have, half of the quantization step
+	double positionTolerance;
+	double velocityTolerance;
+	// frames that can wait for the writer to begin with
+	int bufferedFrames;
+	// the buffers grow past bufferedFrames while a writer that falls behind keeps them under this many bytes, a
+	// frame beyond it is dropped rather than stall the simulation
+	size_t maxBufferBytes;
+}TrajectoryOptions;
+
+typedef struct
+{
+	uint64_t captured;
+	uint64_t dropped;
+	// runs of dropped frames, each one a gap in the recording
+	uint64_t gaps;
+	// frame buffers the writer needed at most
+	uint64_t buffers;
+	uint64_t chunks;
+	uint64_t bytes;
+	// what the written frames take as raw doubles
+	uint64_t rawBytes;
+	// time capture() held up the simulation, in total
+	double captureMs;
+}TrajectoryStats;
+
+// a decoded chunk, every array frame after frame and body by body within a frame. Floats hold a recording
+// to well under its tolerance at solar system distances, at half the memory
+template<typename T>
+struct TrajectoryFramesOf
+{
+	std::vector<double> times;
+	uint32_t bodyCount;
+	bool hasVelocities;
+	std::vector<T> x, y, z;
+	std::vector<T> vx, vy, vz;
+};
+
+typedef TrajectoryFramesOf<double> TrajectoryFrames;
+
+// Streams body positions and velocities to disk while the simulation runs. capture() only copies the state into
+// a free buffer and queues it, a writer thread does the rest: every value is quantized to an integer multiple of
+// twice its tolerance, the first frame of a chunk is kept as is and every later one as its residual from a linear
+// prediction off the two frames before it, and the residuals are zigzag varint coded. Smooth orbits leave residuals
+// of a few quanta, a byte or two where a raw double takes eight. The integers are exact, so the error never builds
+// up along a chunk. Merges change body indices, so a change in the body count starts a new chunk, and so does a gap
+// of dropped frames, which the chunk after it records.
+class TrajectoryRecorder
+{
+	NONCOPYABLE(TrajectoryRecorder)
+
+private:
+	typedef struct
+	{
+		double time;
+		bool hasVelocities;
+		uint32_t droppedBefore;
+		AlignedVector<double> values[6];
+	}Frame;
+
+	std::ofstream _ofs;
+
+	TrajectoryHeader _header{};
+
+	TrajectoryOptions _options{};
+
+	// the frame buffers, free ones and ones queued for the writer, oldest first
+	std::vector<std::unique_ptr<Frame>> _frames;
+	std::vector<Frame*> _free;
+	std::deque<Frame*> _queue;
+	// what the buffers added past bufferedFrames hold, and the frames dropped since the last one queued
+	size_t _grownBytes{ 0 };
+	uint32_t _dropping{ 0 };
+
+	std::mutex _mutex;
+	std::condition_variable _queued;
+	std::thread _writer;
+	bool _isClosing{ false };
+	bool _isFailed{ false };
+
+	TrajectoryStats _stats{};
+
+	// the writer's side, the chunk being encoded and the two frames before the one being encoded as integers
+	std::vector<TrajectoryIndexEntry> _index;
+	TrajectoryChunkHeader _chunk{};
+	std::vector<double> _chunkTimes;
+	std::vector<uint8_t> _payload;
+	std::vector<int64_t> _last[6], _lastButOne[6];
+
+public:
+	TrajectoryRecorder() = default;
+	~TrajectoryRecorder() { close(); };
+
+	static const TrajectoryOptions defaultOptions() { return { 16, 32, 1e-3, 1e-4, 8, (size_t)256 << 20 }; };
+
+	bool open(const std::string& path, const TrajectoryOptions& options, double dt);
+
+	// queue the current state as a frame, or count it dropped if the writer is further behind than the buffers allow. Velocities
+	// are left out on the rails, where the simulation doesn't keep them
+	void capture(const Simulation& sim);
+
+	// write out what is queued, the index and the final header, false if anything failed to write
+	bool close();
+
+	const bool isOpen() const { return _writer.joinable(); };
+
+	const TrajectoryStats stats();
+
+private:
+	void writerLoop();
+
+	void encode(const Frame& frame);
+
+	bool flushChunk();
+
+	static void putVarint(std::vector<uint8_t>& out, uint64_t value);
+
+	static uint64_t zigzag(int64_t value) { return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63); };
+};
+
+// Random access to a recorded trajectory through a read-only mapping, one chunk decoded at a time.
+class TrajectoryReader
+{
+	NONCOPYABLE(TrajectoryReader)
+
+private:
+	MappedFile _file;
+
+	const TrajectoryHeader* _header{ nullptr };
+
+	std::vector<TrajectoryIndexEntry> _index;
+
+public:
+	TrajectoryReader() = default;
+	~TrajectoryReader() = default;
+
+	// takes the index if the recorder was closed, and rebuilds it from the chunks that made it to disk if not
+	bool open(const std::string& path);
+
+	void close();
+
+	template<typename T>
+	bool decode(size_t chunk, TrajectoryFramesOf<T>& out) const;
+
+	// start paging a chunk in ahead of decoding it
+	void prefetch(size_t chunk) const;
+
+	// the chunk whose span holds time, clamped to the first and last
+	const size_t find(double time) const;
+
+	const bool isOpen() const { return _header != nullptr; };
+
+	const TrajectoryHeader& header() const { return *_header; };
+
+	const size_t chunkCount() const { return _index.size(); };
+
+	const TrajectoryIndexEntry& chunk(size_t index) const { return _index[index]; };
+
+	const double startTime() const { return _index.empty() ? 0.0 : _index.front().startTime; };
+
+	const double endTime() const { return _index.empty() ? 0.0 : _index.back().endTime; };
+
+	static bool getVarint(const uint8_t*& at, const uint8_t* end, uint64_t& value);
+
+	static int64_t unzigzag(uint64_t value) { return (int64_t)(value >> 1) ^ -(int64_t)(value & 1); };
+};
+
+bool TrajectoryRecorder::open(const std::string& path, const TrajectoryOptions& options, double dt)
+{
+	close();
+	_options = options;
+	_options.interval = glm::max(_options.interval, 1);
+	_options.framesPerChunk = glm::max(_options.framesPerChunk, 1);
+	_options.bufferedFrames = glm::max(_options.bufferedFrames, 1);
+	if (!(_options.positionTolerance > 0.0) || !(_options.velocityTolerance > 0.0)) return false;
+
+	_ofs.open(path, std::ios::binary | std::ios::trunc);
+	if (!_ofs) return false;
+	_header = {};
+	memcpy(_header.magic, kTrajectoryMagic, sizeof(_header.magic));
+	_header.version = kTrajectoryVersion;
+	_header.framesPerChunk = (uint32_t)_options.framesPerChunk;
+	_header.interval = (uint32_t)_options.interval;
+	_header.dt = dt;
+	_header.positionTolerance = _options.positionTolerance;
+	_header.velocityTolerance = _options.velocityTolerance;
+	_ofs.write((const char*)&_header, sizeof(_header));
+
+	_frames.clear();
+	_free.clear();
+	_queue.clear();
+	_grownBytes = 0;
+	_dropping = 0;
+	for (int i = 0; i < _options.bufferedFrames; i++)
+	{
+		_frames.push_back(std::make_unique<Frame>());
+		_free.push_back(_frames.back().get());
+	}
+	_index.clear();
+	_chunk = {};
+	_chunkTimes.clear();
+	_payload.clear();
+	_stats = {};
+	_stats.buffers = _frames.size();
+	_isClosing = false;
+	_isFailed = false;
+	_writer = std::thread([this]() { writerLoop(); });
+	return true;
+}
+
+void TrajectoryRecorder::capture(const Simulation& sim)
+{
+	if (!isOpen()) return;
+	const auto start = std::chrono::steady_clock::now();
+
+	const bool hasVelocities = !sim.isOnRails();
+	Frame* frame = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stats.captured++;
+		const size_t frameBytes = sim.bodyCount() * (hasVelocities ? 6 : 3) * sizeof(double);
+		if (_free.empty() && _grownBytes + frameBytes <= _options.maxBufferBytes)
+		{
+			// the writer is behind, one more buffer rides it out. it stays, a writer that fell behind once will again
+			_frames.push_back(std::make_unique<Frame>());
+			_free.push_back(_frames.back().get());
+			_grownBytes += frameBytes;
+			_stats.buffers = _frames.size();
+		}
+		if (_free.empty())
+		{
+			_stats.dropped++;
+			if (_dropping++ == 0) _stats.gaps++;
+		}
+		else
+		{
+			frame = _free.back();
+			_free.pop_back();
+			frame->droppedBefore = _dropping;
+			_dropping = 0;
+		}
+	}
+
+	// the copy happens outside the lock, the writer never touches a frame until it is queued
+	if (frame)
+	{
+		const BodyArrays& state = sim.state();
+		const size_t n = sim.bodyCount();
+		const AlignedVector<double>* arrays[] = { &state.px, &state.py, &state.pz, &state.vx, &state.vy, &state.vz };
+		frame->time = sim.clock().time();
+		frame->hasVelocities = hasVelocities;
+		for (int c = 0; c < (frame->hasVelocities ? 6 : 3); c++) frame->values[c].assign(arrays[c]->data(), arrays[c]->data() + n);
+		for (int c = frame->hasVelocities ? 6 : 3; c < 6; c++) frame->values[c].clear();
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_queue.push_back(frame);
+		}
+		_queued.notify_one();
+	}
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	_stats.captureMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool TrajectoryRecorder::close()
+{
+	if (!isOpen()) return false;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_isClosing = true;
+	}
+	_queued.notify_one();
+	_writer.join();
+
+	// the writer is gone, everything below is this thread's alone
+	bool isWritten = !_isFailed && flushChunk();
+	_header.droppedAtEnd = _dropping;
+	_header.chunkCount = _index.size();
+	_header.indexOffset = (uint64_t)_ofs.tellp();
+	_ofs.write((const char*)_index.data(), _index.size() * sizeof(TrajectoryIndexEntry));
+	_ofs.seekp(0);
+	_ofs.write((const char*)&_header, sizeof(_header));
+	isWritten = isWritten && _ofs.good();
+	_ofs.close();
+	_frames.clear();
+	_free.clear();
+	return isWritten;
+}
+
+const TrajectoryStats TrajectoryRecorder::stats()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _stats;
+}
+
+void TrajectoryRecorder::writerLoop()
+{
+	while (true)
+	{
+		Frame* frame;
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_queued.wait(lock, [this]() { return _isClosing || !_queue.empty(); });
+			if (_queue.empty()) return;
+			frame = _queue.front();
+			_queue.pop_front();
+		}
+
+		const uint32_t n = (uint32_t)frame->values[0].size();
+		const uint32_t flags = frame->hasVelocities ? TRAJECTORY_VELOCITIES : 0;
+		if (_chunk.frameCount > 0 && (_chunk.bodyCount != n || _chunk.flags != flags || frame->droppedBefore > 0)) _isFailed = _isFailed || !flushChunk();
+		if (_chunk.frameCount == 0)
+		{
+			_chunk.bodyCount = n;
+			_chunk.flags = flags;
+			_chunk.droppedBefore = frame->droppedBefore;
+			_chunk.startTime = frame->time;
+		}
+		encode(*frame);
+		if (_chunk.frameCount == (uint32_t)_options.framesPerChunk) _isFailed = _isFailed || !flushChunk();
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		_free.push_back(frame);
+	}
+}
+
+void TrajectoryRecorder::encode(const Frame& frame)
+{
+	const size_t n = _chunk.bodyCount;
+	const int components = frame.hasVelocities ? 6 : 3;
+	const uint32_t k = _chunk.frameCount;
+	for (int c = 0; c < components; c++)
+	{
+		const double scale = 0.5 / (c < 3 ? _options.positionTolerance : _options.velocityTolerance);
+		const double* values = frame.values[c].data();
+		std::vector<int64_t>& last = _last[c];
+		std::vector<int64_t>& lastButOne = _lastButOne[c];
+		last.resize(n);
+		lastButOne.resize(n);
+		for (size_t i = 0; i < n; i++)
+		{
+			// anything past 2^52 quanta or not finite has no business in a trajectory, it is pinned rather than overflow
+			double v = values[i] * scale;
+			int64_t q = std::isfinite(v) ? (int64_t)std::llround(glm::clamp(v, -4.5e15, 4.5e15)) : 0;
+			int64_t predicted = k == 0 ? 0 : k == 1 ? last[i] : 2 * last[i] - lastButOne[i];
+			putVarint(_payload, zigzag(q - predicted));
+			lastButOne[i] = last[i];
+			last[i] = q;
+		}
+	}
+	_chunkTimes.push_back(frame.time);
+	_chunk.endTime = frame.time;
+	_chunk.frameCount++;
+}
+
+bool TrajectoryRecorder::flushChunk()
+{
+	if (_chunk.frameCount == 0) return true;
+
+	_chunk.payloadBytes = _payload.size();
+	_index.push_back({ (uint64_t)_ofs.tellp(), _chunk.startTime, _chunk.endTime, _chunk.frameCount, _chunk.bodyCount, _chunk.droppedBefore, 0 });
+	_ofs.write((const char*)&_chunk, sizeof(_chunk));
+	_ofs.write((const char*)_chunkTimes.data(), _chunkTimes.size() * sizeof(double));
+	_ofs.write((const char*)_payload.data(), _payload.size());
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stats.chunks++;
+		_stats.bytes += sizeof(_chunk) + _chunkTimes.size() * sizeof(double) + _payload.size();
+		_stats.rawBytes += (uint64_t)_chunk.frameCount * _chunk.bodyCount * ((_chunk.flags & TRAJECTORY_VELOCITIES) ? 6 : 3) * sizeof(double);
+	}
+	_chunk = {};
+	_chunkTimes.clear();
+	_payload.clear();
+	return _ofs.good();
+}
+
+void TrajectoryRecorder::putVarint(std::vector<uint8_t>& out, uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		out.push_back((uint8_t)(value | 0x80));
+		value >>= 7;
+	}
+	out.push_back((uint8_t)value);
+}
+
+bool TrajectoryReader::open(const std::string& path)
+{
+	close();
+	if (!_file.open(path)) return false;
+
+	const uint8_t* data = _file.data();
+	const uint64_t size = _file.size();
+	const TrajectoryHeader* header = (const TrajectoryHeader*)data;
+	if (size < sizeof(TrajectoryHeader) || memcmp(header->magic, kTrajectoryMagic, sizeof(header->magic)) != 0 ||
+		header->version < 1 || header->version > kTrajectoryVersion || !(header->positionTolerance > 0.0) || !(header->velocityTolerance > 0.0))
+	{
+		_file.close();
+		return false;
+	}
+
+	// a chunk is only taken if it lies whole inside the file
+	auto isChunk = [&](uint64_t offset) {
+		if (offset > size || size - offset < sizeof(TrajectoryChunkHeader)) return false;
+		const TrajectoryChunkHeader* chunk = (const TrajectoryChunkHeader*)(data + offset);
+		uint64_t bytes = (uint64_t)chunk->frameCount * sizeof(double) + chunk->payloadBytes;
+		return chunk->frameCount > 0 && chunk->payloadBytes <= size && bytes <= size - offset - sizeof(TrajectoryChunkHeader);
+	};
+
+	const uint64_t indexBytes = header->chunkCount * sizeof(TrajectoryIndexEntry);
+	if (header->version == kTrajectoryVersion && header->indexOffset != 0 && header->indexOffset <= size && header->chunkCount <= size && indexBytes <= size - header->indexOffset)
+	{
+		const TrajectoryIndexEntry* index = (const TrajectoryIndexEntry*)(data + header->indexOffset);
+		_index.assign(index, index + header->chunkCount);
+		for (auto& entry : _index)
+		{
+			if (isChunk(entry.offset)) continue;
+			_index.clear();
+			break;
+		}
+	}
+	if (_index.empty())
+	{
+		for (uint64_t offset = sizeof(TrajectoryHeader); isChunk(offset);)
+		{
+			const TrajectoryChunkHeader* chunk = (const TrajectoryChunkHeader*)(data + offset);
+			// version 1 wrote zero where the dropped count is now
+			_index.push_back({ offset, chunk->startTime, chunk->endTime, chunk->frameCount, chunk->bodyCount, chunk->droppedBefore, 0 });
+			offset += sizeof(TrajectoryChunkHeader) + chunk->frameCount * sizeof(double) + chunk->payloadBytes;
+		}
+	}
+	_header = header;
+	return true;
+}
+
+void TrajectoryReader::close()
+{
+	_header = nullptr;
+	_index.clear();
+	_file.close();
+}
+
+const size_t TrajectoryReader::find(double time) const
+{
+	if (_index.empty()) return 0;
+	auto it = std::upper_bound(_index.begin(), _index.end(), time, [](double t, const TrajectoryIndexEntry& entry) { return t < entry.startTime; });
+	return it == _index.begin() ? 0 : (size_t)(it - _index.begin()) - 1;
+}
+
+void TrajectoryReader::prefetch(size_t chunk) const
+{
+	if (chunk >= _index.size()) return;
+	const TrajectoryChunkHeader& header = *(const TrajectoryChunkHeader*)(_file.data() + _index[chunk].offset);
+	_file.willNeed((size_t)_index[chunk].offset, sizeof(TrajectoryChunkHeader) + header.frameCount * sizeof(double) + (size_t)header.payloadBytes);
+}
+
+template<typename T>
+bool TrajectoryReader::decode(size_t chunk, TrajectoryFramesOf<T>& out) const
+{
+	if (chunk >= _index.size()) return false;
+	const uint8_t* at = _file.data() + _index[chunk].offset;
+	const TrajectoryChunkHeader& header = *(const TrajectoryChunkHeader*)at;
+	at += sizeof(TrajectoryChunkHeader);
+	const size_t n = header.bodyCount, frames = header.frameCount;
+	out.times.assign((const double*)at, (const double*)at + frames);
+	at += frames * sizeof(double);
+	const uint8_t* end = at + header.payloadBytes;
+
+	out.bodyCount = header.bodyCount;
+	out.hasVelocities = (header.flags & TRAJECTORY_VELOCITIES) != 0;
+	const int components = out.hasVelocities ? 6 : 3;
+	std::vector<T>* arrays[] = { &out.x, &out.y, &out.z, &out.vx, &out.vy, &out.vz };
+	for (int c = 0; c < 6; c++) arrays[c]->assign(c < components ? n * frames : 0, (T)0);
+
+	std::vector<int64_t> last[6], lastButOne[6];
+	for (size_t k = 0; k < frames; k++)
+	{
+		for (int c = 0; c < components; c++)
+		{
+			const double step = 2.0 * (c < 3 ? _header->positionTolerance : _header->velocityTolerance);
+			T* values = arrays[c]->data() + k * n;
+			last[c].resize(n);
+			lastButOne[c].resize(n);
+			for (size_t i = 0; i < n; i++)
+			{
+				uint64_t residual;
+				if (!getVarint(at, end, residual)) return false;
+				int64_t predicted = k == 0 ? 0 : k == 1 ? last[c][i] : 2 * last[c][i] - lastButOne[c][i];
+				int64_t q = predicted + unzigzag(residual);
+				lastButOne[c][i] = last[c][i];
+				last[c][i] = q;
+				values[i] = (T)(q * step);
+			}
+		}
+	}
+	return true;
+}
+
+bool TrajectoryReader::getVarint(const uint8_t*& at, const uint8_t* end, uint64_t& value)
+{
+	value = 0;
+	for (int shift = 0; shift < 64 && at < end; shift += 7)
+	{
+		uint8_t byte = *at++;
+		value |= (uint64_t)(byte & 0x7f) << shift;
+		if (!(byte & 0x80)) return true;
+	}
+	return false;
+}